@@ -0,0 +1,174 @@
+/*
+** 批量插入基准测试：比较不同 chunk_size 和 write_buffer 设置下文件扩展、写入调用的开销
+** 和碎片情况。
+**
+** 用法：bulk_insert_bench [-n 行数] [-s 每行字节数] [-b 每个事务的行数] [-d 目录]
+**
+** 每种配置都从一个空数据库开始，分多个事务插入随机数据，报告耗时、最终文件大小
+** 以及文件的区段（extent）个数（仅 Linux，通过 FIEMAP 获得）。
+*/
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#include "headervfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* 参与比较的配置，选项直接拼接到 URI 上 */
+static const struct {
+    const char *zLabel;
+    const char *zOptions;
+} aConfig[] = {
+    {"no chunk", "chunk_size=0"},
+    {"chunk 1M", "chunk_size=1048576"},
+    {"chunk 8M", "chunk_size=8388608"},
+    {"wbuf 8M", "write_buffer=8388608"},
+    {"chunk+wbuf", "chunk_size=8388608&write_buffer=8388608"},
+};
+
+static double benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 文件的大小和区段个数，不支持时区段个数为 -1 */
+static void benchFileLayout(const char *zPath, long long *pnSize, long long *pnExtent) {
+    *pnSize = -1;
+    *pnExtent = -1;
+#ifdef __linux__
+    const int fd = open(zPath, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        *pnSize = st.st_size;
+    }
+    struct fiemap fm;
+    memset(&fm, 0, sizeof(fm));
+    fm.fm_length = FIEMAP_MAX_OFFSET;
+    fm.fm_flags = FIEMAP_FLAG_SYNC;
+    if (ioctl(fd, FS_IOC_FIEMAP, &fm) == 0) {
+        *pnExtent = fm.fm_mapped_extents;
+    }
+    close(fd);
+#else
+    FILE *f = fopen(zPath, "rb");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        *pnSize = ftell(f);
+        fclose(f);
+    }
+#endif
+}
+
+static int benchExec(sqlite3 *db, const char *zSql) {
+    char *zErr = 0;
+    const int rc = sqlite3_exec(db, zSql, 0, 0, &zErr);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", zSql, zErr ? zErr : sqlite3_errstr(rc));
+        sqlite3_free(zErr);
+    }
+    return rc;
+}
+
+static int benchRun(const char *zDir, const char *zLabel, const char *zOptions, int nRow, int szRow, int nBatch) {
+    char *zPath = sqlite3_mprintf("%s/bulk_insert_bench.db", zDir);
+    char *zUri = sqlite3_mprintf("file:%s?vfs=headervfs&%s", zPath, zOptions);
+    char *zJournal = sqlite3_mprintf("%s-journal", zPath);
+    remove(zPath);
+    remove(zJournal);
+
+    sqlite3 *db = 0;
+    sqlite3_stmt *pStmt = 0;
+    int rc = sqlite3_open_v2(zUri, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, 0);
+    if (rc == SQLITE_OK) {
+        rc = benchExec(db, "PRAGMA synchronous=NORMAL; CREATE TABLE t(id INTEGER PRIMARY KEY, v BLOB);");
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(db, "INSERT INTO t(v) VALUES(randomblob(?1))", -1, &pStmt, 0);
+    }
+
+    const double tStart = benchNow();
+    for (int i = 0; rc == SQLITE_OK && i < nRow; i++) {
+        if (i % nBatch == 0) {
+            rc = benchExec(db, "BEGIN");
+        }
+        if (rc == SQLITE_OK) {
+            sqlite3_bind_int(pStmt, 1, szRow);
+            rc = (sqlite3_step(pStmt) == SQLITE_DONE) ? SQLITE_OK : sqlite3_errcode(db);
+            sqlite3_reset(pStmt);
+        }
+        if (rc == SQLITE_OK && (i % nBatch == nBatch - 1 || i == nRow - 1)) {
+            rc = benchExec(db, "COMMIT");
+        }
+    }
+    const double tElapsed = benchNow() - tStart;
+    sqlite3_finalize(pStmt);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", zLabel, sqlite3_errmsg(db));
+    }
+    sqlite3_close(db);
+
+    if (rc == SQLITE_OK) {
+        long long nSize, nExtent;
+        benchFileLayout(zPath, &nSize, &nExtent);
+        printf("%-12s %10.3f %12.0f %14lld %8lld\n", zLabel, tElapsed, nRow / tElapsed, nSize, nExtent);
+    }
+
+    remove(zPath);
+    remove(zJournal);
+    sqlite3_free(zJournal);
+    sqlite3_free(zUri);
+    sqlite3_free(zPath);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    int nRow = 200000;
+    int szRow = 200;
+    int nBatch = 1000;
+    const char *zDir = ".";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            nRow = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            szRow = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            nBatch = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            zDir = argv[i + 1];
+        } else {
+            fprintf(stderr, "usage: %s [-n rows] [-s row_bytes] [-b rows_per_txn] [-d dir]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nRow <= 0 || szRow <= 0 || nBatch <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    if (sqlite3_headervfs_register("headervfs", 0, 0) != SQLITE_OK) {
+        fprintf(stderr, "failed to register headervfs\n");
+        return 1;
+    }
+
+    printf("rows=%d row_bytes=%d rows_per_txn=%d\n", nRow, szRow, nBatch);
+    printf("%-12s %10s %12s %14s %8s\n", "config", "seconds", "rows/s", "file bytes", "extents");
+    for (size_t i = 0; i < sizeof(aConfig) / sizeof(aConfig[0]); i++) {
+        if (benchRun(zDir, aConfig[i].zLabel, aConfig[i].zOptions, nRow, szRow, nBatch) != SQLITE_OK) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+** headervfs 与原生 VFS 的对比基准测试。
+**
+** 对每种组合（VFS × 日志模式 × 页大小）从空数据库开始，用相同的随机种子依次运行：
+**
+**   bulk_insert   分批插入 nRow 行，每个事务是一个样本
+**   point_lookup  按主键随机查找一行，每次查询是一个样本
+**   range_scan    从随机位置开始按主键顺序读取 100 行，每次扫描是一个样本
+**
+** 查询类的负载分别在热缓存和冷缓存下运行。冷缓存的每个样本之前都会重新打开连接
+** （清空 SQLite 的页缓存），并用 posix_fadvise 让内核丢弃数据库文件的页缓存
+** （只对干净页有效，不需要 root 权限）。
+**
+** 每个结果以一行 JSON 输出到标准输出，包括吞吐量和 p50/p99 延迟（微秒）。
+**
+** 用法：headervfs_bench [-n 行数] [-q 热缓存查询数] [-c 冷缓存查询数] [-p 页大小列表] [-d 目录]
+** 例如：headervfs_bench -n 100000 -p 4096,16384 > result.jsonl
+*/
+#define _POSIX_C_SOURCE 200809L /* clock_gettime、posix_fadvise 等 */
+#include "headervfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// 每个事务插入的行数
+#define BENCH_BATCH 1000
+
+// 范围扫描每次读取的行数
+#define BENCH_SCAN_ROWS 100
+
+// 每行 BLOB 的大小
+#define BENCH_ROW_BYTES 100
+
+/* 参与比较的 VFS，zVfs 为 NULL 表示默认（原生）VFS；zOptions 非空时以这些默认选项注册一个 headervfs 实例 */
+static const struct {
+    const char *zLabel;
+    const char *zVfs;
+    const char *zOptions;
+} aVfs[] = {
+    {"native", 0, 0},
+    {"headervfs", "headervfs", 0},
+    {"headervfs_wbuf", "headervfs_wbuf", "write_buffer=8388608"},
+    {"headervfs_wbuf_uring", "headervfs_wbuf_uring", "write_buffer=8388608&io_uring=1"},
+    {"headervfs_direct", "headervfs_direct", "direct_io=1&write_buffer=8388608"},
+    {"headervfs_excl", "headervfs_excl", "base_vfs=unix-excl"},
+    {"headervfs_heapwal", "headervfs_heapwal", "wal_index=heap"},
+    {"headervfs_cksum", "headervfs_cksum", "page_checksum=1"},
+};
+
+static const char *const azJournalMode[] = {"delete", "wal"};
+
+typedef struct BenchConfig {
+    int nRow;                   /* 插入的行数 */
+    int nWarm;                  /* 热缓存下每种查询的次数 */
+    int nCold;                  /* 冷缓存下每种查询的次数 */
+    const char *zDir;           /* 数据库文件所在的目录 */
+} BenchConfig;
+
+/* 一组样本（微秒） */
+typedef struct BenchSamples {
+    int n;
+    double *a;
+    double tTotal;              /* 所有样本的总耗时（秒） */
+} BenchSamples;
+
+static unsigned long long benchRandState = 0x9E3779B97F4A7C15ULL;
+
+/* xorshift64*：固定种子，保证不同 VFS 运行完全相同的负载 */
+static unsigned long long benchRandom(void) {
+    benchRandState ^= benchRandState >> 12;
+    benchRandState ^= benchRandState << 25;
+    benchRandState ^= benchRandState >> 27;
+    return benchRandState * 2685821657736338717ULL;
+}
+
+static double benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int benchCompare(const void *a, const void *b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* 第 q 分位数（0 <= q <= 1），样本会被排序 */
+static double benchPercentile(BenchSamples *pS, double q) {
+    if (pS->n == 0) {
+        return 0;
+    }
+    qsort(pS->a, pS->n, sizeof(double), benchCompare);
+    int i = (int) (q * (pS->n - 1) + 0.5);
+    return pS->a[i];
+}
+
+static void benchReport(
+    const char *zVfs,
+    const char *zJournal,
+    int szPage,
+    const char *zWorkload,
+    const char *zCache,
+    BenchSamples *pS
+) {
+    const double p50 = benchPercentile(pS, 0.50);
+    const double p99 = benchPercentile(pS, 0.99);
+    printf("{\"vfs\":\"%s\",\"journal_mode\":\"%s\",\"page_size\":%d,\"workload\":\"%s\",\"cache\":\"%s\","
+           "\"ops\":%d,\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"p50_us\":%.2f,\"p99_us\":%.2f}\n",
+           zVfs, zJournal, szPage, zWorkload, zCache, pS->n, pS->tTotal,
+           pS->tTotal > 0 ? pS->n / pS->tTotal : 0.0, p50, p99);
+    fflush(stdout);
+}
+
+static int benchExec(sqlite3 *db, const char *zSql) {
+    char *zErr = 0;
+    const int rc = sqlite3_exec(db, zSql, 0, 0, &zErr);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", zSql, zErr ? zErr : sqlite3_errstr(rc));
+        sqlite3_free(zErr);
+    }
+    return rc;
+}
+
+static int benchOpen(const char *zPath, const char *zVfs, sqlite3 **pDb) {
+    const int rc = sqlite3_open_v2(zPath, pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, zVfs);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "open %s: %s\n", zPath, sqlite3_errmsg(*pDb));
+        sqlite3_close(*pDb);
+        *pDb = 0;
+    }
+    return rc;
+}
+
+/* 让内核丢弃文件的页缓存 */
+static void benchEvict(const char *zPath) {
+#if (defined(__unix__) || defined(__APPLE__)) && defined(POSIX_FADV_DONTNEED)
+    const int fd = open(zPath, O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void) zPath;
+#endif
+}
+
+static void benchRemove(const char *zPath) {
+    static const char *const azSuffix[] = {"", "-journal", "-wal", "-shm"};
+    for (size_t i = 0; i < sizeof(azSuffix) / sizeof(azSuffix[0]); i++) {
+        char *z = sqlite3_mprintf("%s%s", zPath, azSuffix[i]);
+        if (z) {
+            remove(z);
+            sqlite3_free(z);
+        }
+    }
+}
+
+/*
+** 建表并分批插入 nRow 行，每个事务是一个样本。
+*/
+static int benchBulkInsert(sqlite3 *db, const BenchConfig *pCfg, BenchSamples *pS) {
+    sqlite3_stmt *pStmt = 0;
+    int rc = benchExec(db, "CREATE TABLE t(id INTEGER PRIMARY KEY, k INTEGER, v BLOB)");
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(db, "INSERT INTO t(id, k, v) VALUES(?1, ?2, randomblob(?3))", -1, &pStmt, 0);
+    }
+    for (int i = 0; rc == SQLITE_OK && i < pCfg->nRow; i += BENCH_BATCH) {
+        const double t0 = benchNow();
+        rc = benchExec(db, "BEGIN");
+        for (int j = i; rc == SQLITE_OK && j < i + BENCH_BATCH && j < pCfg->nRow; j++) {
+            sqlite3_bind_int(pStmt, 1, j + 1);
+            sqlite3_bind_int64(pStmt, 2, (sqlite3_int64) (benchRandom() >> 1));
+            sqlite3_bind_int(pStmt, 3, BENCH_ROW_BYTES);
+            rc = (sqlite3_step(pStmt) == SQLITE_DONE) ? SQLITE_OK : sqlite3_errcode(db);
+            sqlite3_reset(pStmt);
+        }
+        if (rc == SQLITE_OK) {
+            rc = benchExec(db, "COMMIT");
+        }
+        const double t = benchNow() - t0;
+        pS->a[pS->n++] = t * 1e6;
+        pS->tTotal += t;
+    }
+    sqlite3_finalize(pStmt);
+    return rc;
+}
+
+/*
+** 运行 n 次查询 zSql（参数 ?1 为随机的主键），bCold 时每次查询之前都清空缓存。
+*/
+static int benchQuery(
+    sqlite3 **pDb,
+    const char *zPath,
+    const char *zVfs,
+    const BenchConfig *pCfg,
+    const char *zSql,
+    int n,
+    int bCold,
+    BenchSamples *pS
+) {
+    sqlite3_stmt *pStmt = 0;
+    int rc = SQLITE_OK;
+    for (int i = 0; rc == SQLITE_OK && i < n; i++) {
+        if (pStmt == 0 || bCold) {
+            sqlite3_finalize(pStmt);
+            pStmt = 0;
+            if (bCold) {
+                sqlite3_close(*pDb);
+                *pDb = 0;
+                benchEvict(zPath);
+                rc = benchOpen(zPath, zVfs, pDb);
+            }
+            if (rc == SQLITE_OK) {
+                rc = sqlite3_prepare_v2(*pDb, zSql, -1, &pStmt, 0);
+            }
+            if (rc != SQLITE_OK) {
+                break;
+            }
+        }
+        sqlite3_bind_int64(pStmt, 1, (sqlite3_int64) (benchRandom() % (unsigned long long) pCfg->nRow) + 1);
+        const double t0 = benchNow();
+        int nStep = 0;
+        while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+            nStep++;
+        }
+        const double t = benchNow() - t0;
+        rc = (rc == SQLITE_DONE && nStep > 0) ? SQLITE_OK : (rc == SQLITE_DONE ? SQLITE_ERROR : rc);
+        sqlite3_reset(pStmt);
+        pS->a[pS->n++] = t * 1e6;
+        pS->tTotal += t;
+    }
+    sqlite3_finalize(pStmt);
+    return rc;
+}
+
+static int benchRunOne(const BenchConfig *pCfg, int iVfs, const char *zJournal, int szPage) {
+    const char *zLabel = aVfs[iVfs].zLabel;
+    const char *zVfs = aVfs[iVfs].zVfs;
+    char *zPath = sqlite3_mprintf("%s/vfs_bench_%s.db", pCfg->zDir, zLabel);
+    const int nMax = pCfg->nRow / BENCH_BATCH + 1 + pCfg->nWarm + pCfg->nCold;
+    BenchSamples s = {0, malloc(sizeof(double) * nMax), 0};
+    sqlite3 *db = 0;
+    if (zPath == 0 || s.a == 0) {
+        sqlite3_free(zPath);
+        free(s.a);
+        return SQLITE_NOMEM;
+    }
+
+    benchRemove(zPath);
+    int rc = benchOpen(zPath, zVfs, &db);
+    if (rc == SQLITE_OK) {
+        char *zSql = sqlite3_mprintf(
+            "PRAGMA page_size=%d; PRAGMA journal_mode=%s; PRAGMA synchronous=NORMAL;", szPage, zJournal
+        );
+        rc = zSql ? benchExec(db, zSql) : SQLITE_NOMEM;
+        sqlite3_free(zSql);
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = benchBulkInsert(db, pCfg, &s);
+        benchReport(zLabel, zJournal, szPage, "bulk_insert", "warm", &s);
+    }
+
+    /* 查询类负载：热缓存 / 冷缓存 */
+    static const struct {
+        const char *zName;
+        const char *zSql;
+    } aQuery[] = {
+        {"point_lookup", "SELECT k, v FROM t WHERE id = ?1"},
+        {"range_scan", "SELECT k, v FROM t WHERE id >= ?1 ORDER BY id LIMIT 100"}, /* BENCH_SCAN_ROWS */
+    };
+    for (size_t i = 0; rc == SQLITE_OK && i < sizeof(aQuery) / sizeof(aQuery[0]); i++) {
+        for (int bCold = 0; rc == SQLITE_OK && bCold <= 1; bCold++) {
+            s.n = 0;
+            s.tTotal = 0;
+            rc = benchQuery(&db, zPath, zVfs, pCfg, aQuery[i].zSql, bCold ? pCfg->nCold : pCfg->nWarm, bCold, &s);
+            if (rc == SQLITE_OK) {
+                benchReport(zLabel, zJournal, szPage, aQuery[i].zName, bCold ? "cold" : "warm", &s);
+            }
+        }
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "%s/%s/%d: %s\n", zLabel, zJournal, szPage, db ? sqlite3_errmsg(db) : sqlite3_errstr(rc));
+    }
+
+    sqlite3_close(db);
+    benchRemove(zPath);
+    sqlite3_free(zPath);
+    free(s.a);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig cfg = {100000, 20000, 200, "."};
+    const char *zPageSizes = "4096,16384";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            cfg.nRow = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            cfg.nWarm = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            cfg.nCold = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            zPageSizes = argv[i + 1];
+        } else if (strcmp(argv[i], "-d") == 0) {
+            cfg.zDir = argv[i + 1];
+        } else {
+            fprintf(stderr, "usage: %s [-n rows] [-q warm_queries] [-c cold_queries] [-p page_sizes] [-d dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.nRow < BENCH_SCAN_ROWS || cfg.nWarm < 0 || cfg.nCold < 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(aVfs) / sizeof(aVfs[0]); i++) {
+        if (aVfs[i].zVfs && sqlite3_headervfs_register(aVfs[i].zVfs, aVfs[i].zOptions, 0) != SQLITE_OK) {
+            fprintf(stderr, "failed to register %s\n", aVfs[i].zVfs);
+            return 1;
+        }
+    }
+
+    for (const char *z = zPageSizes; *z;) {
+        const int szPage = atoi(z);
+        if (szPage < 512 || szPage > 65536 || (szPage & (szPage - 1)) != 0) {
+            fprintf(stderr, "invalid page size: %d\n", szPage);
+            return 1;
+        }
+        for (size_t j = 0; j < sizeof(azJournalMode) / sizeof(azJournalMode[0]); j++) {
+            for (size_t i = 0; i < sizeof(aVfs) / sizeof(aVfs[0]); i++) {
+                /* 每种 VFS 从同一个种子开始，负载完全相同 */
+                benchRandState = 0x9E3779B97F4A7C15ULL;
+                if (benchRunOne(&cfg, (int) i, azJournalMode[j], szPage) != SQLITE_OK) {
+                    return 1;
+                }
+            }
+        }
+        z = strchr(z, ',');
+        z = z ? z + 1 : "";
+    }
+    return 0;
+}
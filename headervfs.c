@@ -1,320 +1,8381 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* copy_file_range、fallocate 等 Linux 扩展 */
+#endif
+
 #include "sqlite3ext.h"
 SQLITE_EXTENSION_INIT1
+#include "headervfs.h"
+#include <stdlib.h>
 #include <string.h>
 
-// 在每个数据库主文件的开头要跳过的头部大小
+#if defined(__unix__) || defined(__APPLE__)
+#define HEADER_OS_UNIX 1
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#define HEADER_OS_UNIX 0
+#endif
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+/* io_uring 引擎直接使用系统调用，只需要内核头文件 */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define HEADER_HAVE_URING 1
+#endif
+#endif
+#endif
+#ifndef HEADER_HAVE_URING
+#define HEADER_HAVE_URING 0
+#endif
+
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+
+/* 页校验和的 CRC32C：x86-64 上运行时检测 SSE4.2，AArch64 上编译器开启了 CRC 扩展时直接使用 */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HEADER_HAVE_SSE42 1
+#else
+#define HEADER_HAVE_SSE42 0
+#endif
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HEADER_HAVE_ARM_CRC 1
+#else
+#define HEADER_HAVE_ARM_CRC 0
+#endif
+
+// 默认 VFS（headervfs）在每个数据库主文件的开头要跳过的头部大小
 #define HEADER_SIZE 1024
 
+// 头部大小的上限，防止误传的参数导致巨大的偏移
+#define HEADER_SIZE_MAX 0x40000000
+
+// 缓存的头部的上限：更大的头部只缓存开头这么多字节（参见 headerHeaderLoad()）
+#define HEADER_CACHE_MAX 65536
+
+/*
+** 一个已注册的 headervfs 实例。
+** 每个实例有自己的名字和一组默认选项（与 URI 参数同名），
+** 打开文件时 URI 参数优先于实例的默认选项。
+** pAppData 字段仍然保存着指向真实 VFS 的指针。
+*/
+typedef struct HeaderVfs {
+    sqlite3_vfs base;
+    int nOption;                /* 默认选项的个数 */
+    char **azOption;            /* 键值对：azOption[2*i] 为键，azOption[2*i+1] 为值 */
+} HeaderVfs;
+
+/*
+** 进程内的文件登记表项，每个被 headervfs 打开的主数据库文件（按 dev/inode 区分）对应一项。
+**
+** 有些功能需要直接操作文件描述符（例如 FICLONE），但在 POSIX 系统上关闭一个文件的
+** 任意描述符都会释放本进程在该文件上的所有 fcntl 锁，包括底层 VFS 持有的锁。
+** 因此描述符由登记表统一持有，只有当 headervfs 不再打开这个文件时才会关闭。
+*/
+typedef struct HeaderInode HeaderInode;
+
+/*
+** 写时复制的覆盖层（overlay 模式），参见“覆盖层”一节。
+*/
+typedef struct HeaderOverlay HeaderOverlay;
+
+/*
+** 启动预热（warmup 参数）的访问记录与后台回放，参见“启动预热”一节。
+*/
+typedef struct HeaderWarmup HeaderWarmup;
+
+/*
+** 进程内共享页缓存（page_cache 参数），参见“进程内共享页缓存”一节。
+*/
+typedef struct HeaderShared HeaderShared;
+
+/*
+** 堆内存 WAL 索引（wal_index=heap 参数），参见“堆内存 WAL 索引”一节。
+*/
+typedef struct HeaderHeapWal HeaderHeapWal;
+
+/*
+** 变更跟踪（track_changes 参数），参见“变更跟踪”一节。
+*/
+typedef struct HeaderChanges HeaderChanges;
+typedef struct HeaderBatch HeaderBatch;
+typedef struct HeaderChecksum HeaderChecksum;
+
+/*
+** io_uring 引擎（io_uring 参数），参见“io_uring 引擎”一节。
+*/
+typedef struct HeaderUring HeaderUring;
+
+/*
+** 直接 I/O（direct_io 参数），参见“直接 I/O”一节。
+*/
+typedef struct HeaderDirect HeaderDirect;
+
+// 对齐读缓存默认的块大小（通过 URI 参数 read_cache_block 设置）
+#define HEADER_READ_CACHE_BLOCK 65536
+
+// 写回缓冲区刷新时一次写入调用最多合并的页数（不超过 IOV_MAX）
+#define HEADER_WBUF_RUN 256
+
+// 顺序读取的预读窗口的初始大小（字节）
+#define HEADER_RA_MIN 131072
+
+// 连续多少次顺序读取之后开始预读
+#define HEADER_RA_TRIGGER 4
+
+// 内存镜像使用显式大页（MAP_HUGETLB）时映射长度对齐的粒度
+#define HEADER_HUGE_PAGE 0x200000
+
+// 加载内存镜像时每次读取的字节数
+#define HEADER_MEM_LOAD_CHUNK 0x1000000
+
+/*
+** 对齐读缓存。
+**
+** 由于头部的存在，SQLite 的每个页都会跨越两个文件系统块。这个缓存以真实文件中
+** 按块对齐的区间为单位从 pRealFile 读取数据，再从中切出 SQLite 请求的页，
+** 使底层读取始终是对齐的。缓存采用直接映射：块号 iBlock 存放在 iBlock % nSlot 槽中。
+*/
+typedef struct HeaderReadCache {
+    int szBlock;                /* 块大小（字节），2 的幂 */
+    int nSlot;                  /* 槽的数量 */
+    sqlite3_int64 *aBlock;      /* 每个槽缓存的块号，-1 表示空槽 */
+    int *aValid;                /* 每个槽中有效数据的字节数（文件末尾的块可能不满） */
+    unsigned char *aData;       /* nSlot * szBlock 字节的数据区 */
+    /* 统计计数 */
+    sqlite3_int64 nHit;         /* 完全由缓存满足的块访问次数 */
+    sqlite3_int64 nMiss;        /* 需要从底层读取的块访问次数 */
+    sqlite3_int64 nRealRead;    /* 对 pRealFile 发出的读取次数 */
+    sqlite3_int64 nRealBytes;   /* 从 pRealFile 读取的字节数 */
+    sqlite3_int64 nKeep;        /* 读事务开始时文件版本没有变化、缓存得以保留的次数 */
+    sqlite3_int64 nDrop;        /* 读事务开始时因为文件版本变化（或者无法确认）丢弃缓存的次数 */
+} HeaderReadCache;
+
+/*
+** 写回缓冲区（URI 参数 write_buffer）。
+**
+** 提交时 SQLite 对每个脏页调用一次 xWrite。开启缓冲区后，整页的写入先暂存在这里，
+** 到 xSync（或者 SQLITE_FCNTL_SYNC、解锁、截断等）时再按偏移量排序，把相邻的页合并
+** 成一次 pwritev 写入。缓冲区中的页用开放寻址的哈希表按页号索引，读取时优先从这里取。
+*/
+typedef struct HeaderWriteBuffer {
+    sqlite3_int64 szMax;        /* 缓冲的字节数上限 */
+    int szPage;                 /* 缓冲的页大小，由第一次写入确定 */
+    int nMax;                   /* 最多可以缓冲的页数 */
+    int nPage;                  /* 已缓冲的页数 */
+    int nHash;                  /* 哈希表容量，2 的幂 */
+    int *aHash;                 /* 哈希表：缓冲区下标 + 1，0 表示空位 */
+    sqlite3_int64 *aPgno;       /* 每个缓冲页的页号 */
+    unsigned char *aData;       /* nMax * szPage 字节的数据区 */
+    sqlite3_int64 iEnd;         /* 缓冲页覆盖的最大逻辑偏移量 */
+    /* 统计计数 */
+    sqlite3_int64 nWrite;       /* 进入缓冲区的写入次数 */
+    sqlite3_int64 nFlush;       /* 刷新次数 */
+    sqlite3_int64 nSyscall;     /* 刷新时发出的写入调用次数 */
+} HeaderWriteBuffer;
+
+/*
+** 顺序读取检测与预读（URI 参数 readahead，取值为窗口的上限）。
+**
+** 记录上一次读取的结束位置。连续 HEADER_RA_TRIGGER 次读取都从上一次结束的位置开始
+** （允许跳过至多一页，B 树的内部页通常已经在 SQLite 的页缓存中）时认为是顺序访问，
+** 在已预读的范围剩下不到半个窗口时通知内核在后台读入接下来的一个窗口。
+** 窗口从 HEADER_RA_MIN 开始，每次预读后加倍，不超过 szMax。扫描中偶尔读取的内部页
+** 不打断顺序访问；连续两次不连续的读取才被当作随机访问，回到初始状态。
+*/
+typedef struct HeaderReadahead {
+    sqlite3_int64 szMax;        /* 窗口的上限，0 表示不预读 */
+    sqlite3_int64 szWindow;     /* 下一次预读的窗口大小 */
+    sqlite3_int64 iNext;        /* 上一次读取的结束位置（逻辑偏移量） */
+    sqlite3_int64 iStart;       /* 已预读的连续范围的起点（逻辑偏移量） */
+    sqlite3_int64 iEnd;         /* 已预读的连续范围的终点，与 iStart 相等表示没有 */
+    int nSeq;                   /* 连续的顺序读取次数 */
+    int nMiss;                  /* 连续的不连续读取次数 */
+} HeaderReadahead;
+
+/*
+** 内存镜像（URI 参数 memory=1）。
+**
+** 只读的查询库在打开时把头部之后的全部内容读入一块连续的内存，之后的读取、文件大小
+** 和 xFetch 都直接由这块内存满足，不再经过 pRealFile。镜像是打开时的一致视图，
+** 之后其他连接对文件的修改不可见。
+*/
+typedef struct HeaderMemImage {
+    unsigned char *aData;       /* 数据库的内容（不含头部） */
+    sqlite3_int64 nData;        /* aData 中的字节数 */
+    sqlite3_int64 szMap;        /* 匿名映射的长度，0 表示由 sqlite3_malloc64 分配 */
+    const char *zBacking;       /* 内存的来源："heap"、"mmap"、"thp" 或 "hugetlb" */
+    sqlite3_int64 tLoad;        /* 加载耗时（纳秒） */
+} HeaderMemImage;
+
+/*
+** 数据库文件内容的版本号，用来判断文件在两次读事务之间有没有被修改过（参见 headerFileVersion()）。
+*/
+#define HEADER_VERSION_NONE 0       /* 没有记录，或者要等到读事务开始时再确定 */
+#define HEADER_VERSION_COUNTER 1    /* 文件修改计数器（第 1 页第 24 字节） */
+#define HEADER_VERSION_WAL 2        /* wal-index 头部的盐值和检查点已经写回的帧数 */
+
 // VFS 的 sqlite3_file 对象
 typedef struct HeaderFile {
     sqlite3_file base;
+    HeaderVfsStats stats;       /* I/O 统计计数，用 headerStatAdd() 更新 */
+    struct HeaderFile *pNextFile; /* 所有打开的文件组成的链表，由 headerGlobalMutex() 保护 */
     sqlite3_file *pRealFile;
+    sqlite3_vfs *pRealVfs;      /* 打开 pRealFile 的真实 VFS */
+    const HeaderVfs *pHv;       /* 打开这个文件的 headervfs 实例，用于查找选项 */
+    sqlite3_int64 iHeaderSize;  /* 头部大小，只对主数据库文件有意义 */
+    unsigned char *aHeader;     /* 缓存的头部（开头的 nHeader 字节），没有头部时为 NULL */
+    unsigned char *aHeaderNew;  /* 等待下一次同步时写入的新内容，与 aHeader 在同一块内存中 */
+    int nHeader;                /* 缓存的字节数，不超过 HEADER_CACHE_MAX */
+    int nHeaderNew;             /* aHeaderNew 中等待写入的字节数（从头部的开头算起），0 表示没有 */
+    int bHeaderValid;           /* aHeader 与文件一致，文件被其他连接修改之后要重新读取 */
+    int bReadOnly;              /* 以只读方式打开（包括快照、内存、不可变和覆盖层模式） */
+    sqlite3_int64 szChunk;      /* 按逻辑大小对齐的分配粒度（SQLITE_FCNTL_CHUNK_SIZE），0 表示不分块 */
+    HeaderReadCache *pCache;    /* 对齐读缓存，未开启时为 NULL */
+    int eVersion;               /* 读缓存内容对应的文件版本号的来源（HEADER_VERSION_*） */
+    sqlite3_uint64 iVersion;    /* 读缓存内容对应的文件版本号 */
+    HeaderWriteBuffer *pWBuf;   /* 写回缓冲区，未开启时为 NULL */
+    HeaderReadahead ra;         /* 顺序读取检测与预读的状态 */
+    int bShm;                   /* 已经映射了共享内存（WAL 模式），此时不使用写回缓冲区 */
+    void volatile *pShm0;       /* 共享内存的第一个区域（wal-index 头部），没有映射时为 NULL */
+    HeaderInode *pInode;        /* 进程内的文件登记表项，可能为 NULL */
+    char *zSnapshot;            /* 快照模式下私有副本的路径，关闭时删除 */
+    HeaderOverlay *pOverlay;    /* 覆盖层，未开启时为 NULL */
+    HeaderMemImage *pMem;       /* 内存镜像，未开启时为 NULL */
+    HeaderWarmup *pWarmup;      /* 启动预热，未开启时为 NULL */
+    HeaderUring *pUring;        /* io_uring 引擎，未开启或者不可用时为 NULL */
+    HeaderDirect *pDirect;      /* 直接 I/O，未开启或者不可用时为 NULL */
+    int bImmutable;             /* 不可变模式（URI 参数 immutable）：不加锁，也不使用共享内存 */
+    HeaderHeapWal *pHeapWal;    /* 堆内存 WAL 索引（登记项所有），未开启时为 NULL */
+    HeaderChanges *pChanges;    /* 变更跟踪，未开启时为 NULL */
+    HeaderBatch *pBatch;        /* 原子批量写入，未开启时为 NULL */
+    HeaderChecksum *pChecksum;  /* 页校验和，未开启时为 NULL */
+    unsigned int shmShared;     /* 堆内存 WAL 索引中持有的共享锁（按槽位的位掩码） */
+    unsigned int shmExcl;       /* 堆内存 WAL 索引中持有的排他锁 */
+    sqlite3_int64 iImmSize;     /* 不可变模式下打开时文件的大小，-1 表示未知 */
+    sqlite3_int64 iImmMtime;    /* 不可变模式下打开时文件的修改时间（纳秒），-1 表示未知 */
+    int eLock;                  /* 当前持有的锁（SQLITE_LOCK_*） */
+    const char *zName;          /* SQLite 传入的文件名，在 xClose 之前一直有效 */
+    char *zAltName;             /* 重定向后实际打开的文件名，关闭时释放 */
 } HeaderFile;
 
 
 /****************************************************************************
-** I/O 方法实现
+** 进程内的文件登记表
 ****************************************************************************/
 
+/* 保护 VFS 实例注册和文件登记表的互斥锁 */
+static sqlite3_mutex *headerGlobalMutex(void) {
+    return sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_VFS2);
+}
 
-static int headerClose(sqlite3_file *pFile) {
-    HeaderFile *p = (HeaderFile *) pFile;
-    int rc = SQLITE_OK;
-    if (p->pRealFile) {
-        if (p->pRealFile->pMethods && p->pRealFile->pMethods->xClose) {
-            rc = p->pRealFile->pMethods->xClose(p->pRealFile);
+#if HEADER_OS_UNIX
+
+struct HeaderInode {
+    dev_t dev;                  /* 设备号 */
+    ino_t ino;                  /* inode 号 */
+    int nRef;                   /* 引用这一项的 HeaderFile 个数 */
+    int fd;                     /* 由登记表持有的描述符，尚未打开时为 -1 */
+    int fdDirect;               /* 绕过页缓存的描述符（URI 参数 direct_io），尚未打开时为 -1 */
+    HeaderShared *pShared;      /* 共享页缓存（URI 参数 page_cache），由第一个要求的连接创建 */
+    HeaderHeapWal *pHeapWal;    /* 堆内存 WAL 索引和进程内的锁（URI 参数 wal_index=heap） */
+    int bStamp;                 /* 已经记录了不可变模式打开时的文件状态 */
+    sqlite3_int64 iStampSize;   /* 记录的文件大小 */
+    sqlite3_int64 iStampMtime;  /* 记录的修改时间（纳秒） */
+    char *zPath;                /* 第一次打开时使用的路径，用于按需打开 fd */
+    HeaderInode *pNext;
+};
+
+/* 所有登记项组成的链表，由 headerGlobalMutex() 保护 */
+static HeaderInode *headerInodeList = 0;
+
+static void headerSharedDestroy(HeaderShared *pShared);
+static void headerHeapWalDestroy(HeaderHeapWal *pHeap);
+
+/*
+** 查找（或创建）zPath 对应的登记项并增加引用计数。
+** 文件不存在或内存不足时返回 NULL，调用者应当把它当作“没有登记项”处理。
+*/
+static HeaderInode *headerInodeAcquire(const char *zPath) {
+    struct stat st;
+    if (zPath == 0 || stat(zPath, &st) != 0) {
+        return 0;
+    }
+
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    HeaderInode *pInode;
+    for (pInode = headerInodeList; pInode; pInode = pInode->pNext) {
+        if (pInode->dev == st.st_dev && pInode->ino == st.st_ino) {
+            break;
         }
-        sqlite3_free(p->pRealFile);
-        p->pRealFile = NULL;
     }
-    return rc;
+    if (pInode) {
+        pInode->nRef++;
+    } else {
+        const size_t nPath = strlen(zPath) + 1;
+        pInode = sqlite3_malloc64(sizeof(HeaderInode) + nPath);
+        if (pInode) {
+            memset(pInode, 0, sizeof(HeaderInode));
+            pInode->dev = st.st_dev;
+            pInode->ino = st.st_ino;
+            pInode->nRef = 1;
+            pInode->fd = -1;
+            pInode->fdDirect = -1;
+            pInode->zPath = (char *) &pInode[1];
+            memcpy(pInode->zPath, zPath, nPath);
+            pInode->pNext = headerInodeList;
+            headerInodeList = pInode;
+        }
+    }
+    sqlite3_mutex_leave(pMutex);
+    return pInode;
 }
 
 /*
-** 从文件中读取数据。
-** 读取操作在 iOfst + HEADER_SIZE 的偏移量处执行。
+** 减少引用计数，最后一个引用释放时关闭描述符。
 */
-static int headerRead(
-    sqlite3_file *pFile,
-    void *zBuf,
+static void headerInodeRelease(HeaderInode *pInode) {
+    if (pInode == 0) {
+        return;
+    }
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (--pInode->nRef == 0) {
+        HeaderInode **pp;
+        for (pp = &headerInodeList; *pp != pInode; pp = &(*pp)->pNext) {
+        }
+        *pp = pInode->pNext;
+        if (pInode->fd >= 0) {
+            close(pInode->fd);
+        }
+        if (pInode->fdDirect >= 0) {
+            close(pInode->fdDirect);
+        }
+        headerSharedDestroy(pInode->pShared);
+        headerHeapWalDestroy(pInode->pHeapWal);
+        sqlite3_free(pInode);
+    }
+    sqlite3_mutex_leave(pMutex);
+}
+
+/*
+** 打开登记项对应的文件（优先读写，失败时只读），flags 是额外的打开标志。
+** 无法打开或者路径已经指向另一个文件时返回 -1。调用者持有 headerGlobalMutex()。
+*/
+static int headerInodeOpen(const HeaderInode *pInode, int flags) {
+    int fd = open(pInode->zPath, O_RDWR | O_CLOEXEC | flags);
+    if (fd < 0) {
+        fd = open(pInode->zPath, O_RDONLY | O_CLOEXEC | flags);
+    }
+    struct stat st;
+    if (fd >= 0 && (fstat(fd, &st) != 0 || st.st_dev != pInode->dev || st.st_ino != pInode->ino)) {
+        /* 路径已经被替换为另一个文件，关闭它不会影响我们文件上的锁 */
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/*
+** 返回登记项持有的描述符，必要时打开它（优先读写，失败时只读）。
+** 无法打开或者路径已经指向另一个文件时返回 -1。
+*/
+static int headerInodeFd(HeaderInode *pInode) {
+    if (pInode == 0) {
+        return -1;
+    }
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (pInode->fd < 0) {
+        pInode->fd = headerInodeOpen(pInode, 0);
+    }
+    const int fd = pInode->fd;
+    sqlite3_mutex_leave(pMutex);
+    return fd;
+}
+
+/*
+** 返回登记项持有的绕过页缓存的描述符：Linux 等平台上以 O_DIRECT 打开，macOS 上设置 F_NOCACHE。
+** 和 fd 一样只在最后一个引用释放时关闭（关闭同一个文件的任何描述符都会释放进程的 POSIX 锁）。
+** 平台或文件系统不支持时返回 -1。
+*/
+static int headerInodeDirectFd(HeaderInode *pInode) {
+    if (pInode == 0) {
+        return -1;
+    }
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (pInode->fdDirect < 0) {
+#if defined(O_DIRECT)
+        pInode->fdDirect = headerInodeOpen(pInode, O_DIRECT);
+#elif defined(F_NOCACHE)
+        pInode->fdDirect = headerInodeOpen(pInode, 0);
+        if (pInode->fdDirect >= 0 && fcntl(pInode->fdDirect, F_NOCACHE, 1) == -1) {
+            close(pInode->fdDirect);
+            pInode->fdDirect = -1;
+        }
+#endif
+    }
+    const int fd = pInode->fdDirect;
+    sqlite3_mutex_leave(pMutex);
+    return fd;
+}
+
+/*
+** 不可变模式打开时核对文件的状态。同一个文件第一次以不可变模式打开时记下大小和修改时间，
+** 之后的打开与记录比较，不同时说明文件在进程仍然打开着它的时候被原地改写了（被替换成新文件时
+** inode 不同，对应的是另一个登记项）。返回值为真表示文件变化过，*piSize 和 *piMtime 是当前的状态。
+** 记录只保存在登记项里，不写入文件：只在本进程内、并且这个文件一直有连接打开着的期间有效，
+** 最后一个连接关闭之后、或者在另一个进程中，下一次打开会重新记录，不会发现之前的修改。
+*/
+static int headerInodeStamp(HeaderInode *pInode, sqlite3_int64 *piSize, sqlite3_int64 *piMtime) {
+    *piSize = *piMtime = -1;
+    const int fd = headerInodeFd(pInode);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return 0;
+    }
+    *piSize = (sqlite3_int64) st.st_size;
+#if defined(__APPLE__)
+    *piMtime = (sqlite3_int64) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    *piMtime = (sqlite3_int64) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    const int bChanged = pInode->bStamp && (pInode->iStampSize != *piSize || pInode->iStampMtime != *piMtime);
+    pInode->bStamp = 1;
+    pInode->iStampSize = *piSize;
+    pInode->iStampMtime = *piMtime;
+    sqlite3_mutex_leave(pMutex);
+    return bChanged;
+}
+
+#else
+
+static HeaderInode *headerInodeAcquire(const char *zPath) {
+    (void) zPath;
+    return 0;
+}
+
+static void headerInodeRelease(HeaderInode *pInode) {
+    (void) pInode;
+}
+
+static int headerInodeFd(HeaderInode *pInode) {
+    (void) pInode;
+    return -1;
+}
+
+static int headerInodeDirectFd(HeaderInode *pInode) {
+    (void) pInode;
+    return -1;
+}
+
+static int headerInodeStamp(HeaderInode *pInode, sqlite3_int64 *piSize, sqlite3_int64 *piMtime) {
+    (void) pInode;
+    *piSize = *piMtime = -1;
+    return 0;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+
+/****************************************************************************
+** I/O 统计
+**
+** 每个 HeaderFile 都有自己的计数，用宽松的原子操作更新，不需要加锁。
+** 打开的文件登记在 headerFileList 中；文件关闭时它的计数累加到 headerClosedStats，
+** 因此进程的全局计数等于 headerClosedStats 加上所有打开文件的计数。
+****************************************************************************/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define headerStatAdd(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define headerStatGet(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define headerPtrLoad(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define headerPtrStore(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#else
+#define headerStatAdd(x, v) ((x) += (v))
+#define headerStatGet(x) (x)
+#define headerPtrLoad(x) (x)
+#define headerPtrStore(x, v) ((x) = (v))
+#endif
+
+/* 所有打开的文件，由 headerGlobalMutex() 保护 */
+static HeaderFile *headerFileList = 0;
+
+/* 已经关闭的文件的计数之和，由 headerGlobalMutex() 保护 */
+static HeaderVfsStats headerClosedStats;
+
+/* 单调时钟（纳秒），不支持时返回 0（延迟全部记入第 0 桶） */
+static sqlite3_int64 headerNow(void) {
+#if HEADER_OS_UNIX
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (sqlite3_int64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+#endif
+    return 0;
+}
+
+/* 把从 tStart 开始的一次操作的延迟记入直方图 aHist */
+static void headerStatLatency(sqlite3_int64 *aHist, sqlite3_int64 tStart) {
+    sqlite3_int64 iUs = (headerNow() - tStart) / 1000;
+    int iBucket = 0;
+    while (iUs > 0 && iBucket < HEADERVFS_STATS_BUCKETS - 1) {
+        iUs >>= 1;
+        iBucket++;
+    }
+    headerStatAdd(aHist[iBucket], 1);
+}
+
+/* 把 pSrc 的计数累加到 pDst（HeaderVfsStats 的成员都是 sqlite3_int64） */
+static void headerStatsAccumulate(HeaderVfsStats *pDst, HeaderVfsStats *pSrc) {
+    sqlite3_int64 *aDst = (sqlite3_int64 *) pDst;
+    sqlite3_int64 *aSrc = (sqlite3_int64 *) pSrc;
+    for (size_t i = 0; i < sizeof(HeaderVfsStats) / sizeof(sqlite3_int64); i++) {
+        aDst[i] += headerStatGet(aSrc[i]);
+    }
+}
+
+static void headerFileListAdd(HeaderFile *p) {
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    p->pNextFile = headerFileList;
+    headerFileList = p;
+    sqlite3_mutex_leave(pMutex);
+}
+
+/* 从链表中移除（如果在链表中的话），并把计数累加到 headerClosedStats */
+static void headerFileListRemove(HeaderFile *p) {
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    for (HeaderFile **pp = &headerFileList; *pp; pp = &(*pp)->pNextFile) {
+        if (*pp == p) {
+            *pp = p->pNextFile;
+            headerStatsAccumulate(&headerClosedStats, &p->stats);
+            break;
+        }
+    }
+    sqlite3_mutex_leave(pMutex);
+}
+
+
+/****************************************************************************
+** 对齐读缓存实现
+****************************************************************************/
+
+/*
+** 创建一个总大小约为 szCache 字节、块大小为 szBlock 的读缓存。
+** 参数不合法时返回 SQLITE_OK 且 *ppCache 为 NULL（即不开启缓存）。
+*/
+static int headerCacheCreate(sqlite3_int64 szCache, sqlite3_int64 szBlock, HeaderReadCache **ppCache) {
+    *ppCache = 0;
+    if (szCache <= 0) {
+        return SQLITE_OK;
+    }
+    if (szBlock < 512 || szBlock > 0x1000000 || (szBlock & (szBlock - 1)) != 0) {
+        szBlock = HEADER_READ_CACHE_BLOCK;
+    }
+    sqlite3_int64 nSlot = szCache / szBlock;
+    if (nSlot < 2) {
+        nSlot = 2;
+    }
+    if (nSlot > 0x100000) {
+        nSlot = 0x100000;
+    }
+
+    HeaderReadCache *pCache = sqlite3_malloc64(sizeof(HeaderReadCache));
+    if (!pCache) {
+        return SQLITE_NOMEM;
+    }
+    memset(pCache, 0, sizeof(HeaderReadCache));
+    pCache->szBlock = (int) szBlock;
+    pCache->nSlot = (int) nSlot;
+    pCache->aBlock = sqlite3_malloc64(sizeof(sqlite3_int64) * nSlot);
+    pCache->aValid = sqlite3_malloc64(sizeof(int) * nSlot);
+    pCache->aData = sqlite3_malloc64(szBlock * nSlot);
+    if (!pCache->aBlock || !pCache->aValid || !pCache->aData) {
+        sqlite3_free(pCache->aBlock);
+        sqlite3_free(pCache->aValid);
+        sqlite3_free(pCache->aData);
+        sqlite3_free(pCache);
+        return SQLITE_NOMEM;
+    }
+    for (int i = 0; i < pCache->nSlot; i++) {
+        pCache->aBlock[i] = -1;
+    }
+    *ppCache = pCache;
+    return SQLITE_OK;
+}
+
+static void headerCacheDestroy(HeaderReadCache *pCache) {
+    if (pCache) {
+        sqlite3_free(pCache->aBlock);
+        sqlite3_free(pCache->aValid);
+        sqlite3_free(pCache->aData);
+        sqlite3_free(pCache);
+    }
+}
+
+/*
+** 丢弃所有缓存的块。
+** 在其他连接（或进程）可能修改了文件时调用，例如重新获得 SHARED 锁时。
+*/
+static void headerCacheInvalidate(HeaderReadCache *pCache) {
+    for (int i = 0; i < pCache->nSlot; i++) {
+        pCache->aBlock[i] = -1;
+    }
+}
+
+/*
+** 从缓存中读取真实文件 [iReal, iReal+iAmt) 范围的数据，缺失的块调用 xRealRead 加载。
+** 读到文件末尾之后的部分填零，并返回 SQLITE_IOERR_SHORT_READ。
+*/
+static int headerCacheRead(
+    HeaderReadCache *pCache,
+    HeaderFile *p,
+    int (*xRealRead)(HeaderFile *, void *, int, sqlite3_int64),
+    unsigned char *zBuf,
     int iAmt,
-    sqlite3_int64 iOfst
+    sqlite3_int64 iReal
 ) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xRead(p->pRealFile, zBuf, iAmt, iOfst + HEADER_SIZE);
+    const sqlite3_int64 szBlock = pCache->szBlock;
+    int bShort = 0;
+
+    while (iAmt > 0) {
+        const sqlite3_int64 iBlock = iReal / szBlock;
+        const int iSlot = (int) (iBlock % pCache->nSlot);
+        const int iOff = (int) (iReal - iBlock * szBlock);
+        unsigned char *aSlot = &pCache->aData[(sqlite3_int64) iSlot * szBlock];
+        int n = (int) szBlock - iOff;
+        if (n > iAmt) {
+            n = iAmt;
+        }
+
+        if (pCache->aBlock[iSlot] == iBlock) {
+            pCache->nHit++;
+        } else {
+            pCache->nMiss++;
+            pCache->nRealRead++;
+            pCache->aBlock[iSlot] = -1;
+            int rc = xRealRead(p, aSlot, (int) szBlock, iBlock * szBlock);
+            int nValid = (int) szBlock;
+            if (rc == SQLITE_IOERR_SHORT_READ) {
+                sqlite3_int64 realSize;
+                rc = p->pRealFile->pMethods->xFileSize(p->pRealFile, &realSize);
+                if (rc != SQLITE_OK) {
+                    return rc;
+                }
+                nValid = (realSize <= iBlock * szBlock) ? 0
+                         : (realSize - iBlock * szBlock < szBlock) ? (int) (realSize - iBlock * szBlock)
+                         : (int) szBlock;
+            } else if (rc != SQLITE_OK) {
+                return rc;
+            }
+            pCache->nRealBytes += nValid;
+            pCache->aBlock[iSlot] = iBlock;
+            pCache->aValid[iSlot] = nValid;
+        }
+
+        const int nValid = pCache->aValid[iSlot];
+        if (iOff + n <= nValid) {
+            memcpy(zBuf, &aSlot[iOff], n);
+        } else {
+            const int nCopy = (iOff < nValid) ? (nValid - iOff) : 0;
+            memcpy(zBuf, &aSlot[iOff], nCopy);
+            memset(zBuf + nCopy, 0, n - nCopy);
+            bShort = 1;
+        }
+
+        zBuf += n;
+        iAmt -= n;
+        iReal += n;
+    }
+    return bShort ? SQLITE_IOERR_SHORT_READ : SQLITE_OK;
 }
 
 /*
-** 向文件中写入数据。
-** 写入操作在 iOfst + HEADER_SIZE 的偏移量处执行。
+** 写穿：把已经成功写入 pRealFile 的数据同步到缓存中对应的块。
 */
-static int headerWrite(
-    sqlite3_file *pFile,
-    const void *zBuf,
+static void headerCacheWrite(
+    HeaderReadCache *pCache,
+    const unsigned char *zBuf,
     int iAmt,
-    sqlite3_int64 iOfst
+    sqlite3_int64 iReal
 ) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xWrite(p->pRealFile, zBuf, iAmt, iOfst + HEADER_SIZE);
+    const sqlite3_int64 szBlock = pCache->szBlock;
+    while (iAmt > 0) {
+        const sqlite3_int64 iBlock = iReal / szBlock;
+        const int iSlot = (int) (iBlock % pCache->nSlot);
+        const int iOff = (int) (iReal - iBlock * szBlock);
+        int n = (int) szBlock - iOff;
+        if (n > iAmt) {
+            n = iAmt;
+        }
+        if (pCache->aBlock[iSlot] == iBlock) {
+            if (iOff > pCache->aValid[iSlot]) {
+                /* 写入位置和有效数据之间存在空洞，简单地丢弃这个块 */
+                pCache->aBlock[iSlot] = -1;
+            } else {
+                memcpy(&pCache->aData[(sqlite3_int64) iSlot * szBlock + iOff], zBuf, n);
+                if (iOff + n > pCache->aValid[iSlot]) {
+                    pCache->aValid[iSlot] = iOff + n;
+                }
+            }
+        }
+        zBuf += n;
+        iAmt -= n;
+        iReal += n;
+    }
 }
 
 /*
-** 截断文件。
-** 截断操作在 size + HEADER_SIZE 的大小处执行。
+** 真实文件被扩展后，之前读到文件末尾的块已经不完整了，丢弃它们。
 */
-static int headerTruncate(sqlite3_file *pFile, sqlite_int64 size) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xTruncate(p->pRealFile, size + HEADER_SIZE);
+static void headerCacheExtend(HeaderReadCache *pCache) {
+    for (int i = 0; i < pCache->nSlot; i++) {
+        if (pCache->aBlock[i] >= 0 && pCache->aValid[i] < pCache->szBlock) {
+            pCache->aBlock[i] = -1;
+        }
+    }
 }
 
 /*
-** 同步文件。
-** 这是一个到底层 VFS 的简单传递。
+** 真实文件被截断到 iRealSize 字节后，丢弃所有超出新大小的块。
 */
-static int headerSync(sqlite3_file *pFile, int flags) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xSync(p->pRealFile, flags);
+static void headerCacheTruncate(HeaderReadCache *pCache, sqlite3_int64 iRealSize) {
+    for (int i = 0; i < pCache->nSlot; i++) {
+        const sqlite3_int64 iBlock = pCache->aBlock[i];
+        if (iBlock >= 0 && iBlock * pCache->szBlock + pCache->aValid[i] > iRealSize) {
+            pCache->aBlock[i] = -1;
+        }
+    }
 }
+/****************************************************************************
+** 写回缓冲区实现
+****************************************************************************/
 
 /*
-** 获取文件大小。
-** 报告的大小是物理大小减去头部大小。
+** 创建一个最多缓冲 szMax 字节的写回缓冲区，实际的存储在第一次写入时分配。
+** szMax <= 0 时返回 SQLITE_OK 且 *ppWBuf 为 NULL（即不开启缓冲区）。
 */
-static int headerFileSize(sqlite3_file *pFile, sqlite_int64 *pSize) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    sqlite3_int64 realSize;
-    const int rc = p->pRealFile->pMethods->xFileSize(p->pRealFile, &realSize);
-    if (rc == SQLITE_OK) {
-        *pSize = (realSize > HEADER_SIZE) ? (realSize - HEADER_SIZE) : 0;
+static int headerWBufCreate(sqlite3_int64 szMax, HeaderWriteBuffer **ppWBuf) {
+    *ppWBuf = 0;
+    if (szMax <= 0) {
+        return SQLITE_OK;
+    }
+    HeaderWriteBuffer *pWBuf = sqlite3_malloc64(sizeof(HeaderWriteBuffer));
+    if (!pWBuf) {
+        return SQLITE_NOMEM;
+    }
+    memset(pWBuf, 0, sizeof(HeaderWriteBuffer));
+    pWBuf->szMax = szMax;
+    *ppWBuf = pWBuf;
+    return SQLITE_OK;
+}
+
+static void headerWBufDestroy(HeaderWriteBuffer *pWBuf) {
+    if (pWBuf) {
+        sqlite3_free(pWBuf->aHash);
+        sqlite3_free(pWBuf->aPgno);
+        sqlite3_free(pWBuf->aData);
+        sqlite3_free(pWBuf);
+    }
+}
+
+/*
+** 按页大小 szPage 分配存储。缓冲区必须是空的。
+*/
+static int headerWBufSetPageSize(HeaderWriteBuffer *pWBuf, int szPage) {
+    sqlite3_int64 nMax = pWBuf->szMax / szPage;
+    if (nMax < 1) {
+        nMax = 1;
+    }
+    if (nMax > 0x100000) {
+        nMax = 0x100000;
+    }
+    int nHash = 2;
+    while (nHash < nMax * 2) {
+        nHash *= 2;
+    }
+    int *aHash = sqlite3_malloc64(sizeof(int) * nHash);
+    sqlite3_int64 *aPgno = sqlite3_malloc64(sizeof(sqlite3_int64) * nMax);
+    unsigned char *aData = sqlite3_malloc64(nMax * szPage);
+    if (!aHash || !aPgno || !aData) {
+        sqlite3_free(aHash);
+        sqlite3_free(aPgno);
+        sqlite3_free(aData);
+        return SQLITE_NOMEM;
+    }
+    memset(aHash, 0, sizeof(int) * nHash);
+    sqlite3_free(pWBuf->aHash);
+    sqlite3_free(pWBuf->aPgno);
+    sqlite3_free(pWBuf->aData);
+    pWBuf->aHash = aHash;
+    pWBuf->aPgno = aPgno;
+    pWBuf->aData = aData;
+    pWBuf->nHash = nHash;
+    pWBuf->nMax = (int) nMax;
+    pWBuf->szPage = szPage;
+    return SQLITE_OK;
+}
+
+/*
+** 查找页 iPgno 在缓冲区中的下标，不存在时返回 -1。
+** 如果 piHash 不为 NULL，它被设置为该页（或者可以插入该页的空位）在哈希表中的位置。
+*/
+static int headerWBufFind(const HeaderWriteBuffer *pWBuf, sqlite3_int64 iPgno, int *piHash) {
+    unsigned int h = (unsigned int) (iPgno * 0x9E3779B1u) & (pWBuf->nHash - 1);
+    while (pWBuf->aHash[h] != 0) {
+        if (pWBuf->aPgno[pWBuf->aHash[h] - 1] == iPgno) {
+            break;
+        }
+        h = (h + 1) & (pWBuf->nHash - 1);
+    }
+    if (piHash) {
+        *piHash = (int) h;
+    }
+    return pWBuf->aHash[h] - 1;
+}
+
+/*
+** 清空缓冲区（刷新之后调用）。
+*/
+static void headerWBufReset(HeaderWriteBuffer *pWBuf) {
+    if (pWBuf->nPage > 0) {
+        memset(pWBuf->aHash, 0, sizeof(int) * pWBuf->nHash);
+    }
+    pWBuf->nPage = 0;
+    pWBuf->iEnd = 0;
+}
+
+/*
+** 判断逻辑范围 [iOfst, iOfst+iAmt) 是否与缓冲的页重叠。
+*/
+static int headerWBufOverlaps(const HeaderWriteBuffer *pWBuf, sqlite3_int64 iOfst, int iAmt) {
+    if (pWBuf->nPage == 0) {
+        return 0;
+    }
+    const sqlite3_int64 iLast = (iOfst + iAmt - 1) / pWBuf->szPage;
+    for (sqlite3_int64 iPgno = iOfst / pWBuf->szPage; iPgno <= iLast; iPgno++) {
+        if (headerWBufFind(pWBuf, iPgno, 0) >= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* 刷新时排序用的项：页号和它在缓冲区中的下标 */
+typedef struct HeaderWBufEntry {
+    sqlite3_int64 iPgno;
+    int iIdx;
+} HeaderWBufEntry;
+
+static int headerWBufCompare(const void *a, const void *b) {
+    const sqlite3_int64 x = ((const HeaderWBufEntry *) a)->iPgno;
+    const sqlite3_int64 y = ((const HeaderWBufEntry *) b)->iPgno;
+    return (x > y) - (x < y);
+}
+
+
+/****************************************************************************
+** 进程内共享页缓存（URI 参数 page_cache，取值为缓存的总大小）
+**
+** 同一个文件（按 dev/inode 区分）的所有连接共享一个页缓存，挂在登记表项上，避免多线程的
+** 服务里每个连接的 SQLite 页缓存各自保存一份热点页。缓存按页号分成 HEADER_SHARED_SHARDS
+** 个分片，每个分片有自己的互斥锁、链式哈希表和 CLOCK 淘汰，不同的页很少争用同一把锁。
+**
+** 本进程的写入（包括写回缓冲区的刷新）同步更新缓存。其他进程的修改通过版本号发现：
+** 回滚日志模式下是获得 SHARED 锁时文件中的修改计数器（第 1 页第 24 字节），WAL 模式下是
+** 开始读事务时 wal-index 中检查点已经写回的帧数和盐值，与上次记录的不同时清空整个缓存。
+** 纪元计数器在每次写入和清空时加一，从文件读到的内容只有纪元没有变化时才放进缓存，
+** 防止比写入更早读到的旧内容留在缓存里。
+****************************************************************************/
+
+// 分片的个数
+#define HEADER_SHARED_SHARDS 16
+
+typedef struct HeaderSharedShard {
+    sqlite3_mutex *pMutex;      /* 保护这个分片 */
+    int szPage;                 /* 存储按这个页大小分配，0 表示还没有分配 */
+    int nPage;                  /* 可以容纳的页数 */
+    int nUsed;                  /* 已经使用过的槽数，满之前按顺序分配 */
+    int nCount;                 /* 缓存着的页数 */
+    int nHash;                  /* 哈希桶的个数，2 的幂 */
+    int iHand;                  /* CLOCK 指针 */
+    int *aHash;                 /* 每个桶的第一个槽（下标 + 1），0 表示空桶 */
+    int *aNext;                 /* 同一个桶中的下一个槽（下标 + 1） */
+    sqlite3_int64 *aPgno;       /* 每个槽的页号，-1 表示空槽 */
+    unsigned char *aRef;        /* CLOCK 的访问位 */
+    unsigned char *aData;       /* nPage * szPage 字节的数据区 */
+} HeaderSharedShard;
+
+struct HeaderShared {
+    sqlite3_int64 szMax;        /* 缓存的总大小（字节） */
+    sqlite3_mutex *pMutex;      /* 保护 szPage 的修改和版本号 */
+    sqlite3_int64 szPage;       /* 缓存的页大小，由第一次整页读取确定，0 表示未知 */
+    int eVersion;               /* 版本号的来源（HEADER_VERSION_*） */
+    sqlite3_uint64 iVersion;    /* 上次记录的版本号 */
+    /* 以下用 headerStatAdd() 更新 */
+    sqlite3_int64 iEpoch;       /* 纪元，每次写入和清空加一 */
+    sqlite3_int64 nHit;         /* 命中次数 */
+    sqlite3_int64 nMiss;        /* 未命中次数 */
+    sqlite3_int64 nEvict;       /* 被淘汰的页数 */
+    sqlite3_int64 nInvalidate;  /* 因为版本号变化（或者写入失败、截断）清空的次数 */
+    HeaderSharedShard aShard[HEADER_SHARED_SHARDS];
+};
+
+/*
+** 创建一个总大小约为 szMax 字节的共享页缓存，存储在知道页大小之后按分片分配。
+*/
+static HeaderShared *headerSharedCreate(sqlite3_int64 szMax) {
+    HeaderShared *pShared = sqlite3_malloc64(sizeof(HeaderShared));
+    if (pShared == 0) {
+        return 0;
+    }
+    memset(pShared, 0, sizeof(HeaderShared));
+    pShared->szMax = szMax;
+    pShared->pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+    for (int i = 0; i < HEADER_SHARED_SHARDS; i++) {
+        pShared->aShard[i].pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+    }
+    return pShared;
+}
+
+/*
+** 释放分片的存储。调用者持有分片的锁（或者已经没有其他人能访问它）。
+*/
+static void headerSharedShardFree(HeaderSharedShard *pShard) {
+    sqlite3_free(pShard->aHash);
+    sqlite3_free(pShard->aNext);
+    sqlite3_free(pShard->aPgno);
+    sqlite3_free(pShard->aRef);
+    sqlite3_free(pShard->aData);
+    pShard->aHash = pShard->aNext = 0;
+    pShard->aPgno = 0;
+    pShard->aRef = pShard->aData = 0;
+    pShard->szPage = pShard->nPage = pShard->nUsed = pShard->nCount = pShard->nHash = pShard->iHand = 0;
+}
+
+static void headerSharedDestroy(HeaderShared *pShared) {
+    if (pShared) {
+        for (int i = 0; i < HEADER_SHARED_SHARDS; i++) {
+            headerSharedShardFree(&pShared->aShard[i]);
+            sqlite3_mutex_free(pShared->aShard[i].pMutex);
+        }
+        sqlite3_mutex_free(pShared->pMutex);
+        sqlite3_free(pShared);
+    }
+}
+
+/*
+** 按页大小 szPage 为分片分配存储，原有的内容被丢弃。调用者持有分片的锁。
+*/
+static int headerSharedShardAlloc(HeaderSharedShard *pShard, sqlite3_int64 szMax, int szPage) {
+    headerSharedShardFree(pShard);
+    sqlite3_int64 nPage = szMax / HEADER_SHARED_SHARDS / szPage;
+    if (nPage < 8) {
+        nPage = 8;
+    }
+    if (nPage > 0x100000) {
+        nPage = 0x100000;
+    }
+    int nHash = 2;
+    while (nHash < nPage) {
+        nHash *= 2;
+    }
+    pShard->aHash = sqlite3_malloc64(sizeof(int) * nHash);
+    pShard->aNext = sqlite3_malloc64(sizeof(int) * nPage);
+    pShard->aPgno = sqlite3_malloc64(sizeof(sqlite3_int64) * nPage);
+    pShard->aRef = sqlite3_malloc64(nPage);
+    pShard->aData = sqlite3_malloc64(nPage * szPage);
+    if (!pShard->aHash || !pShard->aNext || !pShard->aPgno || !pShard->aRef || !pShard->aData) {
+        headerSharedShardFree(pShard);
+        return SQLITE_NOMEM;
+    }
+    memset(pShard->aHash, 0, sizeof(int) * nHash);
+    pShard->nHash = nHash;
+    pShard->nPage = (int) nPage;
+    pShard->szPage = szPage;
+    return SQLITE_OK;
+}
+
+/* 页号在分片内的哈希桶 */
+static int headerSharedBucket(const HeaderSharedShard *pShard, sqlite3_int64 iPgno) {
+    return (int) ((unsigned int) ((iPgno / HEADER_SHARED_SHARDS) * 0x9E3779B1u) & (pShard->nHash - 1));
+}
+
+/*
+** 查找页 iPgno 所在的槽，不存在时返回 -1。调用者持有分片的锁。
+*/
+static int headerSharedFind(const HeaderSharedShard *pShard, sqlite3_int64 iPgno) {
+    if (pShard->nPage == 0) {
+        return -1;
+    }
+    for (int j = pShard->aHash[headerSharedBucket(pShard, iPgno)]; j; j = pShard->aNext[j - 1]) {
+        if (pShard->aPgno[j - 1] == iPgno) {
+            return j - 1;
+        }
+    }
+    return -1;
+}
+
+/*
+** 把槽 i 从哈希表中摘下来，变成空槽。调用者持有分片的锁。
+*/
+static void headerSharedUnlink(HeaderSharedShard *pShard, int i) {
+    int *pj = &pShard->aHash[headerSharedBucket(pShard, pShard->aPgno[i])];
+    while (*pj != i + 1) {
+        pj = &pShard->aNext[*pj - 1];
+    }
+    *pj = pShard->aNext[i];
+    pShard->aPgno[i] = -1;
+    pShard->nCount--;
+}
+
+/*
+** 清空整个缓存（不释放存储），纪元加一。
+*/
+static void headerSharedInvalidate(HeaderShared *pShared) {
+    headerStatAdd(pShared->iEpoch, 1);
+    headerStatAdd(pShared->nInvalidate, 1);
+    for (int s = 0; s < HEADER_SHARED_SHARDS; s++) {
+        HeaderSharedShard *pShard = &pShared->aShard[s];
+        sqlite3_mutex_enter(pShard->pMutex);
+        if (pShard->nPage > 0) {
+            memset(pShard->aHash, 0, sizeof(int) * pShard->nHash);
+            pShard->nUsed = pShard->nCount = pShard->iHand = 0;
+        }
+        sqlite3_mutex_leave(pShard->pMutex);
+    }
+}
+
+/*
+** 记录文件当前的版本号，与上次记录的不同（文件被其他进程修改过）时清空缓存。
+** bTrusted 为真时版本号来自本进程自己的写入，只更新记录，不清空缓存。
+*/
+static void headerSharedVersion(HeaderShared *pShared, int eVersion, sqlite3_uint64 iVersion, int bTrusted) {
+    sqlite3_mutex_enter(pShared->pMutex);
+    const int bChanged = pShared->eVersion != eVersion || pShared->iVersion != iVersion;
+    pShared->eVersion = eVersion;
+    pShared->iVersion = iVersion;
+    sqlite3_mutex_leave(pShared->pMutex);
+    if (bChanged && !bTrusted) {
+        headerSharedInvalidate(pShared);
+    }
+}
+
+/*
+** 逻辑范围 [iOfst, iOfst+iAmt) 是不是一个按页对齐的整页。
+*/
+static int headerSharedIsPage(int iAmt, sqlite3_int64 iOfst) {
+    return iAmt >= 512 && iAmt <= 65536 && (iAmt & (iAmt - 1)) == 0 && iOfst % iAmt == 0;
+}
+
+/*
+** 从缓存中读取页 iPgno，命中时返回 1。
+*/
+static int headerSharedLookup(HeaderShared *pShared, sqlite3_int64 iPgno, int szPage, void *zBuf) {
+    HeaderSharedShard *pShard = &pShared->aShard[iPgno % HEADER_SHARED_SHARDS];
+    int bHit = 0;
+    sqlite3_mutex_enter(pShard->pMutex);
+    if (pShard->szPage == szPage) {
+        const int i = headerSharedFind(pShard, iPgno);
+        if (i >= 0) {
+            memcpy(zBuf, &pShard->aData[(sqlite3_int64) i * szPage], szPage);
+            pShard->aRef[i] = 1;
+            bHit = 1;
+        }
+    }
+    sqlite3_mutex_leave(pShard->pMutex);
+    return bHit;
+}
+
+/*
+** 把从文件读到的页 iPgno 放进缓存。iEpoch 是读取之前的纪元，之后有过写入或者清空时放弃。
+*/
+static void headerSharedInsert(HeaderShared *pShared, sqlite3_int64 iPgno, int szPage, const void *zBuf, sqlite3_int64 iEpoch) {
+    HeaderSharedShard *pShard = &pShared->aShard[iPgno % HEADER_SHARED_SHARDS];
+    sqlite3_mutex_enter(pShard->pMutex);
+    if (headerStatGet(pShared->iEpoch) != iEpoch
+        || (pShard->szPage != szPage && headerSharedShardAlloc(pShard, pShared->szMax, szPage) != SQLITE_OK)
+    ) {
+        sqlite3_mutex_leave(pShard->pMutex);
+        return;
+    }
+    int i = headerSharedFind(pShard, iPgno);
+    if (i < 0) {
+        if (pShard->nUsed < pShard->nPage) {
+            i = pShard->nUsed++;
+        } else {
+            /* CLOCK：跳过最近访问过的槽（同时清除访问位），淘汰第一个没有访问过的 */
+            for (;;) {
+                i = pShard->iHand;
+                pShard->iHand = (pShard->iHand + 1) % pShard->nPage;
+                if (pShard->aPgno[i] < 0) {
+                    break;
+                }
+                if (pShard->aRef[i] == 0) {
+                    headerSharedUnlink(pShard, i);
+                    headerStatAdd(pShared->nEvict, 1);
+                    break;
+                }
+                pShard->aRef[i] = 0;
+            }
+        }
+        const int h = headerSharedBucket(pShard, iPgno);
+        pShard->aPgno[i] = iPgno;
+        pShard->aNext[i] = pShard->aHash[h];
+        pShard->aHash[h] = i + 1;
+        pShard->nCount++;
+    }
+    memcpy(&pShard->aData[(sqlite3_int64) i * szPage], zBuf, szPage);
+    pShard->aRef[i] = 1;
+    sqlite3_mutex_leave(pShard->pMutex);
+}
+
+/*
+** SQLite 以 szPage 大小的整页读写文件。与缓存的页大小不同（例如 VACUUM 改变了页大小）时
+** 改用新的页大小并清空缓存，各个分片在下一次放入时按新的大小重新分配存储。
+*/
+static void headerSharedPageSize(HeaderShared *pShared, int szPage) {
+    sqlite3_mutex_enter(pShared->pMutex);
+    const sqlite3_int64 szOld = pShared->szPage;
+    pShared->szPage = szPage;
+    sqlite3_mutex_leave(pShared->pMutex);
+    if (szOld != 0 && szOld != szPage) {
+        headerSharedInvalidate(pShared);
+    }
+}
+
+/*
+** 经过共享页缓存读取逻辑范围：按页对齐的整页先查缓存，未命中时调用 xBaseRead 读取后放进缓存，
+** 其他读取直接调用 xBaseRead。
+*/
+static int headerSharedRead(
+    HeaderShared *pShared,
+    HeaderFile *p,
+    int (*xBaseRead)(HeaderFile *, void *, int, sqlite3_int64),
+    void *zBuf,
+    int iAmt,
+    sqlite3_int64 iOfst
+) {
+    if (!headerSharedIsPage(iAmt, iOfst)) {
+        return xBaseRead(p, zBuf, iAmt, iOfst);
+    }
+    if (headerStatGet(pShared->szPage) == 0) {
+        headerSharedPageSize(pShared, iAmt);
+    }
+    if (headerStatGet(pShared->szPage) != iAmt) {
+        return xBaseRead(p, zBuf, iAmt, iOfst);
+    }
+    const sqlite3_int64 iPgno = iOfst / iAmt;
+    if (headerSharedLookup(pShared, iPgno, iAmt, zBuf)) {
+        headerStatAdd(pShared->nHit, 1);
+        headerStatAdd(p->stats.nPageCacheHit, 1);
+        return SQLITE_OK;
+    }
+    headerStatAdd(pShared->nMiss, 1);
+    headerStatAdd(p->stats.nPageCacheMiss, 1);
+    const sqlite3_int64 iEpoch = headerStatGet(pShared->iEpoch);
+    const int rc = xBaseRead(p, zBuf, iAmt, iOfst);
+    if (rc == SQLITE_OK) {
+        headerSharedInsert(pShared, iPgno, iAmt, zBuf, iEpoch);
+    }
+    return rc;
+}
+
+/*
+** 已经写入文件的逻辑范围：缓存中完整覆盖的页更新为新的内容，部分覆盖的页丢弃。
+*/
+static void headerSharedWrite(HeaderShared *pShared, const unsigned char *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    headerStatAdd(pShared->iEpoch, 1);
+    const sqlite3_int64 szPage = headerStatGet(pShared->szPage);
+    if (szPage == 0) {
+        return;
+    }
+    const sqlite3_int64 iEnd = iOfst + iAmt;
+    for (sqlite3_int64 iPgno = iOfst / szPage; iPgno * szPage < iEnd; iPgno++) {
+        HeaderSharedShard *pShard = &pShared->aShard[iPgno % HEADER_SHARED_SHARDS];
+        sqlite3_mutex_enter(pShard->pMutex);
+        const int i = (pShard->szPage == szPage) ? headerSharedFind(pShard, iPgno) : -1;
+        if (i >= 0) {
+            if (iPgno * szPage >= iOfst && (iPgno + 1) * szPage <= iEnd) {
+                memcpy(&pShard->aData[(sqlite3_int64) i * szPage], &zBuf[iPgno * szPage - iOfst], (size_t) szPage);
+            } else {
+                headerSharedUnlink(pShard, i);
+            }
+        }
+        sqlite3_mutex_leave(pShard->pMutex);
+    }
+}
+
+/*
+** 文件被截断到逻辑大小 iSize，丢弃超出的页。
+*/
+static void headerSharedTruncate(HeaderShared *pShared, sqlite3_int64 iSize) {
+    headerStatAdd(pShared->iEpoch, 1);
+    for (int s = 0; s < HEADER_SHARED_SHARDS; s++) {
+        HeaderSharedShard *pShard = &pShared->aShard[s];
+        sqlite3_mutex_enter(pShard->pMutex);
+        for (int i = 0; i < pShard->nUsed; i++) {
+            if (pShard->aPgno[i] >= 0 && (pShard->aPgno[i] + 1) * pShard->szPage > iSize) {
+                headerSharedUnlink(pShard, i);
+            }
+        }
+        sqlite3_mutex_leave(pShard->pMutex);
+    }
+}
+
+#if HEADER_OS_UNIX
+
+/*
+** 为登记项创建共享页缓存（已经存在时使用原来的，大小以第一次创建时为准）。
+*/
+static int headerSharedAttach(HeaderInode *pInode, sqlite3_int64 szMax) {
+    if (pInode == 0 || szMax <= 0) {
+        return SQLITE_OK;
+    }
+    int rc = SQLITE_OK;
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (pInode->pShared == 0) {
+        HeaderShared *pShared = headerSharedCreate(szMax);
+        if (pShared) {
+            headerPtrStore(pInode->pShared, pShared);
+        } else {
+            rc = SQLITE_NOMEM;
+        }
+    }
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+/*
+** 登记项的共享页缓存。缓存可能由之后打开的连接创建，所以每次都从登记项读取。
+*/
+static HeaderShared *headerSharedOfInode(HeaderInode *pInode) {
+    return pInode ? headerPtrLoad(pInode->pShared) : 0;
+}
+
+#else
+
+static int headerSharedAttach(HeaderInode *pInode, sqlite3_int64 szMax) {
+    (void) pInode;
+    (void) szMax;
+    return SQLITE_OK;
+}
+
+static HeaderShared *headerSharedOfInode(HeaderInode *pInode) {
+    (void) pInode;
+    return 0;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+/*
+** 缓存着的页数。
+*/
+static int headerSharedCount(HeaderShared *pShared) {
+    int nCount = 0;
+    for (int s = 0; s < HEADER_SHARED_SHARDS; s++) {
+        sqlite3_mutex_enter(pShared->aShard[s].pMutex);
+        nCount += pShared->aShard[s].nCount;
+        sqlite3_mutex_leave(pShared->aShard[s].pMutex);
+    }
+    return nCount;
+}
+
+
+/****************************************************************************
+** 堆内存 WAL 索引（URI 参数 wal_index=heap）
+**
+** 底层 VFS 把 WAL 索引放在 -shm 文件的共享映射里，锁也是对 -shm 文件的 fcntl 锁，
+** 即使只有一个进程使用数据库也是如此。开启后同一个文件（按 dev/inode 区分）的 WAL 索引
+** 放在进程的堆内存里，由登记表项持有，数据库文件和 WAL 索引的锁都在进程内用互斥锁实现，
+** 不再创建 -shm 文件，也不再有加锁的系统调用。
+**
+** 其他进程看不到这些锁，所以第一个以这种方式打开文件的连接另外用底层 VFS 打开一个文件句柄，
+** 在上面持有 EXCLUSIVE 锁直到进程不再打开这个文件：其他进程无法读写数据库。同一个进程里
+** 没有使用 wal_index=heap 的连接同样会因为这个锁得到 SQLITE_BUSY。只持有 SHARED 锁是不够的：
+** 另一个进程的 WAL 写入者只需要数据库文件的 SHARED 锁和它自己的 -shm 锁，就可以追加或者重新开始
+** 同一个 -wal 文件，而这里的 WAL 索引看不到这些帧。所以只读打开的连接也要以读写方式打开这个句柄。
+****************************************************************************/
+
+struct HeaderHeapWal {
+    sqlite3_mutex *pMutex;      /* 保护以下所有成员 */
+    sqlite3_file *pHolder;      /* 持有 EXCLUSIVE 锁的底层文件句柄（总是以读写方式打开） */
+    int eLock;                  /* 进程内数据库文件锁的最高级别（SQLITE_LOCK_*） */
+    int nShared;                /* 持有 SHARED 或者更高级别锁的连接数 */
+    int aShmLock[SQLITE_SHM_NLOCK]; /* WAL 索引每个槽位的锁：正数为共享锁的个数，-1 为排他锁 */
+    int nMap;                   /* 映射了 WAL 索引的连接数，降到 0 时释放所有区域 */
+    int szRegion;               /* 区域的大小 */
+    int nRegion;                /* 已经分配的区域数 */
+    char **apRegion;            /* 每个区域的内存 */
+};
+
+/*
+** 释放 WAL 索引的所有区域。调用者持有 pHeap->pMutex（或者对象已经不再被使用）。
+*/
+static void headerHeapWalFreeRegions(HeaderHeapWal *pHeap) {
+    for (int i = 0; i < pHeap->nRegion; i++) {
+        sqlite3_free(pHeap->apRegion[i]);
+    }
+    sqlite3_free(pHeap->apRegion);
+    pHeap->apRegion = 0;
+    pHeap->nRegion = 0;
+    pHeap->szRegion = 0;
+}
+
+/*
+** 销毁 WAL 索引并释放持有的底层锁。登记项释放时调用。
+*/
+static void headerHeapWalDestroy(HeaderHeapWal *pHeap) {
+    if (pHeap == 0) {
+        return;
+    }
+    if (pHeap->pHolder) {
+        if (pHeap->pHolder->pMethods) {
+            pHeap->pHolder->pMethods->xUnlock(pHeap->pHolder, SQLITE_LOCK_NONE);
+            pHeap->pHolder->pMethods->xClose(pHeap->pHolder);
+        }
+        sqlite3_free(pHeap->pHolder);
+    }
+    headerHeapWalFreeRegions(pHeap);
+    sqlite3_mutex_free(pHeap->pMutex);
+    sqlite3_free(pHeap);
+}
+
+/*
+** 创建 WAL 索引，用 pRealVfs 以读写方式打开 zPath 并获得排他锁。其他进程已经打开着数据库时
+** 返回 SQLITE_BUSY；文件只能以只读方式打开（无法获得排他锁）时返回 SQLITE_READONLY。
+*/
+static int headerHeapWalCreate(sqlite3_vfs *pRealVfs, const char *zPath, HeaderHeapWal **ppHeap) {
+    *ppHeap = 0;
+    HeaderHeapWal *pHeap = sqlite3_malloc(sizeof(HeaderHeapWal));
+    if (pHeap == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pHeap, 0, sizeof(HeaderHeapWal));
+    pHeap->pMutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+    pHeap->pHolder = sqlite3_malloc(pRealVfs->szOsFile);
+    if (pHeap->pMutex == 0 || pHeap->pHolder == 0) {
+        headerHeapWalDestroy(pHeap);
+        return SQLITE_NOMEM;
+    }
+    memset(pHeap->pHolder, 0, pRealVfs->szOsFile);
+
+    /* unix VFS 在没有写权限时会悄悄退回到只读打开，这时无法获得排他锁 */
+    int outFlags = 0;
+    int rc = pRealVfs->xOpen(pRealVfs, zPath, pHeap->pHolder, SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE, &outFlags);
+    if (rc == SQLITE_OK && (outFlags & SQLITE_OPEN_READONLY)) {
+        rc = SQLITE_READONLY;
+    }
+    if (rc == SQLITE_OK) {
+        rc = pHeap->pHolder->pMethods->xLock(pHeap->pHolder, SQLITE_LOCK_SHARED);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pHeap->pHolder->pMethods->xLock(pHeap->pHolder, SQLITE_LOCK_EXCLUSIVE);
+    }
+    if (rc != SQLITE_OK) {
+        headerHeapWalDestroy(pHeap);
+        return rc;
+    }
+    *ppHeap = pHeap;
+    return SQLITE_OK;
+}
+
+/*
+** 进程内的数据库文件锁，规则与 unix VFS 在同一进程的多个连接之间的处理相同：
+** 同时可以有多个 SHARED，RESERVED 和 EXCLUSIVE 只能有一个，其他连接持有 SHARED 时
+** EXCLUSIVE 先停在 PENDING，阻止新的 SHARED。
+*/
+static int headerHeapWalLock(HeaderFile *p, int eLock) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    if (p->eLock >= eLock) {
+        return SQLITE_OK;
+    }
+    int rc = SQLITE_OK;
+    sqlite3_mutex_enter(pHeap->pMutex);
+    if (pHeap->eLock != p->eLock && (pHeap->eLock >= SQLITE_LOCK_PENDING || eLock > SQLITE_LOCK_SHARED)) {
+        rc = SQLITE_BUSY;
+    } else if (eLock == SQLITE_LOCK_SHARED) {
+        pHeap->nShared++;
+        if (pHeap->eLock == SQLITE_LOCK_NONE) {
+            pHeap->eLock = SQLITE_LOCK_SHARED;
+        }
+        p->eLock = SQLITE_LOCK_SHARED;
+    } else if (eLock == SQLITE_LOCK_EXCLUSIVE && pHeap->nShared > 1) {
+        pHeap->eLock = p->eLock = SQLITE_LOCK_PENDING;
+        rc = SQLITE_BUSY;
+    } else {
+        pHeap->eLock = p->eLock = eLock;
+    }
+    sqlite3_mutex_leave(pHeap->pMutex);
+    return rc;
+}
+
+static int headerHeapWalUnlock(HeaderFile *p, int eLock) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    if (p->eLock <= eLock) {
+        return SQLITE_OK;
+    }
+    sqlite3_mutex_enter(pHeap->pMutex);
+    if (p->eLock > SQLITE_LOCK_SHARED) {
+        pHeap->eLock = SQLITE_LOCK_SHARED;
+    }
+    if (eLock == SQLITE_LOCK_NONE && --pHeap->nShared == 0) {
+        pHeap->eLock = SQLITE_LOCK_NONE;
+    }
+    p->eLock = eLock;
+    sqlite3_mutex_leave(pHeap->pMutex);
+    return SQLITE_OK;
+}
+
+static int headerHeapWalCheckReserved(const HeaderFile *p) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    sqlite3_mutex_enter(pHeap->pMutex);
+    const int bReserved = pHeap->eLock > SQLITE_LOCK_SHARED;
+    sqlite3_mutex_leave(pHeap->pMutex);
+    return bReserved;
+}
+
+/*
+** 映射 WAL 索引的第 iPg 个区域（大小为 szRegion）。区域不存在而 bExtend 为假时 *pp 为 NULL。
+** 新分配的区域清零，SQLite 看到全零的头部时会从 WAL 文件恢复索引。
+*/
+static int headerHeapWalMap(HeaderFile *p, int iPg, int szRegion, int bExtend, void volatile **pp) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    int rc = SQLITE_OK;
+    *pp = 0;
+    sqlite3_mutex_enter(pHeap->pMutex);
+    if (pHeap->szRegion == 0) {
+        pHeap->szRegion = szRegion;
+    }
+    if (pHeap->szRegion != szRegion) {
+        rc = SQLITE_IOERR_SHMSIZE;
+    } else if (iPg >= pHeap->nRegion && bExtend) {
+        char **apNew = sqlite3_realloc64(pHeap->apRegion, sizeof(char *) * (iPg + 1));
+        if (apNew == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            pHeap->apRegion = apNew;
+            while (rc == SQLITE_OK && pHeap->nRegion <= iPg) {
+                char *pRegion = sqlite3_malloc(szRegion);
+                if (pRegion == 0) {
+                    rc = SQLITE_NOMEM;
+                } else {
+                    memset(pRegion, 0, szRegion);
+                    apNew[pHeap->nRegion++] = pRegion;
+                }
+            }
+        }
+    }
+    if (rc == SQLITE_OK && iPg < pHeap->nRegion) {
+        *pp = pHeap->apRegion[iPg];
+    }
+    if (rc == SQLITE_OK && !p->bShm) {
+        pHeap->nMap++;
+    }
+    sqlite3_mutex_leave(pHeap->pMutex);
+    return rc;
+}
+
+/*
+** WAL 索引的锁，flags 的含义与 xShmLock 相同。
+*/
+static int headerHeapWalShmLock(HeaderFile *p, int offset, int n, int flags) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    const unsigned int mask = ((1u << (offset + n)) - 1) & ~((1u << offset) - 1);
+    int rc = SQLITE_OK;
+    sqlite3_mutex_enter(pHeap->pMutex);
+    if (flags & SQLITE_SHM_UNLOCK) {
+        for (int i = offset; i < offset + n; i++) {
+            if (p->shmExcl & (1u << i)) {
+                pHeap->aShmLock[i] = 0;
+            } else if (p->shmShared & (1u << i)) {
+                pHeap->aShmLock[i]--;
+            }
+        }
+        p->shmShared &= ~mask;
+        p->shmExcl &= ~mask;
+    } else if (flags & SQLITE_SHM_SHARED) {
+        for (int i = offset; rc == SQLITE_OK && i < offset + n; i++) {
+            if (!(p->shmShared & (1u << i)) && pHeap->aShmLock[i] < 0) {
+                rc = SQLITE_BUSY;
+            }
+        }
+        for (int i = offset; rc == SQLITE_OK && i < offset + n; i++) {
+            if (!(p->shmShared & (1u << i))) {
+                pHeap->aShmLock[i]++;
+            }
+        }
+        if (rc == SQLITE_OK) {
+            p->shmShared |= mask;
+        }
+    } else {
+        for (int i = offset; rc == SQLITE_OK && i < offset + n; i++) {
+            if (!(p->shmExcl & (1u << i)) && pHeap->aShmLock[i] != 0) {
+                rc = SQLITE_BUSY;
+            }
+        }
+        for (int i = offset; rc == SQLITE_OK && i < offset + n; i++) {
+            pHeap->aShmLock[i] = -1;
+        }
+        if (rc == SQLITE_OK) {
+            p->shmExcl |= mask;
+        }
+    }
+    sqlite3_mutex_leave(pHeap->pMutex);
+    return rc;
+}
+
+/*
+** 互斥锁的进入和退出包含了完整的内存屏障。
+*/
+static void headerHeapWalBarrier(HeaderFile *p) {
+    sqlite3_mutex_enter(p->pHeapWal->pMutex);
+    sqlite3_mutex_leave(p->pHeapWal->pMutex);
+}
+
+/*
+** 取消映射并释放这个连接持有的 WAL 索引锁。最后一个连接取消映射时释放所有区域，
+** 下一次映射时 SQLite 从 WAL 文件重新恢复索引（进程内没有别人需要它，deleteFlag 不影响结果）。
+*/
+static void headerHeapWalUnmap(HeaderFile *p) {
+    HeaderHeapWal *pHeap = p->pHeapWal;
+    sqlite3_mutex_enter(pHeap->pMutex);
+    for (int i = 0; i < SQLITE_SHM_NLOCK; i++) {
+        if (p->shmExcl & (1u << i)) {
+            pHeap->aShmLock[i] = 0;
+        } else if (p->shmShared & (1u << i)) {
+            pHeap->aShmLock[i]--;
+        }
+    }
+    p->shmShared = p->shmExcl = 0;
+    if (p->bShm && --pHeap->nMap == 0) {
+        headerHeapWalFreeRegions(pHeap);
+    }
+    sqlite3_mutex_leave(pHeap->pMutex);
+}
+
+/*
+** WAL 索引的区域数和总字节数。
+*/
+static void headerHeapWalSize(HeaderHeapWal *pHeap, int *pnRegion, sqlite3_int64 *pnByte) {
+    sqlite3_mutex_enter(pHeap->pMutex);
+    *pnRegion = pHeap->nRegion;
+    *pnByte = (sqlite3_int64) pHeap->nRegion * pHeap->szRegion;
+    sqlite3_mutex_leave(pHeap->pMutex);
+}
+
+#if HEADER_OS_UNIX
+
+/*
+** 为登记项创建（或者使用已经有的）堆内存 WAL 索引。
+*/
+static int headerHeapWalAttach(HeaderInode *pInode, sqlite3_vfs *pRealVfs, HeaderHeapWal **ppHeap) {
+    *ppHeap = 0;
+    int rc = SQLITE_OK;
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (pInode->pHeapWal == 0) {
+        rc = headerHeapWalCreate(pRealVfs, pInode->zPath, &pInode->pHeapWal);
+    }
+    *ppHeap = pInode->pHeapWal;
+    sqlite3_mutex_leave(pMutex);
+    return rc;
+}
+
+#else
+
+static int headerHeapWalAttach(HeaderInode *pInode, sqlite3_vfs *pRealVfs, HeaderHeapWal **ppHeap) {
+    (void) pInode;
+    (void) pRealVfs;
+    *ppHeap = 0;
+    return SQLITE_OK;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+
+/****************************************************************************
+** 覆盖层（overlay 模式）
+**
+** 基础文件（原始的带头部的数据库）以只读方式打开，所有写入都进入一个按页索引的
+** 增量文件（delta），内存中的页表记录每个页在增量文件中的位置。读取时先查页表，
+** 不在页表中的页再从基础文件读取。锁、共享内存、日志和 WAL 都落在增量文件上，
+** 因此读取基础文件的其他进程不会受到写入者的任何影响。
+**
+** 增量文件的格式：
+**
+**   偏移量 0     头部（HEADER_OVERLAY_HDR 字节，整数都是大端序）
+**                  0  16 字节魔数
+**                 16  4 字节槽中页的大小
+**                 24  8 字节逻辑文件大小（截断时更新）
+**                 32  8 字节基础文件中仍然有效的逻辑长度
+**                 40  8 字节纪元，每次截断或合并时加一
+**   之后         槽：8 字节逻辑页号（-1 表示已作废）+ 一整页数据
+**
+** 槽只会追加，不会被另一个页复用；槽的个数由文件大小决定。其他连接在开始读事务时
+** 比较纪元：纪元不变时只需要加载新追加的槽，否则重新加载整个页表。
+** headervfs_overlay_merge() 把增量合并回基础文件并清空增量文件。
+****************************************************************************/
+
+// 增量文件头部的大小
+#define HEADER_OVERLAY_HDR 512
+
+// 增量文件的魔数（16 字节）
+static const char headerOverlayMagic[16] = "headervfs-ovl-1";
+
+struct HeaderOverlay {
+    sqlite3_file *pDelta;       /* 增量文件，通过真实 VFS 以主数据库的方式打开 */
+    char *zDelta;               /* 增量文件的路径 */
+    int bReadOnly;              /* 增量文件是否只读 */
+    int szPage;                 /* 槽中页的大小，0 表示还没有写入过 */
+    sqlite3_int64 iSize;        /* 逻辑文件大小 */
+    sqlite3_int64 iBaseLimit;   /* 基础文件中仍然有效的逻辑长度，之后的内容视为 0 */
+    sqlite3_int64 iEpoch;       /* 已加载的纪元 */
+    sqlite3_int64 nSlot;        /* 已加载的槽数 */
+    sqlite3_int64 iSlotEnd;     /* 已加载的有效槽所覆盖的最大逻辑偏移量 */
+    /* 页表：开放寻址的哈希表，页号 -> 槽号 */
+    int nHash;                  /* 哈希表容量，2 的幂 */
+    int nEntry;                 /* 哈希表中的项数 */
+    sqlite3_int64 *aPage;       /* 页号，-1 表示空位 */
+    sqlite3_int64 *aSlot;       /* 对应的槽号 */
+    unsigned char *aScratch;    /* 8 + szPage 字节的临时缓冲区 */
+};
+
+static sqlite3_uint64 headerGet64(const unsigned char *a) {
+    sqlite3_uint64 v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | a[i];
+    }
+    return v;
+}
+
+static void headerPut64(unsigned char *a, sqlite3_uint64 v) {
+    for (int i = 7; i >= 0; i--) {
+        a[i] = (unsigned char) (v & 0xff);
+        v >>= 8;
+    }
+}
+
+static unsigned int headerGet32(const unsigned char *a) {
+    return ((unsigned int) a[0] << 24) | ((unsigned int) a[1] << 16) | ((unsigned int) a[2] << 8) | a[3];
+}
+
+static void headerPut32(unsigned char *a, unsigned int v) {
+    a[0] = (unsigned char) (v >> 24);
+    a[1] = (unsigned char) (v >> 16);
+    a[2] = (unsigned char) (v >> 8);
+    a[3] = (unsigned char) v;
+}
+
+/* 槽 iSlot 在增量文件中的偏移量 */
+static sqlite3_int64 headerOverlaySlotOffset(const HeaderOverlay *pOv, sqlite3_int64 iSlot) {
+    return HEADER_OVERLAY_HDR + iSlot * (8 + (sqlite3_int64) pOv->szPage);
+}
+
+static sqlite3_int64 headerOverlayFind(const HeaderOverlay *pOv, sqlite3_int64 iPage) {
+    if (pOv->nEntry == 0) {
+        return -1;
+    }
+    unsigned int h = (unsigned int) (iPage * 0x9E3779B1u) & (pOv->nHash - 1);
+    while (pOv->aPage[h] >= 0) {
+        if (pOv->aPage[h] == iPage) {
+            return pOv->aSlot[h];
+        }
+        h = (h + 1) & (pOv->nHash - 1);
+    }
+    return -1;
+}
+
+static int headerOverlayInsert(HeaderOverlay *pOv, sqlite3_int64 iPage, sqlite3_int64 iSlot) {
+    if ((pOv->nEntry + 1) * 2 > pOv->nHash) {
+        /* 负载超过一半时扩容并重新插入 */
+        const int nNew = pOv->nHash ? pOv->nHash * 2 : 256;
+        sqlite3_int64 *aPage = sqlite3_malloc64(sizeof(sqlite3_int64) * nNew);
+        sqlite3_int64 *aSlot = sqlite3_malloc64(sizeof(sqlite3_int64) * nNew);
+        if (aPage == 0 || aSlot == 0) {
+            sqlite3_free(aPage);
+            sqlite3_free(aSlot);
+            return SQLITE_NOMEM;
+        }
+        for (int i = 0; i < nNew; i++) {
+            aPage[i] = -1;
+        }
+        for (int i = 0; i < pOv->nHash; i++) {
+            if (pOv->aPage[i] >= 0) {
+                unsigned int h = (unsigned int) (pOv->aPage[i] * 0x9E3779B1u) & (nNew - 1);
+                while (aPage[h] >= 0) {
+                    h = (h + 1) & (nNew - 1);
+                }
+                aPage[h] = pOv->aPage[i];
+                aSlot[h] = pOv->aSlot[i];
+            }
+        }
+        sqlite3_free(pOv->aPage);
+        sqlite3_free(pOv->aSlot);
+        pOv->aPage = aPage;
+        pOv->aSlot = aSlot;
+        pOv->nHash = nNew;
+    }
+    unsigned int h = (unsigned int) (iPage * 0x9E3779B1u) & (pOv->nHash - 1);
+    while (pOv->aPage[h] >= 0 && pOv->aPage[h] != iPage) {
+        h = (h + 1) & (pOv->nHash - 1);
+    }
+    if (pOv->aPage[h] < 0) {
+        pOv->nEntry++;
+    }
+    pOv->aPage[h] = iPage;
+    pOv->aSlot[h] = iSlot;
+    return SQLITE_OK;
+}
+
+static void headerOverlayClearMap(HeaderOverlay *pOv) {
+    for (int i = 0; i < pOv->nHash; i++) {
+        pOv->aPage[i] = -1;
+    }
+    pOv->nEntry = 0;
+    pOv->nSlot = 0;
+    pOv->iSlotEnd = 0;
+}
+
+/* 把内存中的元数据写入增量文件头部 */
+static int headerOverlayWriteHeader(HeaderOverlay *pOv) {
+    unsigned char aHdr[HEADER_OVERLAY_HDR];
+    memset(aHdr, 0, sizeof(aHdr));
+    memcpy(aHdr, headerOverlayMagic, 16);
+    headerPut32(&aHdr[16], (unsigned int) pOv->szPage);
+    headerPut64(&aHdr[24], (sqlite3_uint64) pOv->iSize);
+    headerPut64(&aHdr[32], (sqlite3_uint64) pOv->iBaseLimit);
+    headerPut64(&aHdr[40], (sqlite3_uint64) pOv->iEpoch);
+    return pOv->pDelta->pMethods->xWrite(pOv->pDelta, aHdr, HEADER_OVERLAY_HDR, 0);
+}
+
+/*
+** 确定槽的页大小并分配临时缓冲区（第一次写入时调用）。
+*/
+static int headerOverlaySetPageSize(HeaderOverlay *pOv, int szPage) {
+    unsigned char *aScratch = sqlite3_malloc64(8 + (sqlite3_int64) szPage);
+    if (aScratch == 0) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_free(pOv->aScratch);
+    pOv->aScratch = aScratch;
+    pOv->szPage = szPage;
+    return SQLITE_OK;
+}
+
+/*
+** 与增量文件同步：读取头部，纪元变化时重新加载整个页表，否则只加载新追加的槽。
+** 在每个读事务开始时调用（此时持有增量文件上的锁）。
+*/
+static int headerOverlayLoad(HeaderOverlay *pOv) {
+    sqlite3_file *pDelta = pOv->pDelta;
+    sqlite3_int64 szDelta;
+    int rc = pDelta->pMethods->xFileSize(pDelta, &szDelta);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (szDelta < HEADER_OVERLAY_HDR) {
+        /* 新的（或被清空的）增量文件，由第一次写入负责初始化 */
+        headerOverlayClearMap(pOv);
+        return SQLITE_OK;
+    }
+
+    unsigned char aHdr[48];
+    rc = pDelta->pMethods->xRead(pDelta, aHdr, sizeof(aHdr), 0);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (memcmp(aHdr, headerOverlayMagic, 16) != 0) {
+        sqlite3_log(SQLITE_CORRUPT, "headervfs: %s is not an overlay delta file", pOv->zDelta);
+        return SQLITE_CORRUPT;
+    }
+    const int szPage = (int) headerGet32(&aHdr[16]);
+    const sqlite3_int64 iEpoch = (sqlite3_int64) headerGet64(&aHdr[40]);
+    if (iEpoch != pOv->iEpoch || szPage != pOv->szPage) {
+        headerOverlayClearMap(pOv);
+        pOv->iEpoch = iEpoch;
+        if (szPage != pOv->szPage) {
+            rc = szPage ? headerOverlaySetPageSize(pOv, szPage) : SQLITE_OK;
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            pOv->szPage = szPage;
+        }
+    }
+    pOv->iSize = (sqlite3_int64) headerGet64(&aHdr[24]);
+    pOv->iBaseLimit = (sqlite3_int64) headerGet64(&aHdr[32]);
+    if (pOv->szPage == 0) {
+        return SQLITE_OK;
+    }
+
+    /* 加载新追加的槽，末尾不完整的槽（写入时崩溃）被忽略 */
+    const sqlite3_int64 szSlot = 8 + (sqlite3_int64) pOv->szPage;
+    const sqlite3_int64 nSlot = (szDelta - HEADER_OVERLAY_HDR) / szSlot;
+    for (sqlite3_int64 i = pOv->nSlot; i < nSlot; i++) {
+        unsigned char aKey[8];
+        rc = pDelta->pMethods->xRead(pDelta, aKey, 8, headerOverlaySlotOffset(pOv, i));
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        const sqlite3_int64 iPage = (sqlite3_int64) headerGet64(aKey);
+        if (iPage >= 0) {
+            rc = headerOverlayInsert(pOv, iPage, i);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            if ((iPage + 1) * pOv->szPage > pOv->iSlotEnd) {
+                pOv->iSlotEnd = (iPage + 1) * pOv->szPage;
+            }
+        }
+    }
+    pOv->nSlot = nSlot;
+
+    /* 追加的槽不更新头部，逻辑大小还要算上槽中的页 */
+    if (pOv->iSlotEnd > pOv->iSize) {
+        pOv->iSize = pOv->iSlotEnd;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** 打开覆盖层。zDelta 为增量文件路径，iBaseSize 为基础文件的逻辑大小。
+*/
+static int headerOverlayOpen(
+    sqlite3_vfs *pRealVfs,
+    const char *zDelta,
+    int flags,
+    sqlite3_int64 iBaseSize,
+    HeaderOverlay **ppOv,
+    int *pOutFlags
+) {
+    *ppOv = 0;
+    const size_t nDelta = strlen(zDelta) + 1;
+    HeaderOverlay *pOv = sqlite3_malloc64(sizeof(HeaderOverlay) + pRealVfs->szOsFile + nDelta);
+    if (pOv == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pOv, 0, sizeof(HeaderOverlay) + pRealVfs->szOsFile);
+    pOv->pDelta = (sqlite3_file *) &pOv[1];
+    pOv->zDelta = (char *) pOv->pDelta + pRealVfs->szOsFile;
+    memcpy(pOv->zDelta, zDelta, nDelta);
+    pOv->iSize = iBaseSize;
+    pOv->iBaseLimit = iBaseSize;
+
+    /* 增量文件的路径不是 URI 文件名 */
+    int deltaFlags = SQLITE_OPEN_MAIN_DB | (flags & (SQLITE_OPEN_READONLY | SQLITE_OPEN_READWRITE));
+    if ((flags & SQLITE_OPEN_READWRITE) != 0) {
+        deltaFlags |= SQLITE_OPEN_CREATE;
+    }
+    int outFlags = 0;
+    int rc = pRealVfs->xOpen(pRealVfs, pOv->zDelta, pOv->pDelta, deltaFlags, &outFlags);
+    if (rc != SQLITE_OK && (flags & SQLITE_OPEN_READWRITE) == 0) {
+        /* 只读连接并且还没有增量文件：只能看到基础文件 */
+        rc = SQLITE_CANTOPEN;
+    }
+    if (rc == SQLITE_OK) {
+        pOv->bReadOnly = (outFlags & SQLITE_OPEN_READONLY) != 0;
+        /* 空的增量文件保留上面基于基础文件的大小 */
+        rc = headerOverlayLoad(pOv);
+    }
+    if (rc != SQLITE_OK) {
+        if (pOv->pDelta->pMethods) {
+            pOv->pDelta->pMethods->xClose(pOv->pDelta);
+        }
+        sqlite3_free(pOv);
+        return rc;
+    }
+    if (pOutFlags) {
+        *pOutFlags = outFlags;
+    }
+    *ppOv = pOv;
+    return SQLITE_OK;
+}
+
+static void headerOverlayClose(HeaderOverlay *pOv) {
+    if (pOv) {
+        if (pOv->pDelta->pMethods) {
+            pOv->pDelta->pMethods->xClose(pOv->pDelta);
+        }
+        sqlite3_free(pOv->aPage);
+        sqlite3_free(pOv->aSlot);
+        sqlite3_free(pOv->aScratch);
+        sqlite3_free(pOv);
+    }
+}
+
+/*
+** 读取逻辑范围 [iOfst, iOfst+iAmt)：页表中的页从增量文件读取，其余的调用 xBaseRead
+** 从基础文件读取。超出逻辑大小的部分填零并返回 SQLITE_IOERR_SHORT_READ。
+*/
+static int headerOverlayRead(
+    HeaderOverlay *pOv,
+    HeaderFile *p,
+    int (*xBaseRead)(HeaderFile *, void *, int, sqlite3_int64),
+    unsigned char *zBuf,
+    int iAmt,
+    sqlite3_int64 iOfst
+) {
+    int bShort = 0;
+    while (iAmt > 0) {
+        int n = iAmt;
+        sqlite3_int64 iSlot = -1;
+        if (pOv->szPage > 0) {
+            const sqlite3_int64 iPage = iOfst / pOv->szPage;
+            const int iInPage = (int) (iOfst - iPage * pOv->szPage);
+            if (n > pOv->szPage - iInPage) {
+                n = pOv->szPage - iInPage;
+            }
+            iSlot = headerOverlayFind(pOv, iPage);
+            if (iSlot >= 0) {
+                const int rc = pOv->pDelta->pMethods->xRead(
+                    pOv->pDelta, zBuf, n, headerOverlaySlotOffset(pOv, iSlot) + 8 + iInPage
+                );
+                if (rc != SQLITE_OK) {
+                    return rc;
+                }
+            }
+        }
+        if (iSlot < 0) {
+            /* 基础文件中只有 iBaseLimit 之前的内容有效 */
+            int nBase = 0;
+            if (iOfst < pOv->iBaseLimit) {
+                nBase = (pOv->iBaseLimit - iOfst < n) ? (int) (pOv->iBaseLimit - iOfst) : n;
+                const int rc = xBaseRead(p, zBuf, nBase, iOfst);
+                if (rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ) {
+                    return rc;
+                }
+            }
+            memset(zBuf + nBase, 0, n - nBase);
+        }
+        if (iOfst + n > pOv->iSize) {
+            const sqlite3_int64 nValid = (pOv->iSize > iOfst) ? pOv->iSize - iOfst : 0;
+            memset(zBuf + nValid, 0, n - nValid);
+            bShort = 1;
+        }
+        zBuf += n;
+        iAmt -= n;
+        iOfst += n;
+    }
+    return bShort ? SQLITE_IOERR_SHORT_READ : SQLITE_OK;
+}
+
+/*
+** 把一整页写入增量文件：已有的槽原地覆盖，否则追加一个新槽。
+*/
+static int headerOverlayPutPage(HeaderOverlay *pOv, sqlite3_int64 iPage, const unsigned char *aData) {
+    sqlite3_int64 iSlot = headerOverlayFind(pOv, iPage);
+    const int bNew = (iSlot < 0);
+    if (bNew) {
+        iSlot = pOv->nSlot;
+    }
+    headerPut64(pOv->aScratch, (sqlite3_uint64) iPage);
+    if (aData != pOv->aScratch + 8) {
+        memcpy(pOv->aScratch + 8, aData, pOv->szPage);
+    }
+    int rc = pOv->pDelta->pMethods->xWrite(
+        pOv->pDelta, pOv->aScratch, 8 + pOv->szPage, headerOverlaySlotOffset(pOv, iSlot)
+    );
+    if (rc == SQLITE_OK && bNew) {
+        rc = headerOverlayInsert(pOv, iPage, iSlot);
+        if (rc == SQLITE_OK) {
+            pOv->nSlot++;
+        }
+    }
+    if (rc == SQLITE_OK && (iPage + 1) * pOv->szPage > pOv->iSlotEnd) {
+        pOv->iSlotEnd = (iPage + 1) * pOv->szPage;
+    }
+    if (rc == SQLITE_OK && pOv->iSlotEnd > pOv->iSize) {
+        pOv->iSize = pOv->iSlotEnd;
+    }
+    return rc;
+}
+
+/*
+** 写入逻辑范围 [iOfst, iOfst+iAmt)。不是整页的写入先读出原来的页再修改。
+*/
+static int headerOverlayWrite(
+    HeaderOverlay *pOv,
+    HeaderFile *p,
+    int (*xBaseRead)(HeaderFile *, void *, int, sqlite3_int64),
+    const unsigned char *zBuf,
+    int iAmt,
+    sqlite3_int64 iOfst
+) {
+    int rc;
+    if (pOv->bReadOnly) {
+        return SQLITE_READONLY;
+    }
+    if (pOv->szPage == 0) {
+        /* 第一次写入：以 SQLite 的页大小作为槽的大小，并初始化头部 */
+        int szPage = 4096;
+        if (iAmt >= 512 && iAmt <= 65536 && (iAmt & (iAmt - 1)) == 0 && iOfst % iAmt == 0) {
+            szPage = iAmt;
+        }
+        rc = headerOverlaySetPageSize(pOv, szPage);
+        if (rc == SQLITE_OK) {
+            rc = headerOverlayWriteHeader(pOv);
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+
+    while (iAmt > 0) {
+        const sqlite3_int64 iPage = iOfst / pOv->szPage;
+        const int iInPage = (int) (iOfst - iPage * pOv->szPage);
+        const int n = (iAmt < pOv->szPage - iInPage) ? iAmt : pOv->szPage - iInPage;
+        if (n == pOv->szPage) {
+            rc = headerOverlayPutPage(pOv, iPage, zBuf);
+        } else {
+            unsigned char *aPage = pOv->aScratch + 8;
+            rc = headerOverlayRead(pOv, p, xBaseRead, aPage, pOv->szPage, iPage * pOv->szPage);
+            if (rc == SQLITE_OK || rc == SQLITE_IOERR_SHORT_READ) {
+                memcpy(aPage + iInPage, zBuf, n);
+                rc = headerOverlayPutPage(pOv, iPage, aPage);
+            }
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        zBuf += n;
+        iAmt -= n;
+        iOfst += n;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** 截断到逻辑大小 iSize：作废超出的槽，并记录基础文件中的有效长度。
+** 纪元加一，让其他连接重新加载页表。
+*/
+static int headerOverlayTruncate(HeaderOverlay *pOv, sqlite3_int64 iSize) {
+    if (pOv->bReadOnly) {
+        return SQLITE_READONLY;
+    }
+    int rc = SQLITE_OK;
+    if (pOv->szPage > 0) {
+        unsigned char aKey[8];
+        headerPut64(aKey, (sqlite3_uint64) -1);
+        for (int i = 0; rc == SQLITE_OK && i < pOv->nHash; i++) {
+            if (pOv->aPage[i] >= 0 && pOv->aPage[i] * pOv->szPage >= iSize) {
+                rc = pOv->pDelta->pMethods->xWrite(pOv->pDelta, aKey, 8,
+                                                   headerOverlaySlotOffset(pOv, pOv->aSlot[i]));
+            }
+        }
+    }
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    pOv->iSize = iSize;
+    if (pOv->iBaseLimit > iSize) {
+        pOv->iBaseLimit = iSize;
+    }
+    pOv->iEpoch++;
+    rc = headerOverlayWriteHeader(pOv);
+    if (rc == SQLITE_OK) {
+        /* 重新加载，页表中只剩下仍然有效的槽 */
+        headerOverlayClearMap(pOv);
+        rc = headerOverlayLoad(pOv);
+    }
+    return rc;
+}
+
+static const char *headerOption(const HeaderVfs *pHv, const char *zName, const char *zKey);
+static char *headerJournalDirName(const char *zDir, const char *zDb, const char *zExt);
+
+// SQLite 回滚日志的魔数和合并时写入的日志头部大小（扇区大小）
+static const unsigned char headerJournalMagic[8] = {0xd9, 0xd5, 0x05, 0xf9, 0x20, 0xa1, 0x63, 0xd7};
+#define HEADER_MERGE_SECTOR 512
+
+/*
+** 合并使用的回滚日志：就是直接打开基础文件的连接会检查的那个日志（"<数据库>-journal"，
+** 设置了 journal_dir 时在日志目录下），这样合并中途崩溃之后，下一个直接打开基础文件的连接
+** 会按照 SQLite 自己的热日志处理把基础文件回滚到合并之前。覆盖层连接的日志跟随增量文件，
+** 看不到这个日志，由下一次合并负责回滚。
+*/
+static char *headerMergeJournalName(const HeaderFile *p) {
+    const char *zDir = headerOption(p->pHv, p->zName, "journal_dir");
+    if (zDir && zDir[0]) {
+        return headerJournalDirName(zDir, p->zName, "journal");
+    }
+    return sqlite3_mprintf("%s-journal", p->zName);
+}
+
+/* 与 SQLite 的 pager_cksum() 相同：从初值开始每隔 200 字节取一个字节 */
+static unsigned int headerJournalCksum(unsigned int iInit, const unsigned char *aData, int szPage) {
+    unsigned int cksum = iInit;
+    for (int i = szPage - 200; i > 0; i -= 200) {
+        cksum += aData[i];
+    }
+    return cksum;
+}
+
+/*
+** 把热日志 pJournal 回滚到基础文件 pBase：写回日志中的原始页，截断到日志记录的原始大小，同步之后
+** 把日志的第一个字节清零（调用者随后会覆盖或删除它）。只处理合并写入的那种单段日志，
+** 其他形式的日志返回 SQLITE_BUSY，需要先直接打开一次数据库让 SQLite 回滚。
+*/
+static int headerMergeRollback(HeaderFile *p, sqlite3_file *pBase, sqlite3_file *pJournal, sqlite3_int64 nJournal) {
+    unsigned char aHdr[28];
+    int rc = pJournal->pMethods->xRead(pJournal, aHdr, sizeof(aHdr), 0);
+    if (rc != SQLITE_OK) {
+        return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_BUSY : rc;
+    }
+    const unsigned int nRec = headerGet32(aHdr + 8);
+    const unsigned int iInit = headerGet32(aHdr + 12);
+    const unsigned int mxPg = headerGet32(aHdr + 16);
+    const unsigned int szSector = headerGet32(aHdr + 20);
+    const unsigned int szPage = headerGet32(aHdr + 24);
+    if (memcmp(aHdr, headerJournalMagic, 8) != 0 || szSector < 32 || szSector > 65536
+        || (szSector & (szSector - 1)) != 0 || szPage < 512 || szPage > 65536 || (szPage & (szPage - 1)) != 0
+        || nJournal != szSector + (sqlite3_int64) nRec * (szPage + 8)) {
+        sqlite3_log(SQLITE_BUSY, "headervfs: %s has a hot journal, open it once without overlay to roll back first",
+                    p->zName);
+        return SQLITE_BUSY;
+    }
+
+    unsigned char *aRec = sqlite3_malloc(szPage + 8);
+    if (aRec == 0) {
+        return SQLITE_NOMEM;
+    }
+    for (unsigned int i = 0; rc == SQLITE_OK && i < nRec; i++) {
+        rc = pJournal->pMethods->xRead(pJournal, aRec, szPage + 8, szSector + (sqlite3_int64) i * (szPage + 8));
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        /* 与 SQLite 相同：校验和不对的记录是没有写完的，到此为止 */
+        const unsigned int pgno = headerGet32(aRec);
+        if (pgno == 0 || headerGet32(aRec + 4 + szPage) != headerJournalCksum(iInit, aRec + 4, szPage)) {
+            break;
+        }
+        rc = pBase->pMethods->xWrite(pBase, aRec + 4, szPage, p->iHeaderSize + (sqlite3_int64) (pgno - 1) * szPage);
+    }
+    sqlite3_free(aRec);
+
+    if (rc == SQLITE_OK) {
+        rc = pBase->pMethods->xTruncate(pBase, p->iHeaderSize + (sqlite3_int64) mxPg * szPage);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pBase->pMethods->xSync(pBase, SQLITE_SYNC_NORMAL);
+    }
+    if (rc == SQLITE_OK) {
+        static const unsigned char zero[1] = {0};
+        rc = pJournal->pMethods->xWrite(pJournal, zero, 1, 0);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: rolled back an interrupted overlay merge of %s", p->zName);
+    }
+    return rc;
+}
+
+/*
+** 在改写基础文件之前写入回滚日志：记录合并会覆盖的页和截断会丢掉的页的原始内容，
+** nOrig 为基础文件原来的页数。日志同步之后才能开始改写基础文件。
+*/
+static int headerMergeJournalWrite(HeaderFile *p, sqlite3_file *pBase, sqlite3_file *pJournal, sqlite3_int64 nOrig) {
+    HeaderOverlay *pOv = p->pOverlay;
+    const int szPage = pOv->szPage;
+    const sqlite3_int64 nNew = (pOv->iSize + szPage - 1) / szPage;
+    unsigned int iInit;
+    sqlite3_randomness(sizeof(iInit), &iInit);
+
+    int rc = pJournal->pMethods->xTruncate(pJournal, 0);
+    sqlite3_int64 iOfst = HEADER_MERGE_SECTOR;
+    unsigned int nRec = 0;
+    /* 先是增量文件中的页，然后是截断之后不再存在的页 */
+    for (sqlite3_int64 i = 0; rc == SQLITE_OK && i < pOv->nHash + nOrig; i++) {
+        sqlite3_int64 iPage;
+        if (i < pOv->nHash) {
+            iPage = pOv->aPage[i];
+            if (iPage < 0 || iPage >= nOrig || iPage >= nNew) {
+                continue;
+            }
+        } else {
+            iPage = i - pOv->nHash;
+            if (iPage < nNew) {
+                continue;
+            }
+        }
+        /* 记录为 4 字节页号（从 1 开始）、页的内容、4 字节校验和，借用 aScratch 拼在一起 */
+        unsigned char *aRec = pOv->aScratch + 4;
+        headerPut32(aRec, (unsigned int) (iPage + 1));
+        rc = pBase->pMethods->xRead(pBase, aRec + 4, szPage, p->iHeaderSize + iPage * szPage);
+        if (rc == SQLITE_OK) {
+            rc = pJournal->pMethods->xWrite(pJournal, aRec, 4 + szPage, iOfst);
+        }
+        if (rc == SQLITE_OK) {
+            unsigned char aCksum[4];
+            headerPut32(aCksum, headerJournalCksum(iInit, aRec + 4, szPage));
+            rc = pJournal->pMethods->xWrite(pJournal, aCksum, 4, iOfst + 4 + szPage);
+        }
+        iOfst += szPage + 8;
+        nRec++;
+    }
+
+    if (rc == SQLITE_OK) {
+        unsigned char aHdr[HEADER_MERGE_SECTOR];
+        memset(aHdr, 0, sizeof(aHdr));
+        memcpy(aHdr, headerJournalMagic, 8);
+        headerPut32(aHdr + 8, nRec);
+        headerPut32(aHdr + 12, iInit);
+        headerPut32(aHdr + 16, (unsigned int) nOrig);
+        headerPut32(aHdr + 20, HEADER_MERGE_SECTOR);
+        headerPut32(aHdr + 24, (unsigned int) szPage);
+        rc = pJournal->pMethods->xWrite(pJournal, aHdr, sizeof(aHdr), 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pJournal->pMethods->xSync(pJournal, SQLITE_SYNC_NORMAL);
+    }
+    return rc;
+}
+
+/*
+** 把增量文件中的页合并回基础文件，然后清空增量文件。
+**
+** 需要同时获得增量文件和基础文件上的 EXCLUSIVE 锁，所以其他连接（包括 WAL 模式下
+** 一直持有 SHARED 锁的连接）都必须先关闭。WAL 模式下调用者要先做 TRUNCATE 检查点。
+** 改写基础文件之前先写入并同步回滚日志，基础文件同步之后删除日志（提交点），最后清空增量文件。
+** 中途崩溃时日志让基础文件回到合并之前，增量文件完好，重新合并即可；删除日志之后崩溃时
+** 基础文件已经是合并的结果，重新合并的结果相同。成功时 *pnPage 为合并的页数。
+*/
+static int headerOverlayMerge(HeaderFile *p, sqlite3_int64 *pnPage) {
+    HeaderOverlay *pOv = p->pOverlay;
+    sqlite3_vfs *pRealVfs = p->pRealVfs;
+    if (pOv == 0) {
+        return SQLITE_NOTFOUND;
+    }
+    if (pOv->bReadOnly) {
+        return SQLITE_READONLY;
+    }
+    if (p->eLock > SQLITE_LOCK_SHARED) {
+        /* 写事务进行中，增量文件里还有未提交的页 */
+        return SQLITE_BUSY;
+    }
+
+    /* 增量文件：逐级升到 EXCLUSIVE */
+    sqlite3_file *pDelta = pOv->pDelta;
+    const int eSaved = p->eLock;
+    int rc = SQLITE_OK;
+    for (int eLock = eSaved + 1; rc == SQLITE_OK && eLock <= SQLITE_LOCK_EXCLUSIVE; eLock++) {
+        if (eLock != SQLITE_LOCK_PENDING) {
+            rc = pDelta->pMethods->xLock(pDelta, eLock);
+        }
+    }
+    if (rc == SQLITE_OK) {
+        rc = headerOverlayLoad(pOv);
+    }
+
+    /* 基础文件：另外以读写方式打开，并且同样要求 EXCLUSIVE */
+    sqlite3_file *pBase = 0;
+    if (rc == SQLITE_OK) {
+        pBase = sqlite3_malloc(pRealVfs->szOsFile);
+        if (pBase == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(pBase, 0, pRealVfs->szOsFile);
+            rc = pRealVfs->xOpen(pRealVfs, p->zName, pBase, SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE, 0);
+        }
+    }
+    for (int eLock = SQLITE_LOCK_SHARED; rc == SQLITE_OK && eLock <= SQLITE_LOCK_EXCLUSIVE; eLock++) {
+        if (eLock != SQLITE_LOCK_PENDING) {
+            rc = pBase->pMethods->xLock(pBase, eLock);
+        }
+    }
+
+    /* 回滚日志：先回滚上一次中断的合并留下的热日志，再记录这一次要改写的页 */
+    char *zJournal = 0;
+    sqlite3_file *pJournal = 0;
+    if (rc == SQLITE_OK) {
+        zJournal = headerMergeJournalName(p);
+        pJournal = sqlite3_malloc(pRealVfs->szOsFile);
+        if (zJournal == 0 || pJournal == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(pJournal, 0, pRealVfs->szOsFile);
+            rc = pRealVfs->xOpen(pRealVfs, zJournal, pJournal,
+                                 SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0);
+        }
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_int64 nJournal = 0;
+        unsigned char c = 0;
+        rc = pJournal->pMethods->xFileSize(pJournal, &nJournal);
+        if (rc == SQLITE_OK && nJournal > 0) {
+            rc = pJournal->pMethods->xRead(pJournal, &c, 1, 0);
+        }
+        if (rc == SQLITE_OK && c != 0) {
+            rc = headerMergeRollback(p, pBase, pJournal, nJournal);
+        }
+    }
+    if (rc == SQLITE_OK && pOv->szPage > 0) {
+        sqlite3_int64 nBase = 0;
+        rc = pBase->pMethods->xFileSize(pBase, &nBase);
+        if (rc == SQLITE_OK) {
+            const sqlite3_int64 nOrig = nBase > p->iHeaderSize ? (nBase - p->iHeaderSize) / pOv->szPage : 0;
+            rc = headerMergeJournalWrite(p, pBase, pJournal, nOrig);
+        }
+    }
+
+    /* 按槽的顺序复制仍然有效的页，然后调整基础文件的大小 */
+    sqlite3_int64 nPage = 0;
+    for (int i = 0; rc == SQLITE_OK && i < pOv->nHash; i++) {
+        const sqlite3_int64 iPage = pOv->aPage[i];
+        if (iPage < 0 || iPage * pOv->szPage >= pOv->iSize) {
+            continue;
+        }
+        unsigned char *aPage = pOv->aScratch + 8;
+        rc = pDelta->pMethods->xRead(pDelta, aPage, pOv->szPage, headerOverlaySlotOffset(pOv, pOv->aSlot[i]) + 8);
+        if (rc == SQLITE_OK) {
+            rc = pBase->pMethods->xWrite(pBase, aPage, pOv->szPage, p->iHeaderSize + iPage * pOv->szPage);
+        }
+        if (rc == SQLITE_OK) {
+            nPage++;
+        }
+    }
+    if (rc == SQLITE_OK) {
+        rc = pBase->pMethods->xTruncate(pBase, p->iHeaderSize + pOv->iSize);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pBase->pMethods->xSync(pBase, SQLITE_SYNC_NORMAL);
+    }
+
+    /* 删除日志是合并的提交点 */
+    if (pJournal) {
+        if (pJournal->pMethods) {
+            pJournal->pMethods->xClose(pJournal);
+        }
+        sqlite3_free(pJournal);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pRealVfs->xDelete(pRealVfs, zJournal, 1);
+    }
+    sqlite3_free(zJournal);
+
+    /* 清空增量文件：只保留头部，纪元加一让其他连接丢弃页表 */
+    if (rc == SQLITE_OK) {
+        pOv->iBaseLimit = pOv->iSize;
+        pOv->iEpoch++;
+        headerOverlayClearMap(pOv);
+        rc = headerOverlayWriteHeader(pOv);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pDelta->pMethods->xTruncate(pDelta, HEADER_OVERLAY_HDR);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pDelta->pMethods->xSync(pDelta, SQLITE_SYNC_NORMAL);
+    }
+    if (p->pCache) {
+        headerCacheInvalidate(p->pCache);
+    }
+    /* 基础文件被改写了，其他直接打开它的连接的共享页缓存也要清空 */
+    if (headerSharedOfInode(p->pInode)) {
+        headerSharedInvalidate(headerSharedOfInode(p->pInode));
+    }
+
+    if (pBase) {
+        if (pBase->pMethods) {
+            pBase->pMethods->xUnlock(pBase, SQLITE_LOCK_NONE);
+            pBase->pMethods->xClose(pBase);
+        }
+        sqlite3_free(pBase);
+    }
+    pDelta->pMethods->xUnlock(pDelta, eSaved);
+    if (rc == SQLITE_OK) {
+        *pnPage = nPage;
+    }
+    return rc;
+}
+
+
+/****************************************************************************
+** 变更跟踪（track_changes 参数）
+**
+** 为增量备份记录自上一次重置以来真实文件中被修改过的范围。文件按 szBlock 字节分块，
+** 每块对应位图中的一位。写入（包括写回缓冲区、io_uring、直接 I/O 和头部的写入）和截断
+** 先在内存中置位；同步数据库文件之前把新置的位合并进旁路文件 "<数据库>-changes" 并同步它，
+** 因此任何已经落盘的修改都一定记录在位图中（反过来不一定：崩溃时可能多记几块）。
+** 解锁和 SQLITE_FCNTL_SYNC 时也会合并（不同步），synchronous=OFF 时位图同样完整。
+**
+** 旁路文件的格式（整数都是大端序）：
+**
+**   偏移量 0     16 字节魔数
+**         16     4 字节块大小
+**         24     8 字节代（generation），每次重置加一
+**         32     位图：第 i 位（第 i/8 字节的第 i%8 位）表示 [i*szBlock, (i+1)*szBlock)，
+**                文件末尾之后的位都是 0
+**
+** 多个连接（包括其他进程）共用旁路文件，合并和重置都在旁路文件的 EXCLUSIVE 锁下读出、
+** 按位或、写回，不会覆盖别人置的位。
+****************************************************************************/
+
+// 旁路文件头部的大小
+#define HEADER_CHANGES_HDR 32
+
+// 默认的块大小（通过 URI 参数 track_changes_block 设置）
+#define HEADER_CHANGES_BLOCK 65536
+
+// 获取旁路文件的锁时最长的等待时间（微秒）
+#define HEADER_CHANGES_BUSY_TIMEOUT 5000000
+
+// 旁路文件的魔数（16 字节）
+static const char headerChangesMagic[16] = "headervfs-chg-1";
+
+struct HeaderChanges {
+    sqlite3_vfs *pRealVfs;      /* 打开旁路文件的真实 VFS */
+    sqlite3_file *pFile;        /* 旁路文件，通过真实 VFS 以主数据库的方式打开 */
+    sqlite3_int64 szBlock;      /* 每一位代表的字节数，2 的幂 */
+    unsigned char *aPending;    /* 本连接置位、还没有合并进旁路文件的位 */
+    sqlite3_int64 nPending;     /* aPending 的字节数 */
+    int bPending;               /* aPending 中有置位的位 */
+    int bUnsynced;              /* 旁路文件写入之后还没有同步 */
+    int bAll;                   /* 内存不足时无法记录：在下一次重置之前把整个文件都当作修改过 */
+    char *zPath;                /* 旁路文件的路径 */
+};
+
+/*
+** 在旁路文件上获取 eLock（SQLITE_LOCK_SHARED 或 SQLITE_LOCK_EXCLUSIVE），遇到 SQLITE_BUSY 时退避重试。
+** 升级为 EXCLUSIVE 失败时先放掉 SHARED 锁再重试，两个连接同时升级时不会互相等待。
+*/
+static int headerChangesLock(HeaderChanges *pCh, int eLock) {
+    sqlite3_file *pFile = pCh->pFile;
+    int eHeld = SQLITE_LOCK_NONE;
+    int nWait = 0;
+    int nSleep = 100;
+    int rc = SQLITE_OK;
+    while (rc == SQLITE_OK && eHeld < eLock) {
+        /* 底层 VFS 要求先获得 SHARED 锁 */
+        const int eNext = (eHeld == SQLITE_LOCK_NONE) ? SQLITE_LOCK_SHARED : eLock;
+        rc = pFile->pMethods->xLock(pFile, eNext);
+        if (rc == SQLITE_OK) {
+            eHeld = eNext;
+        } else if (rc == SQLITE_BUSY && nWait < HEADER_CHANGES_BUSY_TIMEOUT) {
+            pFile->pMethods->xUnlock(pFile, SQLITE_LOCK_NONE);
+            eHeld = SQLITE_LOCK_NONE;
+            nWait += pCh->pRealVfs->xSleep(pCh->pRealVfs, nSleep);
+            if (nSleep < 100000) {
+                nSleep *= 2;
+            }
+            rc = SQLITE_OK;
+        }
+    }
+    if (rc != SQLITE_OK) {
+        pFile->pMethods->xUnlock(pFile, SQLITE_LOCK_NONE);
+    }
+    return rc;
+}
+
+static void headerChangesUnlock(HeaderChanges *pCh) {
+    pCh->pFile->pMethods->xUnlock(pCh->pFile, SQLITE_LOCK_NONE);
+}
+
+/*
+** 读取旁路文件的头部（调用者持有旁路文件的锁）。文件是空的时写入新的头部（调用者持有 EXCLUSIVE 锁），
+** 否则不合法时返回 SQLITE_CORRUPT。
+*/
+static int headerChangesReadHeader(HeaderChanges *pCh, int bCreate, sqlite3_int64 *piGeneration) {
+    unsigned char aHdr[HEADER_CHANGES_HDR];
+    sqlite3_int64 iSize = 0;
+    int rc = pCh->pFile->pMethods->xFileSize(pCh->pFile, &iSize);
+    if (rc == SQLITE_OK && iSize < HEADER_CHANGES_HDR) {
+        if (!bCreate) {
+            *piGeneration = 1;
+            return SQLITE_OK;
+        }
+        memset(aHdr, 0, sizeof(aHdr));
+        memcpy(aHdr, headerChangesMagic, 16);
+        headerPut32(&aHdr[16], (unsigned int) pCh->szBlock);
+        headerPut64(&aHdr[24], 1);
+        rc = pCh->pFile->pMethods->xWrite(pCh->pFile, aHdr, HEADER_CHANGES_HDR, 0);
+        pCh->bUnsynced = 1;
+    } else if (rc == SQLITE_OK) {
+        rc = pCh->pFile->pMethods->xRead(pCh->pFile, aHdr, HEADER_CHANGES_HDR, 0);
+        if (rc == SQLITE_OK) {
+            const unsigned int szBlock = headerGet32(&aHdr[16]);
+            if (memcmp(aHdr, headerChangesMagic, 16) != 0 || szBlock < 512 || (szBlock & (szBlock - 1)) != 0) {
+                return SQLITE_CORRUPT;
+            }
+            /* 块大小以旁路文件中的为准；已经按另一个块大小置了位时无法换算 */
+            if (pCh->szBlock != szBlock) {
+                if (pCh->bPending) {
+                    return SQLITE_CORRUPT;
+                }
+                pCh->szBlock = szBlock;
+            }
+        }
+    }
+    if (rc == SQLITE_OK) {
+        *piGeneration = (sqlite3_int64) headerGet64(&aHdr[24]);
+    }
+    return rc;
+}
+
+/*
+** 打开（或创建）数据库 zDb 的旁路文件，szBlock 是新建旁路文件时使用的块大小。
+*/
+static int headerChangesOpen(sqlite3_vfs *pRealVfs, const char *zDb, sqlite3_int64 szBlock, HeaderChanges **ppCh) {
+    *ppCh = 0;
+    const size_t nPath = strlen(zDb) + sizeof("-changes");
+    HeaderChanges *pCh = sqlite3_malloc64(sizeof(HeaderChanges) + pRealVfs->szOsFile + nPath);
+    if (pCh == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pCh, 0, sizeof(HeaderChanges) + pRealVfs->szOsFile);
+    pCh->pRealVfs = pRealVfs;
+    pCh->pFile = (sqlite3_file *) &pCh[1];
+    pCh->zPath = (char *) pCh->pFile + pRealVfs->szOsFile;
+    memcpy(pCh->zPath, zDb, nPath - sizeof("-changes"));
+    memcpy(&pCh->zPath[nPath - sizeof("-changes")], "-changes", sizeof("-changes"));
+    pCh->szBlock = szBlock;
+
+    /* 旁路文件的路径不是 URI 文件名 */
+    int rc = pRealVfs->xOpen(pRealVfs, pCh->zPath, pCh->pFile,
+                             SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0);
+    sqlite3_int64 iGeneration = 0;
+    if (rc == SQLITE_OK) {
+        rc = headerChangesLock(pCh, SQLITE_LOCK_EXCLUSIVE);
+        if (rc == SQLITE_OK) {
+            rc = headerChangesReadHeader(pCh, 1, &iGeneration);
+            headerChangesUnlock(pCh);
+        }
+    }
+    if (rc != SQLITE_OK) {
+        if (pCh->pFile->pMethods) {
+            pCh->pFile->pMethods->xClose(pCh->pFile);
+        }
+        sqlite3_free(pCh);
+        return rc;
+    }
+    *ppCh = pCh;
+    return SQLITE_OK;
+}
+
+/*
+** 记录真实文件中 [iReal, iReal+nByte) 被修改了。写入已经完成，内存不足时不能让它失败，
+** 改为把整个文件当作修改过。
+*/
+static void headerChangesMark(HeaderChanges *pCh, sqlite3_int64 iReal, sqlite3_int64 nByte) {
+    if (nByte <= 0 || pCh->bAll) {
+        return;
+    }
+    const sqlite3_int64 iFirst = iReal / pCh->szBlock;
+    const sqlite3_int64 iLast = (iReal + nByte - 1) / pCh->szBlock;
+    if (iLast / 8 >= pCh->nPending) {
+        sqlite3_int64 nNew = pCh->nPending ? pCh->nPending : 64;
+        while (nNew <= iLast / 8) {
+            nNew *= 2;
+        }
+        unsigned char *aNew = sqlite3_realloc64(pCh->aPending, nNew);
+        if (aNew == 0) {
+            pCh->bAll = 1;
+            return;
+        }
+        memset(&aNew[pCh->nPending], 0, nNew - pCh->nPending);
+        pCh->aPending = aNew;
+        pCh->nPending = nNew;
+    }
+    for (sqlite3_int64 i = iFirst; i <= iLast; i++) {
+        pCh->aPending[i / 8] |= (unsigned char) (1 << (i % 8));
+    }
+    pCh->bPending = 1;
+}
+
+/*
+** 把本连接置的位合并进旁路文件（不同步）。
+*/
+static int headerChangesPersist(HeaderChanges *pCh) {
+    if (!pCh->bPending) {
+        return SQLITE_OK;
+    }
+    sqlite3_int64 iLo = 0;
+    sqlite3_int64 iHi = pCh->nPending;
+    while (iLo < iHi && pCh->aPending[iLo] == 0) {
+        iLo++;
+    }
+    while (iHi > iLo && pCh->aPending[iHi - 1] == 0) {
+        iHi--;
+    }
+    if (iLo == iHi) {
+        pCh->bPending = 0;
+        return SQLITE_OK;
+    }
+
+    unsigned char *aBuf = sqlite3_malloc64(iHi - iLo);
+    if (aBuf == 0) {
+        return SQLITE_NOMEM;
+    }
+    int rc = headerChangesLock(pCh, SQLITE_LOCK_EXCLUSIVE);
+    if (rc == SQLITE_OK) {
+        sqlite3_int64 iGeneration;
+        rc = headerChangesReadHeader(pCh, 1, &iGeneration);
+        if (rc == SQLITE_OK) {
+            rc = pCh->pFile->pMethods->xRead(pCh->pFile, aBuf, (int) (iHi - iLo), HEADER_CHANGES_HDR + iLo);
+            if (rc == SQLITE_IOERR_SHORT_READ) {
+                rc = SQLITE_OK;
+            }
+        }
+        if (rc == SQLITE_OK) {
+            for (sqlite3_int64 i = iLo; i < iHi; i++) {
+                aBuf[i - iLo] |= pCh->aPending[i];
+            }
+            rc = pCh->pFile->pMethods->xWrite(pCh->pFile, aBuf, (int) (iHi - iLo), HEADER_CHANGES_HDR + iLo);
+        }
+        if (rc == SQLITE_OK) {
+            memset(&pCh->aPending[iLo], 0, iHi - iLo);
+            pCh->bPending = 0;
+            pCh->bUnsynced = 1;
+        }
+        headerChangesUnlock(pCh);
+    }
+    sqlite3_free(aBuf);
+    return rc;
+}
+
+/*
+** 数据库文件同步之前调用：合并新置的位，并且让旁路文件先落盘。
+*/
+static int headerChangesSync(HeaderChanges *pCh, int flags) {
+    int rc = headerChangesPersist(pCh);
+    if (rc == SQLITE_OK && pCh->bUnsynced) {
+        rc = pCh->pFile->pMethods->xSync(pCh->pFile, flags);
+        if (rc == SQLITE_OK) {
+            pCh->bUnsynced = 0;
+        }
+    }
+    return rc;
+}
+
+/*
+** 读出当前的位图（包括本连接还没有合并的位），bReset 时同时开始新的一代：
+** 返回的是被清空的那一代的位图。iSize 是真实文件的大小，无法记录时（bAll）它之前的位全部置位。
+** pOut->aBitmap 由调用者用 sqlite3_free() 释放。
+*/
+static int headerChangesRead(HeaderChanges *pCh, int bReset, sqlite3_int64 iFileSize, HeaderVfsChanges *pOut) {
+    int rc = headerChangesLock(pCh, bReset ? SQLITE_LOCK_EXCLUSIVE : SQLITE_LOCK_SHARED);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    sqlite3_int64 iGeneration = 0;
+    sqlite3_int64 iSize = 0;
+    unsigned char *aBitmap = 0;
+    sqlite3_int64 nBitmap = 0;
+    rc = headerChangesReadHeader(pCh, bReset, &iGeneration);
+    if (rc == SQLITE_OK) {
+        rc = pCh->pFile->pMethods->xFileSize(pCh->pFile, &iSize);
+    }
+    if (rc == SQLITE_OK) {
+        nBitmap = (iSize > HEADER_CHANGES_HDR) ? iSize - HEADER_CHANGES_HDR : 0;
+        if (nBitmap < pCh->nPending) {
+            nBitmap = pCh->nPending;
+        }
+        if (pCh->bAll && nBitmap < (iFileSize + pCh->szBlock * 8 - 1) / (pCh->szBlock * 8)) {
+            nBitmap = (iFileSize + pCh->szBlock * 8 - 1) / (pCh->szBlock * 8);
+        }
+        aBitmap = sqlite3_malloc64(nBitmap > 0 ? nBitmap : 1);
+        if (aBitmap == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(aBitmap, 0, nBitmap);
+        }
+    }
+    if (rc == SQLITE_OK && iSize > HEADER_CHANGES_HDR) {
+        rc = pCh->pFile->pMethods->xRead(pCh->pFile, aBitmap, (int) (iSize - HEADER_CHANGES_HDR), HEADER_CHANGES_HDR);
+    }
+    if (rc == SQLITE_OK) {
+        for (sqlite3_int64 i = 0; i < pCh->nPending; i++) {
+            aBitmap[i] |= pCh->aPending[i];
+        }
+        if (pCh->bAll) {
+            memset(aBitmap, 0xff, nBitmap);
+        }
+    }
+    if (rc == SQLITE_OK && bReset) {
+        unsigned char aGen[8];
+        headerPut64(aGen, (sqlite3_uint64) iGeneration + 1);
+        rc = pCh->pFile->pMethods->xWrite(pCh->pFile, aGen, 8, 24);
+        if (rc == SQLITE_OK) {
+            rc = pCh->pFile->pMethods->xTruncate(pCh->pFile, HEADER_CHANGES_HDR);
+        }
+        if (rc == SQLITE_OK) {
+            rc = pCh->pFile->pMethods->xSync(pCh->pFile, SQLITE_SYNC_NORMAL);
+        }
+        if (rc == SQLITE_OK) {
+            memset(pCh->aPending, 0, pCh->nPending);
+            pCh->bPending = 0;
+            pCh->bUnsynced = 0;
+            pCh->bAll = 0;
+        }
+    }
+    headerChangesUnlock(pCh);
+
+    if (rc != SQLITE_OK) {
+        sqlite3_free(aBitmap);
+        return rc;
+    }
+    pOut->iGeneration = iGeneration;
+    pOut->szBlock = pCh->szBlock;
+    pOut->nBlock = nBitmap * 8;
+    pOut->iSize = iFileSize;
+    pOut->aBitmap = aBitmap;
+    return SQLITE_OK;
+}
+
+static void headerChangesClose(HeaderChanges *pCh) {
+    if (pCh) {
+        headerChangesSync(pCh, SQLITE_SYNC_NORMAL);
+        if (pCh->pFile->pMethods) {
+            pCh->pFile->pMethods->xClose(pCh->pFile);
+        }
+        sqlite3_free(pCh->aPending);
+        sqlite3_free(pCh);
+    }
+}
+
+
+/****************************************************************************
+** 原子批量写入（atomic_write 参数）
+**
+** 主数据库文件报告 SQLITE_IOCAP_BATCH_ATOMIC，用 SQLITE_ENABLE_BATCH_ATOMIC_WRITE 编译的 SQLite
+** 在回滚日志模式下提交时不再写回滚日志，而是在 SQLITE_FCNTL_BEGIN_ATOMIC_WRITE 和
+** SQLITE_FCNTL_COMMIT_ATOMIC_WRITE 之间写入所有修改过的页，由 VFS 保证它们要么全部生效要么都不生效。
+**
+** 普通文件系统没有跨多个范围的原子写入，这里用一个私有的重做日志（<数据库>-batch）实现：
+** 批量写入先缓冲在内存中，提交时整体写入日志并同步（一次写入、一次同步），然后写入数据库文件；
+** 数据库文件下一次同步成功之后把日志截断为空。进程在两者之间崩溃时，下一个获得 SHARED 锁的连接
+** 在 EXCLUSIVE 锁下重放日志。与回滚日志相比不需要读出原来的页，也没有回滚日志在 synchronous=FULL 时单独同步头部的那一次。
+**
+** 日志的格式（整数都是大端序）：
+**
+**   偏移量 0     16 字节魔数
+**         16     8 字节记录的总长度
+**         24     4 字节提交之后第 1 页的文件修改计数器
+**         32     8 字节校验和（覆盖前 32 字节和所有记录）
+**         40     记录：8 字节偏移量（数据库的逻辑偏移量）、4 字节长度、数据
+**
+** 重放之前核对文件中的计数器，只有等于日志记录的值或者比它小一（第 1 页还没有写入）时才重放。
+** 只靠计数器不够：PRAGMA locking_mode=EXCLUSIVE 下 SQLite 不在每次提交时增加计数器，
+** 截断如果没有落盘，崩溃之后旧日志会覆盖之后退回到回滚日志的提交。截断本身不立即同步
+** （下一次批量提交会覆盖并同步日志），而是在下一次不经过批量写入修改数据库文件之前同步。
+**
+** 同步遵循 PRAGMA synchronous（通过 SQLITE_FCNTL_PRAGMA 记下，默认 FULL）。synchronous=OFF 时
+** SQLite 不调用 xSync，日志和数据库文件都不同步，日志在提交的 SQLITE_FCNTL_SYNC 时截断：
+** 这时数据已经交给操作系统，进程崩溃不会丢失，与回滚日志在 synchronous=OFF 下的保证相同。
+****************************************************************************/
+
+// 日志头部的大小
+#define HEADER_BATCH_HDR 40
+
+// 一次批量写入最多缓冲的字节数，超过时让 SQLite 退回到回滚日志
+#define HEADER_BATCH_MAX 0x4000000
+
+// 日志的魔数（16 字节）
+static const char headerBatchMagic[16] = "headervfs-bat-1";
+
+struct HeaderBatch {
+    sqlite3_vfs *pRealVfs;      /* 打开日志的真实 VFS */
+    sqlite3_file *pLog;         /* 日志，通过真实 VFS 以主数据库的方式打开 */
+    int bLogOpen;               /* pLog 已经打开（只读连接在日志出现之后才打开） */
+    int bWritable;              /* 读写连接：报告 SQLITE_IOCAP_BATCH_ATOMIC，能够重放日志 */
+    int bActive;                /* 处于 BEGIN_ATOMIC_WRITE 和 COMMIT/ROLLBACK_ATOMIC_WRITE 之间 */
+    int bPending;               /* 日志已经写入，数据库文件同步之后才能截断 */
+    int bTruncUnsynced;         /* 日志已经截断，截断还没有同步 */
+    int eSync;                  /* PRAGMA synchronous 的级别（0 到 3），0 表示不同步 */
+    unsigned char *aBuf;        /* 头部加上缓冲的记录，与日志的内容相同 */
+    sqlite3_int64 nBuf;         /* aBuf 中已用的字节数，不小于 HEADER_BATCH_HDR */
+    sqlite3_int64 nAlloc;       /* aBuf 的大小 */
+    char *zPath;                /* 日志的路径 */
+};
+
+static int headerWrite(sqlite3_file *pFile, const void *zBuf, int iAmt, sqlite3_int64 iOfst);
+static int headerSync(sqlite3_file *pFile, int flags);
+static int headerRealRead(HeaderFile *p, void *zBuf, int iAmt, sqlite3_int64 iReal);
+static int headerReadData(sqlite3_file *pFile, void *zBuf, int iAmt, sqlite3_int64 iOfst);
+static int headerFileSize(sqlite3_file *pFile, sqlite_int64 *pSize);
+
+/*
+** 与 WAL 帧相同的校验和，按 8 字节一组累加，末尾不足 8 字节的部分补零。
+*/
+static void headerBatchChecksum(const unsigned char *a, sqlite3_int64 n, unsigned int *aSum) {
+    unsigned int s1 = 0;
+    unsigned int s2 = 0;
+    sqlite3_int64 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s1 += headerGet32(&a[i]) + s2;
+        s2 += headerGet32(&a[i + 4]) + s1;
+    }
+    if (i < n) {
+        unsigned char aTail[8];
+        memset(aTail, 0, sizeof(aTail));
+        memcpy(aTail, &a[i], (size_t) (n - i));
+        s1 += headerGet32(&aTail[0]) + s2;
+        s2 += headerGet32(&aTail[4]) + s1;
+    }
+    aSum[0] = s1;
+    aSum[1] = s2;
+}
+
+/*
+** 打开日志。读写连接总是创建它；只读连接只在它已经存在时打开，不存在时返回 SQLITE_OK 并保持未打开。
+*/
+static int headerBatchLogOpen(HeaderBatch *pB) {
+    if (pB->bLogOpen) {
+        return SQLITE_OK;
+    }
+    int flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    if (!pB->bWritable) {
+        int bExists = 0;
+        const int rc = pB->pRealVfs->xAccess(pB->pRealVfs, pB->zPath, SQLITE_ACCESS_EXISTS, &bExists);
+        if (rc != SQLITE_OK || !bExists) {
+            return rc;
+        }
+        flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READONLY;
+    }
+    const int rc = pB->pRealVfs->xOpen(pB->pRealVfs, pB->zPath, pB->pLog, flags, 0);
+    if (rc == SQLITE_OK) {
+        pB->bLogOpen = 1;
+    } else if (pB->pLog->pMethods) {
+        pB->pLog->pMethods->xClose(pB->pLog);
+        pB->pLog->pMethods = 0;
+    }
+    return rc;
+}
+
+static int headerBatchOpen(sqlite3_vfs *pRealVfs, const char *zDb, int bWritable, HeaderBatch **ppB) {
+    *ppB = 0;
+    const size_t nPath = strlen(zDb) + sizeof("-batch");
+    HeaderBatch *pB = sqlite3_malloc64(sizeof(HeaderBatch) + pRealVfs->szOsFile + nPath);
+    if (pB == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pB, 0, sizeof(HeaderBatch) + pRealVfs->szOsFile);
+    pB->pRealVfs = pRealVfs;
+    pB->pLog = (sqlite3_file *) &pB[1];
+    pB->zPath = (char *) pB->pLog + pRealVfs->szOsFile;
+    memcpy(pB->zPath, zDb, nPath - sizeof("-batch"));
+    memcpy(&pB->zPath[nPath - sizeof("-batch")], "-batch", sizeof("-batch"));
+    pB->bWritable = bWritable;
+    pB->eSync = 2;
+    pB->nBuf = HEADER_BATCH_HDR;
+
+    const int rc = headerBatchLogOpen(pB);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pB);
+        return rc;
+    }
+    *ppB = pB;
+    return SQLITE_OK;
+}
+
+static void headerBatchClose(HeaderBatch *pB) {
+    if (pB) {
+        /* 还没有截断的日志留给下一个打开的连接核对 */
+        if (pB->bLogOpen) {
+            pB->pLog->pMethods->xClose(pB->pLog);
+        }
+        sqlite3_free(pB->aBuf);
+        sqlite3_free(pB);
+    }
+}
+
+/*
+** 把一次 xWrite 追加到缓冲区。失败时返回 SQLITE_IOERR_WRITE，SQLite 随即回滚这次批量写入，
+** 改用回滚日志重新提交。
+*/
+static int headerBatchAppend(HeaderBatch *pB, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    const sqlite3_int64 nNeed = pB->nBuf + 12 + iAmt;
+    if (nNeed > HEADER_BATCH_HDR + HEADER_BATCH_MAX) {
+        return SQLITE_IOERR_WRITE;
+    }
+    if (nNeed > pB->nAlloc) {
+        sqlite3_int64 nNew = pB->nAlloc ? pB->nAlloc : 65536;
+        while (nNew < nNeed) {
+            nNew *= 2;
+        }
+        unsigned char *aNew = sqlite3_realloc64(pB->aBuf, nNew);
+        if (aNew == 0) {
+            return SQLITE_IOERR_WRITE;
+        }
+        pB->aBuf = aNew;
+        pB->nAlloc = nNew;
+    }
+    unsigned char *a = &pB->aBuf[pB->nBuf];
+    headerPut64(a, (sqlite3_uint64) iOfst);
+    headerPut32(&a[8], (unsigned int) iAmt);
+    memcpy(&a[12], zBuf, iAmt);
+    pB->nBuf = nNeed;
+    return SQLITE_OK;
+}
+
+/*
+** 在 aBuf[HEADER_BATCH_HDR, nBuf) 的记录中找到第 1 页的文件修改计数器（逻辑偏移量 24）。
+** 记录不完整时返回 SQLITE_CORRUPT，没有写入计数器时返回 SQLITE_NOTFOUND。
+*/
+static int headerBatchCounter(const unsigned char *aBuf, sqlite3_int64 nBuf, unsigned int *piCounter) {
+    int rc = SQLITE_NOTFOUND;
+    sqlite3_int64 i = HEADER_BATCH_HDR;
+    while (i < nBuf) {
+        if (i + 12 > nBuf) {
+            return SQLITE_CORRUPT;
+        }
+        const sqlite3_int64 iOfst = (sqlite3_int64) headerGet64(&aBuf[i]);
+        const sqlite3_int64 iAmt = headerGet32(&aBuf[i + 8]);
+        if (iOfst < 0 || i + 12 + iAmt > nBuf) {
+            return SQLITE_CORRUPT;
+        }
+        if (iOfst <= 24 && iOfst + iAmt >= 28) {
+            *piCounter = headerGet32(&aBuf[i + 12 + 24 - iOfst]);
+            rc = SQLITE_OK;
+        }
+        i += 12 + iAmt;
+    }
+    return rc;
+}
+
+/*
+** 把 aBuf 中的记录依次写入数据库文件（经过写回缓冲区、读缓存和共享页缓存）。
+*/
+static int headerBatchApply(HeaderFile *p, const unsigned char *aBuf, sqlite3_int64 nBuf) {
+    int rc = SQLITE_OK;
+    for (sqlite3_int64 i = HEADER_BATCH_HDR; rc == SQLITE_OK && i < nBuf;) {
+        const sqlite3_int64 iOfst = (sqlite3_int64) headerGet64(&aBuf[i]);
+        const int iAmt = (int) headerGet32(&aBuf[i + 8]);
+        rc = headerWrite(&p->base, &aBuf[i + 12], iAmt, iOfst);
+        i += 12 + iAmt;
+    }
+    return rc;
+}
+
+/*
+** SQLITE_FCNTL_COMMIT_ATOMIC_WRITE：写入并同步日志，然后写入数据库文件。
+** 日志落盘之前失败时数据库文件没有被修改，返回 SQLITE_IOERR_COMMIT_ATOMIC，SQLite 改用回滚日志；
+** 日志落盘之后事务已经确定，写入数据库文件失败时返回的错误同样让 SQLite 用回滚日志重写这些页，
+** 即使那样也失败了，日志仍然保留，下一个读事务开始时重放。
+*/
+static int headerBatchCommit(HeaderFile *p) {
+    HeaderBatch *pB = p->pBatch;
+    pB->bActive = 0;
+    if (pB->nBuf == HEADER_BATCH_HDR) {
+        return SQLITE_OK;
+    }
+    unsigned int iCounter = 0;
+    int rc = headerBatchCounter(pB->aBuf, pB->nBuf, &iCounter);
+    if (rc != SQLITE_OK) {
+        /* 没有写第 1 页的提交（不应该发生）无法在重放时核对，交给回滚日志 */
+        pB->nBuf = HEADER_BATCH_HDR;
+        headerStatAdd(p->stats.nAtomicFallback, 1);
+        return SQLITE_IOERR_COMMIT_ATOMIC;
+    }
+    /* 上一次提交写入的数据还没有同步时不能覆盖它的日志 */
+    if (pB->bPending && pB->eSync > 0) {
+        rc = headerSync(&p->base, SQLITE_SYNC_NORMAL);
+    }
+
+    unsigned char *aHdr = pB->aBuf;
+    unsigned int aSum[2];
+    memset(aHdr, 0, HEADER_BATCH_HDR);
+    memcpy(aHdr, headerBatchMagic, 16);
+    headerPut64(&aHdr[16], (sqlite3_uint64) (pB->nBuf - HEADER_BATCH_HDR));
+    headerPut32(&aHdr[24], iCounter);
+    headerBatchChecksum(aHdr, 32, aSum);
+    unsigned int aBody[2];
+    headerBatchChecksum(&pB->aBuf[HEADER_BATCH_HDR], pB->nBuf - HEADER_BATCH_HDR, aBody);
+    headerPut32(&aHdr[32], aSum[0] + aBody[0]);
+    headerPut32(&aHdr[36], aSum[1] + aBody[1]);
+    if (rc == SQLITE_OK) {
+        rc = pB->pLog->pMethods->xWrite(pB->pLog, pB->aBuf, (int) pB->nBuf, 0);
+    }
+    if (rc == SQLITE_OK && pB->eSync > 0) {
+        rc = pB->pLog->pMethods->xSync(pB->pLog, SQLITE_SYNC_NORMAL);
+    }
+    if (rc == SQLITE_OK) {
+        pB->bTruncUnsynced = 0;
+    }
+    if (rc != SQLITE_OK) {
+        pB->pLog->pMethods->xTruncate(pB->pLog, 0);
+        pB->nBuf = HEADER_BATCH_HDR;
+        headerStatAdd(p->stats.nAtomicFallback, 1);
+        return SQLITE_IOERR_COMMIT_ATOMIC;
+    }
+    pB->bPending = 1;
+    rc = headerBatchApply(p, pB->aBuf, pB->nBuf);
+    pB->nBuf = HEADER_BATCH_HDR;
+    headerStatAdd(p->stats.nAtomicCommit, 1);
+    return rc;
+}
+
+/*
+** 数据库文件同步成功之后调用：日志中的数据都已经落盘，可以截断了。
+*/
+static int headerBatchSynced(HeaderBatch *pB) {
+    if (!pB->bPending) {
+        return SQLITE_OK;
+    }
+    const int rc = pB->pLog->pMethods->xTruncate(pB->pLog, 0);
+    if (rc == SQLITE_OK) {
+        pB->bPending = 0;
+        pB->bTruncUnsynced = 1;
+    }
+    return rc;
+}
+
+/*
+** 不经过批量写入修改数据库文件之前调用：先让日志的截断落盘，
+** 否则崩溃之后旧日志可能被重放，覆盖这次修改。
+*/
+static int headerBatchSettle(HeaderBatch *pB) {
+    if (!pB->bTruncUnsynced) {
+        return SQLITE_OK;
+    }
+    const int rc = (pB->eSync > 0) ? pB->pLog->pMethods->xSync(pB->pLog, SQLITE_SYNC_NORMAL) : SQLITE_OK;
+    if (rc == SQLITE_OK) {
+        pB->bTruncUnsynced = 0;
+    }
+    return rc;
+}
+
+/*
+** PRAGMA synchronous 设置新的级别时调用，zValue 的写法与 SQLite 相同（名字或者数字）。
+*/
+static void headerBatchSyncLevel(HeaderBatch *pB, const char *zValue) {
+    static const char *const azLevel[] = {"off", "normal", "full", "extra"};
+    if (zValue[0] >= '0' && zValue[0] <= '9') {
+        pB->eSync = atoi(zValue) & 3;
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (sqlite3_stricmp(zValue, azLevel[i]) == 0) {
+            pB->eSync = i;
+            return;
+        }
+    }
+    if (sqlite3_stricmp(zValue, "no") == 0 || sqlite3_stricmp(zValue, "false") == 0) {
+        pB->eSync = 0;
+    } else if (sqlite3_stricmp(zValue, "yes") == 0 || sqlite3_stricmp(zValue, "on") == 0
+               || sqlite3_stricmp(zValue, "true") == 0) {
+        pB->eSync = 1;
+    }
+}
+
+/*
+** 在真实文件（或者堆内存 WAL 索引的进程内锁）上加锁、解锁，不经过 headerLock。
+*/
+static int headerBatchRealLock(HeaderFile *p, sqlite3_file *pLockFile, int eLock, int bUnlock) {
+    if (p->pHeapWal) {
+        return bUnlock ? headerHeapWalUnlock(p, eLock) : headerHeapWalLock(p, eLock);
+    }
+    return bUnlock ? pLockFile->pMethods->xUnlock(pLockFile, eLock) : pLockFile->pMethods->xLock(pLockFile, eLock);
+}
+
+/*
+** 刚获得 SHARED 锁时调用：日志不是空的说明有一次提交没有完成同步（通常是进程崩溃了），
+** 升级为 EXCLUSIVE 锁重放它。其他连接也持有 SHARED 锁时返回 SQLITE_BUSY，只读连接返回
+** SQLITE_READONLY_ROLLBACK，两种情况都放掉 SHARED 锁，由 SQLite 的忙等待处理重试。
+*/
+static int headerBatchRecover(HeaderFile *p, sqlite3_file *pLockFile) {
+    HeaderBatch *pB = p->pBatch;
+    sqlite3_int64 iSize = 0;
+    int rc = headerBatchLogOpen(pB);
+    if (rc != SQLITE_OK || !pB->bLogOpen) {
+        return rc;
+    }
+    rc = pB->pLog->pMethods->xFileSize(pB->pLog, &iSize);
+    if (rc != SQLITE_OK || iSize == 0) {
+        return rc;
+    }
+    if (!pB->bWritable) {
+        headerBatchRealLock(p, pLockFile, SQLITE_LOCK_NONE, 1);
+        return SQLITE_READONLY_ROLLBACK;
+    }
+    rc = headerBatchRealLock(p, pLockFile, SQLITE_LOCK_RESERVED, 0);
+    if (rc == SQLITE_OK) {
+        rc = headerBatchRealLock(p, pLockFile, SQLITE_LOCK_EXCLUSIVE, 0);
+    }
+    if (rc != SQLITE_OK) {
+        headerBatchRealLock(p, pLockFile, SQLITE_LOCK_NONE, 1);
+        return ((rc & 0xff) == SQLITE_BUSY) ? SQLITE_BUSY : rc;
+    }
+
+    /* 持有 EXCLUSIVE 锁之后日志不会再变化 */
+    unsigned char *aLog = 0;
+    rc = pB->pLog->pMethods->xFileSize(pB->pLog, &iSize);
+    if (rc == SQLITE_OK && iSize > HEADER_BATCH_HDR + HEADER_BATCH_MAX) {
+        iSize = HEADER_BATCH_HDR + HEADER_BATCH_MAX;
+    }
+    if (rc == SQLITE_OK && iSize >= HEADER_BATCH_HDR) {
+        aLog = sqlite3_malloc64(iSize);
+        rc = aLog ? pB->pLog->pMethods->xRead(pB->pLog, aLog, (int) iSize, 0) : SQLITE_NOMEM;
+    }
+    int bReplay = 0;
+    sqlite3_int64 nLog = 0;
+    if (rc == SQLITE_OK && aLog && memcmp(aLog, headerBatchMagic, 16) == 0) {
+        nLog = HEADER_BATCH_HDR + (sqlite3_int64) headerGet64(&aLog[16]);
+        unsigned int aSum[2];
+        unsigned int aBody[2];
+        unsigned int iCounter = 0;
+        if (nLog >= HEADER_BATCH_HDR && nLog <= iSize) {
+            headerBatchChecksum(aLog, 32, aSum);
+            headerBatchChecksum(&aLog[HEADER_BATCH_HDR], nLog - HEADER_BATCH_HDR, aBody);
+            bReplay = headerGet32(&aLog[32]) == aSum[0] + aBody[0] && headerGet32(&aLog[36]) == aSum[1] + aBody[1]
+                      && headerBatchCounter(aLog, nLog, &iCounter) == SQLITE_OK;
+        }
+        if (bReplay) {
+            unsigned char aCounter[4];
+            int rcCounter = headerRealRead(p, aCounter, 4, 24 + p->iHeaderSize);
+            if (rcCounter == SQLITE_IOERR_SHORT_READ) {
+                memset(aCounter, 0, sizeof(aCounter));
+                rcCounter = SQLITE_OK;
+            }
+            /* 计数器比日志中的大说明之后又有过提交，日志已经过时 */
+            const unsigned int iCurrent = headerGet32(aCounter);
+            bReplay = rcCounter == SQLITE_OK && (iCurrent == iCounter || iCurrent + 1 == iCounter);
+            rc = rcCounter;
+        }
+    }
+    if (rc == SQLITE_OK && bReplay) {
+        sqlite3_log(SQLITE_NOTICE_RECOVER_ROLLBACK, "headervfs: replayed %lld bytes of atomic write log %s",
+                    nLog, pB->zPath);
+        pB->bPending = 1;
+        rc = headerBatchApply(p, aLog, nLog);
+        if (rc == SQLITE_OK) {
+            rc = headerSync(&p->base, SQLITE_SYNC_NORMAL);
+        }
+    } else if (rc == SQLITE_OK) {
+        /* 没有写完的日志（写入日志时崩溃，数据库文件还没有被修改）或者过时的日志 */
+        rc = pB->pLog->pMethods->xTruncate(pB->pLog, 0);
+    }
+    sqlite3_free(aLog);
+
+    if (rc == SQLITE_OK) {
+        rc = headerBatchRealLock(p, pLockFile, SQLITE_LOCK_SHARED, 1);
+    } else {
+        headerBatchRealLock(p, pLockFile, SQLITE_LOCK_NONE, 1);
+    }
+    return rc;
+}
+
+/****************************************************************************
+** 页校验和（page_checksum 参数）
+**
+** 每个页的 CRC32C 保存在数据库旁边的 <数据库>-cksum 文件中（页的保留字节可能已经被 SQLCipher
+** 用来存放 IV 和 HMAC，所以不放在页里）。headerWrite 写入整页时计算校验和，headerRead 和 xFetch
+** 读到整页时核对，不一致时返回 SQLITE_IOERR_DATA，复制或存储造成的损坏在 SQLCipher 报告
+** HMAC 错误之前就能定位到具体的页。
+**
+** 旁路文件的格式（整数都是大端序）：
+**
+**   偏移量 0     16 字节魔数
+**         16     4 字节页大小
+**         20     4 字节代：最后一次写回时数据库文件第 24 到 27 字节的内容
+**         32     每页 4 字节的校验和，第 i 项对应第 i+1 页；0 表示没有记录（不核对）
+**
+** 校验和表缓存在内存中，写入时只修改内存，在数据库文件同步之前（以及放锁之前）写回旁路文件，
+** 提交时两者一起落盘；崩溃时没有完成的页会由回滚日志、检查点或原子批量写入的日志重写。
+** 其他进程修改过的页在内存中的校验和是旧的，核对不一致时先重新读入旁路文件再下结论。
+**
+** 没有开启 page_checksum 的连接修改数据库文件时不更新旁路文件。回滚日志模式下每次提交都改写
+** 第 1 页中的文件修改计数器（加密的数据库中是密文，同样随每次改写而变），与旁路文件记录的代不同：
+** 核对不一致时不报告错误，旁路文件作废；读写连接第一次修改数据库文件之前发现时清空旁路文件重新记录。
+** WAL 模式下不改写第 1 页的提交不改变计数器，检查点写回的这些页无法与损坏区分。
+****************************************************************************/
+
+// 旁路文件头部的大小
+#define HEADER_CHECKSUM_HDR 32
+
+// 旁路文件的魔数（16 字节）
+static const char headerChecksumMagic[16] = "headervfs-crc-1";
+
+struct HeaderChecksum {
+    sqlite3_vfs *pRealVfs;      /* 打开旁路文件的真实 VFS */
+    sqlite3_file *pFile;        /* 旁路文件，通过真实 VFS 以主数据库的方式打开 */
+    int bWritable;              /* 读写连接：写入时记录校验和 */
+    int szPage;                 /* 页大小，还没有写入过整页时为 0 */
+    int bHdrDirty;              /* 页大小变了，旁路文件的头部等待写回（并截掉旧的校验和） */
+    int bUnsynced;              /* 旁路文件写入之后还没有同步 */
+    int bStale;                 /* 其他连接修改过数据库文件，没有记录的页要重新读入旁路文件 */
+    int bGenDirty;              /* 修改过数据库文件，写回时更新旁路文件中记录的代 */
+    unsigned char aGen[4];      /* 写回时记录的代 */
+    sqlite3_int64 iRecompLo;    /* [iRecompLo, iRecompHi) 中有只写了一部分的页，写回之前读出整页重新计算 */
+    sqlite3_int64 iRecompHi;
+    unsigned int *aSum;         /* 校验和表，下标是页号减一 */
+    unsigned char *aDirty;      /* 等待写回的项（位图） */
+    sqlite3_int64 nSum;         /* 表中的项数 */
+    sqlite3_int64 nAlloc;       /* aSum 能容纳的项数 */
+    sqlite3_int64 iDirtyLo;     /* 等待写回的项的范围 [iDirtyLo, iDirtyHi) */
+    sqlite3_int64 iDirtyHi;
+    sqlite3_int64 nVerify;      /* 核对过的页数（PRAGMA headervfs_page_checksum） */
+    char *zPath;                /* 旁路文件的路径 */
+};
+
+/* 软件实现的查找表（slicing-by-8），由 headerCrc32cInit() 生成 */
+static unsigned int headerCrc32cTable[8][256];
+
+/*
+** 硬件指令的延迟是吞吐量的 3 倍，一个页分成三段同时计算，再用“追加 n 个零字节”的查找表合并
+** （Mark Adler 的 crc32c.c 的做法）。长段和短段的长度必须是 2 的幂。
+*/
+#define HEADER_CRC_LONG 1024
+#define HEADER_CRC_SHORT 256
+static unsigned int headerCrc32cLong[4][256];
+static unsigned int headerCrc32cShort[4][256];
+
+static unsigned int headerGf2Times(const unsigned int *aMat, unsigned int v) {
+    unsigned int sum = 0;
+    while (v) {
+        if (v & 1) {
+            sum ^= *aMat;
+        }
+        v >>= 1;
+        aMat++;
+    }
+    return sum;
+}
+
+static void headerGf2Square(unsigned int *aSquare, const unsigned int *aMat) {
+    for (int n = 0; n < 32; n++) {
+        aSquare[n] = headerGf2Times(aMat, aMat[n]);
+    }
+}
+
+/* 生成把 CRC 寄存器移过 nZero 个零字节的查找表 */
+static void headerCrc32cZeros(unsigned int aZeros[4][256], unsigned int nZero) {
+    unsigned int aOdd[32];
+    unsigned int aEven[32];
+    aOdd[0] = 0x82F63B78;
+    for (int n = 1; n < 32; n++) {
+        aOdd[n] = 1u << (n - 1);
+    }
+    headerGf2Square(aEven, aOdd);
+    headerGf2Square(aOdd, aEven);
+    const unsigned int *aOp = aOdd;
+    do {
+        headerGf2Square(aEven, aOdd);
+        aOp = aEven;
+        nZero >>= 1;
+        if (nZero == 0) {
+            break;
+        }
+        headerGf2Square(aOdd, aEven);
+        aOp = aOdd;
+        nZero >>= 1;
+    } while (nZero);
+    for (unsigned int n = 0; n < 256; n++) {
+        aZeros[0][n] = headerGf2Times(aOp, n);
+        aZeros[1][n] = headerGf2Times(aOp, n << 8);
+        aZeros[2][n] = headerGf2Times(aOp, n << 16);
+        aZeros[3][n] = headerGf2Times(aOp, n << 24);
+    }
+}
+
+static unsigned int headerCrc32cShift(unsigned int aZeros[4][256], unsigned int crc) {
+    return aZeros[0][crc & 0xff] ^ aZeros[1][(crc >> 8) & 0xff] ^ aZeros[2][(crc >> 16) & 0xff] ^ aZeros[3][crc >> 24];
+}
+
+static unsigned int headerCrc32cSoft(unsigned int crc, const unsigned char *a, sqlite3_int64 n) {
+    crc = ~crc;
+    while (n > 0 && ((size_t) a & 7) != 0) {
+        crc = headerCrc32cTable[0][(crc ^ *a++) & 0xff] ^ (crc >> 8);
+        n--;
+    }
+    while (n >= 8) {
+        /* 按小端序组合，与硬件指令的结果一致 */
+        const unsigned int lo = crc ^ ((unsigned int) a[0] | (unsigned int) a[1] << 8
+                                       | (unsigned int) a[2] << 16 | (unsigned int) a[3] << 24);
+        const unsigned int hi = (unsigned int) a[4] | (unsigned int) a[5] << 8
+                                | (unsigned int) a[6] << 16 | (unsigned int) a[7] << 24;
+        crc = headerCrc32cTable[7][lo & 0xff] ^ headerCrc32cTable[6][(lo >> 8) & 0xff]
+              ^ headerCrc32cTable[5][(lo >> 16) & 0xff] ^ headerCrc32cTable[4][lo >> 24]
+              ^ headerCrc32cTable[3][hi & 0xff] ^ headerCrc32cTable[2][(hi >> 8) & 0xff]
+              ^ headerCrc32cTable[1][(hi >> 16) & 0xff] ^ headerCrc32cTable[0][hi >> 24];
+        a += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        crc = headerCrc32cTable[0][(crc ^ *a++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if HEADER_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static unsigned int headerCrc32cSse42(unsigned int crc, const unsigned char *a, sqlite3_int64 n) {
+    unsigned long long c = ~crc;
+    while (n > 0 && ((size_t) a & 7) != 0) {
+        c = _mm_crc32_u8((unsigned int) c, *a++);
+        n--;
+    }
+    /* 三段交错：三条依赖链互不等待 */
+    for (int k = 0; k < 2; k++) {
+        const sqlite3_int64 szRun = (k == 0) ? HEADER_CRC_LONG : HEADER_CRC_SHORT;
+        unsigned int (*aZeros)[256] = (k == 0) ? headerCrc32cLong : headerCrc32cShort;
+        while (n >= 3 * szRun) {
+            unsigned long long c1 = 0;
+            unsigned long long c2 = 0;
+            for (sqlite3_int64 i = 0; i < szRun; i += 8) {
+                unsigned long long v0, v1, v2;
+                memcpy(&v0, &a[i], 8);
+                memcpy(&v1, &a[i + szRun], 8);
+                memcpy(&v2, &a[i + 2 * szRun], 8);
+                c = _mm_crc32_u64(c, v0);
+                c1 = _mm_crc32_u64(c1, v1);
+                c2 = _mm_crc32_u64(c2, v2);
+            }
+            c = headerCrc32cShift(aZeros, (unsigned int) c) ^ (unsigned int) c1;
+            c = headerCrc32cShift(aZeros, (unsigned int) c) ^ (unsigned int) c2;
+            a += 3 * szRun;
+            n -= 3 * szRun;
+        }
+    }
+    while (n >= 8) {
+        unsigned long long v;
+        memcpy(&v, a, 8);
+        c = _mm_crc32_u64(c, v);
+        a += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        c = _mm_crc32_u8((unsigned int) c, *a++);
+    }
+    return ~(unsigned int) c;
+}
+#endif
+
+#if HEADER_HAVE_ARM_CRC
+static unsigned int headerCrc32cArm(unsigned int crc, const unsigned char *a, sqlite3_int64 n) {
+    crc = ~crc;
+    while (n > 0 && ((size_t) a & 7) != 0) {
+        crc = __crc32cb(crc, *a++);
+        n--;
+    }
+    while (n >= 8) {
+        unsigned long long v;
+        memcpy(&v, a, 8);
+        crc = __crc32cd(crc, v);
+        a += 8;
+        n -= 8;
+    }
+    while (n-- > 0) {
+        crc = __crc32cb(crc, *a++);
+    }
+    return ~crc;
+}
+#endif
+
+/* 当前使用的实现和它的名字，由 headerCrc32cInit() 选择 */
+static unsigned int (*headerCrc32c)(unsigned int, const unsigned char *, sqlite3_int64) = 0;
+static const char *headerCrc32cName = "soft";
+
+static void headerCrc32cInit(void) {
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (headerCrc32c == 0) {
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : (c >> 1);
+            }
+            headerCrc32cTable[0][i] = c;
+        }
+        for (unsigned int i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                const unsigned int c = headerCrc32cTable[k - 1][i];
+                headerCrc32cTable[k][i] = headerCrc32cTable[0][c & 0xff] ^ (c >> 8);
+            }
+        }
+        headerCrc32cZeros(headerCrc32cLong, HEADER_CRC_LONG);
+        headerCrc32cZeros(headerCrc32cShort, HEADER_CRC_SHORT);
+        unsigned int (*xCrc)(unsigned int, const unsigned char *, sqlite3_int64) = headerCrc32cSoft;
+#if HEADER_HAVE_SSE42
+        if (__builtin_cpu_supports("sse4.2")) {
+            xCrc = headerCrc32cSse42;
+            headerCrc32cName = "sse4.2";
+        }
+#endif
+#if HEADER_HAVE_ARM_CRC
+        xCrc = headerCrc32cArm;
+        headerCrc32cName = "armv8";
+#endif
+        headerPtrStore(headerCrc32c, xCrc);
+    }
+    sqlite3_mutex_leave(pMutex);
+}
+
+/* 页的校验和，0 留给“没有记录” */
+static unsigned int headerChecksumOf(const void *zBuf, int iAmt) {
+    const unsigned int crc = headerCrc32c(0, (const unsigned char *) zBuf, iAmt);
+    return crc ? crc : 1;
+}
+
+/*
+** 让表至少有 n 项，新增的项为 0。
+*/
+static int headerChecksumGrow(HeaderChecksum *pCk, sqlite3_int64 n) {
+    if (n > pCk->nAlloc) {
+        sqlite3_int64 nNew = pCk->nAlloc ? pCk->nAlloc : 1024;
+        while (nNew < n) {
+            nNew *= 2;
+        }
+        unsigned int *aSum = sqlite3_realloc64(pCk->aSum, nNew * sizeof(unsigned int));
+        if (aSum == 0) {
+            return SQLITE_NOMEM;
+        }
+        pCk->aSum = aSum;
+        unsigned char *aDirty = sqlite3_realloc64(pCk->aDirty, nNew / 8);
+        if (aDirty == 0) {
+            return SQLITE_NOMEM;
+        }
+        memset(&aDirty[pCk->nAlloc / 8], 0, (nNew - pCk->nAlloc) / 8);
+        pCk->aDirty = aDirty;
+        pCk->nAlloc = nNew;
+    }
+    if (n > pCk->nSum) {
+        memset(&pCk->aSum[pCk->nSum], 0, (n - pCk->nSum) * sizeof(unsigned int));
+        pCk->nSum = n;
+    }
+    return SQLITE_OK;
+}
+
+static int headerChecksumIsDirty(const HeaderChecksum *pCk, sqlite3_int64 i) {
+    return i < pCk->nSum && (pCk->aDirty[i / 8] & (1 << (i % 8))) != 0;
+}
+
+/*
+** 读入旁路文件的项 [iFirst, iFirst+n)（文件末尾之后的按 0 处理），等待写回的项保留内存中的值。
+*/
+static int headerChecksumReadRange(HeaderChecksum *pCk, sqlite3_int64 iFirst, sqlite3_int64 n) {
+    if (n <= 0) {
+        return SQLITE_OK;
+    }
+    unsigned char *aBuf = sqlite3_malloc64(n * 4);
+    if (aBuf == 0) {
+        return SQLITE_NOMEM;
+    }
+    int rc = pCk->pFile->pMethods->xRead(pCk->pFile, aBuf, (int) (n * 4), HEADER_CHECKSUM_HDR + iFirst * 4);
+    if (rc == SQLITE_IOERR_SHORT_READ) {
+        rc = SQLITE_OK;
+    }
+    if (rc == SQLITE_OK) {
+        for (sqlite3_int64 i = 0; i < n; i++) {
+            if (!headerChecksumIsDirty(pCk, iFirst + i)) {
+                pCk->aSum[iFirst + i] = headerGet32(&aBuf[i * 4]);
+            }
+        }
+    }
+    sqlite3_free(aBuf);
+    return rc;
+}
+
+/*
+** 重新读入整个旁路文件。页大小与内存中的不同（另一个连接改变了页大小）时采用文件中的。
+*/
+static int headerChecksumLoad(HeaderChecksum *pCk) {
+    sqlite3_int64 iSize = 0;
+    unsigned char aHdr[HEADER_CHECKSUM_HDR];
+    int rc = pCk->pFile->pMethods->xFileSize(pCk->pFile, &iSize);
+    if (rc != SQLITE_OK || iSize < HEADER_CHECKSUM_HDR || pCk->bHdrDirty) {
+        return rc;
+    }
+    rc = pCk->pFile->pMethods->xRead(pCk->pFile, aHdr, HEADER_CHECKSUM_HDR, 0);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    const int szPage = (int) headerGet32(&aHdr[16]);
+    if (memcmp(aHdr, headerChecksumMagic, 16) != 0 || szPage < 512 || szPage > 65536 || (szPage & (szPage - 1)) != 0) {
+        return SQLITE_CORRUPT;
+    }
+    if (szPage != pCk->szPage) {
+        pCk->szPage = szPage;
+        pCk->nSum = 0;
+    }
+    const sqlite3_int64 n = (iSize - HEADER_CHECKSUM_HDR) / 4;
+    rc = headerChecksumGrow(pCk, n);
+    if (rc == SQLITE_OK) {
+        rc = headerChecksumReadRange(pCk, 0, n);
+    }
+    pCk->bStale = 0;
+    return rc;
+}
+
+static int headerChecksumOpen(sqlite3_vfs *pRealVfs, const char *zDb, int bWritable, HeaderChecksum **ppCk) {
+    *ppCk = 0;
+    const size_t nPath = strlen(zDb) + sizeof("-cksum");
+    HeaderChecksum *pCk = sqlite3_malloc64(sizeof(HeaderChecksum) + pRealVfs->szOsFile + nPath);
+    if (pCk == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pCk, 0, sizeof(HeaderChecksum) + pRealVfs->szOsFile);
+    pCk->pRealVfs = pRealVfs;
+    pCk->pFile = (sqlite3_file *) &pCk[1];
+    pCk->zPath = (char *) pCk->pFile + pRealVfs->szOsFile;
+    memcpy(pCk->zPath, zDb, nPath - sizeof("-cksum"));
+    memcpy(&pCk->zPath[nPath - sizeof("-cksum")], "-cksum", sizeof("-cksum"));
+    pCk->bWritable = bWritable;
+    headerCrc32cInit();
+
+    /* 只读连接只核对已经存在的校验和 */
+    int flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    int rc = SQLITE_OK;
+    if (!bWritable) {
+        int bExists = 0;
+        rc = pRealVfs->xAccess(pRealVfs, pCk->zPath, SQLITE_ACCESS_EXISTS, &bExists);
+        if (rc != SQLITE_OK || !bExists) {
+            sqlite3_free(pCk);
+            return rc;
+        }
+        flags = SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READONLY;
+    }
+    rc = pRealVfs->xOpen(pRealVfs, pCk->zPath, pCk->pFile, flags, 0);
+    if (rc == SQLITE_OK) {
+        rc = headerChecksumLoad(pCk);
+    }
+    if (rc != SQLITE_OK) {
+        if (pCk->pFile->pMethods) {
+            pCk->pFile->pMethods->xClose(pCk->pFile);
+        }
+        sqlite3_free(pCk->aSum);
+        sqlite3_free(pCk->aDirty);
+        sqlite3_free(pCk);
+        return rc;
+    }
+    *ppCk = pCk;
+    return SQLITE_OK;
+}
+
+static void headerChecksumSet(HeaderChecksum *pCk, sqlite3_int64 i, unsigned int v) {
+    pCk->aSum[i] = v;
+    pCk->aDirty[i / 8] |= (unsigned char) (1 << (i % 8));
+    if (pCk->iDirtyLo >= pCk->iDirtyHi) {
+        pCk->iDirtyLo = i;
+        pCk->iDirtyHi = i + 1;
+    } else if (i < pCk->iDirtyLo) {
+        pCk->iDirtyLo = i;
+    } else if (i >= pCk->iDirtyHi) {
+        pCk->iDirtyHi = i + 1;
+    }
+}
+
+/* 丢掉所有的校验和，写回时截掉旁路文件中旧的项 */
+static void headerChecksumReset(HeaderChecksum *pCk) {
+    pCk->nSum = 0;
+    memset(pCk->aDirty, 0, pCk->nAlloc / 8);
+    pCk->iDirtyLo = pCk->iDirtyHi = 0;
+    pCk->iRecompLo = pCk->iRecompHi = 0;
+    pCk->bHdrDirty = 1;
+}
+
+/* 读取数据库文件当前的代（第 24 到 27 字节，直接从文件读取），文件还没有第 1 页时为 0 */
+static int headerChecksumFileGen(HeaderFile *p, unsigned char *aGen) {
+    memset(aGen, 0, 4);
+    const int rc = headerRealRead(p, aGen, 4, 24 + p->iHeaderSize);
+    return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_OK : rc;
+}
+
+/*
+** 比较旁路文件记录的代与数据库文件当前的代，不同时 *pbStale 设为真。
+** 旁路文件还没有头部（或者等待清空）时没有可以作废的校验和，按相同处理。
+*/
+static int headerChecksumCheckGen(HeaderFile *p, int *pbStale) {
+    HeaderChecksum *pCk = p->pChecksum;
+    sqlite3_int64 iSize = 0;
+    unsigned char aRecorded[4];
+    unsigned char aCurrent[4];
+    *pbStale = 0;
+    int rc = pCk->pFile->pMethods->xFileSize(pCk->pFile, &iSize);
+    if (rc != SQLITE_OK || iSize < HEADER_CHECKSUM_HDR || pCk->bHdrDirty) {
+        return rc;
+    }
+    rc = pCk->pFile->pMethods->xRead(pCk->pFile, aRecorded, 4, 20);
+    if (rc == SQLITE_OK) {
+        rc = headerChecksumFileGen(p, aCurrent);
+    }
+    if (rc == SQLITE_OK) {
+        *pbStale = memcmp(aRecorded, aCurrent, 4) != 0;
+    }
+    return rc;
+}
+
+/*
+** 读写连接修改数据库文件之前调用（持有写锁），上次写回之后第一次修改时检查记录的代：
+** 不同说明之间有没有开启 page_checksum 的连接修改过数据库文件，旁路文件中的校验和都不可信。
+*/
+static int headerChecksumBegin(HeaderFile *p) {
+    HeaderChecksum *pCk = p->pChecksum;
+    if (pCk->bGenDirty) {
+        return SQLITE_OK;
+    }
+    int bStale = 0;
+    const int rc = headerChecksumCheckGen(p, &bStale);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (bStale) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: %s was modified without page_checksum, discarding its page checksums",
+                    p->zName);
+        headerChecksumReset(pCk);
+    }
+    pCk->bGenDirty = 1;
+    return SQLITE_OK;
+}
+
+/*
+** 写入成功之后记录 [iOfst, iOfst+iAmt) 的校验和。按页对齐的整页（或者连续的几页）写入计算新的校验和，
+** 其他写入覆盖到的页改为没有记录。页大小只取自写入的大小：SQLite 总是按页大小整页写入，
+** 一次按自身大小对齐、大小是 512 到 65536 之间 2 的幂并且与当前页大小不同的写入说明页大小变了。
+** 不能读第 1 页中的数据库头部：SQLCipher 等加密扩展下那里是密文。
+** 内存不足时返回 SQLITE_NOMEM，写入本身已经完成。
+*/
+static int headerChecksumWritten(HeaderChecksum *pCk, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    const unsigned char *a = (const unsigned char *) zBuf;
+    if (iAmt != pCk->szPage && iAmt >= 512 && iAmt <= 65536 && (iAmt & (iAmt - 1)) == 0 && iOfst % iAmt == 0) {
+        /* 第一次写入整页，或者改变了页大小：旧的校验和都作废 */
+        pCk->szPage = iAmt;
+        headerChecksumReset(pCk);
+    }
+    const int szPage = pCk->szPage;
+    if (szPage == 0) {
+        return SQLITE_OK;
+    }
+    const sqlite3_int64 iFirst = iOfst / szPage;
+    const sqlite3_int64 iLast = (iOfst + iAmt - 1) / szPage;
+    const int rc = headerChecksumGrow(pCk, iLast + 1);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    const int bPages = iOfst % szPage == 0 && iAmt % szPage == 0;
+    for (sqlite3_int64 i = iFirst; i <= iLast; i++) {
+        headerChecksumSet(pCk, i, bPages ? headerChecksumOf(&a[(i - iFirst) * szPage], szPage) : 0);
+    }
+    if (!bPages) {
+        if (pCk->iRecompLo >= pCk->iRecompHi) {
+            pCk->iRecompLo = iFirst;
+            pCk->iRecompHi = iLast + 1;
+        } else {
+            pCk->iRecompLo = iFirst < pCk->iRecompLo ? iFirst : pCk->iRecompLo;
+            pCk->iRecompHi = iLast + 1 > pCk->iRecompHi ? iLast + 1 : pCk->iRecompHi;
+        }
+    }
+    return SQLITE_OK;
+}
+
+/* 截断数据库文件之后丢掉末尾之后的页的校验和 */
+static void headerChecksumTruncate(HeaderChecksum *pCk, sqlite3_int64 iSize) {
+    if (pCk->szPage > 0) {
+        const sqlite3_int64 n = (iSize + pCk->szPage - 1) / pCk->szPage;
+        for (sqlite3_int64 i = n; i < pCk->nSum; i++) {
+            headerChecksumSet(pCk, i, 0);
+        }
+    }
+}
+
+/*
+** 核对读到的整页。其他连接修改过的页先重新读入旁路文件，仍然不一致时返回 SQLITE_IOERR_DATA。
+*/
+static int headerChecksumVerify(HeaderFile *p, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderChecksum *pCk = p->pChecksum;
+    if (iAmt != pCk->szPage || iOfst % iAmt != 0) {
+        return SQLITE_OK;
+    }
+    const sqlite3_int64 i = iOfst / iAmt;
+    if ((i >= pCk->nSum || pCk->aSum[i] == 0) && pCk->bStale && pCk->iDirtyLo >= pCk->iDirtyHi) {
+        const int rc = headerChecksumLoad(pCk);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    if (i >= pCk->nSum || pCk->aSum[i] == 0) {
+        return SQLITE_OK;
+    }
+    pCk->nVerify++;
+    headerStatAdd(p->stats.nChecksumVerified, 1);
+    const unsigned int v = headerChecksumOf(zBuf, iAmt);
+    if (v == pCk->aSum[i]) {
+        return SQLITE_OK;
+    }
+    if (!headerChecksumIsDirty(pCk, i)) {
+        const int rc = headerChecksumReadRange(pCk, i, 1);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        if (pCk->aSum[i] == 0 || v == pCk->aSum[i]) {
+            return SQLITE_OK;
+        }
+    }
+    if (!pCk->bGenDirty) {
+        /* 本连接上次写回之后没有修改过数据库文件：记录的代不同时是别的连接绕过了校验和 */
+        int bStale = 0;
+        const int rc = headerChecksumCheckGen(p, &bStale);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        if (bStale) {
+            sqlite3_log(SQLITE_NOTICE, "headervfs: %s was modified without page_checksum, ignoring its page checksums",
+                        p->zName);
+            pCk->nSum = 0;
+            pCk->bStale = 0;
+            return SQLITE_OK;
+        }
+    }
+    headerStatAdd(p->stats.nChecksumError, 1);
+    sqlite3_log(SQLITE_IOERR_DATA, "headervfs: checksum mismatch on page %lld of %s (expected %08x, got %08x)",
+                i + 1, p->zName, pCk->aSum[i], v);
+    return SQLITE_IOERR_DATA;
+}
+
+/*
+** 把等待写回的项写入旁路文件，bSync 时再同步。范围内其他连接写入的项先读出来，不会被覆盖。
+** 记录的代在这些项之后写入，中途失败时旁路文件仍然带着旧的代，下一次修改之前会被清空。
+** 还不知道页大小时（没有写入过整页）没有头部可写，旁路文件截断为空。
+*/
+static int headerChecksumFlush(HeaderChecksum *pCk, int bSync) {
+    int rc = SQLITE_OK;
+    if (pCk->bHdrDirty) {
+        unsigned char aHdr[HEADER_CHECKSUM_HDR];
+        memset(aHdr, 0, sizeof(aHdr));
+        memcpy(aHdr, headerChecksumMagic, 16);
+        headerPut32(&aHdr[16], (unsigned int) pCk->szPage);
+        rc = pCk->pFile->pMethods->xTruncate(pCk->pFile, pCk->szPage ? HEADER_CHECKSUM_HDR : 0);
+        if (rc == SQLITE_OK && pCk->szPage) {
+            rc = pCk->pFile->pMethods->xWrite(pCk->pFile, aHdr, HEADER_CHECKSUM_HDR, 0);
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        pCk->bHdrDirty = 0;
+        pCk->bUnsynced = 1;
+    }
+    if (pCk->iDirtyLo < pCk->iDirtyHi) {
+        const sqlite3_int64 iLo = pCk->iDirtyLo;
+        const sqlite3_int64 n = pCk->iDirtyHi - iLo;
+        unsigned char *aBuf = sqlite3_malloc64(n * 4);
+        if (aBuf == 0) {
+            return SQLITE_NOMEM;
+        }
+        rc = headerChecksumReadRange(pCk, iLo, n);
+        if (rc == SQLITE_OK) {
+            for (sqlite3_int64 i = 0; i < n; i++) {
+                headerPut32(&aBuf[i * 4], pCk->aSum[iLo + i]);
+            }
+            rc = pCk->pFile->pMethods->xWrite(pCk->pFile, aBuf, (int) (n * 4), HEADER_CHECKSUM_HDR + iLo * 4);
+        }
+        sqlite3_free(aBuf);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        memset(&pCk->aDirty[iLo / 8], 0, (size_t) ((pCk->iDirtyHi + 7) / 8 - iLo / 8));
+        pCk->iDirtyLo = pCk->iDirtyHi = 0;
+        pCk->bUnsynced = 1;
+    }
+    if (pCk->bGenDirty && pCk->szPage) {
+        rc = pCk->pFile->pMethods->xWrite(pCk->pFile, pCk->aGen, 4, 20);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        pCk->bGenDirty = 0;
+        pCk->bUnsynced = 1;
+    }
+    if (bSync && pCk->bUnsynced) {
+        rc = pCk->pFile->pMethods->xSync(pCk->pFile, SQLITE_SYNC_NORMAL);
+        if (rc == SQLITE_OK) {
+            pCk->bUnsynced = 0;
+        }
+    }
+    return rc;
+}
+
+/*
+** 写回校验和，在事务的写入都已经完成时（同步、放锁）调用。只写了一部分的页这时已经完整，
+** 先从文件读出整页计算校验和；文件末尾之后的页保持没有记录。
+*/
+static int headerChecksumSave(HeaderFile *p, int bSync) {
+    HeaderChecksum *pCk = p->pChecksum;
+    int rc = SQLITE_OK;
+    if (pCk->iRecompLo < pCk->iRecompHi) {
+        sqlite3_int64 iSize = 0;
+        unsigned char *aPage = 0;
+        rc = headerFileSize(&p->base, &iSize);
+        if (rc == SQLITE_OK && (aPage = sqlite3_malloc(pCk->szPage)) == 0) {
+            rc = SQLITE_NOMEM;
+        }
+        const sqlite3_int64 iHi = pCk->iRecompHi < pCk->nSum ? pCk->iRecompHi : pCk->nSum;
+        for (sqlite3_int64 i = pCk->iRecompLo; rc == SQLITE_OK && i < iHi && (i + 1) * pCk->szPage <= iSize; i++) {
+            if (pCk->aSum[i] == 0) {
+                rc = headerReadData(&p->base, aPage, pCk->szPage, i * pCk->szPage);
+                if (rc == SQLITE_OK) {
+                    headerChecksumSet(pCk, i, headerChecksumOf(aPage, pCk->szPage));
+                }
+            }
+        }
+        sqlite3_free(aPage);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        pCk->iRecompLo = pCk->iRecompHi = 0;
+    }
+    if (pCk->bGenDirty) {
+        rc = headerChecksumFileGen(p, pCk->aGen);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    return headerChecksumFlush(pCk, bSync);
+}
+
+static void headerChecksumClose(HeaderChecksum *pCk) {
+    if (pCk) {
+        if (pCk->bWritable) {
+            /* 已经放锁，数据库文件可能被别人修改过，不更新记录的代 */
+            pCk->bGenDirty = 0;
+            headerChecksumFlush(pCk, 0);
+        }
+        pCk->pFile->pMethods->xClose(pCk->pFile);
+        sqlite3_free(pCk->aSum);
+        sqlite3_free(pCk->aDirty);
+        sqlite3_free(pCk);
+    }
+}
+
+/****************************************************************************
+** 内存镜像（memory 模式）
+**
+** 镜像的内存默认来自 sqlite3_malloc64。指定 memory_hugepages=1 时依次尝试预留的显式大页
+** （MAP_HUGETLB）和透明大页（匿名映射加 MADV_HUGEPAGE），减少随机查找时的 TLB 未命中。
+****************************************************************************/
+
+static int headerMemAlloc(HeaderMemImage *pMem, int bHuge) {
+#if HEADER_OS_UNIX
+    if (bHuge && pMem->nData > 0) {
+        void *pMap = MAP_FAILED;
+        size_t szMap = 0;
+#ifdef MAP_HUGETLB
+        szMap = (size_t) ((pMem->nData + HEADER_HUGE_PAGE - 1) & ~(sqlite3_int64) (HEADER_HUGE_PAGE - 1));
+        pMap = mmap(0, szMap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        pMem->zBacking = "hugetlb";
+#endif
+        if (pMap == MAP_FAILED) {
+            /* 没有预留的大页，退回到普通的匿名映射，再请求透明大页 */
+            szMap = (size_t) pMem->nData;
+            pMap = mmap(0, szMap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            pMem->zBacking = "mmap";
+#ifdef MADV_HUGEPAGE
+            if (pMap != MAP_FAILED && madvise(pMap, szMap, MADV_HUGEPAGE) == 0) {
+                pMem->zBacking = "thp";
+            }
+#endif
+        }
+        if (pMap != MAP_FAILED) {
+            pMem->aData = pMap;
+            pMem->szMap = (sqlite3_int64) szMap;
+            return SQLITE_OK;
+        }
+    }
+#else
+    (void) bHuge;
+#endif
+    pMem->aData = sqlite3_malloc64(pMem->nData > 0 ? (sqlite3_uint64) pMem->nData : 1);
+    pMem->szMap = 0;
+    pMem->zBacking = "heap";
+    return pMem->aData ? SQLITE_OK : SQLITE_NOMEM;
+}
+
+static void headerMemFree(HeaderMemImage *pMem) {
+    if (pMem == 0) {
+        return;
+    }
+#if HEADER_OS_UNIX
+    if (pMem->szMap > 0) {
+        munmap(pMem->aData, (size_t) pMem->szMap);
+    } else
+#endif
+    {
+        sqlite3_free(pMem->aData);
+    }
+    sqlite3_free(pMem);
+}
+
+/*
+** 从内存镜像读取逻辑范围，超出末尾的部分填零并返回 SQLITE_IOERR_SHORT_READ。
+*/
+static int headerMemRead(const HeaderMemImage *pMem, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    const sqlite3_int64 nAvail = (iOfst < pMem->nData) ? pMem->nData - iOfst : 0;
+    if (nAvail >= iAmt) {
+        memcpy(zBuf, &pMem->aData[iOfst], iAmt);
+        return SQLITE_OK;
+    }
+    if (nAvail > 0) {
+        memcpy(zBuf, &pMem->aData[iOfst], (size_t) nAvail);
+    }
+    memset((char *) zBuf + nAvail, 0, (size_t) (iAmt - nAvail));
+    return SQLITE_IOERR_SHORT_READ;
+}
+
+
+/****************************************************************************
+** 启动预热（URI 参数 warmup，取值为记录的秒数）
+**
+** 打开之后的前 warmup 秒内记录主数据库文件被读取过的页，窗口结束时写入旁边的
+** 访问记录文件 <数据库>-warmup。下次打开时，一个后台线程按记录中的页（相邻的页合并成
+** 一个范围）通知内核预读，让服务在第一个查询到来之前就把常用的页读入页缓存。
+**
+** 访问记录的格式（整数都是大端序）：
+**
+**   0   16 字节的魔数 "headervfs-wrm-1"
+**   16  4 字节的记录粒度（页大小）
+**   20  4 字节的页数 n
+**   24  n 个按升序排列的 4 字节页号
+**
+** 访问记录先写入临时文件再改名替换，读者不会看到写了一半的文件。还没到时间就关闭的
+** 连接只有在原来没有访问记录时才写入，避免短暂的连接用几个页覆盖完整的记录。
+****************************************************************************/
+
+#if HEADER_OS_UNIX
+
+#define HEADER_WARMUP_HDR 24
+
+// 回放时合并成一次预读的最大字节数
+#define HEADER_WARMUP_RUN 0x100000
+
+static const char headerWarmupMagic[16] = "headervfs-wrm-1";
+
+struct HeaderWarmup {
+    char *zPath;                /* 访问记录文件的路径 */
+    sqlite3_int64 tDeadline;    /* 记录窗口结束的时间（headerNow()），0 表示已经停止记录 */
+    int szPage;                 /* 记录的粒度，由第一次整页读取确定 */
+    int nRecord;                /* 本次记录的页数 */
+    unsigned char *aBitmap;     /* 本次读取过的页的位图 */
+    sqlite3_int64 nBitmap;      /* aBitmap 的字节数 */
+    int bHaveProfile;           /* 打开时已经有访问记录 */
+    /* 回放，后台线程只读取下面这些成员 */
+    int fd;                     /* 主数据库文件的描述符（由登记表持有） */
+    sqlite3_int64 iHeaderSize;  /* 页号换算成文件偏移量时加上的头部大小 */
+    int szReplay;               /* 访问记录的粒度 */
+    int nReplay;                /* 访问记录中的页数 */
+    unsigned char *aReplay;     /* 访问记录中的页号（大端序） */
+    pthread_t thread;           /* 回放线程 */
+    int bThread;                /* 回放线程已经启动 */
+    int bStop;                  /* 请求回放线程停止，用 headerStatAdd()/headerStatGet() 访问 */
+    int nReplayed;              /* 已经预读的页数，同上 */
+    sqlite3_int64 tReplay;      /* 回放耗时（纳秒），回放结束时写入，同上 */
+};
+
+/*
+** 回放线程：按访问记录预读，相邻的页合并成一个不超过 HEADER_WARMUP_RUN 的范围。
+** 支持 POSIX_FADV_WILLNEED 的平台只发出提示，否则直接读入页缓存。
+*/
+static void *headerWarmupMain(void *pArg) {
+    HeaderWarmup *pW = (HeaderWarmup *) pArg;
+    const sqlite3_int64 tStart = headerNow();
+#ifndef POSIX_FADV_WILLNEED
+    char *aBuf = sqlite3_malloc(HEADER_WARMUP_RUN);
+#endif
+    int i = 0;
+    while (i < pW->nReplay && headerStatGet(pW->bStop) == 0) {
+        const sqlite3_int64 iFirst = headerGet32(&pW->aReplay[i * 4]);
+        int n = 1;
+        while (i + n < pW->nReplay
+               && headerGet32(&pW->aReplay[(i + n) * 4]) == iFirst + n
+               && (sqlite3_int64) (n + 1) * pW->szReplay <= HEADER_WARMUP_RUN
+        ) {
+            n++;
+        }
+        const off_t iOfst = (off_t) (iFirst * pW->szReplay + pW->iHeaderSize);
+#ifdef POSIX_FADV_WILLNEED
+        posix_fadvise(pW->fd, iOfst, (off_t) n * pW->szReplay, POSIX_FADV_WILLNEED);
+#else
+        if (aBuf) {
+            (void) pread(pW->fd, aBuf, (size_t) n * pW->szReplay, iOfst);
+        }
+#endif
+        headerStatAdd(pW->nReplayed, n);
+        i += n;
+    }
+#ifndef POSIX_FADV_WILLNEED
+    sqlite3_free(aBuf);
+#endif
+    headerStatAdd(pW->tReplay, headerNow() - tStart);
+    return 0;
+}
+
+/*
+** 读取已有的访问记录。文件不存在或者格式不对时当作没有记录。
+*/
+static void headerWarmupLoad(HeaderWarmup *pW) {
+    const int fd = open(pW->zPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    unsigned char aHdr[HEADER_WARMUP_HDR];
+    struct stat st;
+    if (fstat(fd, &st) == 0
+        && pread(fd, aHdr, sizeof(aHdr), 0) == (ssize_t) sizeof(aHdr)
+        && memcmp(aHdr, headerWarmupMagic, sizeof(headerWarmupMagic)) == 0
+    ) {
+        const unsigned int szPage = headerGet32(&aHdr[16]);
+        const unsigned int n = headerGet32(&aHdr[20]);
+        if (szPage >= 512 && szPage <= 65536 && (szPage & (szPage - 1)) == 0
+            && n > 0 && n < 0x40000000
+            && st.st_size == HEADER_WARMUP_HDR + (off_t) n * 4
+        ) {
+            pW->aReplay = sqlite3_malloc64((sqlite3_uint64) n * 4);
+            if (pW->aReplay && pread(fd, pW->aReplay, (size_t) n * 4, HEADER_WARMUP_HDR) == (ssize_t) n * 4) {
+                pW->szReplay = (int) szPage;
+                pW->nReplay = (int) n;
+                pW->bHaveProfile = 1;
+            } else {
+                sqlite3_free(pW->aReplay);
+                pW->aReplay = 0;
+            }
+        }
+    }
+    close(fd);
+}
+
+/*
+** 把本次记录的页写入访问记录文件（写临时文件再改名）。
+*/
+static void headerWarmupSave(HeaderWarmup *pW) {
+    if (pW->nRecord == 0) {
+        return;
+    }
+    const size_t nByte = HEADER_WARMUP_HDR + (size_t) pW->nRecord * 4;
+    unsigned char *aBuf = sqlite3_malloc64(nByte);
+    char *zTmp = sqlite3_mprintf("%s-XXXXXX", pW->zPath);
+    if (aBuf && zTmp) {
+        memcpy(aBuf, headerWarmupMagic, sizeof(headerWarmupMagic));
+        headerPut32(&aBuf[16], (unsigned int) pW->szPage);
+        headerPut32(&aBuf[20], (unsigned int) pW->nRecord);
+        unsigned char *a = &aBuf[HEADER_WARMUP_HDR];
+        for (sqlite3_int64 i = 0; i < pW->nBitmap; i++) {
+            for (int j = 0; pW->aBitmap[i] && j < 8; j++) {
+                if (pW->aBitmap[i] & (1 << j)) {
+                    headerPut32(a, (unsigned int) (i * 8 + j));
+                    a += 4;
+                }
+            }
+        }
+        const int fd = mkstemp(zTmp);
+        struct stat st;
+        if (fd >= 0 && pW->fd >= 0 && fstat(pW->fd, &st) == 0) {
+            /* 与 SQLite 的日志文件一样沿用数据库文件的权限 */
+            (void) fchmod(fd, st.st_mode & 0777);
+        }
+        if (fd >= 0) {
+            size_t nDone = 0;
+            while (nDone < nByte) {
+                const ssize_t nWritten = write(fd, aBuf + nDone, nByte - nDone);
+                if (nWritten < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (nWritten <= 0) {
+                    break;
+                }
+                nDone += (size_t) nWritten;
+            }
+            close(fd);
+            if (nDone != nByte || rename(zTmp, pW->zPath) != 0) {
+                unlink(zTmp);
+            }
+        }
+    }
+    sqlite3_free(aBuf);
+    sqlite3_free(zTmp);
+}
+
+/*
+** 开启启动预热：读取已有的访问记录并启动回放线程，开始 nSecond 秒的记录窗口。
+*/
+static int headerWarmupOpen(HeaderFile *p, sqlite3_int64 nSecond, HeaderWarmup **ppW) {
+    *ppW = 0;
+    if (nSecond <= 0 || p->zName == 0) {
+        return SQLITE_OK;
+    }
+    HeaderWarmup *pW = sqlite3_malloc(sizeof(HeaderWarmup));
+    if (pW == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pW, 0, sizeof(HeaderWarmup));
+    pW->zPath = sqlite3_mprintf("%s-warmup", p->zName);
+    if (pW->zPath == 0) {
+        sqlite3_free(pW);
+        return SQLITE_NOMEM;
+    }
+    pW->tDeadline = headerNow() + nSecond * 1000000000;
+    pW->iHeaderSize = p->iHeaderSize;
+    pW->fd = headerInodeFd(p->pInode);
+    headerWarmupLoad(pW);
+    if (pW->nReplay > 0 && pW->fd >= 0) {
+        pW->bThread = (pthread_create(&pW->thread, 0, headerWarmupMain, pW) == 0);
+    }
+    *ppW = pW;
+    return SQLITE_OK;
+}
+
+/*
+** 记录一次读取涉及的页。记录窗口结束后第一次读取时写入访问记录并停止记录。
+*/
+static void headerWarmupRecord(HeaderWarmup *pW, sqlite3_int64 iOfst, int iAmt) {
+    if (pW->tDeadline == 0) {
+        return;
+    }
+    if (headerNow() >= pW->tDeadline) {
+        pW->tDeadline = 0;
+        headerWarmupSave(pW);
+        return;
+    }
+    if (pW->szPage == 0) {
+        /* 数据库头部的 100 字节等零散读取不能确定页大小 */
+        if (iAmt < 512 || iAmt > 65536 || (iAmt & (iAmt - 1)) != 0) {
+            return;
+        }
+        pW->szPage = iAmt;
+    }
+    const sqlite3_int64 iLast = (iOfst + iAmt - 1) / pW->szPage;
+    for (sqlite3_int64 iPage = iOfst / pW->szPage; iPage <= iLast && iPage < 0xffffffff; iPage++) {
+        const sqlite3_int64 iByte = iPage / 8;
+        if (iByte >= pW->nBitmap) {
+            sqlite3_int64 nNew = pW->nBitmap ? pW->nBitmap * 2 : 1024;
+            while (nNew <= iByte) {
+                nNew *= 2;
+            }
+            unsigned char *aNew = sqlite3_realloc64(pW->aBitmap, (sqlite3_uint64) nNew);
+            if (aNew == 0) {
+                /* 内存不足：保留已经记录的部分 */
+                pW->tDeadline = 0;
+                headerWarmupSave(pW);
+                return;
+            }
+            memset(&aNew[pW->nBitmap], 0, (size_t) (nNew - pW->nBitmap));
+            pW->aBitmap = aNew;
+            pW->nBitmap = nNew;
+        }
+        const unsigned char mask = (unsigned char) (1 << (iPage & 7));
+        if ((pW->aBitmap[iByte] & mask) == 0) {
+            pW->aBitmap[iByte] |= mask;
+            pW->nRecord++;
+        }
+    }
+}
+
+static void headerWarmupClose(HeaderWarmup *pW) {
+    if (pW == 0) {
+        return;
+    }
+    if (pW->bThread) {
+        headerStatAdd(pW->bStop, 1);
+        pthread_join(pW->thread, 0);
+    }
+    if (pW->tDeadline != 0 && !pW->bHaveProfile) {
+        headerWarmupSave(pW);
+    }
+    sqlite3_free(pW->aBitmap);
+    sqlite3_free(pW->aReplay);
+    sqlite3_free(pW->zPath);
+    sqlite3_free(pW);
+}
+
+#else
+
+struct HeaderWarmup {
+    int nRecord;
+    int nReplay;
+    int nReplayed;
+    sqlite3_int64 tDeadline;
+    sqlite3_int64 tReplay;
+};
+
+static int headerWarmupOpen(HeaderFile *p, sqlite3_int64 nSecond, HeaderWarmup **ppW) {
+    (void) p;
+    (void) nSecond;
+    *ppW = 0;
+    return SQLITE_OK;
+}
+
+static void headerWarmupRecord(HeaderWarmup *pW, sqlite3_int64 iOfst, int iAmt) {
+    (void) pW;
+    (void) iOfst;
+    (void) iAmt;
+}
+
+static void headerWarmupClose(HeaderWarmup *pW) {
+    (void) pW;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+
+/****************************************************************************
+** 直接 I/O（URI 参数 direct_io=1）
+**
+** 主数据库文件的读写绕过内核页缓存，避免 SQLite 的页缓存（以及对齐读缓存）和内核各缓存
+** 一份。O_DIRECT 要求偏移量、长度和内存地址都按块对齐，而头部使每个页都错开了
+** iHeaderSize 字节，因此请求先被扩展到对齐的范围，通过对齐的中转缓冲区完成：
+** 读取时读入整个对齐范围再取出需要的部分；写入时不完整的首尾块先读出来（读-改-写），
+** 头部所在的块也因此保持不变。超出文件末尾的部分写入后再截断回原来的大小。
+**
+** 中转缓冲区由所有文件共享一个池，用完归还，池中最多保留 HEADER_DIRECT_POOL 个。
+****************************************************************************/
+
+#if HEADER_OS_UNIX
+
+// 中转缓冲区的大小，更长的请求分段完成
+#define HEADER_DIRECT_BUF 0x40000
+
+// 对齐的下限和上限，文件系统报告的要求超出上限时不使用直接 I/O
+#define HEADER_DIRECT_ALIGN_MIN 512
+#define HEADER_DIRECT_ALIGN_MAX 0x10000
+
+// 池中保留的空闲中转缓冲区个数
+#define HEADER_DIRECT_POOL 8
+
+struct HeaderDirect {
+    int fd;                     /* 登记表持有的 O_DIRECT 描述符 */
+    int szAlign;                /* 偏移量、长度和内存地址的对齐要求 */
+    sqlite3_int64 nRead;        /* 发出的对齐读取次数 */
+    sqlite3_int64 nWrite;       /* 发出的对齐写入次数 */
+    sqlite3_int64 nRmw;         /* 写入前需要先读出来的不完整块数 */
+};
+
+/* 空闲的中转缓冲区，由 headerGlobalMutex() 保护 */
+static void *headerDirectPool[HEADER_DIRECT_POOL];
+static int headerDirectPoolSize = 0;
+
+/*
+** 从池中取出一个中转缓冲区，池为空时新分配一个。内存不足时返回 NULL。
+*/
+static unsigned char *headerDirectBufGet(void) {
+    void *pBuf = 0;
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (headerDirectPoolSize > 0) {
+        pBuf = headerDirectPool[--headerDirectPoolSize];
+    }
+    sqlite3_mutex_leave(pMutex);
+    if (pBuf == 0 && posix_memalign(&pBuf, HEADER_DIRECT_ALIGN_MAX, HEADER_DIRECT_BUF) != 0) {
+        pBuf = 0;
+    }
+    return pBuf;
+}
+
+/*
+** 把中转缓冲区还给池，池已满时释放。
+*/
+static void headerDirectBufPut(unsigned char *pBuf) {
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    if (headerDirectPoolSize < HEADER_DIRECT_POOL) {
+        headerDirectPool[headerDirectPoolSize++] = pBuf;
+        pBuf = 0;
+    }
+    sqlite3_mutex_leave(pMutex);
+    free(pBuf);
+}
+
+/*
+** 查询描述符上直接 I/O 的对齐要求（Linux 6.1 开始由 statx 报告），不支持时返回 0。
+** 无法查询时假设为 4096，这能满足绝大多数设备。
+*/
+static int headerDirectAlign(int fd) {
+    int szAlign = 4096;
+#if defined(__linux__) && defined(STATX_DIOALIGN)
+    struct statx stx;
+    if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN) != 0) {
+        if (stx.stx_dio_offset_align == 0) {
+            return 0;
+        }
+        const unsigned szReq = (stx.stx_dio_offset_align > stx.stx_dio_mem_align)
+                               ? stx.stx_dio_offset_align : stx.stx_dio_mem_align;
+        if (szReq > HEADER_DIRECT_ALIGN_MAX || (szReq & (szReq - 1)) != 0) {
+            return 0;
+        }
+        szAlign = (szReq > HEADER_DIRECT_ALIGN_MIN) ? (int) szReq : HEADER_DIRECT_ALIGN_MIN;
+    }
+#else
+    (void) fd;
+#endif
+    return szAlign;
+}
+
+/*
+** 从 iOfst 开始读取 nByte 字节（都已对齐），处理 EINTR 和不完整的读取。
+** 返回读到的字节数，到达文件末尾时小于 nByte；出错时返回 -1。
+*/
+static ssize_t headerDirectPread(int fd, unsigned char *aBuf, size_t nByte, off_t iOfst) {
+    size_t nDone = 0;
+    while (nDone < nByte) {
+        const ssize_t n = pread(fd, aBuf + nDone, nByte - nDone, iOfst + (off_t) nDone);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        nDone += (size_t) n;
+    }
+    return (ssize_t) nDone;
+}
+
+/*
+** 读取真实文件 [iReal, iReal+iAmt) 的数据。
+** 读到文件末尾之后的部分填零，并返回 SQLITE_IOERR_SHORT_READ。
+*/
+static int headerDirectRead(HeaderDirect *pD, void *zBuf, int iAmt, sqlite3_int64 iReal) {
+    const sqlite3_int64 szAlign = pD->szAlign;
+    unsigned char *aBuf = headerDirectBufGet();
+    if (aBuf == 0) {
+        return SQLITE_IOERR_NOMEM;
+    }
+    unsigned char *zOut = zBuf;
+    int rc = SQLITE_OK;
+    while (iAmt > 0) {
+        const sqlite3_int64 iBase = iReal & ~(szAlign - 1);
+        const int iSkip = (int) (iReal - iBase);
+        const int n = (iAmt < HEADER_DIRECT_BUF - iSkip) ? iAmt : HEADER_DIRECT_BUF - iSkip;
+        const size_t nAligned = (size_t) ((iSkip + n + szAlign - 1) & ~(szAlign - 1));
+        const ssize_t nGot = headerDirectPread(pD->fd, aBuf, nAligned, (off_t) iBase);
+        pD->nRead++;
+        if (nGot < 0) {
+            rc = SQLITE_IOERR_READ;
+            break;
+        }
+        const int nAvail = (nGot > iSkip) ? (int) (nGot - iSkip) : 0;
+        if (nAvail < n) {
+            /* 到达文件末尾，后面的部分都填零 */
+            memcpy(zOut, &aBuf[iSkip], nAvail);
+            memset(zOut + nAvail, 0, iAmt - nAvail);
+            rc = SQLITE_IOERR_SHORT_READ;
+            break;
+        }
+        memcpy(zOut, &aBuf[iSkip], n);
+        zOut += n;
+        iAmt -= n;
+        iReal += n;
+    }
+    headerDirectBufPut(aBuf);
+    return rc;
+}
+
+/*
+** 读出 iBlock 开始的一个对齐块用于读-改-写，超出文件末尾的部分填零。
+*/
+static int headerDirectLoadBlock(HeaderDirect *pD, unsigned char *aBlock, sqlite3_int64 iBlock) {
+    const ssize_t nGot = headerDirectPread(pD->fd, aBlock, (size_t) pD->szAlign, (off_t) iBlock);
+    pD->nRmw++;
+    if (nGot < 0) {
+        return SQLITE_IOERR_READ;
+    }
+    memset(&aBlock[nGot], 0, (size_t) (pD->szAlign - nGot));
+    return SQLITE_OK;
+}
+
+/*
+** 把数据写入真实文件 [iReal, iReal+iAmt)。不完整的首尾块先读出来再整块写回，
+** 写到文件末尾之后的对齐部分最后截断掉，文件大小与普通的写入相同。
+*/
+static int headerDirectWrite(HeaderDirect *pD, const void *zBuf, int iAmt, sqlite3_int64 iReal) {
+    const sqlite3_int64 szAlign = pD->szAlign;
+    struct stat st;
+    if (fstat(pD->fd, &st) != 0) {
+        return SQLITE_IOERR_FSTAT;
+    }
+    const sqlite3_int64 iSize = (st.st_size > iReal + iAmt) ? st.st_size : iReal + iAmt;
+    sqlite3_int64 iWritten = 0;
+    unsigned char *aBuf = headerDirectBufGet();
+    if (aBuf == 0) {
+        return SQLITE_IOERR_NOMEM;
+    }
+    const unsigned char *zIn = zBuf;
+    int rc = SQLITE_OK;
+    while (rc == SQLITE_OK && iAmt > 0) {
+        const sqlite3_int64 iBase = iReal & ~(szAlign - 1);
+        const int iSkip = (int) (iReal - iBase);
+        const int n = (iAmt < HEADER_DIRECT_BUF - iSkip) ? iAmt : HEADER_DIRECT_BUF - iSkip;
+        const sqlite3_int64 nAligned = (iSkip + n + szAlign - 1) & ~(szAlign - 1);
+        if (iSkip > 0) {
+            rc = headerDirectLoadBlock(pD, aBuf, iBase);
+        }
+        if (rc == SQLITE_OK && (iSkip + n) % szAlign != 0 && (iSkip == 0 || nAligned > szAlign)) {
+            rc = headerDirectLoadBlock(pD, &aBuf[nAligned - szAlign], iBase + nAligned - szAlign);
+        }
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        memcpy(&aBuf[iSkip], zIn, n);
+        sqlite3_int64 nDone = 0;
+        while (nDone < nAligned) {
+            const ssize_t nPut = pwrite(pD->fd, aBuf + nDone, (size_t) (nAligned - nDone), (off_t) (iBase + nDone));
+            if (nPut < 0 && errno == EINTR) {
+                continue;
+            }
+            if (nPut <= 0) {
+                rc = (nPut < 0 && errno == ENOSPC) ? SQLITE_FULL : SQLITE_IOERR_WRITE;
+                break;
+            }
+            nDone += nPut;
+        }
+        pD->nWrite++;
+        if (iBase + nDone > iWritten) {
+            iWritten = iBase + nDone;
+        }
+        zIn += n;
+        iAmt -= n;
+        iReal += n;
+    }
+    headerDirectBufPut(aBuf);
+    if (iWritten > iSize && ftruncate(pD->fd, (off_t) iSize) != 0 && rc == SQLITE_OK) {
+        rc = SQLITE_IOERR_TRUNCATE;
+    }
+    return rc;
+}
+
+/*
+** 为主数据库文件开启直接 I/O。平台或文件系统不支持时只记录日志，文件仍然使用页缓存。
+*/
+static int headerDirectOpen(HeaderFile *p, HeaderDirect **ppD) {
+    *ppD = 0;
+    const int fd = headerInodeDirectFd(p->pInode);
+    const int szAlign = (fd >= 0) ? headerDirectAlign(fd) : 0;
+    if (szAlign == 0) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: direct I/O is not supported for %s", p->zName);
+        return SQLITE_OK;
+    }
+    HeaderDirect *pD = sqlite3_malloc(sizeof(HeaderDirect));
+    if (pD == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pD, 0, sizeof(HeaderDirect));
+    pD->fd = fd;
+    pD->szAlign = szAlign;
+    *ppD = pD;
+    return SQLITE_OK;
+}
+
+#else
+
+struct HeaderDirect {
+    int szAlign;
+    sqlite3_int64 nRead;
+    sqlite3_int64 nWrite;
+    sqlite3_int64 nRmw;
+};
+
+static int headerDirectRead(HeaderDirect *pD, void *zBuf, int iAmt, sqlite3_int64 iReal) {
+    (void) pD;
+    (void) zBuf;
+    (void) iAmt;
+    (void) iReal;
+    return SQLITE_IOERR_READ;
+}
+
+static int headerDirectWrite(HeaderDirect *pD, const void *zBuf, int iAmt, sqlite3_int64 iReal) {
+    (void) pD;
+    (void) zBuf;
+    (void) iAmt;
+    (void) iReal;
+    return SQLITE_IOERR_WRITE;
+}
+
+static int headerDirectOpen(HeaderFile *p, HeaderDirect **ppD) {
+    *ppD = 0;
+    sqlite3_log(SQLITE_NOTICE, "headervfs: direct I/O is not available on this platform");
+    (void) p;
+    return SQLITE_OK;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+
+/****************************************************************************
+** io_uring 引擎（URI 参数 io_uring=1，只在 Linux 上可用）
+**
+** 写回缓冲区的刷新改由 io_uring 完成：登记表的描述符注册为固定文件，写回缓冲区的数据区
+** 注册为固定缓冲区，刷新时所有脏页的写入（每页一个 IORING_OP_WRITE_FIXED）放进同一次
+** io_uring_enter 提交。单独的读写每次只有一个操作，提交一次和 pread/pwrite 没有区别，
+** 仍然交给底层 VFS；同步也由底层 VFS 完成（它还负责新文件所在目录的同步）。
+** 直接使用系统调用，不依赖 liburing。锁仍然由底层 VFS 处理。
+**
+** 内核不支持（ENOSYS）、被禁用（io_uring_disabled、seccomp）或者某个操作返回 EINVAL
+** 时关闭引擎，回到底层 VFS 的同步路径。
+****************************************************************************/
+
+#if HEADER_HAVE_URING
+
+// 提交队列的深度，也是一次提交的最大操作数
+#define HEADER_URING_ENTRIES 64
+
+struct HeaderUring {
+    int fd;                     /* io_uring 实例的描述符 */
+    unsigned nEntry;            /* 提交队列的深度 */
+    void *pSqRing;              /* 映射的提交队列 */
+    size_t szSqRing;
+    void *pCqRing;              /* 映射的完成队列，与 pSqRing 相同时只映射了一次 */
+    size_t szCqRing;
+    struct io_uring_sqe *aSqe;  /* 映射的 SQE 数组 */
+    size_t szSqe;
+    unsigned *pSqHead;
+    unsigned *pSqTail;
+    unsigned *pSqMask;
+    unsigned *aSqArray;
+    unsigned *pCqHead;
+    unsigned *pCqTail;
+    unsigned *pCqMask;
+    struct io_uring_cqe *aCqe;
+    unsigned nPending;          /* 已经填好、尚未提交的 SQE 个数 */
+    const unsigned char *pBuf;  /* 注册过的缓冲区（写回缓冲区的数据区），NULL 表示还没有注册 */
+    int bFixed;                 /* pBuf 注册成功，可以使用 IORING_OP_WRITE_FIXED */
+    /* 统计计数 */
+    sqlite3_int64 nEnter;       /* io_uring_enter 调用次数 */
+    sqlite3_int64 nOp;          /* 提交的操作个数 */
+};
+
+static int headerUringSetup(unsigned nEntry, struct io_uring_params *pParams) {
+    return (int) syscall(__NR_io_uring_setup, nEntry, pParams);
+}
+
+static int headerUringEnter(int fd, unsigned nSubmit, unsigned nWait) {
+    return (int) syscall(__NR_io_uring_enter, fd, nSubmit, nWait, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int headerUringRegister(int fd, unsigned op, const void *pArg, unsigned nArg) {
+    return (int) syscall(__NR_io_uring_register, fd, op, pArg, nArg);
+}
+
+static void headerUringDestroy(HeaderUring *pU) {
+    if (pU == 0) {
+        return;
+    }
+    if (pU->aSqe) {
+        munmap(pU->aSqe, pU->szSqe);
+    }
+    if (pU->pCqRing && pU->pCqRing != pU->pSqRing) {
+        munmap(pU->pCqRing, pU->szCqRing);
+    }
+    if (pU->pSqRing) {
+        munmap(pU->pSqRing, pU->szSqRing);
+    }
+    if (pU->fd >= 0) {
+        close(pU->fd);
+    }
+    sqlite3_free(pU);
+}
+
+static void *headerUringMap(int fd, size_t sz, off_t iOfst) {
+    void *p = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, iOfst);
+    return (p == MAP_FAILED) ? 0 : p;
+}
+
+/*
+** 创建 io_uring 实例并把 fdFile 注册为 0 号固定文件。不可用时返回 SQLITE_NOTFOUND。
+*/
+static int headerUringCreate(int fdFile, HeaderUring **ppU) {
+    *ppU = 0;
+    HeaderUring *pU = sqlite3_malloc(sizeof(HeaderUring));
+    if (pU == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pU, 0, sizeof(HeaderUring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    pU->fd = headerUringSetup(HEADER_URING_ENTRIES, &params);
+    if (pU->fd < 0) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring_setup failed (errno %d)", errno);
+        headerUringDestroy(pU);
+        return SQLITE_NOTFOUND;
+    }
+    pU->nEntry = params.sq_entries < HEADER_URING_ENTRIES ? params.sq_entries : HEADER_URING_ENTRIES;
+    pU->szSqRing = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    pU->szCqRing = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (pU->szCqRing > pU->szSqRing) {
+            pU->szSqRing = pU->szCqRing;
+        }
+        pU->pSqRing = headerUringMap(pU->fd, pU->szSqRing, IORING_OFF_SQ_RING);
+        pU->pCqRing = pU->pSqRing;
+    } else {
+        pU->pSqRing = headerUringMap(pU->fd, pU->szSqRing, IORING_OFF_SQ_RING);
+        pU->pCqRing = headerUringMap(pU->fd, pU->szCqRing, IORING_OFF_CQ_RING);
+    }
+    pU->szSqe = params.sq_entries * sizeof(struct io_uring_sqe);
+    pU->aSqe = headerUringMap(pU->fd, pU->szSqe, IORING_OFF_SQES);
+    if (pU->pSqRing == 0 || pU->pCqRing == 0 || pU->aSqe == 0
+        || headerUringRegister(pU->fd, IORING_REGISTER_FILES, &fdFile, 1) < 0
+    ) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring initialization failed (errno %d)", errno);
+        headerUringDestroy(pU);
+        return SQLITE_NOTFOUND;
+    }
+    unsigned char *pSq = pU->pSqRing;
+    unsigned char *pCq = pU->pCqRing;
+    pU->pSqHead = (unsigned *) (pSq + params.sq_off.head);
+    pU->pSqTail = (unsigned *) (pSq + params.sq_off.tail);
+    pU->pSqMask = (unsigned *) (pSq + params.sq_off.ring_mask);
+    pU->aSqArray = (unsigned *) (pSq + params.sq_off.array);
+    pU->pCqHead = (unsigned *) (pCq + params.cq_off.head);
+    pU->pCqTail = (unsigned *) (pCq + params.cq_off.tail);
+    pU->pCqMask = (unsigned *) (pCq + params.cq_off.ring_mask);
+    pU->aCqe = (struct io_uring_cqe *) (pCq + params.cq_off.cqes);
+    *ppU = pU;
+    return SQLITE_OK;
+}
+
+/*
+** 取得下一个空闲的 SQE（针对 0 号固定文件），user_data 是它在本次提交中的序号。
+** 调用者保证一次提交的 SQE 不超过 nEntry 个。
+*/
+static struct io_uring_sqe *headerUringSqe(HeaderUring *pU, unsigned char opcode, sqlite3_int64 iOfst) {
+    const unsigned idx = (*pU->pSqTail + pU->nPending) & *pU->pSqMask;
+    struct io_uring_sqe *pSqe = &pU->aSqe[idx];
+    memset(pSqe, 0, sizeof(struct io_uring_sqe));
+    pSqe->opcode = opcode;
+    pSqe->flags = IOSQE_FIXED_FILE;
+    pSqe->fd = 0;
+    pSqe->off = (__u64) iOfst;
+    pSqe->user_data = pU->nPending;
+    pU->aSqArray[idx] = idx;
+    pU->nPending++;
+    return pSqe;
+}
+
+/*
+** 取走完成队列中已有的 CQE，user_data 小于 n 的结果写入 aRes。返回取走的个数。
+*/
+static unsigned headerUringReap(HeaderUring *pU, unsigned n, int *aRes) {
+    unsigned iHead = *pU->pCqHead;
+    const unsigned iTail = __atomic_load_n(pU->pCqTail, __ATOMIC_ACQUIRE);
+    unsigned nReap = 0;
+    while (iHead != iTail) {
+        const struct io_uring_cqe *pCqe = &pU->aCqe[iHead & *pU->pCqMask];
+        if (pCqe->user_data < n) {
+            aRes[pCqe->user_data] = pCqe->res;
+        }
+        iHead++;
+        nReap++;
+    }
+    __atomic_store_n(pU->pCqHead, iHead, __ATOMIC_RELEASE);
+    return nReap;
+}
+
+/*
+** 提交所有填好的 SQE 并等待它们全部完成，第 i 个操作的结果（字节数或者 -errno）写入 aRes[i]。
+** io_uring_enter 失败时收回还没有提交的 SQE，并等待已经提交的操作完成、取走它们的 CQE，
+** 否则它们会在下一次提交时混进新的结果里（写入的缓冲区也可能已经被重新使用）。
+*/
+static int headerUringSubmit(HeaderUring *pU, int *aRes) {
+    const unsigned n = pU->nPending;
+    __atomic_store_n(pU->pSqTail, *pU->pSqTail + n, __ATOMIC_RELEASE);
+    pU->nPending = 0;
+    unsigned nSubmit = n;
+    unsigned nDone = 0;
+    while (nDone < n) {
+        const int rc = headerUringEnter(pU->fd, nSubmit, n - nDone);
+        pU->nEnter++;
+        if (rc < 0 && errno != EINTR) {
+            const int iErrno = errno;
+            /* 没有使用 SQPOLL，内核只在 io_uring_enter 中消费提交队列，可以把队尾退回到队头 */
+            __atomic_store_n(pU->pSqTail, __atomic_load_n(pU->pSqHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            nDone += headerUringReap(pU, n, aRes);
+            while (nDone < n - nSubmit) {
+                if (headerUringEnter(pU->fd, 0, n - nSubmit - nDone) < 0 && errno != EINTR) {
+                    break;
+                }
+                nDone += headerUringReap(pU, n, aRes);
+            }
+            sqlite3_log(SQLITE_IOERR, "headervfs: io_uring_enter failed (errno %d)", iErrno);
+            return SQLITE_IOERR;
+        }
+        if (rc > 0) {
+            nSubmit -= ((unsigned) rc < nSubmit) ? (unsigned) rc : nSubmit;
+        }
+        nDone += headerUringReap(pU, n, aRes);
+    }
+    pU->nOp += n;
+    return SQLITE_OK;
+}
+
+/*
+** 执行单个读或写操作，直到完成全部 iAmt 字节（批量写入中没有写完的页用它补写）。
+** 操作不受支持时返回 SQLITE_NOTFOUND。
+*/
+static int headerUringReadWrite(HeaderUring *pU, int bWrite, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    int nDone = 0;
+    while (nDone < iAmt) {
+        struct io_uring_sqe *pSqe = headerUringSqe(pU, bWrite ? IORING_OP_WRITE : IORING_OP_READ, iOfst + nDone);
+        pSqe->addr = (__u64) (uintptr_t) ((char *) zBuf + nDone);
+        pSqe->len = (__u32) (iAmt - nDone);
+        int res = 0;
+        const int rc = headerUringSubmit(pU, &res);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        if (res == -EINTR || res == -EAGAIN) {
+            continue;
+        }
+        if ((res == -EINVAL || res == -EOPNOTSUPP) && nDone == 0) {
+            return SQLITE_NOTFOUND;
+        }
+        if (res < 0) {
+            if (bWrite) {
+                return (res == -ENOSPC || res == -EDQUOT) ? SQLITE_FULL : SQLITE_IOERR_WRITE;
+            }
+            return SQLITE_IOERR_READ;
+        }
+        if (res == 0) {
+            if (bWrite) {
+                return SQLITE_IOERR_WRITE;
+            }
+            /* 读到文件末尾：与 unix VFS 一样把剩下的部分填零 */
+            memset((char *) zBuf + nDone, 0, (size_t) (iAmt - nDone));
+            return SQLITE_IOERR_SHORT_READ;
+        }
+        nDone += res;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** 写出写回缓冲区中按偏移量排好序的 nPage 个页，每次提交最多 nEntry 个。
+** 第一次使用（或者数据区重新分配之后）把数据区注册为固定缓冲区，注册失败时使用普通的写入。
+*/
+static int headerUringWritePages(
+    HeaderUring *pU,
+    const HeaderWriteBuffer *pWBuf,
+    const HeaderWBufEntry *aEntry,
+    int nPage,
+    sqlite3_int64 iHeaderSize
+) {
+    const int szPage = pWBuf->szPage;
+    if (pU->pBuf != pWBuf->aData) {
+        if (pU->bFixed) {
+            headerUringRegister(pU->fd, IORING_UNREGISTER_BUFFERS, 0, 0);
+        }
+        struct iovec iov;
+        iov.iov_base = pWBuf->aData;
+        iov.iov_len = (size_t) pWBuf->nMax * szPage;
+        pU->bFixed = (headerUringRegister(pU->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0);
+        pU->pBuf = pWBuf->aData;
+    }
+    int aRes[HEADER_URING_ENTRIES];
+    for (int i = 0; i < nPage;) {
+        const int n = (nPage - i < (int) pU->nEntry) ? nPage - i : (int) pU->nEntry;
+        for (int j = 0; j < n; j++) {
+            struct io_uring_sqe *pSqe = headerUringSqe(
+                pU, pU->bFixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, aEntry[i + j].iPgno * szPage + iHeaderSize
+            );
+            pSqe->addr = (__u64) (uintptr_t) &pWBuf->aData[(sqlite3_int64) aEntry[i + j].iIdx * szPage];
+            pSqe->len = (__u32) szPage;
+        }
+        const int rc = headerUringSubmit(pU, aRes);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        for (int j = 0; j < n; j++) {
+            if (aRes[j] == szPage) {
+                continue;
+            }
+            if ((aRes[j] == -EINVAL || aRes[j] == -EOPNOTSUPP) && i == 0 && j == 0) {
+                return SQLITE_NOTFOUND;
+            }
+            /* 被打断或者只写入了一部分：单独重新写入这一页 */
+            const int rc2 = headerUringReadWrite(
+                pU, 1, &pWBuf->aData[(sqlite3_int64) aEntry[i + j].iIdx * szPage], szPage,
+                aEntry[i + j].iPgno * szPage + iHeaderSize
+            );
+            if (rc2 != SQLITE_OK) {
+                return (rc2 == SQLITE_NOTFOUND) ? SQLITE_IOERR_WRITE : rc2;
+            }
+        }
+        i += n;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** 为主数据库文件开启 io_uring 引擎。不可用时只记录日志，文件仍然使用同步路径。
+*/
+static void headerUringOpen(HeaderFile *p, int bWritable) {
+    const int fd = headerInodeFd(p->pInode);
+    if (fd < 0) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring needs a file descriptor for %s", p->zName);
+        return;
+    }
+    if (bWritable && (fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDWR) {
+        sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring needs a writable descriptor for %s", p->zName);
+        return;
+    }
+    headerUringCreate(fd, &p->pUring);
+}
+
+#else
+
+struct HeaderUring {
+    unsigned nEntry;
+    int bFixed;
+    sqlite3_int64 nEnter;
+    sqlite3_int64 nOp;
+};
+
+static void headerUringDestroy(HeaderUring *pU) {
+    (void) pU;
+}
+
+static int headerUringWritePages(
+    HeaderUring *pU,
+    const HeaderWriteBuffer *pWBuf,
+    const HeaderWBufEntry *aEntry,
+    int nPage,
+    sqlite3_int64 iHeaderSize
+) {
+    (void) pU;
+    (void) pWBuf;
+    (void) aEntry;
+    (void) nPage;
+    (void) iHeaderSize;
+    return SQLITE_NOTFOUND;
+}
+
+static void headerUringOpen(HeaderFile *p, int bWritable) {
+    (void) p;
+    (void) bWritable;
+    sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring is not available on this platform");
+}
+
+#endif /* HEADER_HAVE_URING */
+
+/*
+** 某个操作不受支持：关闭引擎，之后都使用同步路径。
+*/
+static void headerUringDisable(HeaderFile *p) {
+    sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring operation not supported, falling back for %s", p->zName);
+    headerUringDestroy(p->pUring);
+    p->pUring = 0;
+}
+
+
+/****************************************************************************
+** I/O 方法实现
+****************************************************************************/
+
+
+/*
+** 承担锁、共享内存和同步的文件：覆盖层模式下是增量文件，否则是真实文件。
+*/
+static sqlite3_file *headerLockFile(const HeaderFile *p) {
+    return p->pOverlay ? p->pOverlay->pDelta : p->pRealFile;
+}
+
+/*
+** 文件使用的共享页缓存。覆盖层和内存模式看到的内容与文件本身不同，不使用共享页缓存。
+*/
+static HeaderShared *headerSharedOf(const HeaderFile *p) {
+    return (p->pOverlay || p->pMem) ? 0 : headerSharedOfInode(p->pInode);
+}
+
+/*
+** 写入之后维护共享页缓存和记录的文件版本号，写入失败时清空共享页缓存并忘记版本号。
+** 回滚日志模式下第 1 页中的文件修改计数器就是版本号，写入它的连接持有排他锁，
+** 所以直接更新记录，下一个读事务（以及同一进程中共享页缓存的其他连接）不必清空缓存。
+*/
+static void headerDataWritten(HeaderFile *p, const unsigned char *zBuf, int iAmt, sqlite3_int64 iOfst, int rc) {
+    HeaderShared *pShared = headerSharedOf(p);
+    if (rc != SQLITE_OK) {
+        p->eVersion = HEADER_VERSION_NONE;
+        if (pShared) {
+            headerSharedInvalidate(pShared);
+        }
+        return;
+    }
+    if (p->pChanges) {
+        headerChangesMark(p->pChanges, iOfst + p->iHeaderSize, iAmt);
+    }
+    const int bCounter = !p->bShm && iOfst <= 24 && iOfst + iAmt >= 28;
+    if (bCounter) {
+        p->eVersion = HEADER_VERSION_COUNTER;
+        p->iVersion = headerGet32(&zBuf[24 - iOfst]);
+    }
+    if (pShared) {
+        headerSharedWrite(pShared, zBuf, iAmt, iOfst);
+        if (bCounter) {
+            headerSharedVersion(pShared, HEADER_VERSION_COUNTER, p->iVersion, 1);
+        }
+    }
+}
+
+/*
+** 读取真实文件 [iReal, iReal+iAmt) 的数据：开启直接 I/O 时绕过页缓存，否则交给底层 VFS。
+*/
+static int headerRealRead(HeaderFile *p, void *zBuf, int iAmt, sqlite3_int64 iReal) {
+    if (p->pDirect) {
+        return headerDirectRead(p->pDirect, zBuf, iAmt, iReal);
+    }
+    return p->pRealFile->pMethods->xRead(p->pRealFile, zBuf, iAmt, iReal);
+}
+
+/*
+** 从真实文件（覆盖层模式下是基础文件）读取逻辑范围，经过读缓存。
+*/
+static int headerBaseRead(HeaderFile *p, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    if (p->pCache) {
+        return headerCacheRead(p->pCache, p, headerRealRead, zBuf, iAmt, iOfst + p->iHeaderSize);
+    }
+    return headerRealRead(p, zBuf, iAmt, iOfst + p->iHeaderSize);
+}
+
+/*
+** 把逻辑范围写入真实文件（覆盖层模式下写入增量文件），并维护读缓存。
+*/
+static int headerWriteThrough(HeaderFile *p, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    if (p->pOverlay) {
+        return headerOverlayWrite(p->pOverlay, p, headerBaseRead, zBuf, iAmt, iOfst);
+    }
+    int rc;
+    if (p->pDirect) {
+        rc = headerDirectWrite(p->pDirect, zBuf, iAmt, iOfst + p->iHeaderSize);
+    } else {
+        rc = p->pRealFile->pMethods->xWrite(p->pRealFile, zBuf, iAmt, iOfst + p->iHeaderSize);
+    }
+    headerDataWritten(p, zBuf, iAmt, iOfst, rc);
+    if (p->pCache) {
+        if (rc == SQLITE_OK) {
+            headerCacheWrite(p->pCache, zBuf, iAmt, iOfst + p->iHeaderSize);
+        } else {
+            headerCacheInvalidate(p->pCache);
+        }
+    }
+    return rc;
+}
+
+/*
+** 从文件读入缓存的头部。文件比头部还短（新建的空文件）时不足的部分为零。
+*/
+static int headerHeaderLoad(HeaderFile *p) {
+    int rc = headerRealRead(p, p->aHeader, p->nHeader, 0);
+    if (rc == SQLITE_IOERR_SHORT_READ) {
+        rc = SQLITE_OK;
+    }
+    p->bHeaderValid = (rc == SQLITE_OK);
+    return rc;
+}
+
+/*
+** 把等待写入的头部写进文件（不同步，随后的 xSync 让它和这次提交的数据一起落盘）。
+*/
+static int headerHeaderFlush(HeaderFile *p) {
+    if (p->nHeaderNew == 0) {
+        return SQLITE_OK;
+    }
+    int rc;
+    if (p->pDirect) {
+        rc = headerDirectWrite(p->pDirect, p->aHeaderNew, p->nHeaderNew, 0);
+    } else {
+        rc = p->pRealFile->pMethods->xWrite(p->pRealFile, p->aHeaderNew, p->nHeaderNew, 0);
+    }
+    if (rc == SQLITE_OK) {
+        if (p->pChanges) {
+            headerChangesMark(p->pChanges, 0, p->nHeaderNew);
+        }
+        memcpy(p->aHeader, p->aHeaderNew, p->nHeaderNew);
+        p->nHeaderNew = 0;
+    }
+    return rc;
+}
+
+/*
+** 写入写回缓冲区中从 aEntry[0] 开始的 n 个连续页。
+** 优先通过登记表的描述符用一次 pwritev 写入；没有可写的描述符（或者在覆盖层模式下）时，
+** 把这些页拼接起来用一次 xWrite 写入，内存不足时逐页写入。
+*/
+static int headerWBufWriteRun(HeaderFile *p, int fd, const HeaderWBufEntry *aEntry, int n) {
+    HeaderWriteBuffer *pWBuf = p->pWBuf;
+    const int szPage = pWBuf->szPage;
+    const sqlite3_int64 iOfst = aEntry[0].iPgno * szPage;
+
+#if HEADER_OS_UNIX
+    if (fd >= 0 && n > 1) {
+        struct iovec aIov[HEADER_WBUF_RUN];
+        for (int i = 0; i < n; i++) {
+            aIov[i].iov_base = &pWBuf->aData[(sqlite3_int64) aEntry[i].iIdx * szPage];
+            aIov[i].iov_len = szPage;
+        }
+        ssize_t nDone;
+        do {
+            nDone = pwritev(fd, aIov, n, iOfst + p->iHeaderSize);
+        } while (nDone < 0 && errno == EINTR);
+        pWBuf->nSyscall++;
+        if (nDone == (ssize_t) n * szPage) {
+            for (int i = 0; p->pCache && i < n; i++) {
+                headerCacheWrite(p->pCache, aIov[i].iov_base, szPage, iOfst + (sqlite3_int64) i * szPage + p->iHeaderSize);
+            }
+            for (int i = 0; i < n; i++) {
+                headerDataWritten(p, aIov[i].iov_base, szPage, iOfst + (sqlite3_int64) i * szPage, SQLITE_OK);
+            }
+            return SQLITE_OK;
+        }
+        /* 出错或者只写入了一部分：交给下面重新写入整段，重写已经写入的部分没有问题 */
+    }
+#else
+    (void) fd;
+#endif
+
+    unsigned char *aRun = (n > 1) ? sqlite3_malloc64((sqlite3_int64) n * szPage) : 0;
+    if (aRun) {
+        for (int i = 0; i < n; i++) {
+            memcpy(&aRun[(sqlite3_int64) i * szPage], &pWBuf->aData[(sqlite3_int64) aEntry[i].iIdx * szPage], szPage);
+        }
+        const int rc = headerWriteThrough(p, aRun, n * szPage, iOfst);
+        pWBuf->nSyscall++;
+        sqlite3_free(aRun);
+        return rc;
+    }
+    int rc = SQLITE_OK;
+    for (int i = 0; rc == SQLITE_OK && i < n; i++) {
+        rc = headerWriteThrough(p, &pWBuf->aData[(sqlite3_int64) aEntry[i].iIdx * szPage], szPage,
+                                iOfst + (sqlite3_int64) i * szPage);
+        pWBuf->nSyscall++;
+    }
+    return rc;
+}
+
+/*
+** 把写回缓冲区中的页按偏移量排序后写出，相邻的页合并为一次写入。
+** 无论成功与否缓冲区都会被清空：写入失败时 SQLite 会回滚事务并从日志恢复这些页。
+*/
+static int headerWBufFlush(HeaderFile *p) {
+    HeaderWriteBuffer *pWBuf = p->pWBuf;
+    if (pWBuf == 0 || pWBuf->nPage == 0) {
+        return SQLITE_OK;
+    }
+    int rc = SQLITE_OK;
+    HeaderWBufEntry *aEntry = sqlite3_malloc64(sizeof(HeaderWBufEntry) * pWBuf->nPage);
+    if (aEntry == 0) {
+        rc = SQLITE_NOMEM;
+    } else {
+        for (int i = 0; i < pWBuf->nPage; i++) {
+            aEntry[i].iPgno = pWBuf->aPgno[i];
+            aEntry[i].iIdx = i;
+        }
+        qsort(aEntry, pWBuf->nPage, sizeof(HeaderWBufEntry), headerWBufCompare);
+
+        /* io_uring 引擎：所有页在一次（或者很少几次）提交中写出 */
+        rc = SQLITE_NOTFOUND;
+        if (p->pUring) {
+            const sqlite3_int64 nEnter = p->pUring->nEnter;
+            rc = headerUringWritePages(p->pUring, pWBuf, aEntry, pWBuf->nPage, p->iHeaderSize);
+            if (rc == SQLITE_NOTFOUND) {
+                headerUringDisable(p);
+            } else {
+                pWBuf->nSyscall += p->pUring->nEnter - nEnter;
+            }
+            for (int i = 0; rc == SQLITE_OK && p->pCache && i < pWBuf->nPage; i++) {
+                headerCacheWrite(p->pCache, &pWBuf->aData[(sqlite3_int64) aEntry[i].iIdx * pWBuf->szPage],
+                                 pWBuf->szPage, aEntry[i].iPgno * pWBuf->szPage + p->iHeaderSize);
+            }
+            for (int i = 0; rc == SQLITE_OK && i < pWBuf->nPage; i++) {
+                headerDataWritten(p, &pWBuf->aData[(sqlite3_int64) aEntry[i].iIdx * pWBuf->szPage],
+                                    pWBuf->szPage, aEntry[i].iPgno * pWBuf->szPage, SQLITE_OK);
+            }
+            if (rc != SQLITE_OK && rc != SQLITE_NOTFOUND && p->pCache) {
+                headerCacheInvalidate(p->pCache);
+            }
+            if (rc != SQLITE_OK && rc != SQLITE_NOTFOUND) {
+                headerDataWritten(p, 0, 0, 0, rc);
+            }
+        }
+
+        if (rc == SQLITE_NOTFOUND) {
+            rc = SQLITE_OK;
+            /* 直接 I/O 时不能用页缓存的描述符，合并后的整段交给 headerWriteThrough */
+            const int fd = (p->pOverlay || p->pDirect) ? -1 : headerInodeFd(p->pInode);
+            for (int i = 0; rc == SQLITE_OK && i < pWBuf->nPage;) {
+                int n = 1;
+                while (i + n < pWBuf->nPage && n < HEADER_WBUF_RUN && aEntry[i + n].iPgno == aEntry[i].iPgno + n) {
+                    n++;
+                }
+                rc = headerWBufWriteRun(p, fd, &aEntry[i], n);
+                i += n;
+            }
+        }
+        sqlite3_free(aEntry);
+    }
+    pWBuf->nFlush++;
+    headerWBufReset(pWBuf);
+    return rc;
+}
+
+/*
+** 把一个整页的写入放进写回缓冲区，缓冲区满时先刷新。
+*/
+static int headerWBufPut(HeaderFile *p, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderWriteBuffer *pWBuf = p->pWBuf;
+    const sqlite3_int64 iPgno = iOfst / iAmt;
+    int iHash;
+    int iIdx = headerWBufFind(pWBuf, iPgno, &iHash);
+    if (iIdx < 0) {
+        if (pWBuf->nPage >= pWBuf->nMax) {
+            const int rc = headerWBufFlush(p);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            headerWBufFind(pWBuf, iPgno, &iHash);
+        }
+        iIdx = pWBuf->nPage++;
+        pWBuf->aPgno[iIdx] = iPgno;
+        pWBuf->aHash[iHash] = iIdx + 1;
+    }
+    memcpy(&pWBuf->aData[(sqlite3_int64) iIdx * pWBuf->szPage], zBuf, iAmt);
+    pWBuf->nWrite++;
+    if (iOfst + iAmt > pWBuf->iEnd) {
+        pWBuf->iEnd = iOfst + iAmt;
+    }
+    return SQLITE_OK;
+}
+
+static int headerClose(sqlite3_file *pFile) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    int rc = SQLITE_OK;
+    headerFileListRemove(p);
+    if (p->pWBuf) {
+        rc = headerWBufFlush(p);
+        headerWBufDestroy(p->pWBuf);
+        p->pWBuf = NULL;
+    }
+    headerChangesClose(p->pChanges);
+    p->pChanges = NULL;
+    headerBatchClose(p->pBatch);
+    p->pBatch = NULL;
+    headerChecksumClose(p->pChecksum);
+    p->pChecksum = NULL;
+    /* 固定文件引用登记表的描述符，必须在释放登记项之前销毁 */
+    headerUringDestroy(p->pUring);
+    p->pUring = NULL;
+    /* 描述符属于登记表，这里只释放状态 */
+    sqlite3_free(p->pDirect);
+    p->pDirect = NULL;
+    if (p->pRealFile) {
+        if (p->pRealFile->pMethods && p->pRealFile->pMethods->xClose) {
+            const int rc2 = p->pRealFile->pMethods->xClose(p->pRealFile);
+            if (rc == SQLITE_OK) {
+                rc = rc2;
+            }
+        }
+        sqlite3_free(p->pRealFile);
+        p->pRealFile = NULL;
+    }
+    headerCacheDestroy(p->pCache);
+    p->pCache = NULL;
+    /* 回放线程使用登记表的描述符，必须先停止 */
+    headerWarmupClose(p->pWarmup);
+    p->pWarmup = NULL;
+    /* 进程内的锁记在登记项的 WAL 索引里，必须在释放登记项之前放掉 */
+    if (p->pHeapWal) {
+        if (p->bShm) {
+            headerHeapWalUnmap(p);
+        }
+        headerHeapWalUnlock(p, SQLITE_LOCK_NONE);
+        p->pHeapWal = NULL;
+    }
+    headerInodeRelease(p->pInode);
+    p->pInode = NULL;
+    headerOverlayClose(p->pOverlay);
+    p->pOverlay = NULL;
+    headerMemFree(p->pMem);
+    p->pMem = NULL;
+    if (p->nHeaderNew > 0) {
+        /* 没有提交过事务，修改和没有提交的事务一起丢弃 */
+        sqlite3_log(SQLITE_NOTICE, "headervfs: header update of %s discarded, no transaction was committed", p->zName);
+    }
+    sqlite3_free(p->aHeader);
+    p->aHeader = p->aHeaderNew = NULL;
+    p->nHeader = p->nHeaderNew = 0;
+    sqlite3_free(p->zAltName);
+    p->zAltName = NULL;
+    if (p->zSnapshot) {
+        /* 快照是私有的，关闭后就没有用了 */
+        p->pRealVfs->xDelete(p->pRealVfs, p->zSnapshot, 0);
+        sqlite3_free(p->zSnapshot);
+        p->zSnapshot = NULL;
+    }
+    return rc;
+}
+
+/*
+** 通知内核在后台读入真实文件中 [iRealOfst, iRealOfst+nByte) 的数据。
+** 平台不支持或者没有可用的描述符时返回 SQLITE_NOTFOUND。
+*/
+static int headerAdvise(const HeaderFile *p, sqlite3_int64 iRealOfst, sqlite3_int64 nByte) {
+#if HEADER_OS_UNIX && defined(POSIX_FADV_WILLNEED)
+    const int fd = headerInodeFd(p->pInode);
+    if (fd >= 0 && posix_fadvise(fd, (off_t) iRealOfst, (off_t) nByte, POSIX_FADV_WILLNEED) == 0) {
+        return SQLITE_OK;
+    }
+#elif HEADER_OS_UNIX && defined(F_RDADVISE)
+    const int fd = headerInodeFd(p->pInode);
+    struct radvisory ra;
+    ra.ra_offset = (off_t) iRealOfst;
+    ra.ra_count = (int) nByte;
+    if (fd >= 0 && fcntl(fd, F_RDADVISE, &ra) != -1) {
+        return SQLITE_OK;
+    }
+#else
+    (void) p;
+    (void) iRealOfst;
+    (void) nByte;
+#endif
+    return SQLITE_NOTFOUND;
+}
+
+/*
+** 记录一次读取的位置，检测到顺序访问时预读下一个窗口。
+*/
+static void headerReadahead(HeaderFile *p, sqlite3_int64 iOfst, int iAmt) {
+    HeaderReadahead *pRa = &p->ra;
+    const sqlite3_int64 iEnd = iOfst + iAmt;
+    if (iOfst >= pRa->iStart && iEnd <= pRa->iEnd) {
+        headerStatAdd(p->stats.nReadaheadHit, 1);
+    }
+    if (iOfst >= pRa->iNext && iOfst <= pRa->iNext + iAmt) {
+        pRa->nSeq++;
+        pRa->nMiss = 0;
+    } else if (++pRa->nMiss < 2) {
+        /* 可能是扫描途中读取的内部页，保留顺序访问的状态 */
+        return;
+    } else {
+        /* 随机访问：回到初始状态 */
+        pRa->nSeq = 0;
+        pRa->szWindow = HEADER_RA_MIN;
+        pRa->iStart = pRa->iEnd = 0;
+    }
+    pRa->iNext = iEnd;
+    if (pRa->nSeq < HEADER_RA_TRIGGER || pRa->iEnd - iEnd >= pRa->szWindow / 2) {
+        return;
+    }
+    const sqlite3_int64 iFrom = (pRa->iEnd > iEnd) ? pRa->iEnd : iEnd;
+    if (headerAdvise(p, iFrom + p->iHeaderSize, pRa->szWindow) != SQLITE_OK) {
+        /* 不支持预读提示，以后不再尝试 */
+        pRa->szMax = 0;
+        return;
+    }
+    headerStatAdd(p->stats.nReadahead, 1);
+    headerStatAdd(p->stats.nReadaheadBytes, pRa->szWindow);
+    if (pRa->iEnd < iEnd) {
+        pRa->iStart = iFrom;
+    }
+    pRa->iEnd = iFrom + pRa->szWindow;
+    pRa->szWindow = (pRa->szWindow * 2 < pRa->szMax) ? pRa->szWindow * 2 : pRa->szMax;
+}
+
+/*
+** 从文件中读取数据。
+** 读取操作在 iOfst + iHeaderSize 的偏移量处执行。
+*/
+static int headerReadData(
+    sqlite3_file *pFile,
+    void *zBuf,
+    int iAmt,
+    sqlite3_int64 iOfst
+) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    if (p->pMem) {
+        return headerMemRead(p->pMem, zBuf, iAmt, iOfst);
+    }
+    if (p->ra.szMax > 0) {
+        headerReadahead(p, iOfst, iAmt);
+    }
+    if (p->pWarmup) {
+        headerWarmupRecord(p->pWarmup, iOfst, iAmt);
+    }
+    if (p->pWBuf && headerWBufOverlaps(p->pWBuf, iOfst, iAmt)) {
+        /* 完全落在一个缓冲页内的读取直接从缓冲区取，其他情况先刷新 */
+        const HeaderWriteBuffer *pWBuf = p->pWBuf;
+        const sqlite3_int64 iPgno = iOfst / pWBuf->szPage;
+        const int iIdx = headerWBufFind(pWBuf, iPgno, 0);
+        if (iIdx >= 0 && iOfst + iAmt <= (iPgno + 1) * pWBuf->szPage) {
+            memcpy(zBuf, &pWBuf->aData[(sqlite3_int64) iIdx * pWBuf->szPage + (iOfst - iPgno * pWBuf->szPage)], iAmt);
+            return SQLITE_OK;
+        }
+        const int rc = headerWBufFlush(p);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    if (p->pOverlay) {
+        return headerOverlayRead(p->pOverlay, p, headerBaseRead, zBuf, iAmt, iOfst);
+    }
+    HeaderShared *pShared = headerSharedOf(p);
+    if (pShared) {
+        return headerSharedRead(pShared, p, headerBaseRead, zBuf, iAmt, iOfst);
+    }
+    return headerBaseRead(p, zBuf, iAmt, iOfst);
+}
+
+/*
+** 向文件中写入数据。
+** 写入操作在 iOfst + iHeaderSize 的偏移量处执行。
+*/
+static int headerWriteData(
+    sqlite3_file *pFile,
+    const void *zBuf,
+    int iAmt,
+    sqlite3_int64 iOfst
+) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    HeaderWriteBuffer *pWBuf = p->pWBuf;
+    HeaderShared *pShared = headerSharedOf(p);
+    if (pShared && headerSharedIsPage(iAmt, iOfst) && iAmt != headerStatGet(pShared->szPage)) {
+        headerSharedPageSize(pShared, iAmt);
+    }
+    if (pWBuf && !p->bShm) {
+        /* 只缓冲按页对齐的整页写入 */
+        const int bPage = iAmt >= 512 && iAmt <= 65536 && (iAmt & (iAmt - 1)) == 0 && iOfst % iAmt == 0;
+        if (bPage && pWBuf->szPage != iAmt) {
+            const int rc = headerWBufFlush(p);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            if (headerWBufSetPageSize(pWBuf, iAmt) != SQLITE_OK) {
+                return headerWriteThrough(p, zBuf, iAmt, iOfst);
+            }
+        }
+        if (bPage) {
+            return headerWBufPut(p, zBuf, iAmt, iOfst);
+        }
+    }
+    if (pWBuf) {
+        const int rc = headerWBufFlush(p);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    return headerWriteThrough(p, zBuf, iAmt, iOfst);
+}
+
+/*
+** 以下两个方法在读写之外记录统计计数。
+*/
+static int headerRead(sqlite3_file *pFile, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_int64 tStart = headerNow();
+    int rc = headerReadData(pFile, zBuf, iAmt, iOfst);
+    if (rc == SQLITE_OK && p->pChecksum) {
+        rc = headerChecksumVerify(p, zBuf, iAmt, iOfst);
+    }
+    headerStatAdd(p->stats.nRead, 1);
+    headerStatAdd(p->stats.nReadBytes, iAmt);
+    headerStatLatency(p->stats.aReadLatency, tStart);
+    return rc;
+}
+
+static int headerWrite(sqlite3_file *pFile, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    if (p->pBatch && p->pBatch->bActive) {
+        /* 批量写入中的页在提交时才写入文件，那时再计数 */
+        return headerBatchAppend(p->pBatch, zBuf, iAmt, iOfst);
+    }
+    if (p->pBatch) {
+        const int rcSettle = headerBatchSettle(p->pBatch);
+        if (rcSettle != SQLITE_OK) {
+            return rcSettle;
+        }
+    }
+    if (p->pChecksum) {
+        const int rcGen = headerChecksumBegin(p);
+        if (rcGen != SQLITE_OK) {
+            return rcGen;
+        }
+    }
+    const sqlite3_int64 tStart = headerNow();
+    int rc = headerWriteData(pFile, zBuf, iAmt, iOfst);
+    if (rc == SQLITE_OK && p->pChecksum && headerChecksumWritten(p->pChecksum, zBuf, iAmt, iOfst) != SQLITE_OK) {
+        /* 没有记下新的校验和，之后读这一页会报告不一致 */
+        rc = SQLITE_IOERR_NOMEM;
+    }
+    headerStatAdd(p->stats.nWrite, 1);
+    headerStatAdd(p->stats.nWriteBytes, iAmt);
+    headerStatLatency(p->stats.aWriteLatency, tStart);
+    return rc;
+}
+
+/*
+** 截断文件。
+** 截断操作在 size + iHeaderSize 的大小处执行。
+*/
+static int headerTruncate(sqlite3_file *pFile, sqlite_int64 size) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    headerStatAdd(p->stats.nTruncate, 1);
+    int rcFlush = headerWBufFlush(p);
+    if (rcFlush == SQLITE_OK && p->pBatch) {
+        rcFlush = headerBatchSettle(p->pBatch);
+    }
+    if (rcFlush == SQLITE_OK && p->pChecksum) {
+        rcFlush = headerChecksumBegin(p);
+    }
+    if (rcFlush != SQLITE_OK) {
+        return rcFlush;
+    }
+    if (p->pOverlay) {
+        return headerOverlayTruncate(p->pOverlay, size);
+    }
+    if (p->szChunk > 0) {
+        /* 与 unix VFS 相同：分块时截断到整块，避免刚释放的空间马上又要重新分配 */
+        size = ((size + p->szChunk - 1) / p->szChunk) * p->szChunk;
+    }
+    /* 变更跟踪：缩短的部分以后再长出来时是零，备份也要重新复制 */
+    sqlite3_int64 iOldSize = -1;
+    if (p->pChanges && p->pRealFile->pMethods->xFileSize(p->pRealFile, &iOldSize) != SQLITE_OK) {
+        iOldSize = -1;
+    }
+    const int rc = p->pRealFile->pMethods->xTruncate(p->pRealFile, size + p->iHeaderSize);
+    if (rc == SQLITE_OK && p->pChecksum) {
+        headerChecksumTruncate(p->pChecksum, size);
+    }
+    if (rc == SQLITE_OK && p->pChanges) {
+        const sqlite3_int64 iNewSize = size + p->iHeaderSize;
+        if (iOldSize < 0) {
+            headerChangesMark(p->pChanges, 0, iNewSize);
+        } else if (iOldSize > iNewSize) {
+            headerChangesMark(p->pChanges, iNewSize, iOldSize - iNewSize);
+        } else {
+            headerChangesMark(p->pChanges, iOldSize, iNewSize - iOldSize);
+        }
+    }
+    if (p->pCache) {
+        if (rc == SQLITE_OK) {
+            headerCacheTruncate(p->pCache, size + p->iHeaderSize);
+        } else {
+            headerCacheInvalidate(p->pCache);
+        }
+    }
+    HeaderShared *pShared = headerSharedOf(p);
+    if (pShared) {
+        if (rc == SQLITE_OK) {
+            headerSharedTruncate(pShared, size);
+        } else {
+            headerSharedInvalidate(pShared);
+        }
+    }
+    return rc;
+}
+
+/*
+** 同步文件。
+** 这是一个到底层 VFS 的简单传递（覆盖层模式下同步增量文件）。
+*/
+static int headerSync(sqlite3_file *pFile, int flags) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    const sqlite3_int64 tStart = headerNow();
+    int rc = headerWBufFlush(p);
+    if (rc == SQLITE_OK) {
+        rc = headerHeaderFlush(p);
+    }
+    /* 修改过的范围和页校验和要先于数据落盘 */
+    if (rc == SQLITE_OK && p->pChanges) {
+        rc = headerChangesSync(p->pChanges, flags);
+    }
+    if (rc == SQLITE_OK && p->pChecksum && p->pChecksum->bWritable) {
+        rc = headerChecksumSave(p, 1);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pLockFile->pMethods->xSync(pLockFile, flags);
+    }
+    /* 原子批量写入的数据已经落盘，日志不再需要 */
+    if (rc == SQLITE_OK && p->pBatch) {
+        rc = headerBatchSynced(p->pBatch);
+    }
+    headerStatAdd(p->stats.nSync, 1);
+    headerStatLatency(p->stats.aSyncLatency, tStart);
+    return rc;
+}
+
+/*
+** 获取文件大小。
+** 报告的大小是物理大小减去头部大小。
+*/
+static int headerFileSize(sqlite3_file *pFile, sqlite_int64 *pSize) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    int rc = SQLITE_OK;
+    if (p->pMem) {
+        *pSize = p->pMem->nData;
+    } else if (p->pOverlay) {
+        *pSize = p->pOverlay->iSize;
+    } else {
+        sqlite3_int64 realSize;
+        rc = p->pRealFile->pMethods->xFileSize(p->pRealFile, &realSize);
+        if (rc == SQLITE_OK) {
+            *pSize = (realSize > p->iHeaderSize) ? (realSize - p->iHeaderSize) : 0;
+        }
+    }
+    /* 写回缓冲区中的页可能位于文件末尾之后 */
+    if (rc == SQLITE_OK && p->pWBuf && p->pWBuf->nPage > 0 && p->pWBuf->iEnd > *pSize) {
+        *pSize = p->pWBuf->iEnd;
+    }
+    return rc;
+}
+
+/*
+** 把真实文件预分配到 iRealSize 字节（文件大小随之扩展），只会增长不会截断。
+** 一次分配整块的空间，文件系统可以给出连续的区段，之后的写入也不必再逐页扩展文件。
+** 平台或文件系统不支持时返回 SQLITE_NOTFOUND，由调用者退回到底层 VFS。
+*/
+static int headerPreallocate(const HeaderFile *p, sqlite3_int64 iRealSize) {
+#if HEADER_OS_UNIX && !defined(__APPLE__)
+    const int fd = headerInodeFd(p->pInode);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        return SQLITE_NOTFOUND;
+    }
+    if (st.st_size >= iRealSize) {
+        return SQLITE_OK;
+    }
+    int err;
+    do {
+#if defined(__linux__)
+        err = (fallocate(fd, 0, st.st_size, iRealSize - st.st_size) == 0) ? 0 : errno;
+#else
+        err = posix_fallocate(fd, st.st_size, iRealSize - st.st_size);
+#endif
+    } while (err == EINTR);
+    if (err == 0) {
+        if (p->pCache) {
+            headerCacheExtend(p->pCache);
+        }
+        return SQLITE_OK;
+    }
+    if (err == ENOSPC) {
+        return SQLITE_FULL;
+    }
+    /* EOPNOTSUPP、只读的描述符等 */
+    return SQLITE_NOTFOUND;
+#else
+    (void) p;
+    (void) iRealSize;
+    return SQLITE_NOTFOUND;
+#endif
+}
+
+/*
+** 读取文件当前的版本号。WAL 模式下是 wal-index 头部的盐值（每次重新开始 WAL 时改变）和检查点
+** 已经写回的帧数，只有检查点会修改数据库文件；回滚日志模式下是文件修改计数器，每次提交都会改变。
+** 第 1 页的写版本（第 18 字节）为 2 表示数据库处于 WAL 模式，这时获得 SHARED 锁时的计数器
+** 不会随提交改变，*peVersion 设为 HEADER_VERSION_NONE，等到读事务开始、映射了共享内存之后再检查。
+** 计数器直接从文件读取（绕过读缓存），读取失败时返回错误码。
+*/
+static int headerFileVersion(HeaderFile *p, int *peVersion, sqlite3_uint64 *piVersion) {
+    if (p->bShm && p->pShm0) {
+        /* WalIndexHdr.aSalt[0] 位于第 32 字节，WalCkptInfo.nBackfill 位于第 96 字节 */
+        const volatile unsigned int *aShm = (const volatile unsigned int *) p->pShm0;
+        *peVersion = HEADER_VERSION_WAL;
+        *piVersion = ((sqlite3_uint64) aShm[8] << 32) | aShm[24];
+        return SQLITE_OK;
+    }
+    unsigned char aHdr[10];
+    int rc = headerRealRead(p, aHdr, sizeof(aHdr), 18 + p->iHeaderSize);
+    if (rc == SQLITE_IOERR_SHORT_READ) {
+        /* 空文件（还没有写入第 1 页）：计数器按 0 处理 */
+        rc = SQLITE_OK;
+    }
+    if (rc == SQLITE_OK) {
+        *peVersion = (aHdr[0] == 2) ? HEADER_VERSION_NONE : HEADER_VERSION_COUNTER;
+        *piVersion = headerGet32(&aHdr[6]);
+    }
+    return rc;
+}
+
+/*
+** 开始读事务时调用：其他连接可能已经修改了文件，重新加载覆盖层的页表。读缓存和共享页缓存
+** 只在文件版本号与上次记录的不同时丢弃，没有修改过的文件在多个短读事务之间一直命中缓存。
+** 回滚日志模式下取得版本号要多读一次文件，只有开启了依赖它的读缓存、共享页缓存或页校验和时才读取；
+** 否则缓存的头部直接按被修改过处理，用到时再重新读取。
+*/
+static int headerBeginRead(HeaderFile *p) {
+    HeaderShared *pShared = headerSharedOf(p);
+    if (p->pCache == 0 && pShared == 0 && p->pChecksum == 0) {
+        p->bHeaderValid = 0;
+        p->eVersion = HEADER_VERSION_NONE;
+        return p->pOverlay ? headerOverlayLoad(p->pOverlay) : SQLITE_OK;
+    }
+    int eVersion = HEADER_VERSION_NONE;
+    sqlite3_uint64 iVersion = 0;
+    const int rcVersion = headerFileVersion(p, &eVersion, &iVersion);
+    if (rcVersion == SQLITE_OK && eVersion == HEADER_VERSION_NONE) {
+        /* WAL 数据库刚获得 SHARED 锁，读事务开始时再检查 */
+    } else if (rcVersion == SQLITE_OK && eVersion == p->eVersion && iVersion == p->iVersion) {
+        if (p->pCache) {
+            p->pCache->nKeep++;
+        }
+    } else {
+        if (p->pCache) {
+            headerCacheInvalidate(p->pCache);
+            p->pCache->nDrop++;
+        }
+        /* 打开时读入的头部保留到第一次发现文件被修改 */
+        if (p->eVersion != HEADER_VERSION_NONE || rcVersion != SQLITE_OK) {
+            p->bHeaderValid = 0;
+        }
+        if (p->pChecksum) {
+            p->pChecksum->bStale = 1;
+        }
+        p->eVersion = (rcVersion == SQLITE_OK) ? eVersion : HEADER_VERSION_NONE;
+        p->iVersion = iVersion;
+    }
+    if (pShared && rcVersion != SQLITE_OK) {
+        headerSharedInvalidate(pShared);
+    } else if (pShared && eVersion != HEADER_VERSION_NONE) {
+        headerSharedVersion(pShared, eVersion, iVersion, 0);
+    }
+    return p->pOverlay ? headerOverlayLoad(p->pOverlay) : SQLITE_OK;
+}
+
+/*
+** 加锁。
+** 从无锁状态获得 SHARED 锁时，其他连接可能已经修改了文件，需要丢弃读缓存。
+*/
+static int headerLock(sqlite3_file *pFile, int eLock) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    if (p->bImmutable) {
+        /* 不可变的文件不需要加锁，SQLite 看到 SQLITE_IOCAP_IMMUTABLE 之后一般也不会调用这里 */
+        p->eLock = eLock;
+        return SQLITE_OK;
+    }
+    sqlite3_file *pLockFile = headerLockFile(p);
+    int rc = p->pHeapWal ? headerHeapWalLock(p, eLock) : pLockFile->pMethods->xLock(pLockFile, eLock);
+    if ((rc & 0xff) == SQLITE_BUSY) {
+        headerStatAdd(p->stats.nLockBusy, 1);
+    }
+    if (rc == SQLITE_OK) {
+        headerStatAdd(p->stats.nLock, 1);
+        p->eLock = eLock;
+        if (eLock == SQLITE_LOCK_SHARED) {
+            rc = headerBeginRead(p);
+        }
+        /* 重放没有完成的原子批量写入，失败时已经放掉了锁 */
+        if (rc == SQLITE_OK && eLock == SQLITE_LOCK_SHARED && p->pBatch) {
+            rc = headerBatchRecover(p, pLockFile);
+            if (rc != SQLITE_OK) {
+                p->eLock = SQLITE_LOCK_NONE;
+            }
+        }
+    }
+    return rc;
+}
+
+/*
+** 解锁。
+** 其他连接在我们解锁之后就可能读取文件，写回缓冲区必须先刷新。正常的提交在
+** SQLITE_FCNTL_SYNC 时已经刷新过了，这里只是兜底。
+*/
+static int headerUnlock(sqlite3_file *pFile, int eLock) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    if (p->bImmutable) {
+        p->eLock = eLock;
+        return SQLITE_OK;
+    }
+    sqlite3_file *pLockFile = headerLockFile(p);
+    int rcFlush = headerWBufFlush(p);
+    /* 回滚（或者 synchronous=OFF 时的提交）不会同步，修改过的范围在放锁之前合并进旁路文件 */
+    if (rcFlush == SQLITE_OK && p->pChanges) {
+        rcFlush = headerChangesPersist(p->pChanges);
+    }
+    /* 其他进程放锁之后就会读到这些页，校验和也要写回旁路文件 */
+    if (rcFlush == SQLITE_OK && p->pChecksum && p->pChecksum->bWritable) {
+        rcFlush = headerChecksumSave(p, 0);
+    }
+    const int rc = p->pHeapWal ? headerHeapWalUnlock(p, eLock) : pLockFile->pMethods->xUnlock(pLockFile, eLock);
+    if (rc == SQLITE_OK) {
+        p->eLock = eLock;
+    }
+    return (rcFlush != SQLITE_OK) ? rcFlush : rc;
+}
+
+/*
+** 以下都是简单的传递方法。
+*/
+static int headerCheckReservedLock(sqlite3_file *pFile, int *pResOut) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    if (p->bImmutable) {
+        *pResOut = 0;
+        return SQLITE_OK;
+    }
+    if (p->pHeapWal) {
+        *pResOut = headerHeapWalCheckReserved(p);
+        return SQLITE_OK;
+    }
+    sqlite3_file *pLockFile = headerLockFile(p);
+    return pLockFile->pMethods->xCheckReservedLock(pLockFile, pResOut);
+}
+
+/*
+** 文件控制。
+** 涉及文件大小的请求需要把逻辑大小换算成物理大小，其余的直接传递。
+*/
+static int headerFileControl(sqlite3_file *pFile, int op, void *pArg) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    switch (op) {
+        case HEADERVFS_FCNTL_OVERLAY_MERGE: {
+            const int rc = headerWBufFlush(p);
+            return (rc != SQLITE_OK) ? rc : headerOverlayMerge(p, (sqlite3_int64 *) pArg);
+        }
+        case HEADERVFS_FCNTL_STATS: {
+            HeaderVfsStats *pStats = (HeaderVfsStats *) pArg;
+            memset(pStats, 0, sizeof(HeaderVfsStats));
+            headerStatsAccumulate(pStats, &p->stats);
+            return SQLITE_OK;
+        }
+        case SQLITE_FCNTL_BEGIN_ATOMIC_WRITE:
+        case SQLITE_FCNTL_COMMIT_ATOMIC_WRITE:
+        case SQLITE_FCNTL_ROLLBACK_ATOMIC_WRITE: {
+            HeaderBatch *pB = p->pBatch;
+            if (pB == 0 || !pB->bWritable) {
+                return pLockFile->pMethods->xFileControl(pLockFile, op, pArg);
+            }
+            if (op == SQLITE_FCNTL_COMMIT_ATOMIC_WRITE) {
+                return headerBatchCommit(p);
+            }
+            if (op == SQLITE_FCNTL_ROLLBACK_ATOMIC_WRITE && pB->bActive) {
+                /* 缓冲区超过上限或者写入失败，SQLite 改用回滚日志 */
+                headerStatAdd(p->stats.nAtomicFallback, 1);
+            }
+            pB->bActive = (op == SQLITE_FCNTL_BEGIN_ATOMIC_WRITE);
+            pB->nBuf = HEADER_BATCH_HDR;
+            return SQLITE_OK;
+        }
+        case HEADERVFS_FCNTL_CHANGES:
+        case HEADERVFS_FCNTL_CHANGES_RESET: {
+            if (p->pChanges == 0) {
+                return SQLITE_NOTFOUND;
+            }
+            sqlite3_int64 iSize = 0;
+            int rc = headerWBufFlush(p);
+            if (rc == SQLITE_OK) {
+                rc = p->pRealFile->pMethods->xFileSize(p->pRealFile, &iSize);
+            }
+            if (rc == SQLITE_OK) {
+                rc = headerChangesRead(p->pChanges, op == HEADERVFS_FCNTL_CHANGES_RESET, iSize, (HeaderVfsChanges *) pArg);
+            }
+            return rc;
+        }
+        case HEADERVFS_FCNTL_HEADER_READ: {
+            /* 缓存的头部，加上还没有写入的修改 */
+            HeaderVfsHeader *pHdr = (HeaderVfsHeader *) pArg;
+            if (p->nHeader > 0 && !p->bHeaderValid) {
+                const int rc = headerHeaderLoad(p);
+                if (rc != SQLITE_OK) {
+                    return rc;
+                }
+            }
+            const int n = (pHdr->nData < p->nHeader) ? pHdr->nData : p->nHeader;
+            if (n > 0) {
+                memcpy(pHdr->aData, p->aHeader, n);
+                memcpy(pHdr->aData, p->aHeaderNew, (n < p->nHeaderNew) ? n : p->nHeaderNew);
+            }
+            pHdr->nData = p->nHeader;
+            return SQLITE_OK;
+        }
+        case HEADERVFS_FCNTL_HEADER_WRITE: {
+            /* 只修改内存中的副本，下一次同步时与提交的数据一起写入 */
+            const HeaderVfsHeader *pHdr = (const HeaderVfsHeader *) pArg;
+            if (pHdr->nData < 0 || pHdr->nData > p->nHeader) {
+                return SQLITE_TOOBIG;
+            }
+            if (p->bReadOnly) {
+                return SQLITE_READONLY;
+            }
+            if (pHdr->nData > 0 && !p->bHeaderValid) {
+                const int rc = headerHeaderLoad(p);
+                if (rc != SQLITE_OK) {
+                    return rc;
+                }
+            }
+            if (pHdr->nData > p->nHeaderNew) {
+                memcpy(&p->aHeaderNew[p->nHeaderNew], &p->aHeader[p->nHeaderNew], pHdr->nData - p->nHeaderNew);
+                p->nHeaderNew = pHdr->nData;
+            }
+            memcpy(p->aHeaderNew, pHdr->aData, pHdr->nData);
+            return SQLITE_OK;
+        }
+        case SQLITE_FCNTL_SYNC: {
+            /*
+            ** 提交时 SQLite 写完所有脏页之后、删除（或重置）日志之前总会发出这个请求，
+            ** 即使 synchronous=OFF 不会调用 xSync。在这里刷新写回缓冲区，写入等待中的头部。
+            */
+            int rc = headerWBufFlush(p);
+            if (rc == SQLITE_OK) {
+                rc = headerHeaderFlush(p);
+            }
+            if (rc == SQLITE_OK && p->pChanges) {
+                rc = headerChangesPersist(p->pChanges);
+            }
+            if (rc == SQLITE_OK && p->pChecksum && p->pChecksum->bWritable) {
+                rc = headerChecksumSave(p, 0);
+            }
+            /* synchronous=OFF 时之后没有 xSync，原子批量写入的日志在这里截断 */
+            if (rc == SQLITE_OK && p->pBatch && p->pBatch->eSync == 0) {
+                rc = headerBatchSynced(p->pBatch);
+            }
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            return pLockFile->pMethods->xFileControl(pLockFile, op, pArg);
+        }
+        case SQLITE_FCNTL_CHUNK_SIZE:
+            /*
+            ** 不传给底层 VFS：它会按物理大小对齐，使逻辑文件的末尾差一个头部。
+            ** 分块由下面的 SIZE_HINT 和 headerTruncate 按逻辑大小处理。
+            */
+            p->szChunk = (*(int *) pArg > 0) ? *(int *) pArg : 0;
+            return SQLITE_OK;
+        case SQLITE_FCNTL_SIZE_HINT: {
+            if (p->pOverlay) {
+                /* 增量文件按页追加，用不上大小提示 */
+                return SQLITE_OK;
+            }
+            if (p->szChunk > 0) {
+                const sqlite3_int64 iHint = *(sqlite3_int64 *) pArg;
+                const sqlite3_int64 iSize = ((iHint + p->szChunk - 1) / p->szChunk) * p->szChunk;
+                const int rc = headerPreallocate(p, iSize + p->iHeaderSize);
+                if (rc != SQLITE_NOTFOUND) {
+                    return rc;
+                }
+            }
+            /* 底层 VFS 可能会据此扩展（甚至截断）文件并重新映射，必须加上头部 */
+            sqlite3_int64 iHint = *(sqlite3_int64 *) pArg + p->iHeaderSize;
+            return p->pRealFile->pMethods->xFileControl(p->pRealFile, op, &iHint);
+        }
+        case SQLITE_FCNTL_MMAP_SIZE: {
+            /* 映射包含头部，限制也要相应放大；返回的旧值再换算回逻辑大小 */
+            sqlite3_int64 iLimit = *(sqlite3_int64 *) pArg;
+            if (iLimit > 0) {
+                iLimit += p->iHeaderSize;
+            }
+            const int rc = p->pRealFile->pMethods->xFileControl(p->pRealFile, op, &iLimit);
+            if (rc == SQLITE_OK) {
+                *(sqlite3_int64 *) pArg = (iLimit > p->iHeaderSize) ? (iLimit - p->iHeaderSize) : iLimit;
+            }
+            return rc;
+        }
+        case SQLITE_FCNTL_PRAGMA: {
+            char **azArg = (char **) pArg;
+            /* PRAGMA synchronous 仍然由 SQLite 处理，这里只记下原子批量写入要遵循的级别 */
+            if (p->pBatch && azArg[2] && sqlite3_stricmp(azArg[1], "synchronous") == 0) {
+                headerBatchSyncLevel(p->pBatch, azArg[2]);
+            }
+            /* PRAGMA headervfs_cache_stats：返回对齐读缓存的统计计数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_cache_stats") == 0) {
+                const HeaderReadCache *pCache = p->pCache;
+                if (pCache) {
+                    azArg[0] = sqlite3_mprintf(
+                        "block=%d slots=%d hits=%lld misses=%lld reads=%lld bytes=%lld kept=%lld dropped=%lld",
+                        pCache->szBlock, pCache->nSlot, pCache->nHit, pCache->nMiss,
+                        pCache->nRealRead, pCache->nRealBytes, pCache->nKeep, pCache->nDrop
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_write_buffer：返回写回缓冲区的统计计数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_write_buffer") == 0) {
+                const HeaderWriteBuffer *pWBuf = p->pWBuf;
+                if (pWBuf) {
+                    azArg[0] = sqlite3_mprintf(
+                        "pending=%d writes=%lld flushes=%lld syscalls=%lld",
+                        pWBuf->nPage, pWBuf->nWrite, pWBuf->nFlush, pWBuf->nSyscall
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_base_vfs：返回实际打开文件的底层 VFS 的名字 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_base_vfs") == 0) {
+                azArg[0] = sqlite3_mprintf("%s", p->pRealVfs->zName);
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_snapshot：返回快照副本的路径 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_snapshot") == 0) {
+                azArg[0] = sqlite3_mprintf("%s", p->zSnapshot ? p->zSnapshot : "off");
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_memory：返回内存镜像的大小、内存来源和加载耗时 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_memory") == 0) {
+                const HeaderMemImage *pMem = p->pMem;
+                if (pMem) {
+                    azArg[0] = sqlite3_mprintf(
+                        "bytes=%lld backing=%s load_us=%lld",
+                        pMem->nData, pMem->zBacking, pMem->tLoad / 1000
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_wal_index：返回 WAL 索引的位置，在堆内存中时还返回它的大小 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_wal_index") == 0) {
+                if (p->pHeapWal) {
+                    int nRegion = 0;
+                    sqlite3_int64 nByte = 0;
+                    headerHeapWalSize(p->pHeapWal, &nRegion, &nByte);
+                    azArg[0] = sqlite3_mprintf("heap regions=%d bytes=%lld", nRegion, nByte);
+                } else {
+                    azArg[0] = sqlite3_mprintf("shm");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_page_checksum：返回 CRC32C 的实现、页大小和核对过的页数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_page_checksum") == 0) {
+                const HeaderChecksum *pCk = p->pChecksum;
+                if (pCk) {
+                    azArg[0] = sqlite3_mprintf(
+                        "crc32c=%s page_size=%d pages=%lld verified=%lld",
+                        headerCrc32cName, pCk->szPage, pCk->nSum, pCk->nVerify
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_immutable：返回不可变模式打开时记录的文件大小和修改时间 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_immutable") == 0) {
+                if (p->bImmutable) {
+                    azArg[0] = sqlite3_mprintf("size=%lld mtime_ns=%lld", p->iImmSize, p->iImmMtime);
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_io_uring：返回 io_uring 引擎的统计计数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_io_uring") == 0) {
+                const HeaderUring *pU = p->pUring;
+                if (pU) {
+                    azArg[0] = sqlite3_mprintf(
+                        "entries=%u fixed_buffer=%d enters=%lld ops=%lld",
+                        pU->nEntry, pU->bFixed, pU->nEnter, pU->nOp
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_page_cache：返回共享页缓存的容量和统计计数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_page_cache") == 0) {
+                HeaderShared *pShared = headerSharedOf(p);
+                if (pShared) {
+                    azArg[0] = sqlite3_mprintf(
+                        "size=%lld page_size=%lld pages=%d hits=%lld misses=%lld evictions=%lld invalidations=%lld",
+                        pShared->szMax, headerStatGet(pShared->szPage), headerSharedCount(pShared),
+                        headerStatGet(pShared->nHit), headerStatGet(pShared->nMiss),
+                        headerStatGet(pShared->nEvict), headerStatGet(pShared->nInvalidate)
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_direct_io：返回直接 I/O 的对齐要求和读写计数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_direct_io") == 0) {
+                const HeaderDirect *pD = p->pDirect;
+                if (pD) {
+                    azArg[0] = sqlite3_mprintf(
+                        "align=%d reads=%lld writes=%lld rmw_blocks=%lld",
+                        pD->szAlign, pD->nRead, pD->nWrite, pD->nRmw
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_warmup：返回启动预热的记录和回放进度 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_warmup") == 0) {
+                HeaderWarmup *pW = p->pWarmup;
+                if (pW) {
+                    azArg[0] = sqlite3_mprintf(
+                        "recording=%d recorded=%d replayed=%d/%d replay_us=%lld",
+                        pW->tDeadline != 0, pW->nRecord, headerStatGet(pW->nReplayed), pW->nReplay,
+                        headerStatGet(pW->tReplay) / 1000
+                    );
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            /* PRAGMA headervfs_overlay：返回增量文件的路径和其中的页数 */
+            if (sqlite3_stricmp(azArg[1], "headervfs_overlay") == 0) {
+                const HeaderOverlay *pOv = p->pOverlay;
+                if (pOv) {
+                    azArg[0] = sqlite3_mprintf("%s pages=%d", pOv->zDelta, pOv->nEntry);
+                } else {
+                    azArg[0] = sqlite3_mprintf("off");
+                }
+                return SQLITE_OK;
+            }
+            return pLockFile->pMethods->xFileControl(pLockFile, op, pArg);
+        }
+        default:
+            return pLockFile->pMethods->xFileControl(pLockFile, op, pArg);
+    }
+}
+
+static int headerSectorSize(sqlite3_file *pFile) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    return pLockFile->pMethods->xSectorSize(pLockFile);
+}
+
+/*
+** 内存镜像和不可变模式的文件不会再改变：声明为不可变，SQLite 不再加锁，也不再检查热日志和 WAL。
+*/
+static int headerDeviceCharacteristics(sqlite3_file *pFile) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    const int iDc = pLockFile->pMethods->xDeviceCharacteristics(pLockFile);
+    if (p->pBatch && p->pBatch->bWritable) {
+        return iDc | SQLITE_IOCAP_BATCH_ATOMIC;
+    }
+    return (p->pMem || p->bImmutable) ? (iDc | SQLITE_IOCAP_IMMUTABLE) : iDc;
+}
+
+/*
+** 以下是为 WAL 支持的传递方法。
+*/
+static int headerShmMap(
+    sqlite3_file *pFile,
+    int iPg,
+    int pgsz,
+    int bExtend,
+    void volatile **pp
+) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    /*
+    ** WAL 模式下只有检查点写数据库文件，而检查点在 synchronous=OFF 时不会同步，
+    ** 无法确定刷新的时机，所以映射共享内存之后不再使用写回缓冲区。
+    */
+    int rc = headerWBufFlush(p);
+    if (rc == SQLITE_OK && p->pHeapWal) {
+        rc = headerHeapWalMap(p, iPg, pgsz, bExtend, pp);
+    } else if (rc == SQLITE_OK) {
+        rc = pLockFile->pMethods->xShmMap(pLockFile, iPg, pgsz, bExtend, pp);
+    }
+    if (rc == SQLITE_OK) {
+        p->bShm = 1;
+        if (iPg == 0) {
+            p->pShm0 = *pp;
+        }
+    }
+    return rc;
+}
+
+/*
+** WAL 模式下数据库文件一直持有 SHARED 锁，检查点可能在两次读事务之间修改文件。
+** 每个读事务开始时都会获取一个读标记锁（偏移量 3 及以后），此时检查文件版本号。
+*/
+static int headerShmLock(sqlite3_file *pFile, int offset, int n, int flags) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    int rc = p->pHeapWal ? headerHeapWalShmLock(p, offset, n, flags)
+                         : pLockFile->pMethods->xShmLock(pLockFile, offset, n, flags);
+    if ((rc & 0xff) == SQLITE_BUSY) {
+        headerStatAdd(p->stats.nShmLockBusy, 1);
+    }
+    if (rc == SQLITE_OK && offset >= 3 && flags == (SQLITE_SHM_LOCK | SQLITE_SHM_SHARED)) {
+        rc = headerBeginRead(p);
+    }
+    return rc;
+}
+
+static void headerShmBarrier(sqlite3_file *pFile) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    if (p->pHeapWal) {
+        headerHeapWalBarrier(p);
+        return;
+    }
+    pLockFile->pMethods->xShmBarrier(pLockFile);
+}
+
+static int headerShmUnmap(sqlite3_file *pFile, int deleteFlag) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    sqlite3_file *pLockFile = headerLockFile(p);
+    int rc = SQLITE_OK;
+    if (p->pHeapWal) {
+        headerHeapWalUnmap(p);
+    } else {
+        rc = pLockFile->pMethods->xShmUnmap(pLockFile, deleteFlag);
+    }
+    p->bShm = 0;
+    p->pShm0 = 0;
+    return rc;
+}
+
+/*
+** 以下是为内存映射 I/O（mmap）支持的方法。
+**
+** 底层 VFS（unix）映射的是整个真实文件（包含头部），而且对偏移量没有对齐要求，
+** 所以这里只需要把逻辑偏移量加上 iHeaderSize，就能拿到指向对应页的指针。
+** 映射的建立、随文件增长/截断重新映射，都由底层 VFS 在处理
+** SQLITE_FCNTL_MMAP_SIZE、SQLITE_FCNTL_SIZE_HINT 和 xTruncate 时完成，
+** 因此 headerFileControl 必须把这些请求中的大小换算成物理大小。
+**
+** 如果底层文件不支持 xFetch，或者映射无法覆盖请求的范围，返回 *pp = 0，
+** SQLite 会退回到 headerRead。内存模式下直接返回镜像中的指针。
+*/
+static int headerFetch(sqlite3_file *pFile, sqlite3_int64 iOfst, int iAmt, void **pp) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_io_methods *pMethods = p->pRealFile->pMethods;
+    *pp = 0;
+    if (p->pChecksum) {
+        /* 映射的页每次使用都要核对；退回到 headerRead，读进 SQLite 的页缓存时核对一次 */
+        return SQLITE_OK;
+    }
+    if (p->pMem) {
+        if (iOfst + iAmt <= p->pMem->nData) {
+            *pp = &p->pMem->aData[iOfst];
+        }
+        return SQLITE_OK;
+    }
+    if (p->pDirect) {
+        /* 映射会把页读进内核页缓存，直接 I/O 时总是退回到 headerRead */
+        return SQLITE_OK;
+    }
+    if (pMethods->iVersion < 3 || pMethods->xFetch == 0) {
+        return SQLITE_OK;
+    }
+    if (p->pWBuf && headerWBufOverlaps(p->pWBuf, iOfst, iAmt)) {
+        /* 映射中还是旧的内容，退回到 headerRead 从写回缓冲区读取 */
+        return SQLITE_OK;
+    }
+    if (p->pOverlay) {
+        /* 只有完全来自基础文件的页才能直接映射 */
+        const HeaderOverlay *pOv = p->pOverlay;
+        if (iOfst + iAmt > pOv->iBaseLimit
+            || (pOv->szPage > 0 && (iOfst % pOv->szPage) + iAmt > pOv->szPage)
+            || (pOv->szPage > 0 && headerOverlayFind(pOv, iOfst / pOv->szPage) >= 0)
+        ) {
+            return SQLITE_OK;
+        }
+    }
+    return pMethods->xFetch(p->pRealFile, iOfst + p->iHeaderSize, iAmt, pp);
+}
+
+static int headerUnfetch(sqlite3_file *pFile, sqlite3_int64 iOfst, void *pPage) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_io_methods *pMethods = p->pRealFile->pMethods;
+    if (p->pMem) {
+        return SQLITE_OK;
+    }
+    if (pMethods->iVersion < 3 || pMethods->xUnfetch == 0) {
+        return SQLITE_OK;
+    }
+    return pMethods->xUnfetch(p->pRealFile, iOfst + p->iHeaderSize, pPage);
+}
+
+
+/****************************************************************************
+** 非主数据库文件（日志、WAL、临时文件等）的传递方法
+**
+** 这些文件没有头部，但 SQLite 传给我们的 sqlite3_file 指针是 HeaderFile，
+** 不能直接把底层文件的 pMethods 交给 SQLite，必须经由 pRealFile 转发。
+****************************************************************************/
+
+static int passRead(sqlite3_file *pFile, void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_int64 tStart = headerNow();
+    const int rc = p->pRealFile->pMethods->xRead(p->pRealFile, zBuf, iAmt, iOfst);
+    headerStatAdd(p->stats.nRead, 1);
+    headerStatAdd(p->stats.nReadBytes, iAmt);
+    headerStatLatency(p->stats.aReadLatency, tStart);
+    return rc;
+}
+
+static int passWrite(sqlite3_file *pFile, const void *zBuf, int iAmt, sqlite3_int64 iOfst) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_int64 tStart = headerNow();
+    const int rc = p->pRealFile->pMethods->xWrite(p->pRealFile, zBuf, iAmt, iOfst);
+    headerStatAdd(p->stats.nWrite, 1);
+    headerStatAdd(p->stats.nWriteBytes, iAmt);
+    headerStatLatency(p->stats.aWriteLatency, tStart);
+    return rc;
+}
+
+static int passTruncate(sqlite3_file *pFile, sqlite_int64 size) {
+    HeaderFile *p = (HeaderFile *) pFile;
+    headerStatAdd(p->stats.nTruncate, 1);
+    return p->pRealFile->pMethods->xTruncate(p->pRealFile, size);
+}
+
+static int passFileSize(sqlite3_file *pFile, sqlite_int64 *pSize) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    return p->pRealFile->pMethods->xFileSize(p->pRealFile, pSize);
+}
+
+static int passFileControl(sqlite3_file *pFile, int op, void *pArg) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    return p->pRealFile->pMethods->xFileControl(p->pRealFile, op, pArg);
+}
+
+static int passFetch(sqlite3_file *pFile, sqlite3_int64 iOfst, int iAmt, void **pp) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_io_methods *pMethods = p->pRealFile->pMethods;
+    *pp = 0;
+    if (pMethods->iVersion < 3 || pMethods->xFetch == 0) {
+        return SQLITE_OK;
+    }
+    return pMethods->xFetch(p->pRealFile, iOfst, iAmt, pp);
+}
+
+static int passUnfetch(sqlite3_file *pFile, sqlite3_int64 iOfst, void *pPage) {
+    const HeaderFile *p = (HeaderFile *) pFile;
+    const sqlite3_io_methods *pMethods = p->pRealFile->pMethods;
+    if (pMethods->iVersion < 3 || pMethods->xUnfetch == 0) {
+        return SQLITE_OK;
+    }
+    return pMethods->xUnfetch(p->pRealFile, iOfst, pPage);
+}
+
+
+/****************************************************************************
+** 选项
+****************************************************************************/
+
+/*
+** 查找选项 zKey 的值：先查 URI 参数，再查 VFS 实例的默认选项。
+** 都没有时返回 NULL。
+*/
+static const char *headerOption(const HeaderVfs *pHv, const char *zName, const char *zKey) {
+    if (zName) {
+        const char *zVal = sqlite3_uri_parameter(zName, zKey);
+        if (zVal) {
+            return zVal;
+        }
+    }
+    for (int i = 0; i < pHv->nOption; i++) {
+        if (strcmp(pHv->azOption[2 * i], zKey) == 0) {
+            return pHv->azOption[2 * i + 1];
+        }
+    }
+    return 0;
+}
+
+static int headerOptionBool(const HeaderVfs *pHv, const char *zName, const char *zKey) {
+    const char *zVal = headerOption(pHv, zName, zKey);
+    if (zVal == 0) {
+        return 0;
+    }
+    return sqlite3_stricmp(zVal, "1") == 0 || sqlite3_stricmp(zVal, "on") == 0
+           || sqlite3_stricmp(zVal, "true") == 0 || sqlite3_stricmp(zVal, "yes") == 0;
+}
+
+static sqlite3_int64 headerOptionInt64(
+    const HeaderVfs *pHv,
+    const char *zName,
+    const char *zKey,
+    sqlite3_int64 iDflt
+) {
+    const char *zVal = headerOption(pHv, zName, zKey);
+    if (zVal == 0 || zVal[0] == 0) {
+        return iDflt;
+    }
+    char *zEnd = 0;
+    const sqlite3_int64 iVal = strtoll(zVal, &zEnd, 0);
+    return (zEnd && *zEnd == 0) ? iVal : iDflt;
+}
+
+static int headerOpen(sqlite3_vfs *pVfs, const char *zName, sqlite3_file *pFile, int flags, int *pOutFlags);
+
+/*
+** 按名字查找底层 VFS。名字是另一个 headervfs 实例时叠加在它下面的真实 VFS 上，
+** 避免头部被跳过两次。找不到时返回 NULL。
+*/
+static sqlite3_vfs *headerFindBaseVfs(const char *zBase) {
+    sqlite3_vfs *pBase = sqlite3_vfs_find(zBase);
+    if (pBase != 0 && pBase->xOpen == headerOpen) {
+        pBase = pBase->pAppData;
+    }
+    return pBase;
+}
+
+/*
+** 打开 zName 使用的底层 VFS：URI 参数 base_vfs 优先，否则是实例注册时确定的 pAppData。
+** base_vfs 指定的 VFS 不存在时返回 NULL。
+*/
+static sqlite3_vfs *headerBaseVfs(sqlite3_vfs *pVfs, const char *zName) {
+    const char *zBase = zName ? sqlite3_uri_parameter(zName, "base_vfs") : 0;
+    if (zBase == 0 || zBase[0] == 0) {
+        return pVfs->pAppData;
+    }
+    return headerFindBaseVfs(zBase);
+}
+
+/*
+** 底层 VFS 是否是 unix 系列（unix、unix-excl、unix-none、unix-dotfile 等共用同一个 xOpen）。
+** 只有这时数据才直接存放在 zName 指向的文件里，登记表的描述符才能用来读写、克隆和预分配；
+** 内存 VFS 或者自己带缓存的 VFS 下，绕过它们直接访问同名文件会得到错误的结果。
+*/
+static int headerBaseVfsIsUnix(const sqlite3_vfs *pRealVfs) {
+    const sqlite3_vfs *pUnix = sqlite3_vfs_find("unix");
+    return pUnix != 0 && pRealVfs->xOpen == pUnix->xOpen;
+}
+
+/*
+** 覆盖层增量文件的路径：overlay=1 时为 "<数据库>-overlay"，否则就是参数的值。
+** 未开启时返回 NULL，返回值由调用者用 sqlite3_free() 释放。
+** zName 可以是主数据库、日志或 WAL 的文件名。
+*/
+static char *headerOverlayPath(const HeaderVfs *pHv, const char *zName) {
+    const char *zVal = headerOption(pHv, zName, "overlay");
+    if (zVal == 0 || zVal[0] == 0 || sqlite3_stricmp(zVal, "0") == 0 || sqlite3_stricmp(zVal, "off") == 0
+        || sqlite3_stricmp(zVal, "false") == 0 || sqlite3_stricmp(zVal, "no") == 0
+    ) {
+        return 0;
+    }
+    if (headerOptionBool(pHv, zName, "overlay")) {
+        return sqlite3_mprintf("%s-overlay", sqlite3_filename_database(zName));
+    }
+    return sqlite3_mprintf("%s", zVal);
+}
+
+/*
+** zPath 是 SQLite 生成的日志或 WAL 文件名（"<数据库>-journal" 或 "<数据库>-wal"）时返回后缀，
+** 否则返回 NULL。
+*/
+static const char *headerJournalSuffix(const char *zPath) {
+    const char *zDb = sqlite3_filename_database(zPath);
+    const size_t nDb = strlen(zDb);
+    if (zDb == zPath || strncmp(zPath, zDb, nDb) != 0) {
+        return 0;
+    }
+    const char *zSuffix = zPath + nDb;
+    if (strcmp(zSuffix, "-journal") != 0 && strcmp(zSuffix, "-wal") != 0) {
+        return 0;
+    }
+    return zSuffix;
+}
+
+/*
+** 覆盖层模式下日志和 WAL 跟随增量文件：把 "<数据库>-journal" 映射为 "<增量文件>-journal"，
+** WAL 同理。这样基础文件所在的目录可以是只读的。不需要重定向时返回 NULL。
+*/
+static char *headerOverlayRedirect(const HeaderVfs *pHv, const char *zPath) {
+    const char *zSuffix = headerJournalSuffix(zPath);
+    if (zSuffix == 0) {
+        return 0;
+    }
+    char *zDelta = headerOverlayPath(pHv, zPath);
+    if (zDelta == 0) {
+        return 0;
+    }
+    char *zRedirect = sqlite3_mprintf("%s%s", zDelta, zSuffix);
+    sqlite3_free(zDelta);
+    return zRedirect;
+}
+
+/*
+** 日志目录（journal_dir 参数）：把 "<数据库>-journal" 映射为 "<目录>/<数据库文件名>.<完整路径的哈希>.journal"，
+** WAL 为 ".wal"。哈希让不同目录下同名的数据库不会共用一个日志。文件名不以 "-journal" 结尾，
+** unix VFS 不会再去掉 "-" 之后的部分查找数据库文件来决定新文件的权限（那个文件并不存在）。
+** -shm 文件由底层 VFS 按数据库文件名决定，仍然在数据库旁边。
+*/
+static char *headerJournalDirName(const char *zDir, const char *zDb, const char *zExt) {
+    const char *zBase = zDb;
+    sqlite3_uint64 h = 0xcbf29ce484222325ULL;  /* FNV-1a */
+    for (const char *z = zDb; *z; z++) {
+        if (*z == '/' || *z == '\\') {
+            zBase = z + 1;
+        }
+        h = (h ^ (unsigned char) *z) * 0x100000001b3ULL;
+    }
+    return sqlite3_mprintf("%s/%s.%016llx.%s", zDir, zBase, h, zExt);
+}
+
+/* zPath 是日志或 WAL 文件名并且设置了 journal_dir 时返回日志目录下的路径，否则返回 NULL */
+static char *headerJournalDirRedirect(const HeaderVfs *pHv, const char *zPath) {
+    const char *zSuffix = headerJournalSuffix(zPath);
+    const char *zDir = zSuffix ? headerOption(pHv, zPath, "journal_dir") : 0;
+    if (zDir == 0 || zDir[0] == 0) {
+        return 0;
+    }
+    return headerJournalDirName(zDir, sqlite3_filename_database(zPath), zSuffix + 1);
+}
+
+/*
+** 日志和 WAL 文件实际使用的文件名：覆盖层模式下跟随增量文件，否则放在日志目录下。
+** 打开、删除和检查文件是否存在时都经过这里，保证 SQLite 看到的是同一个文件。不需要重定向时返回 NULL。
+*/
+static char *headerRedirect(const HeaderVfs *pHv, const char *zPath) {
+    char *zRedirect = headerOverlayRedirect(pHv, zPath);
+    return zRedirect ? zRedirect : headerJournalDirRedirect(pHv, zPath);
+}
+
+/*
+** 临时文件（临时数据库、语句日志等，SQLite 不给它们文件名）放在实例选项 temp_dir 指定的目录，
+** 没有指定时放在 journal_dir 下。这些文件没有 URI，只能使用注册实例时的默认选项。
+** 不需要重定向时返回 NULL。
+*/
+static char *headerTempPath(const HeaderVfs *pHv) {
+    const char *zDir = headerOption(pHv, 0, "temp_dir");
+    if (zDir == 0 || zDir[0] == 0) {
+        zDir = headerOption(pHv, 0, "journal_dir");
+    }
+    if (zDir == 0 || zDir[0] == 0) {
+        return 0;
+    }
+    sqlite3_uint64 iRandom;
+    sqlite3_randomness(sizeof(iRandom), &iRandom);
+    return sqlite3_mprintf("%s/headervfs-%016llx.tmp", zDir, iRandom);
+}
+
+
+/****************************************************************************
+** 快照模式（snapshot=1）
+**
+** 打开主数据库文件时，在 SHARED 锁的保护下把文件克隆为一个私有的临时副本，
+** 之后所有读取都在副本上进行：每个读者都有一个一致的视图，并且不再与其他进程
+** 争用锁。Linux 上优先使用 FICLONE（Btrfs/XFS 等支持 reflink 的文件系统上是瞬间完成的），
+** 其次是 copy_file_range；macOS 上使用 fclonefileat；最后退回到普通的读写复制。
+**
+** 快照只包含数据库文件本身，因此要求 WAL 文件不存在或为空（WAL 模式的数据库需要先执行
+** 检查点并切换到回滚日志模式）。
+****************************************************************************/
+
+// 等待 SHARED 锁的最长时间（微秒）
+#define HEADER_SNAPSHOT_BUSY_TIMEOUT 5000000
+
+/*
+** 在 pFile 上获取 SHARED 锁，遇到 SQLITE_BUSY 时退避重试，最多等待 HEADER_SNAPSHOT_BUSY_TIMEOUT。
+*/
+static int headerLockSharedWait(sqlite3_vfs *pRealVfs, sqlite3_file *pFile) {
+    int nWait = 0;
+    int nSleep = 1000;
+    for (;;) {
+        const int rc = pFile->pMethods->xLock(pFile, SQLITE_LOCK_SHARED);
+        if (rc != SQLITE_BUSY || nWait >= HEADER_SNAPSHOT_BUSY_TIMEOUT) {
+            return rc;
+        }
+        nWait += pRealVfs->xSleep(pRealVfs, nSleep);
+        if (nSleep < 100000) {
+            nSleep *= 2;
+        }
+    }
+}
+
+/*
+** WAL 文件 zWal 存在并且不为空时 *pbWal 为真。检查点以 TRUNCATE 方式完成之后（或者
+** journal_size_limit 为 0 时）WAL 文件会留下来但长度为 0，其中没有任何帧，与不存在相同。
+*/
+static int headerWalNotEmpty(sqlite3_vfs *pRealVfs, const char *zWal, int *pbWal) {
+    int bWal = 0;
+    int rc = pRealVfs->xAccess(pRealVfs, zWal, SQLITE_ACCESS_EXISTS, &bWal);
+    if (rc == SQLITE_OK && bWal) {
+        sqlite3_file *pWal = sqlite3_malloc(pRealVfs->szOsFile);
+        sqlite3_int64 nWal = 0;
+        if (pWal == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(pWal, 0, pRealVfs->szOsFile);
+            rc = pRealVfs->xOpen(pRealVfs, zWal, pWal, SQLITE_OPEN_WAL | SQLITE_OPEN_READONLY, 0);
+            if (rc == SQLITE_OK) {
+                rc = pWal->pMethods->xFileSize(pWal, &nWal);
+            }
+            if (pWal->pMethods) {
+                pWal->pMethods->xClose(pWal);
+            }
+            sqlite3_free(pWal);
+        }
+        bWal = nWal > 0;
+    }
+    *pbWal = bWal;
+    return rc;
+}
+
+/*
+** 快照和内存镜像都只包含数据库文件本身，WAL 文件存在且不为空时拒绝打开。
+** WAL 文件名与 SQLite 打开它时一样经过 headerRedirect，设置了 journal_dir 时在日志目录下查找。
+** 空的 WAL 文件（例如检查点之后 PRAGMA journal_size_limit=0 截断的）没有内容，不影响打开。
+*/
+static int headerCheckNoWal(const HeaderVfs *pHv, sqlite3_vfs *pRealVfs, const char *zName, const char *zMode) {
+    if (zName == 0) {
+        return SQLITE_OK;
+    }
+    const char *zWalName = sqlite3_filename_wal(zName);
+    char *zRedirect = headerRedirect(pHv, zWalName);
+    int bWal = 0;
+    int rc = headerWalNotEmpty(pRealVfs, zRedirect ? zRedirect : zWalName, &bWal);
+    sqlite3_free(zRedirect);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (bWal) {
+        sqlite3_log(SQLITE_CANTOPEN, "headervfs: cannot open %s in %s mode while its WAL file is not empty",
+                    zName, zMode);
+        return SQLITE_CANTOPEN;
+    }
+    return SQLITE_OK;
+}
+
+#if HEADER_OS_UNIX
+
+/*
+** 把 fdSrc 中 [iSrc, iSrc+nByte) 的数据复制到 fdDst 的 iDst 处。
+** 优先使用 copy_file_range，让内核（或文件系统）完成复制。
+*/
+static int headerCopyFdRange(int fdSrc, off_t iSrc, int fdDst, off_t iDst, off_t nByte) {
+#ifdef __linux__
+    while (nByte > 0) {
+        loff_t iIn = iSrc;
+        loff_t iOut = iDst;
+        const ssize_t n = copy_file_range(fdSrc, &iIn, fdDst, &iOut, (size_t) nByte, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        iSrc += n;
+        iDst += n;
+        nByte -= n;
+    }
+    if (nByte == 0) {
+        return SQLITE_OK;
+    }
+#endif
+
+    const size_t szBuf = 1024 * 1024;
+    char *aBuf = sqlite3_malloc64(szBuf);
+    if (aBuf == 0) {
+        return SQLITE_NOMEM;
+    }
+    int rc = SQLITE_OK;
+    while (nByte > 0) {
+        const size_t nChunk = (nByte < (off_t) szBuf) ? (size_t) nByte : szBuf;
+        const ssize_t nRead = pread(fdSrc, aBuf, nChunk, iSrc);
+        if (nRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nRead <= 0) {
+            rc = SQLITE_IOERR_READ;
+            break;
+        }
+        ssize_t nDone = 0;
+        while (nDone < nRead) {
+            const ssize_t nWritten = pwrite(fdDst, aBuf + nDone, (size_t) (nRead - nDone), iDst + nDone);
+            if (nWritten < 0 && errno == EINTR) {
+                continue;
+            }
+            if (nWritten <= 0) {
+                rc = SQLITE_IOERR_WRITE;
+                break;
+            }
+            nDone += nWritten;
+        }
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        iSrc += nRead;
+        iDst += nRead;
+        nByte -= nRead;
+    }
+    sqlite3_free(aBuf);
+    return rc;
+}
+
+/*
+** 创建 fdSrc 的一个副本，路径模板 zPath 以 "XXXXXX" 结尾，返回时被替换为实际路径。
+*/
+static int headerCloneToPath(int fdSrc, char *zPath) {
+    struct stat st;
+    if (fstat(fdSrc, &st) != 0) {
+        return SQLITE_IOERR_FSTAT;
+    }
+
+    int fdOut = mkstemp(zPath);
+    if (fdOut < 0) {
+        return SQLITE_CANTOPEN;
+    }
+
+#ifdef __APPLE__
+    /* fclonefileat 要求目标不存在：先用 mkstemp 得到一个唯一的名字，再用克隆替换它 */
+    close(fdOut);
+    unlink(zPath);
+    if (fclonefileat(fdSrc, AT_FDCWD, zPath, 0) == 0) {
+        return SQLITE_OK;
+    }
+    fdOut = open(zPath, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fdOut < 0) {
+        return SQLITE_CANTOPEN;
+    }
+#endif
+
+    int rc = SQLITE_OK;
+#if defined(__linux__) && defined(FICLONE)
+    if (ioctl(fdOut, FICLONE, fdSrc) != 0)
+#endif
+    {
+        rc = headerCopyFdRange(fdSrc, 0, fdOut, 0, st.st_size);
+    }
+    close(fdOut);
+    if (rc != SQLITE_OK) {
+        unlink(zPath);
+    }
+    return rc;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+/*
+** 通过真实 VFS 逐块复制（没有描述符可用时的通用实现）。
+*/
+static int headerCloneWithVfs(sqlite3_vfs *pRealVfs, sqlite3_file *pSrc, const char *zDst) {
+    sqlite3_int64 nSize;
+    int rc = pSrc->pMethods->xFileSize(pSrc, &nSize);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    sqlite3_file *pDst = sqlite3_malloc(pRealVfs->szOsFile);
+    const int szBuf = 1024 * 1024;
+    char *aBuf = sqlite3_malloc(szBuf);
+    if (pDst == 0 || aBuf == 0) {
+        sqlite3_free(pDst);
+        sqlite3_free(aBuf);
+        return SQLITE_NOMEM;
+    }
+    memset(pDst, 0, pRealVfs->szOsFile);
+    rc = pRealVfs->xOpen(pRealVfs, zDst, pDst,
+                         SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE, 0);
+    for (sqlite3_int64 i = 0; rc == SQLITE_OK && i < nSize; i += szBuf) {
+        const int n = (nSize - i < szBuf) ? (int) (nSize - i) : szBuf;
+        rc = pSrc->pMethods->xRead(pSrc, aBuf, n, i);
+        if (rc == SQLITE_OK) {
+            rc = pDst->pMethods->xWrite(pDst, aBuf, n, i);
+        }
+    }
+    if (pDst->pMethods) {
+        pDst->pMethods->xClose(pDst);
+    }
+    sqlite3_free(pDst);
+    sqlite3_free(aBuf);
+    if (rc != SQLITE_OK) {
+        pRealVfs->xDelete(pRealVfs, zDst, 0);
+    }
+    return rc;
+}
+
+/*
+** 为主数据库文件 zName 创建快照，成功时 *pzSnapshot 为副本的路径（由调用者释放）。
+*/
+static int headerSnapshotCreate(const HeaderVfs *pHv, sqlite3_vfs *pRealVfs, const char *zName, char **pzSnapshot) {
+    *pzSnapshot = 0;
+    if (zName == 0) {
+        return SQLITE_CANTOPEN;
+    }
+
+    /* 快照不包含 WAL 中的内容 */
+    int rc = headerCheckNoWal(pHv, pRealVfs, zName, "snapshot");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    /* 用一个独立的句柄在源文件上持有 SHARED 锁，防止复制时有写入者提交 */
+    sqlite3_file *pSrc = sqlite3_malloc(pRealVfs->szOsFile);
+    if (pSrc == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pSrc, 0, pRealVfs->szOsFile);
+    rc = pRealVfs->xOpen(pRealVfs, zName, pSrc, SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READONLY, 0);
+    if (rc == SQLITE_OK) {
+        rc = headerLockSharedWait(pRealVfs, pSrc);
+    }
+
+    char *zSnapshot = 0;
+    HeaderInode *pInode = 0;
+    if (rc == SQLITE_OK) {
+#if HEADER_OS_UNIX
+        pInode = headerBaseVfsIsUnix(pRealVfs) ? headerInodeAcquire(zName) : 0;
+        const int fdSrc = headerInodeFd(pInode);
+        if (fdSrc >= 0) {
+            /* 副本放在源文件旁边（同一个文件系统才能 reflink），不行再放到临时目录 */
+            zSnapshot = sqlite3_mprintf("%s-snapshot-XXXXXX", zName);
+            rc = zSnapshot ? headerCloneToPath(fdSrc, zSnapshot) : SQLITE_NOMEM;
+            if (rc == SQLITE_CANTOPEN) {
+                const char *zTmp = getenv("TMPDIR");
+                const char *zBase = strrchr(zName, '/');
+                sqlite3_free(zSnapshot);
+                zSnapshot = sqlite3_mprintf("%s/%s-snapshot-XXXXXX",
+                                            zTmp && zTmp[0] ? zTmp : "/tmp", zBase ? zBase + 1 : zName);
+                rc = zSnapshot ? headerCloneToPath(fdSrc, zSnapshot) : SQLITE_NOMEM;
+            }
+        }
+        if (fdSrc < 0)
+#endif
+        {
+            unsigned char aRand[8];
+            pRealVfs->xRandomness(pRealVfs, sizeof(aRand), (char *) aRand);
+            zSnapshot = sqlite3_mprintf("%s-snapshot-%02x%02x%02x%02x%02x%02x%02x%02x", zName,
+                                        aRand[0], aRand[1], aRand[2], aRand[3],
+                                        aRand[4], aRand[5], aRand[6], aRand[7]);
+            rc = zSnapshot ? headerCloneWithVfs(pRealVfs, pSrc, zSnapshot) : SQLITE_NOMEM;
+        }
+        pSrc->pMethods->xUnlock(pSrc, SQLITE_LOCK_NONE);
+    }
+
+    if (pSrc->pMethods) {
+        pSrc->pMethods->xClose(pSrc);
+    }
+    sqlite3_free(pSrc);
+    /* 登记项是最后一个引用时会关闭它的描述符，这会释放进程在这个文件上的所有 POSIX 锁，
+    ** 包括保护复制的 SHARED 锁，所以要等 pSrc 放锁并关闭之后再释放 */
+    headerInodeRelease(pInode);
+
+    if (rc != SQLITE_OK) {
+        sqlite3_free(zSnapshot);
+        return rc;
+    }
+    *pzSnapshot = zSnapshot;
+    return SQLITE_OK;
+}
+
+
+/****************************************************************************
+** 导出与导入
+**
+** headervfs_export() 把带头部的数据库去掉头部，复制为普通的 SQLite 数据库文件；
+** headervfs_import() 反过来给普通的数据库文件加上头部。复制在源文件的 SHARED 锁保护下进行，
+** 得到的是一个一致的副本。和快照一样，数据尽量由内核完成复制：Linux 上先尝试 FICLONERANGE
+** （支持 reflink 的文件系统上只共享数据块，但要求源和目标的偏移量都按文件系统块对齐，
+** 也就是头部大小是块大小的倍数），其次是 copy_file_range，最后退回到普通的读写复制。
+**
+** 每复制完 HEADER_COPY_CHUNK 字节通过 sqlite3_log 报告一次进度，已复制的字节数同时计入
+** headervfs_stats 的全局计数 copy_bytes，其他线程可以在复制进行时查询。
+****************************************************************************/
+
+// 导出和导入时每段复制的字节数，每段复制完报告一次进度
+#define HEADER_COPY_CHUNK 0x4000000
+
+/*
+** 一次导出或导入的状态。
+*/
+typedef struct HeaderCopy {
+    const char *zOp;            /* "export" 或 "import"，用于日志 */
+    const char *zDst;           /* 目标文件 */
+    sqlite3_int64 nTotal;       /* 要复制的字节数（不含头部） */
+    sqlite3_int64 nDone;        /* 已经复制的字节数 */
+    int bClone;                 /* 还可以尝试 FICLONERANGE，失败一次之后不再尝试 */
+} HeaderCopy;
+
+/* 记录又复制完了 n 字节 */
+static void headerCopyProgress(HeaderCopy *pCopy, sqlite3_int64 n) {
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    headerClosedStats.nCopyBytes += n;
+    sqlite3_mutex_leave(pMutex);
+    pCopy->nDone += n;
+    sqlite3_log(SQLITE_NOTICE, "headervfs: %s to %s: %lld of %lld bytes copied",
+                pCopy->zOp, pCopy->zDst, pCopy->nDone, pCopy->nTotal);
+}
+
+#if HEADER_OS_UNIX
+
+/*
+** 把 fdSrc 中 [iSrc, iSrc+nByte) 的数据复制到 fdDst 的 iDst 处。先尝试 FICLONERANGE，
+** 偏移量没有对齐或者文件系统不支持时退回到 headerCopyFdRange()。
+*/
+static int headerCloneFdRange(HeaderCopy *pCopy, int fdSrc, off_t iSrc, int fdDst, off_t iDst, off_t nByte) {
+#if defined(__linux__) && defined(FICLONERANGE)
+    if (pCopy->bClone) {
+        struct file_clone_range range;
+        range.src_fd = fdSrc;
+        range.src_offset = (__u64) iSrc;
+        range.src_length = (__u64) nByte;
+        range.dest_offset = (__u64) iDst;
+        if (ioctl(fdDst, FICLONERANGE, &range) == 0) {
+            return SQLITE_OK;
+        }
+        pCopy->bClone = 0;
+    }
+#endif
+    return headerCopyFdRange(fdSrc, iSrc, fdDst, iDst, nByte);
+}
+
+/*
+** 通过描述符复制：新建 zDst（权限与源文件相同），开头写入 nHead 字节的 aHead，
+** 再把 fdSrc 中 iSrc 之后的 pCopy->nTotal 字节复制到 iDst 处，最后同步到磁盘。
+** aHead 与 iDst 之间的空隙读出来是零。
+*/
+static int headerCopyFd(
+    HeaderCopy *pCopy,
+    int fdSrc,
+    sqlite3_int64 iSrc,
+    const void *aHead,
+    int nHead,
+    sqlite3_int64 iDst
+) {
+    struct stat st;
+    if (fstat(fdSrc, &st) != 0) {
+        return SQLITE_IOERR_FSTAT;
+    }
+    const int fdDst = open(pCopy->zDst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 0777);
+    if (fdDst < 0) {
+        return SQLITE_CANTOPEN;
+    }
+
+    int rc = SQLITE_OK;
+    if (nHead > 0 && pwrite(fdDst, aHead, (size_t) nHead, 0) != nHead) {
+        rc = SQLITE_IOERR_WRITE;
+    }
+    while (rc == SQLITE_OK && pCopy->nDone < pCopy->nTotal) {
+        const sqlite3_int64 nLeft = pCopy->nTotal - pCopy->nDone;
+        const sqlite3_int64 n = (nLeft < HEADER_COPY_CHUNK) ? nLeft : HEADER_COPY_CHUNK;
+        rc = headerCloneFdRange(pCopy, fdSrc, (off_t) (iSrc + pCopy->nDone), fdDst, (off_t) (iDst + pCopy->nDone), (off_t) n);
+        if (rc == SQLITE_OK) {
+            headerCopyProgress(pCopy, n);
+        }
+    }
+    /* 头部之后没有数据（空数据库）时文件也要包含整个头部 */
+    if (rc == SQLITE_OK && ftruncate(fdDst, (off_t) (iDst + pCopy->nTotal)) != 0) {
+        rc = SQLITE_IOERR_TRUNCATE;
+    }
+    if (rc == SQLITE_OK && fsync(fdDst) != 0) {
+        rc = SQLITE_IOERR_FSYNC;
+    }
+    close(fdDst);
+    if (rc != SQLITE_OK) {
+        unlink(pCopy->zDst);
+    }
+    return rc;
+}
+
+#endif /* HEADER_OS_UNIX */
+
+/*
+** 通过真实 VFS 复制（没有描述符可用时的通用实现），参数的含义与 headerCopyFd() 相同。
+*/
+static int headerCopyWithVfs(
+    HeaderCopy *pCopy,
+    sqlite3_vfs *pRealVfs,
+    sqlite3_file *pSrc,
+    sqlite3_int64 iSrc,
+    const void *aHead,
+    int nHead,
+    sqlite3_int64 iDst
+) {
+    sqlite3_file *pDst = sqlite3_malloc(pRealVfs->szOsFile);
+    const int szBuf = 1024 * 1024;
+    char *aBuf = sqlite3_malloc(szBuf);
+    if (pDst == 0 || aBuf == 0) {
+        sqlite3_free(pDst);
+        sqlite3_free(aBuf);
+        return SQLITE_NOMEM;
+    }
+    memset(pDst, 0, pRealVfs->szOsFile);
+    int rc = pRealVfs->xOpen(pRealVfs, pCopy->zDst, pDst,
+                             SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE, 0);
+    if (rc == SQLITE_OK && nHead > 0) {
+        rc = pDst->pMethods->xWrite(pDst, aHead, nHead, 0);
+    }
+    while (rc == SQLITE_OK && pCopy->nDone < pCopy->nTotal) {
+        const sqlite3_int64 nLeft = pCopy->nTotal - pCopy->nDone;
+        const sqlite3_int64 nChunk = (nLeft < HEADER_COPY_CHUNK) ? nLeft : HEADER_COPY_CHUNK;
+        for (sqlite3_int64 i = 0; rc == SQLITE_OK && i < nChunk; i += szBuf) {
+            const int n = (nChunk - i < szBuf) ? (int) (nChunk - i) : szBuf;
+            rc = pSrc->pMethods->xRead(pSrc, aBuf, n, iSrc + pCopy->nDone + i);
+            if (rc == SQLITE_OK) {
+                rc = pDst->pMethods->xWrite(pDst, aBuf, n, iDst + pCopy->nDone + i);
+            }
+        }
+        if (rc == SQLITE_OK) {
+            headerCopyProgress(pCopy, nChunk);
+        }
+    }
+    if (rc == SQLITE_OK) {
+        rc = pDst->pMethods->xTruncate(pDst, iDst + pCopy->nTotal);
+    }
+    if (rc == SQLITE_OK) {
+        rc = pDst->pMethods->xSync(pDst, SQLITE_SYNC_NORMAL);
+    }
+    if (pDst->pMethods) {
+        pDst->pMethods->xClose(pDst);
+    }
+    sqlite3_free(pDst);
+    sqlite3_free(aBuf);
+    if (rc != SQLITE_OK && rc != SQLITE_CANTOPEN) {
+        pRealVfs->xDelete(pRealVfs, pCopy->zDst, 0);
+    }
+    return rc;
+}
+
+/*
+** 复制之前检查源文件（调用者已经持有 SHARED 锁）：
+** - 和快照一样，WAL 文件存在时拒绝：WAL 中的提交不在数据库文件里，检查点也不受 SHARED 锁的约束；
+** - 存在热日志（崩溃时中断的事务）时拒绝，回滚要由 SQLite 打开数据库时完成。
+** zJournalDir 是日志所在的目录（journal_dir 选项），为 NULL 时日志在数据库旁边。
+** 不能复制时返回 SQLITE_ERROR，*pzErr 为错误信息。
+*/
+static int headerCopyCheckSource(
+    sqlite3_vfs *pRealVfs,
+    sqlite3_file *pSrc,
+    const char *zSrc,
+    const char *zJournalDir,
+    char **pzErr
+) {
+    char *zWal = zJournalDir ? headerJournalDirName(zJournalDir, zSrc, "wal") : sqlite3_mprintf("%s-wal", zSrc);
+    char *zJournal = zJournalDir ? headerJournalDirName(zJournalDir, zSrc, "journal")
+                                 : sqlite3_mprintf("%s-journal", zSrc);
+    int rc = (zWal && zJournal) ? SQLITE_OK : SQLITE_NOMEM;
+
+    int bExists = 0;
+    if (rc == SQLITE_OK) {
+        rc = headerWalNotEmpty(pRealVfs, zWal, &bExists);
+    }
+    if (rc == SQLITE_OK && bExists) {
+        *pzErr = sqlite3_mprintf("headervfs: %s has a WAL file, checkpoint it and close all connections first", zSrc);
+        rc = SQLITE_ERROR;
+    }
+
+    /* 与 SQLite 判断热日志的方法相同：日志存在、没有连接持有 RESERVED 锁，并且日志的第一个字节不为零 */
+    if (rc == SQLITE_OK) {
+        rc = pRealVfs->xAccess(pRealVfs, zJournal, SQLITE_ACCESS_EXISTS, &bExists);
+    }
+    int bReserved = 0;
+    if (rc == SQLITE_OK && bExists) {
+        rc = pSrc->pMethods->xCheckReservedLock(pSrc, &bReserved);
+    }
+    if (rc == SQLITE_OK && bExists && !bReserved) {
+        sqlite3_file *pJournal = sqlite3_malloc(pRealVfs->szOsFile);
+        unsigned char c = 0;
+        if (pJournal == 0) {
+            rc = SQLITE_NOMEM;
+        } else {
+            memset(pJournal, 0, pRealVfs->szOsFile);
+            if (pRealVfs->xOpen(pRealVfs, zJournal, pJournal, SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_READONLY, 0)
+                == SQLITE_OK) {
+                sqlite3_int64 nJournal = 0;
+                if (pJournal->pMethods->xFileSize(pJournal, &nJournal) == SQLITE_OK && nJournal > 0) {
+                    pJournal->pMethods->xRead(pJournal, &c, 1, 0);
+                }
+            }
+            if (pJournal->pMethods) {
+                pJournal->pMethods->xClose(pJournal);
+            }
+            sqlite3_free(pJournal);
+        }
+        if (c != 0) {
+            *pzErr = sqlite3_mprintf("headervfs: %s has a hot journal, open it once to roll back first", zSrc);
+            rc = SQLITE_ERROR;
+        }
+    }
+
+    sqlite3_free(zWal);
+    sqlite3_free(zJournal);
+    return rc;
+}
+
+/*
+** 在 SHARED 锁的保护下把 zSrc 中 iSrc 之后的内容复制到新文件 zDst 的 iDst 处，
+** zDst 开头写入 nHead 字节的 aHead。zSrc 通过实例 pHv 的底层 VFS 打开，
+** zJournalDir 的含义与 headerCopyCheckSource() 相同。成功时 *pnByte 为复制的字节数（不含头部）。
+** 失败时 *pzErr 可能是错误信息（由调用者释放）。
+*/
+static int headerCopyDatabase(
+    const HeaderVfs *pHv,
+    const char *zOp,
+    const char *zSrc,
+    sqlite3_int64 iSrc,
+    const char *zJournalDir,
+    const char *zDst,
+    const void *aHead,
+    int nHead,
+    sqlite3_int64 iDst,
+    sqlite3_int64 *pnByte,
+    char **pzErr
+) {
+    sqlite3_vfs *pRealVfs = pHv->base.pAppData;
+    HeaderCopy copy;
+    memset(&copy, 0, sizeof(copy));
+    copy.zOp = zOp;
+    copy.zDst = zDst;
+    copy.bClone = 1;
+    HeaderInode *pInode = 0;
+
+    /* 日志目录中的文件名用完整路径计算哈希，与 SQLite 打开数据库时一致 */
+    char *zFull = sqlite3_malloc(pRealVfs->mxPathname + 1);
+    sqlite3_file *pSrc = sqlite3_malloc(pRealVfs->szOsFile);
+    if (zFull == 0 || pSrc == 0) {
+        sqlite3_free(zFull);
+        sqlite3_free(pSrc);
+        return SQLITE_NOMEM;
+    }
+    memset(pSrc, 0, pRealVfs->szOsFile);
+    int rc = pRealVfs->xFullPathname(pRealVfs, zSrc, pRealVfs->mxPathname + 1, zFull);
+    if (rc == SQLITE_OK) {
+        rc = pRealVfs->xOpen(pRealVfs, zFull, pSrc, SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_READONLY, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = headerLockSharedWait(pRealVfs, pSrc);
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = headerCopyCheckSource(pRealVfs, pSrc, zFull, zJournalDir, pzErr);
+        sqlite3_int64 iSize = 0;
+        if (rc == SQLITE_OK) {
+            rc = pSrc->pMethods->xFileSize(pSrc, &iSize);
+        }
+        copy.nTotal = (iSize > iSrc) ? iSize - iSrc : 0;
+        if (rc == SQLITE_OK) {
+#if HEADER_OS_UNIX
+            pInode = headerBaseVfsIsUnix(pRealVfs) ? headerInodeAcquire(zFull) : 0;
+            const int fdSrc = headerInodeFd(pInode);
+            if (fdSrc >= 0) {
+                rc = headerCopyFd(&copy, fdSrc, iSrc, aHead, nHead, iDst);
+            } else
+#endif
+            {
+                rc = headerCopyWithVfs(&copy, pRealVfs, pSrc, iSrc, aHead, nHead, iDst);
+            }
+        }
+        pSrc->pMethods->xUnlock(pSrc, SQLITE_LOCK_NONE);
+    }
+
+    if (pSrc->pMethods) {
+        pSrc->pMethods->xClose(pSrc);
+    }
+    sqlite3_free(pSrc);
+    /* 登记项的描述符在 pSrc 关闭之后才可能被关闭，不会提前释放 pSrc 的锁 */
+    headerInodeRelease(pInode);
+    sqlite3_free(zFull);
+    *pnByte = copy.nDone;
+    return rc;
+}
+
+
+/*
+** 内存模式：在 SHARED 锁的保护下把真实文件头部之后的全部内容读入内存镜像。
+** 加载的字节数和耗时通过 sqlite3_log 报告，也可以用 PRAGMA headervfs_memory 查看。
+*/
+static int headerMemLoad(HeaderFile *p, int bHuge) {
+    const sqlite3_int64 tStart = headerNow();
+    sqlite3_file *pReal = p->pRealFile;
+    HeaderMemImage *pMem = sqlite3_malloc(sizeof(HeaderMemImage));
+    if (pMem == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pMem, 0, sizeof(HeaderMemImage));
+
+    int rc = headerLockSharedWait(p->pRealVfs, pReal);
+    if (rc == SQLITE_OK) {
+        sqlite3_int64 iRealSize = 0;
+        rc = pReal->pMethods->xFileSize(pReal, &iRealSize);
+        if (rc == SQLITE_OK) {
+            pMem->nData = (iRealSize > p->iHeaderSize) ? iRealSize - p->iHeaderSize : 0;
+            rc = headerMemAlloc(pMem, bHuge);
+        }
+        for (sqlite3_int64 i = 0; rc == SQLITE_OK && i < pMem->nData; i += HEADER_MEM_LOAD_CHUNK) {
+            const int n = (pMem->nData - i < HEADER_MEM_LOAD_CHUNK) ? (int) (pMem->nData - i) : HEADER_MEM_LOAD_CHUNK;
+            rc = pReal->pMethods->xRead(pReal, &pMem->aData[i], n, i + p->iHeaderSize);
+        }
+        pReal->pMethods->xUnlock(pReal, SQLITE_LOCK_NONE);
+    }
+    if (rc != SQLITE_OK) {
+        headerMemFree(pMem);
+        return rc;
+    }
+
+    pMem->tLoad = headerNow() - tStart;
+    sqlite3_log(SQLITE_NOTICE, "headervfs: loaded %lld bytes of %s into memory (%s) in %lld us",
+                pMem->nData, p->zName, pMem->zBacking, pMem->tLoad / 1000);
+    p->pMem = pMem;
+    return SQLITE_OK;
+}
+
+
+/****************************************************************************
+** VFS 方法实现
+****************************************************************************/
+
+/*
+** 打开文件。
+*/
+static int headerOpen(
+    sqlite3_vfs *pVfs, /* VFS */
+    const char *zName, /* 要打开的文件 */
+    sqlite3_file *pFile, /* 指向要填充的 HeaderFile 结构的指针 */
+    int flags, /* 输入的 SQLITE_OPEN_XXX 标志 */
+    int *pOutFlags /* 输出的 SQLITE_OPEN_XXX 标志 */
+) {
+    /* VFS 的自定义 I/O 方法。它包含 WAL 支持。 */
+    static const sqlite3_io_methods header_io_methods = {
+        3, /* iVersion 3， SQLite 3.7.6（2011-04-12）开始支持 */
+        headerClose,
+        headerRead,
+        headerWrite,
+        headerTruncate,
+        headerSync,
+        headerFileSize,
+        headerLock,
+        headerUnlock,
+        headerCheckReservedLock,
+        headerFileControl,
+        headerSectorSize,
+        headerDeviceCharacteristics,
+        /* WAL 支持方法 */
+        headerShmMap,
+        headerShmLock,
+        headerShmBarrier,
+        headerShmUnmap,
+        /* 内存映射 I/O 支持方法 */
+        headerFetch,
+        headerUnfetch
+    };
+
+    /*
+    ** 底层 VFS 不支持共享内存时（例如 unix-none）使用的方法：不提供 xShmMap，
+    ** SQLite 会拒绝 WAL 模式，或者在 EXCLUSIVE 锁模式下把 WAL 索引放在堆内存中。
+    */
+    static const sqlite3_io_methods header_noshm_io_methods = {
+        3,
+        headerClose,
+        headerRead,
+        headerWrite,
+        headerTruncate,
+        headerSync,
+        headerFileSize,
+        headerLock,
+        headerUnlock,
+        headerCheckReservedLock,
+        headerFileControl,
+        headerSectorSize,
+        headerDeviceCharacteristics,
+        0,
+        0,
+        0,
+        0,
+        headerFetch,
+        headerUnfetch
+    };
+
+    /* 非主数据库文件使用的传递方法，偏移量和大小都不做换算 */
+    static const sqlite3_io_methods pass_io_methods = {
+        3,
+        headerClose,
+        passRead,
+        passWrite,
+        passTruncate,
+        headerSync,
+        passFileSize,
+        headerLock,
+        headerUnlock,
+        headerCheckReservedLock,
+        passFileControl,
+        headerSectorSize,
+        headerDeviceCharacteristics,
+        headerShmMap,
+        headerShmLock,
+        headerShmBarrier,
+        headerShmUnmap,
+        passFetch,
+        passUnfetch
+    };
+
+    HeaderFile *p = (HeaderFile *) pFile;
+    const HeaderVfs *pHv = (HeaderVfs *) pVfs;
+    sqlite3_vfs *pRealVfs = headerBaseVfs(pVfs, zName);
+    if (pRealVfs == 0) {
+        sqlite3_log(SQLITE_CANTOPEN, "headervfs: no such base vfs: %s", sqlite3_uri_parameter(zName, "base_vfs"));
+        return SQLITE_CANTOPEN;
+    }
+
+    memset(&p->stats, 0, sizeof(p->stats));
+    p->pNextFile = 0;
+    p->pRealVfs = pRealVfs;
+    p->pHv = pHv;
+    p->pCache = 0;
+    p->eVersion = HEADER_VERSION_NONE;
+    p->iVersion = 0;
+    p->pWBuf = 0;
+    memset(&p->ra, 0, sizeof(p->ra));
+    p->bShm = 0;
+    p->pShm0 = 0;
+    p->pInode = 0;
+    p->zSnapshot = 0;
+    p->pOverlay = 0;
+    p->pMem = 0;
+    p->pWarmup = 0;
+    p->pUring = 0;
+    p->pDirect = 0;
+    p->bImmutable = 0;
+    p->iImmSize = p->iImmMtime = -1;
+    p->pHeapWal = 0;
+    p->pChanges = 0;
+    p->pBatch = 0;
+    p->pChecksum = 0;
+    p->shmShared = p->shmExcl = 0;
+    p->eLock = SQLITE_LOCK_NONE;
+    p->zName = zName;
+    p->zAltName = 0;
+    p->iHeaderSize = 0;
+    p->aHeader = p->aHeaderNew = 0;
+    p->nHeader = p->nHeaderNew = 0;
+    p->bHeaderValid = 0;
+    p->bReadOnly = 0;
+    p->szChunk = 0;
+    if ((flags & SQLITE_OPEN_MAIN_DB) != 0) {
+        /* 头部大小：URI 参数 header_size 优先，其次是实例的默认值 */
+        p->iHeaderSize = headerOptionInt64(pHv, zName, "header_size", HEADER_SIZE);
+        /* 分配粒度的默认值，之后可以被 SQLITE_FCNTL_CHUNK_SIZE 修改 */
+        p->szChunk = headerOptionInt64(pHv, zName, "chunk_size", 0);
+        if (p->szChunk < 0) {
+            p->szChunk = 0;
+        }
+        if (p->iHeaderSize < 0 || p->iHeaderSize > HEADER_SIZE_MAX) {
+            sqlite3_log(SQLITE_CANTOPEN, "headervfs: invalid header_size %lld", p->iHeaderSize);
+            return SQLITE_CANTOPEN;
+        }
+    }
+    p->pRealFile = sqlite3_malloc(pRealVfs->szOsFile);
+    if (!p->pRealFile) {
+        return SQLITE_NOMEM;
+    }
+    memset(p->pRealFile, 0, pRealVfs->szOsFile);
+
+    int rc = SQLITE_OK;
+    const char *zRealName = zName;
+    int realFlags = flags;
+
+    /* 快照模式：实际打开的是源文件的私有副本，并且总是只读的 */
+    if ((flags & SQLITE_OPEN_MAIN_DB) != 0 && headerOptionBool(pHv, zName, "snapshot")) {
+        rc = headerSnapshotCreate(pHv, pRealVfs, zName, &p->zSnapshot);
+        zRealName = p->zSnapshot;
+        /* 副本的路径不是 URI 文件名，不能让底层 VFS 在上面解析 URI 参数 */
+        realFlags &= ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI);
+        realFlags |= SQLITE_OPEN_READONLY;
+    }
+
+    /* 内存模式：只读，打开时把整个数据库读入内存（可以与快照模式同时使用） */
+    const int bMemory = (flags & SQLITE_OPEN_MAIN_DB) != 0 && headerOptionBool(pHv, zName, "memory");
+    if (bMemory) {
+        if (rc == SQLITE_OK && !p->zSnapshot) {
+            rc = headerCheckNoWal(pHv, pRealVfs, zName, "memory");
+        }
+        realFlags &= ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        realFlags |= SQLITE_OPEN_READONLY;
+    }
+
+    /* 不可变模式：只读，不加锁，不使用共享内存，只在打开时核对文件的状态 */
+    p->bImmutable = (flags & SQLITE_OPEN_MAIN_DB) != 0 && headerOptionBool(pHv, zName, "immutable");
+    if (p->bImmutable) {
+        if (rc == SQLITE_OK && !p->zSnapshot) {
+            rc = headerCheckNoWal(pHv, pRealVfs, zName, "immutable");
+        }
+        realFlags &= ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        realFlags |= SQLITE_OPEN_READONLY;
+    }
+
+    /* 覆盖层模式：基础文件只读，写入进入增量文件（与快照模式、内存模式、不可变模式互斥） */
+    char *zDelta = 0;
+    if ((flags & SQLITE_OPEN_MAIN_DB) != 0) {
+        zDelta = headerOverlayPath(pHv, zName);
+        if (zDelta && p->zSnapshot) {
+            sqlite3_log(SQLITE_CANTOPEN, "headervfs: snapshot and overlay cannot be combined");
+            rc = SQLITE_CANTOPEN;
+        }
+        if (zDelta && bMemory) {
+            sqlite3_log(SQLITE_CANTOPEN, "headervfs: memory and overlay cannot be combined");
+            rc = SQLITE_CANTOPEN;
+        }
+        if (zDelta && p->bImmutable) {
+            sqlite3_log(SQLITE_CANTOPEN, "headervfs: immutable and overlay cannot be combined");
+            rc = SQLITE_CANTOPEN;
+        }
+        if (zDelta) {
+            realFlags &= ~(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+            realFlags |= SQLITE_OPEN_READONLY;
+        }
+    } else if ((flags & (SQLITE_OPEN_MAIN_JOURNAL | SQLITE_OPEN_WAL)) != 0 && zName) {
+        p->zAltName = headerRedirect(pHv, zName);
+        if (p->zAltName) {
+            zRealName = p->zAltName;
+            realFlags &= ~SQLITE_OPEN_URI;
+        }
+    } else if (zName == 0 && (flags & SQLITE_OPEN_DELETEONCLOSE) != 0) {
+        /* 临时文件：名字要一直有效到关闭（有的 VFS 会保存这个指针） */
+        p->zAltName = headerTempPath(pHv);
+        if (p->zAltName) {
+            zRealName = p->zAltName;
+        }
+    }
+
+    /* 使用底层 VFS 打开文件 */
+    if (rc == SQLITE_OK) {
+        rc = pRealVfs->xOpen(pRealVfs, zRealName, p->pRealFile, realFlags, pOutFlags);
+        p->bReadOnly = (realFlags & SQLITE_OPEN_READONLY) != 0 || (pOutFlags && (*pOutFlags & SQLITE_OPEN_READONLY));
+    }
+
+    if (rc == SQLITE_OK) {
+        /*
+         * 关键改动：
+         * 区分主数据库文件和其他文件。
+         * 头部偏移逻辑只应应用于主数据库文件，日志、WAL 和临时文件应被透明处理。
+        */
+        if ((flags & SQLITE_OPEN_MAIN_DB) != 0) {
+            const sqlite3_io_methods *pShmMethods = p->pRealFile->pMethods;
+            p->base.pMethods = (pShmMethods->iVersion >= 2 && pShmMethods->xShmMap && !p->bImmutable)
+                               ? &header_io_methods : &header_noshm_io_methods;
+            if ((realFlags & SQLITE_OPEN_CREATE) != 0) {
+                sqlite3_int64 currentSize;
+                if (p->pRealFile->pMethods->xFileSize(p->pRealFile, &currentSize) == SQLITE_OK
+                    && currentSize == 0
+                ) {
+                    rc = p->pRealFile->pMethods->xTruncate(p->pRealFile, p->iHeaderSize);
+                }
+            }
+            /* 应用几乎总要用到头部，打开时读入缓存，之后通过 HEADERVFS_FCNTL_HEADER_READ 读取 */
+            if (rc == SQLITE_OK && p->iHeaderSize > 0) {
+                p->nHeader = (p->iHeaderSize < HEADER_CACHE_MAX) ? (int) p->iHeaderSize : HEADER_CACHE_MAX;
+                p->aHeader = sqlite3_malloc(2 * p->nHeader);
+                if (p->aHeader == 0) {
+                    rc = SQLITE_NOMEM;
+                } else {
+                    p->aHeaderNew = &p->aHeader[p->nHeader];
+                    rc = headerHeaderLoad(p);
+                }
+            }
+            if (rc == SQLITE_OK && bMemory) {
+                rc = headerMemLoad(p, headerOptionBool(pHv, zName, "memory_hugepages"));
+            }
+            if (rc == SQLITE_OK && headerBaseVfsIsUnix(pRealVfs)) {
+                p->pInode = headerInodeAcquire(zRealName);
+            }
+            if (rc == SQLITE_OK && p->bImmutable
+                && headerInodeStamp(p->pInode, &p->iImmSize, &p->iImmMtime)
+            ) {
+                /* 不可变的文件被改写了：之前缓存的内容都不能再用 */
+                sqlite3_log(SQLITE_NOTICE, "headervfs: %s changed while it was open as immutable", zName);
+                if (headerSharedOfInode(p->pInode)) {
+                    headerSharedInvalidate(headerSharedOfInode(p->pInode));
+                }
+            }
+            if (rc == SQLITE_OK && zDelta) {
+                sqlite3_int64 iBaseSize = 0;
+                rc = headerFileSize(pFile, &iBaseSize);
+                if (rc == SQLITE_OK) {
+                    rc = headerOverlayOpen(pRealVfs, zDelta, flags, iBaseSize, &p->pOverlay, pOutFlags);
+                }
+            }
+            /* 可选的堆内存 WAL 索引：file:x.db?vfs=headervfs&wal_index=heap */
+            const char *zWalIndex = headerOption(pHv, zName, "wal_index");
+            if (rc == SQLITE_OK && zWalIndex && sqlite3_stricmp(zWalIndex, "heap") == 0 && !p->pMem && !p->bImmutable) {
+                if (p->pInode == 0 || p->pOverlay) {
+                    sqlite3_log(SQLITE_NOTICE, "headervfs: wal_index=heap is not available for %s, using the base vfs", zName);
+                } else {
+                    rc = headerHeapWalAttach(p->pInode, pRealVfs, &p->pHeapWal);
+                    if (rc == SQLITE_OK) {
+                        p->base.pMethods = &header_io_methods;
+                    } else if ((rc & 0xff) == SQLITE_BUSY) {
+                        sqlite3_log(rc, "headervfs: %s is in use by another process, cannot use wal_index=heap", zName);
+                    } else if (rc == SQLITE_READONLY) {
+                        /* 没有写权限时无法阻止其他进程写入，退回到底层 VFS 的 -shm 索引 */
+                        sqlite3_log(SQLITE_NOTICE, "headervfs: %s is not writable, cannot use wal_index=heap", zName);
+                        rc = SQLITE_OK;
+                    }
+                }
+            }
+            /* 可选的变更跟踪：file:x.db?vfs=headervfs&track_changes=1&track_changes_block=65536 */
+            if (rc == SQLITE_OK && headerOptionBool(pHv, zName, "track_changes")) {
+                sqlite3_int64 szBlock = headerOptionInt64(pHv, zName, "track_changes_block", HEADER_CHANGES_BLOCK);
+                if (szBlock < 512 || szBlock > 0x40000000 || (szBlock & (szBlock - 1)) != 0) {
+                    szBlock = HEADER_CHANGES_BLOCK;
+                }
+                if (p->bReadOnly || p->pOverlay) {
+                    /* 只读的连接不会修改文件；覆盖层模式下修改都在增量文件里 */
+                    sqlite3_log(SQLITE_NOTICE, "headervfs: track_changes is not available for %s", zName);
+                } else {
+                    rc = headerChangesOpen(pRealVfs, zRealName, szBlock, &p->pChanges);
+                }
+            }
+            /* 可选的原子批量写入：file:x.db?vfs=headervfs&atomic_write=1 */
+            if (rc == SQLITE_OK && headerOptionBool(pHv, zName, "atomic_write")) {
+                if (p->pOverlay || p->pMem || p->bImmutable || p->zSnapshot) {
+                    /* 这些模式下不会修改数据库文件 */
+                    sqlite3_log(SQLITE_NOTICE, "headervfs: atomic_write is not available for %s", zName);
+                } else {
+                    rc = headerBatchOpen(pRealVfs, zRealName, !p->bReadOnly, &p->pBatch);
+                }
+            }
+            /* 可选的页校验和：file:x.db?vfs=headervfs&page_checksum=1 */
+            if (rc == SQLITE_OK && headerOptionBool(pHv, zName, "page_checksum")) {
+                if (p->pOverlay || p->zSnapshot) {
+                    /* 页不在（或者不只在）zRealName 中 */
+                    sqlite3_log(SQLITE_NOTICE, "headervfs: page_checksum is not available for %s", zName);
+                } else {
+                    rc = headerChecksumOpen(pRealVfs, zRealName, !p->bReadOnly, &p->pChecksum);
+                    if (rc == SQLITE_OK && p->pChecksum == 0) {
+                        sqlite3_log(SQLITE_NOTICE, "headervfs: %s has no page checksums yet", zName);
+                    }
+                }
+            }
+            /* 可选的进程内共享页缓存：file:x.db?vfs=headervfs&page_cache=67108864 */
+            if (rc == SQLITE_OK && !p->pMem && !p->pOverlay) {
+                rc = headerSharedAttach(p->pInode, headerOptionInt64(pHv, zName, "page_cache", 0));
+            }
+            /* 可选的对齐读缓存：file:x.db?vfs=headervfs&read_cache=4194304&read_cache_block=65536 */
+            if (rc == SQLITE_OK && !p->pMem) {
+                rc = headerCacheCreate(
+                    headerOptionInt64(pHv, zName, "read_cache", 0),
+                    headerOptionInt64(pHv, zName, "read_cache_block", HEADER_READ_CACHE_BLOCK),
+                    &p->pCache
+                );
+            }
+            /* 可选的写回缓冲区：file:x.db?vfs=headervfs&write_buffer=8388608 */
+            if (rc == SQLITE_OK && !p->pMem) {
+                rc = headerWBufCreate(headerOptionInt64(pHv, zName, "write_buffer", 0), &p->pWBuf);
+            }
+            /* 可选的直接 I/O：file:x.db?vfs=headervfs&direct_io=1 */
+            if (rc == SQLITE_OK && !p->pMem && headerOptionBool(pHv, zName, "direct_io")) {
+                rc = headerDirectOpen(p, &p->pDirect);
+            }
+            /* 可选的 io_uring 引擎：file:x.db?vfs=headervfs&io_uring=1&write_buffer=...（直接 I/O 时不使用） */
+            if (rc == SQLITE_OK && !p->pMem && !p->pOverlay && !p->pDirect && headerOptionBool(pHv, zName, "io_uring")) {
+                if (p->pWBuf) {
+                    headerUringOpen(p, (realFlags & SQLITE_OPEN_READWRITE) != 0);
+                } else {
+                    sqlite3_log(SQLITE_NOTICE, "headervfs: io_uring only batches write_buffer flushes, ignored for %s", zName);
+                }
+            }
+            /* 可选的启动预热：file:x.db?vfs=headervfs&warmup=30（预读提示作用于页缓存，直接 I/O 时不使用） */
+            if (rc == SQLITE_OK && !p->pMem && !p->pDirect) {
+                rc = headerWarmupOpen(p, headerOptionInt64(pHv, zName, "warmup", 0), &p->pWarmup);
+            }
+            /* 可选的顺序预读：file:x.db?vfs=headervfs&readahead=2097152 */
+            if (rc == SQLITE_OK && !p->pMem && !p->pDirect) {
+                const sqlite3_int64 szMax = headerOptionInt64(pHv, zName, "readahead", 0);
+                if (szMax > 0) {
+                    p->ra.szMax = (szMax > HEADER_RA_MIN) ? szMax : HEADER_RA_MIN;
+                    p->ra.szWindow = HEADER_RA_MIN;
+                }
+            }
+        } else {
+            p->base.pMethods = &pass_io_methods;
+        }
+    }
+
+    sqlite3_free(zDelta);
+    if (rc == SQLITE_OK) {
+        headerFileListAdd(p);
+    } else {
+        headerClose(pFile);
+        p->base.pMethods = 0;
+    }
+
+    return rc;
+}
+
+/*
+** 以下 VFS 方法是到底层 VFS 的简单传递。
+** pVfs->pAppData 字段保存着指向真实 VFS 的指针。
+*/
+/*
+** 删除和检查文件时使用的底层 VFS。日志和 WAL 文件名带着数据库的 URI 参数，
+** 和 headerOpen 一样按 base_vfs 选择，保证打开、检查和删除的是同一个底层 VFS 中的文件；
+** 其他文件名（例如多数据库事务的主日志）没有 URI 参数，使用实例的底层 VFS。
+*/
+static sqlite3_vfs *headerPathVfs(sqlite3_vfs *pVfs, const char *zPath) {
+    sqlite3_vfs *pRealVfs = headerJournalSuffix(zPath) ? headerBaseVfs(pVfs, zPath) : 0;
+    return pRealVfs ? pRealVfs : pVfs->pAppData;
+}
+
+static int headerDelete(sqlite3_vfs *pVfs, const char *zPath, int dirSync) {
+    sqlite3_vfs *pRealVfs = headerPathVfs(pVfs, zPath);
+    char *zRedirect = headerRedirect((HeaderVfs *) pVfs, zPath);
+    const int rc = pRealVfs->xDelete(pRealVfs, zRedirect ? zRedirect : zPath, dirSync);
+    sqlite3_free(zRedirect);
+    return rc;
+}
+
+static int headerAccess(sqlite3_vfs *pVfs, const char *zPath, int flags, int *pResOut) {
+    sqlite3_vfs *pRealVfs = headerPathVfs(pVfs, zPath);
+    char *zRedirect = headerRedirect((HeaderVfs *) pVfs, zPath);
+    const int rc = pRealVfs->xAccess(pRealVfs, zRedirect ? zRedirect : zPath, flags, pResOut);
+    sqlite3_free(zRedirect);
+    return rc;
+}
+
+static int headerFullPathname(sqlite3_vfs *pVfs, const char *zPath, int nPathOut, char *zPathOut) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xFullPathname(pRealVfs, zPath, nPathOut, zPathOut);
+}
+
+static void *headerDlOpen(sqlite3_vfs *pVfs, const char *zPath) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xDlOpen(pRealVfs, zPath);
+}
+
+static void headerDlError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    pRealVfs->xDlError(pRealVfs, nByte, zErrMsg);
+}
+
+static void (*headerDlSym(sqlite3_vfs *pVfs, void *pH, const char *zSym))(void) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xDlSym(pRealVfs, pH, zSym);
+}
+
+static void headerDlClose(sqlite3_vfs *pVfs, void *pHandle) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    pRealVfs->xDlClose(pRealVfs, pHandle);
+}
+
+static int headerRandomness(sqlite3_vfs *pVfs, int nByte, char *zByte) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xRandomness(pRealVfs, nByte, zByte);
+}
+
+static int headerSleep(sqlite3_vfs *pVfs, int nMicro) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xSleep(pRealVfs, nMicro);
+}
+
+static int headerCurrentTime(sqlite3_vfs *pVfs, double *pTime) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xCurrentTime(pRealVfs, pTime);
+}
+
+static int headerGetLastError(sqlite3_vfs *pVfs, int n, char *s) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xGetLastError(pRealVfs, n, s);
+}
+
+static int headerCurrentTimeInt64(sqlite3_vfs *pVfs, sqlite3_int64 *pTime) {
+    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    return pRealVfs->xCurrentTimeInt64(pRealVfs, pTime);
+}
+
+/****************************************************************************
+** 虚拟表 headervfs_stats
+**
+** SELECT * FROM headervfs_stats; 每个打开的文件的每个计数是一行，file 为 '*' 的行是
+** 进程的全局计数（包括已经关闭的文件）。查询开始时对所有计数做一次快照。
+****************************************************************************/
+
+/* 标量计数的名字，顺序与 HeaderVfsStats 的成员一致 */
+static const char *const headerStatNames[] = {
+    "read", "read_bytes", "write", "write_bytes", "sync", "truncate", "lock", "lock_busy", "shm_lock_busy",
+    "readahead", "readahead_bytes", "readahead_hit", "page_cache_hit", "page_cache_miss",
+    "copy_bytes", "atomic_commit", "atomic_fallback", "checksum_verified", "checksum_error"
+};
+
+/* 延迟直方图的名字前缀，跟在标量计数之后 */
+static const char *const headerStatHistNames[] = {"read_latency", "write_latency", "sync_latency"};
+
+#define HEADER_STAT_COUNT ((int) (sizeof(HeaderVfsStats) / sizeof(sqlite3_int64)))
+
+/* 名字的个数必须与 HeaderVfsStats 的成员一致 */
+typedef char headerStatNamesCheck[
+    (sizeof(headerStatNames) / sizeof(headerStatNames[0])
+     + sizeof(headerStatHistNames) / sizeof(headerStatHistNames[0]) * HEADERVFS_STATS_BUCKETS
+     == sizeof(HeaderVfsStats) / sizeof(sqlite3_int64)) ? 1 : -1];
+
+typedef struct HeaderStatsCursor {
+    sqlite3_vtab_cursor base;
+    int nFile;                  /* 快照中的项数，第 0 项是全局计数 */
+    char **azFile;              /* 每一项的文件名 */
+    HeaderVfsStats *aStats;     /* 每一项的计数 */
+    int iFile;                  /* 当前项 */
+    int iStat;                  /* 当前计数在 HeaderVfsStats 中的下标 */
+} HeaderStatsCursor;
+
+static int headerStatsConnect(
+    sqlite3 *db,
+    void *pAux,
+    int argc,
+    const char *const *argv,
+    sqlite3_vtab **ppVtab,
+    char **pzErr
+) {
+    (void) pAux;
+    (void) argc;
+    (void) argv;
+    (void) pzErr;
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(file TEXT, stat TEXT, value INTEGER)");
+    if (rc == SQLITE_OK) {
+        *ppVtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+        if (*ppVtab == 0) {
+            return SQLITE_NOMEM;
+        }
+        memset(*ppVtab, 0, sizeof(sqlite3_vtab));
+    }
+    return rc;
+}
+
+static int headerStatsDisconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int headerStatsBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void) pVtab;
+    pInfo->estimatedCost = 1000.0;
+    return SQLITE_OK;
+}
+
+static int headerStatsOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void) pVtab;
+    HeaderStatsCursor *pCur = sqlite3_malloc(sizeof(HeaderStatsCursor));
+    if (pCur == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pCur, 0, sizeof(HeaderStatsCursor));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static void headerStatsReset(HeaderStatsCursor *pCur) {
+    for (int i = 0; i < pCur->nFile; i++) {
+        sqlite3_free(pCur->azFile[i]);
+    }
+    sqlite3_free(pCur->azFile);
+    sqlite3_free(pCur->aStats);
+    pCur->azFile = 0;
+    pCur->aStats = 0;
+    pCur->nFile = 0;
+    pCur->iFile = 0;
+    pCur->iStat = 0;
+}
+
+static int headerStatsClose(sqlite3_vtab_cursor *pCursor) {
+    headerStatsReset((HeaderStatsCursor *) pCursor);
+    sqlite3_free(pCursor);
+    return SQLITE_OK;
+}
+
+static int headerStatsFilter(
+    sqlite3_vtab_cursor *pCursor,
+    int idxNum,
+    const char *idxStr,
+    int argc,
+    sqlite3_value **argv
+) {
+    (void) idxNum;
+    (void) idxStr;
+    (void) argc;
+    (void) argv;
+    HeaderStatsCursor *pCur = (HeaderStatsCursor *) pCursor;
+    headerStatsReset(pCur);
+
+    int rc = SQLITE_OK;
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
+    int nFile = 1;
+    for (HeaderFile *p = headerFileList; p; p = p->pNextFile) {
+        nFile++;
+    }
+    pCur->azFile = sqlite3_malloc64(sizeof(char *) * nFile);
+    pCur->aStats = sqlite3_malloc64(sizeof(HeaderVfsStats) * nFile);
+    if (pCur->azFile == 0 || pCur->aStats == 0) {
+        rc = SQLITE_NOMEM;
+    } else {
+        memset(pCur->azFile, 0, sizeof(char *) * nFile);
+        memset(pCur->aStats, 0, sizeof(HeaderVfsStats) * nFile);
+        pCur->nFile = nFile;
+        pCur->azFile[0] = sqlite3_mprintf("*");
+        headerStatsAccumulate(&pCur->aStats[0], &headerClosedStats);
+        int i = 1;
+        for (HeaderFile *p = headerFileList; p; p = p->pNextFile, i++) {
+            pCur->azFile[i] = sqlite3_mprintf("%s", p->zName ? p->zName : "");
+            headerStatsAccumulate(&pCur->aStats[i], &p->stats);
+            headerStatsAccumulate(&pCur->aStats[0], &p->stats);
+        }
+        for (i = 0; i < nFile; i++) {
+            if (pCur->azFile[i] == 0) {
+                rc = SQLITE_NOMEM;
+            }
+        }
+    }
+    sqlite3_mutex_leave(pMutex);
+    if (rc != SQLITE_OK) {
+        headerStatsReset(pCur);
+    }
+    return rc;
+}
+
+static int headerStatsNext(sqlite3_vtab_cursor *pCursor) {
+    HeaderStatsCursor *pCur = (HeaderStatsCursor *) pCursor;
+    if (++pCur->iStat == HEADER_STAT_COUNT) {
+        pCur->iStat = 0;
+        pCur->iFile++;
+    }
+    return SQLITE_OK;
+}
+
+static int headerStatsEof(sqlite3_vtab_cursor *pCursor) {
+    const HeaderStatsCursor *pCur = (HeaderStatsCursor *) pCursor;
+    return pCur->iFile >= pCur->nFile;
+}
+
+static int headerStatsColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *ctx, int iCol) {
+    const HeaderStatsCursor *pCur = (HeaderStatsCursor *) pCursor;
+    const int nScalar = (int) (sizeof(headerStatNames) / sizeof(headerStatNames[0]));
+    switch (iCol) {
+        case 0:
+            sqlite3_result_text(ctx, pCur->azFile[pCur->iFile], -1, SQLITE_TRANSIENT);
+            break;
+        case 1:
+            if (pCur->iStat < nScalar) {
+                sqlite3_result_text(ctx, headerStatNames[pCur->iStat], -1, SQLITE_STATIC);
+            } else {
+                /* 直方图的桶：xxx_lt_<上限>us，最后一桶为 xxx_ge_<下限>us */
+                const int iHist = (pCur->iStat - nScalar) / HEADERVFS_STATS_BUCKETS;
+                const int iBucket = (pCur->iStat - nScalar) % HEADERVFS_STATS_BUCKETS;
+                char *zName = (iBucket == HEADERVFS_STATS_BUCKETS - 1)
+                              ? sqlite3_mprintf("%s_ge_%lldus", headerStatHistNames[iHist], 1LL << (iBucket - 1))
+                              : sqlite3_mprintf("%s_lt_%lldus", headerStatHistNames[iHist], 1LL << iBucket);
+                if (zName == 0) {
+                    return SQLITE_NOMEM;
+                }
+                sqlite3_result_text(ctx, zName, -1, sqlite3_free);
+            }
+            break;
+        default:
+            sqlite3_result_int64(ctx, ((const sqlite3_int64 *) &pCur->aStats[pCur->iFile])[pCur->iStat]);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+static int headerStatsRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid) {
+    const HeaderStatsCursor *pCur = (HeaderStatsCursor *) pCursor;
+    *pRowid = (sqlite3_int64) pCur->iFile * HEADER_STAT_COUNT + pCur->iStat;
+    return SQLITE_OK;
+}
+
+/* 只有 xConnect 没有 xCreate：只能以同名（eponymous）方式使用 */
+static sqlite3_module headerStatsModule = {
+    0,                          /* iVersion */
+    0,                          /* xCreate */
+    headerStatsConnect,         /* xConnect */
+    headerStatsBestIndex,       /* xBestIndex */
+    headerStatsDisconnect,      /* xDisconnect */
+    0,                          /* xDestroy */
+    headerStatsOpen,            /* xOpen */
+    headerStatsClose,           /* xClose */
+    headerStatsFilter,          /* xFilter */
+    headerStatsNext,            /* xNext */
+    headerStatsEof,             /* xEof */
+    headerStatsColumn,          /* xColumn */
+    headerStatsRowid,           /* xRowid */
+    0,                          /* xUpdate */
+    0,                          /* xBegin */
+    0,                          /* xSync */
+    0,                          /* xCommit */
+    0,                          /* xRollback */
+    0,                          /* xFindFunction */
+    0,                          /* xRename */
+    0,                          /* xSavepoint */
+    0,                          /* xRelease */
+    0,                          /* xRollbackTo */
+    0                           /* xShadowName */
+};
+
+/****************************************************************************
+** 虚拟表 headervfs_changes
+**
+** SELECT * FROM headervfs_changes('main'); 列出数据库文件（开启了 track_changes）自上一次重置以来
+** 修改过的范围，相邻的块合并成一行，超出文件末尾的部分被去掉。offset 和 length 都是真实文件
+** （包括头部）中的字节数，备份只需要复制这些范围并把副本截断到文件当前的大小。
+****************************************************************************/
+
+typedef struct HeaderChangesVtab {
+    sqlite3_vtab base;
+    sqlite3 *db;                /* 用来向数据库文件发出文件控制请求 */
+} HeaderChangesVtab;
+
+typedef struct HeaderChangesCursor {
+    sqlite3_vtab_cursor base;
+    HeaderVfsChanges changes;   /* 查询开始时读出的位图 */
+    sqlite3_int64 nBlock;       /* 文件范围内的块数 */
+    sqlite3_int64 iFirst;       /* 当前这一行的第一块 */
+    sqlite3_int64 nRun;         /* 当前这一行的块数，0 表示已经结束 */
+} HeaderChangesCursor;
+
+static int headerChangesConnect(
+    sqlite3 *db,
+    void *pAux,
+    int argc,
+    const char *const *argv,
+    sqlite3_vtab **ppVtab,
+    char **pzErr
+) {
+    (void) pAux;
+    (void) argc;
+    (void) argv;
+    (void) pzErr;
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(offset INTEGER, length INTEGER, generation INTEGER, schema HIDDEN)");
+    if (rc == SQLITE_OK) {
+        HeaderChangesVtab *pTab = sqlite3_malloc(sizeof(HeaderChangesVtab));
+        if (pTab == 0) {
+            return SQLITE_NOMEM;
+        }
+        memset(pTab, 0, sizeof(HeaderChangesVtab));
+        pTab->db = db;
+        *ppVtab = &pTab->base;
+    }
+    return rc;
+}
+
+static int headerChangesDisconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+/* schema 列上的等值约束作为 xFilter 的参数，没有时使用 main */
+static int headerChangesBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void) pVtab;
+    pInfo->idxNum = 0;
+    for (int i = 0; i < pInfo->nConstraint; i++) {
+        const struct sqlite3_index_constraint *pCons = &pInfo->aConstraint[i];
+        if (pCons->iColumn == 3 && pCons->op == SQLITE_INDEX_CONSTRAINT_EQ) {
+            if (!pCons->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            pInfo->aConstraintUsage[i].argvIndex = 1;
+            pInfo->aConstraintUsage[i].omit = 1;
+            pInfo->idxNum = 1;
+            break;
+        }
     }
-    return rc;
+    pInfo->estimatedCost = 1000.0;
+    return SQLITE_OK;
 }
 
-/*
-** 以下都是简单的传递方法。
-*/
-static int headerLock(sqlite3_file *pFile, int eLock) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xLock(p->pRealFile, eLock);
+static int headerChangesOpenCursor(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void) pVtab;
+    HeaderChangesCursor *pCur = sqlite3_malloc(sizeof(HeaderChangesCursor));
+    if (pCur == 0) {
+        return SQLITE_NOMEM;
+    }
+    memset(pCur, 0, sizeof(HeaderChangesCursor));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
 }
 
-static int headerUnlock(sqlite3_file *pFile, int eLock) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xUnlock(p->pRealFile, eLock);
+static int headerChangesCloseCursor(sqlite3_vtab_cursor *pCursor) {
+    HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    sqlite3_free(pCur->changes.aBitmap);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
 }
 
-static int headerCheckReservedLock(sqlite3_file *pFile, int *pResOut) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xCheckReservedLock(p->pRealFile, pResOut);
+static int headerChangesBit(const HeaderChangesCursor *pCur, sqlite3_int64 i) {
+    return i < pCur->changes.nBlock && (pCur->changes.aBitmap[i / 8] & (1 << (i % 8))) != 0;
 }
 
-static int headerFileControl(sqlite3_file *pFile, int op, void *pArg) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xFileControl(p->pRealFile, op, pArg);
+/* 从 iFrom 开始找下一段连续的置位块 */
+static void headerChangesSeek(HeaderChangesCursor *pCur, sqlite3_int64 iFrom) {
+    while (iFrom < pCur->nBlock && !headerChangesBit(pCur, iFrom)) {
+        iFrom++;
+    }
+    pCur->iFirst = iFrom;
+    pCur->nRun = 0;
+    while (iFrom + pCur->nRun < pCur->nBlock && headerChangesBit(pCur, iFrom + pCur->nRun)) {
+        pCur->nRun++;
+    }
 }
 
-static int headerSectorSize(sqlite3_file *pFile) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xSectorSize(p->pRealFile);
-}
+static int headerChangesFilter(
+    sqlite3_vtab_cursor *pCursor,
+    int idxNum,
+    const char *idxStr,
+    int argc,
+    sqlite3_value **argv
+) {
+    (void) idxStr;
+    HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    HeaderChangesVtab *pTab = (HeaderChangesVtab *) pCursor->pVtab;
+    const char *zSchema = (idxNum == 1 && argc > 0) ? (const char *) sqlite3_value_text(argv[0]) : "main";
+    sqlite3_free(pCur->changes.aBitmap);
+    memset(&pCur->changes, 0, sizeof(pCur->changes));
+    pCur->nBlock = pCur->nRun = 0;
 
-static int headerDeviceCharacteristics(sqlite3_file *pFile) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xDeviceCharacteristics(p->pRealFile);
+    const int rc = sqlite3_file_control(pTab->db, zSchema ? zSchema : "main", HEADERVFS_FCNTL_CHANGES, &pCur->changes);
+    if (rc == SQLITE_NOTFOUND) {
+        sqlite3_free(pTab->base.zErrMsg);
+        pTab->base.zErrMsg = sqlite3_mprintf("headervfs: %s is not opened with track_changes", zSchema ? zSchema : "main");
+        return SQLITE_ERROR;
+    }
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    pCur->nBlock = (pCur->changes.iSize + pCur->changes.szBlock - 1) / pCur->changes.szBlock;
+    headerChangesSeek(pCur, 0);
+    return SQLITE_OK;
 }
 
-/*
-** 以下是为 WAL 支持的传递方法。
-*/
-static int headerShmMap(
-    sqlite3_file *pFile,
-    int iPg,
-    int pgsz,
-    int bExtend,
-    void volatile **pp
-) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xShmMap(p->pRealFile, iPg, pgsz, bExtend, pp);
+static int headerChangesNext(sqlite3_vtab_cursor *pCursor) {
+    HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    headerChangesSeek(pCur, pCur->iFirst + pCur->nRun);
+    return SQLITE_OK;
 }
 
-static int headerShmLock(sqlite3_file *pFile, int offset, int n, int flags) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xShmLock(p->pRealFile, offset, n, flags);
+static int headerChangesEof(sqlite3_vtab_cursor *pCursor) {
+    const HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    return pCur->nRun == 0;
 }
 
-static void headerShmBarrier(sqlite3_file *pFile) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    p->pRealFile->pMethods->xShmBarrier(p->pRealFile);
+static int headerChangesColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *ctx, int iCol) {
+    const HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    const sqlite3_int64 iOffset = pCur->iFirst * pCur->changes.szBlock;
+    sqlite3_int64 iEnd = (pCur->iFirst + pCur->nRun) * pCur->changes.szBlock;
+    if (iEnd > pCur->changes.iSize) {
+        iEnd = pCur->changes.iSize;
+    }
+    switch (iCol) {
+        case 0:
+            sqlite3_result_int64(ctx, iOffset);
+            break;
+        case 1:
+            sqlite3_result_int64(ctx, iEnd - iOffset);
+            break;
+        case 2:
+            sqlite3_result_int64(ctx, pCur->changes.iGeneration);
+            break;
+        default:
+            break;
+    }
+    return SQLITE_OK;
 }
 
-static int headerShmUnmap(sqlite3_file *pFile, int deleteFlag) {
-    const HeaderFile *p = (HeaderFile *) pFile;
-    return p->pRealFile->pMethods->xShmUnmap(p->pRealFile, deleteFlag);
+static int headerChangesRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid) {
+    const HeaderChangesCursor *pCur = (HeaderChangesCursor *) pCursor;
+    *pRowid = pCur->iFirst;
+    return SQLITE_OK;
 }
 
+/* 与 headervfs_stats 一样只能以同名方式使用，schema 参数写在表名后的括号里 */
+static sqlite3_module headerChangesModule = {
+    0,                          /* iVersion */
+    0,                          /* xCreate */
+    headerChangesConnect,       /* xConnect */
+    headerChangesBestIndex,     /* xBestIndex */
+    headerChangesDisconnect,    /* xDisconnect */
+    0,                          /* xDestroy */
+    headerChangesOpenCursor,    /* xOpen */
+    headerChangesCloseCursor,   /* xClose */
+    headerChangesFilter,        /* xFilter */
+    headerChangesNext,          /* xNext */
+    headerChangesEof,           /* xEof */
+    headerChangesColumn,        /* xColumn */
+    headerChangesRowid,         /* xRowid */
+    0,                          /* xUpdate */
+    0,                          /* xBegin */
+    0,                          /* xSync */
+    0,                          /* xCommit */
+    0,                          /* xRollback */
+    0,                          /* xFindFunction */
+    0,                          /* xRename */
+    0,                          /* xSavepoint */
+    0,                          /* xRelease */
+    0,                          /* xRollbackTo */
+    0                           /* xShadowName */
+};
 
 /****************************************************************************
-** VFS 方法实现
+** 扩展注册函数
 ****************************************************************************/
 
+
 /*
-** 打开文件。
+** 注册一个新的 headervfs 实例，参见 headervfs.h。
 */
-static int headerOpen(
-    sqlite3_vfs *pVfs, /* VFS */
-    const char *zName, /* 要打开的文件 */
-    sqlite3_file *pFile, /* 指向要填充的 HeaderFile 结构的指针 */
-    int flags, /* 输入的 SQLITE_OPEN_XXX 标志 */
-    int *pOutFlags /* 输出的 SQLITE_OPEN_XXX 标志 */
-) {
-    /* VFS 的自定义 I/O 方法。它包含 WAL 支持。 */
-    static const sqlite3_io_methods header_io_methods = {
-        3, /* iVersion 3， SQLite 3.7.6（2011-04-12）开始支持 */
-        headerClose,
-        headerRead,
-        headerWrite,
-        headerTruncate,
-        headerSync,
-        headerFileSize,
-        headerLock,
-        headerUnlock,
-        headerCheckReservedLock,
-        headerFileControl,
-        headerSectorSize,
-        headerDeviceCharacteristics,
-        /* WAL 支持方法 */
-        headerShmMap,
-        headerShmLock,
-        headerShmBarrier,
-        headerShmUnmap,
-        /**
-         * xFetch 和 xUnfetch 的作用：
-         * 尝试直接获取一个指向数据库文件某一页（Page）的内存指针，以避免 read() 系统调用和内存拷贝。通常用于实现内存映射 I/O（mmap）
-         *
-         * 没有实现 xFetch 和 xUnfetch 的原因：
-         * 1、对性能的影响不大
-         * 2、实现这两个方法，过于麻烦
-         */
-        0,
-        0
-    };
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_headervfs_register(const char *zName, const char *zOptions, int makeDefault) {
+    if (zName == 0 || zName[0] == 0) {
+        return SQLITE_MISUSE;
+    }
+    if (zOptions == 0) {
+        zOptions = "";
+    }
 
-    HeaderFile *p = (HeaderFile *) pFile;
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
+    sqlite3_mutex *pMutex = headerGlobalMutex();
+    sqlite3_mutex_enter(pMutex);
 
-    p->pRealFile = sqlite3_malloc(pRealVfs->szOsFile);
-    if (!p->pRealFile) {
-        return SQLITE_NOMEM;
+    if (sqlite3_vfs_find(zName) != 0) {
+        sqlite3_mutex_leave(pMutex);
+        return SQLITE_ERROR;
     }
-    memset(p->pRealFile, 0, pRealVfs->szOsFile);
 
-    /* 使用底层 VFS 打开文件 */
-    int rc = pRealVfs->xOpen(pRealVfs, zName, p->pRealFile, flags, pOutFlags);
+    /* 选项的个数最多是 '&' 的个数加一 */
+    int nMaxOption = 1;
+    for (const char *z = zOptions; *z; z++) {
+        if (*z == '&') {
+            nMaxOption++;
+        }
+    }
 
-    if (rc == SQLITE_OK) {
-        /*
-         * 关键改动：
-         * 区分主数据库文件和其他文件。
-         * 头部偏移逻辑只应应用于主数据库文件，日志、WAL 和临时文件应被透明处理。
-        */
-        if ((flags & SQLITE_OPEN_MAIN_DB) != 0) {
-            p->base.pMethods = &header_io_methods;
-            if ((flags & SQLITE_OPEN_CREATE) != 0) {
-                sqlite3_int64 currentSize;
-                if (p->pRealFile->pMethods->xFileSize(p->pRealFile, &currentSize) == SQLITE_OK
-                    && currentSize == 0
-                ) {
-                    rc = p->pRealFile->pMethods->xTruncate(p->pRealFile, HEADER_SIZE);
-                }
-            }
+    /* 实例、名字、选项键值对指针和选项字符串放在同一块内存里，注册之后永不释放 */
+    const size_t nName = strlen(zName) + 1;
+    const size_t nOptions = strlen(zOptions) + 1;
+    const size_t nByte = sizeof(HeaderVfs) + sizeof(char *) * 2 * nMaxOption + nName + nOptions;
+    HeaderVfs *pHv = sqlite3_malloc64(nByte);
+    if (pHv == 0) {
+        sqlite3_mutex_leave(pMutex);
+        return SQLITE_NOMEM;
+    }
+    memset(pHv, 0, nByte);
+    pHv->azOption = (char **) &pHv[1];
+    char *zNameCopy = (char *) &pHv->azOption[2 * nMaxOption];
+    char *zOpt = zNameCopy + nName;
+    memcpy(zNameCopy, zName, nName);
+    memcpy(zOpt, zOptions, nOptions);
+
+    /* 解析 "key1=value1&key2=value2"，没有值的键视为 "1" */
+    while (*zOpt) {
+        char *zKey = zOpt;
+        char *zEnd = strchr(zOpt, '&');
+        if (zEnd) {
+            *zEnd = 0;
+            zOpt = zEnd + 1;
+        } else {
+            zOpt += strlen(zOpt);
+        }
+        if (zKey[0] == 0) {
+            continue;
+        }
+        char *zVal = strchr(zKey, '=');
+        if (zVal) {
+            *zVal++ = 0;
         } else {
-            p->base.pMethods = p->pRealFile->pMethods;
+            zVal = "1";
         }
+        pHv->azOption[2 * pHv->nOption] = zKey;
+        pHv->azOption[2 * pHv->nOption + 1] = zVal;
+        pHv->nOption++;
+    }
+
+    /*
+    ** 底层 VFS：选项 base_vfs 指定的 VFS，否则是当前的默认 VFS。
+    ** 它本身是一个 headervfs 实例时，叠加在它下面的真实 VFS 上。
+    */
+    const char *zBase = headerOption(pHv, 0, "base_vfs");
+    sqlite3_vfs *pRealVfs = headerFindBaseVfs((zBase && zBase[0]) ? zBase : 0);
+    if (pRealVfs == 0) {
+        sqlite3_free(pHv);
+        sqlite3_mutex_leave(pMutex);
+        return (zBase && zBase[0]) ? SQLITE_NOTFOUND : SQLITE_ERROR;
     }
 
+    /* 复制真实 VFS 的内容到我们的结构体中，以继承其方法 */
+    sqlite3_vfs *pVfs = &pHv->base;
+    memcpy(pVfs, pRealVfs, sizeof(sqlite3_vfs));
+
+    /* 设置 VFS 的名字 */
+    pVfs->zName = zNameCopy;
+
+    /* 存储指向真实 VFS 的指针，以便后续的传递调用 */
+    pVfs->pAppData = pRealVfs;
+
+    /* 设置自定义的 sqlite3_file 结构的大小 */
+    pVfs->szOsFile = sizeof(HeaderFile);
+
+    /* 覆写我们需要修改的 VFS 方法 */
+    pVfs->xOpen = headerOpen;
+    pVfs->xDelete = headerDelete;
+    pVfs->xAccess = headerAccess;
+    pVfs->xFullPathname = headerFullPathname;
+    pVfs->xDlOpen = headerDlOpen;
+    pVfs->xDlError = headerDlError;
+    pVfs->xDlSym = headerDlSym;
+    pVfs->xDlClose = headerDlClose;
+    pVfs->xRandomness = headerRandomness;
+    pVfs->xSleep = headerSleep;
+    pVfs->xCurrentTime = headerCurrentTime;
+    pVfs->xGetLastError = headerGetLastError;
+    pVfs->xCurrentTimeInt64 = headerCurrentTimeInt64;
+
+    const int rc = sqlite3_vfs_register(pVfs, makeDefault);
     if (rc != SQLITE_OK) {
-        if (p->pRealFile->pMethods && p->pRealFile->pMethods->xClose) {
-            p->pRealFile->pMethods->xClose(p->pRealFile);
-        }
-        sqlite3_free(p->pRealFile);
-        p->pRealFile = 0;
+        sqlite3_free(pHv);
     }
 
+    sqlite3_mutex_leave(pMutex);
     return rc;
 }
 
 /*
-** 以下 VFS 方法是到底层 VFS 的简单传递。
-** pVfs->pAppData 字段保存着指向真实 VFS 的指针。
+** SQL 函数：headervfs_register(NAME [, OPTIONS])
+**
+** 注册一个名为 NAME 的 headervfs 实例。OPTIONS 可以是一个整数（头部大小），
+** 也可以是 "header_size=4096&read_cache=1048576" 形式的默认选项，
+** 其中 base_vfs 选择实例叠加在哪个 VFS 上，例如 "base_vfs=unix-excl"。
 */
-static int headerDelete(sqlite3_vfs *pVfs, const char *zPath, int dirSync) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xDelete(pRealVfs, zPath, dirSync);
-}
+static void headerRegisterFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    const char *zName = (const char *) sqlite3_value_text(argv[0]);
+    char *zOptions = 0;
+    if (argc > 1) {
+        if (sqlite3_value_type(argv[1]) == SQLITE_INTEGER) {
+            zOptions = sqlite3_mprintf("header_size=%lld", sqlite3_value_int64(argv[1]));
+        } else {
+            zOptions = sqlite3_mprintf("%s", (const char *) sqlite3_value_text(argv[1]));
+        }
+        if (zOptions == 0) {
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+    }
 
-static int headerAccess(sqlite3_vfs *pVfs, const char *zPath, int flags, int *pResOut) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xAccess(pRealVfs, zPath, flags, pResOut);
+    const int rc = sqlite3_headervfs_register(zName, zOptions, 0);
+    sqlite3_free(zOptions);
+    if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "headervfs: base vfs not found", -1);
+    } else if (rc == SQLITE_ERROR) {
+        char *zErr = sqlite3_mprintf("headervfs: vfs \"%s\" already exists", zName ? zName : "");
+        sqlite3_result_error(ctx, zErr, -1);
+        sqlite3_free(zErr);
+    } else if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+    }
 }
 
-static int headerFullPathname(sqlite3_vfs *pVfs, const char *zPath, int nPathOut, char *zPathOut) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xFullPathname(pRealVfs, zPath, nPathOut, zPathOut);
-}
+/*
+** SQL 函数 headervfs_overlay_merge([schema])：把覆盖层的增量文件合并回基础文件，
+** 返回合并的页数。WAL 模式下先做一次 TRUNCATE 检查点，让所有提交都进入增量文件。
+*/
+static void headerOverlayMergeFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    sqlite3 *db = sqlite3_context_db_handle(ctx);
+    const char *zSchema = (argc > 0) ? (const char *) sqlite3_value_text(argv[0]) : "main";
+    sqlite3_int64 nPage = 0;
 
-static void *headerDlOpen(sqlite3_vfs *pVfs, const char *zPath) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xDlOpen(pRealVfs, zPath);
+    int rc = sqlite3_wal_checkpoint_v2(db, zSchema, SQLITE_CHECKPOINT_TRUNCATE, 0, 0);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_file_control(db, zSchema, HEADERVFS_FCNTL_OVERLAY_MERGE, &nPage);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_result_int64(ctx, nPage);
+    } else if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "headervfs: database is not opened in overlay mode", -1);
+    } else {
+        sqlite3_result_error_code(ctx, rc);
+    }
 }
 
-static void headerDlError(sqlite3_vfs *pVfs, int nByte, char *zErrMsg) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    pRealVfs->xDlError(pRealVfs, nByte, zErrMsg);
+/*
+** SQL 函数 headervfs_header([schema [, HEADER]])：一个参数时返回缓存的头部（BLOB）；
+** 两个参数时用 BLOB HEADER 替换头部的开头部分，在下一次提交时写入文件，返回 NULL。
+*/
+static void headerHeaderFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    sqlite3 *db = sqlite3_context_db_handle(ctx);
+    const char *zSchema = (argc > 0) ? (const char *) sqlite3_value_text(argv[0]) : "main";
+    HeaderVfsHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    int rc;
+    if (argc > 1) {
+        hdr.aData = (void *) sqlite3_value_blob(argv[1]);
+        hdr.nData = sqlite3_value_bytes(argv[1]);
+        rc = sqlite3_file_control(db, zSchema, HEADERVFS_FCNTL_HEADER_WRITE, &hdr);
+    } else {
+        /* 第一次调用取得头部的大小 */
+        rc = sqlite3_file_control(db, zSchema, HEADERVFS_FCNTL_HEADER_READ, &hdr);
+        if (rc == SQLITE_OK && hdr.nData > 0) {
+            hdr.aData = sqlite3_malloc(hdr.nData);
+            rc = hdr.aData ? sqlite3_file_control(db, zSchema, HEADERVFS_FCNTL_HEADER_READ, &hdr) : SQLITE_NOMEM;
+        }
+        if (rc == SQLITE_OK) {
+            if (hdr.aData) {
+                sqlite3_result_blob(ctx, hdr.aData, hdr.nData, sqlite3_free);
+            } else {
+                sqlite3_result_zeroblob(ctx, 0);
+            }
+            return;
+        }
+        sqlite3_free(hdr.aData);
+    }
+    if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "headervfs: database is not opened with headervfs", -1);
+    } else if (rc == SQLITE_TOOBIG) {
+        sqlite3_result_error(ctx, "headervfs: new header is larger than the header", -1);
+    } else if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+    }
 }
 
-static void (*headerDlSym(sqlite3_vfs *pVfs, void *pH, const char *zSym))(void) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xDlSym(pRealVfs, pH, zSym);
+/*
+** SQL 函数 headervfs_changes_reset([schema])：开始变更跟踪的新一代，返回新一代的编号。
+** 备份应当在一个读事务中列出修改过的范围、复制它们，再调用这个函数，参见 README。
+*/
+static void headerChangesResetFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    sqlite3 *db = sqlite3_context_db_handle(ctx);
+    const char *zSchema = (argc > 0) ? (const char *) sqlite3_value_text(argv[0]) : "main";
+    HeaderVfsChanges changes;
+    memset(&changes, 0, sizeof(changes));
+    const int rc = sqlite3_file_control(db, zSchema, HEADERVFS_FCNTL_CHANGES_RESET, &changes);
+    sqlite3_free(changes.aBitmap);
+    if (rc == SQLITE_OK) {
+        sqlite3_result_int64(ctx, changes.iGeneration + 1);
+    } else if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "headervfs: database is not opened with track_changes", -1);
+    } else {
+        sqlite3_result_error_code(ctx, rc);
+    }
 }
 
-static void headerDlClose(sqlite3_vfs *pVfs, void *pHandle) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    pRealVfs->xDlClose(pRealVfs, pHandle);
-}
+/*
+** SQL 函数 headervfs_export(SRC, DEST [, VFS])：把 headervfs 实例 VFS（默认为 headervfs）格式的
+** 数据库 SRC 去掉头部，复制为普通的 SQLite 数据库文件 DEST。
+**
+** SQL 函数 headervfs_import(SRC, DEST [, HEADER [, VFS]])：把普通的数据库文件 SRC 加上头部复制为 DEST，
+** 头部的内容是 BLOB HEADER，不足头部大小的部分补零，HEADER 为 NULL 时全部为零。
+**
+** DEST 必须不存在。两个函数都返回复制的字节数（不含头部）。
+*/
+static void headerCopyFunc(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    const int bImport = sqlite3_user_data(ctx) != 0;
+    const char *zSrc = (const char *) sqlite3_value_text(argv[0]);
+    const char *zDst = (const char *) sqlite3_value_text(argv[1]);
+    const int iVfsArg = bImport ? 3 : 2;
+    const char *zVfs = (argc > iVfsArg) ? (const char *) sqlite3_value_text(argv[iVfsArg]) : "headervfs";
+    if (zSrc == 0 || zDst == 0 || zVfs == 0) {
+        sqlite3_result_error(ctx, "headervfs: source and destination paths are required", -1);
+        return;
+    }
 
-static int headerRandomness(sqlite3_vfs *pVfs, int nByte, char *zByte) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xRandomness(pRealVfs, nByte, zByte);
-}
+    sqlite3_vfs *pVfs = sqlite3_vfs_find(zVfs);
+    if (pVfs == 0 || pVfs->xOpen != headerOpen) {
+        char *zErr = sqlite3_mprintf("headervfs: \"%s\" is not a headervfs instance", zVfs);
+        sqlite3_result_error(ctx, zErr, -1);
+        sqlite3_free(zErr);
+        return;
+    }
+    const HeaderVfs *pHv = (HeaderVfs *) pVfs;
+    const sqlite3_int64 iHeaderSize = headerOptionInt64(pHv, 0, "header_size", HEADER_SIZE);
+    if (iHeaderSize < 0 || iHeaderSize > HEADER_SIZE_MAX) {
+        sqlite3_result_error(ctx, "headervfs: invalid header_size", -1);
+        return;
+    }
 
-static int headerSleep(sqlite3_vfs *pVfs, int nMicro) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xSleep(pRealVfs, nMicro);
-}
+    const void *aHead = 0;
+    int nHead = 0;
+    if (bImport && argc > 2) {
+        aHead = sqlite3_value_blob(argv[2]);
+        nHead = sqlite3_value_bytes(argv[2]);
+        if (nHead > iHeaderSize) {
+            char *zErr = sqlite3_mprintf("headervfs: header is larger than header_size (%lld bytes)", iHeaderSize);
+            sqlite3_result_error(ctx, zErr, -1);
+            sqlite3_free(zErr);
+            return;
+        }
+    }
 
-static int headerCurrentTime(sqlite3_vfs *pVfs, double *pTime) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xCurrentTime(pRealVfs, pTime);
+    sqlite3_int64 nByte = 0;
+    char *zErr = 0;
+    int rc;
+    if (bImport) {
+        rc = headerCopyDatabase(pHv, "import", zSrc, 0, 0, zDst, aHead, nHead, iHeaderSize, &nByte, &zErr);
+    } else {
+        rc = headerCopyDatabase(pHv, "export", zSrc, iHeaderSize, headerOption(pHv, 0, "journal_dir"), zDst,
+                                0, 0, 0, &nByte, &zErr);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_result_int64(ctx, nByte);
+    } else if (zErr) {
+        sqlite3_result_error(ctx, zErr, -1);
+    } else if (rc == SQLITE_CANTOPEN) {
+        zErr = sqlite3_mprintf("headervfs: cannot %s %s to %s (the destination must not exist)",
+                               bImport ? "import" : "export", zSrc, zDst);
+        sqlite3_result_error(ctx, zErr, -1);
+    } else {
+        sqlite3_result_error_code(ctx, rc);
+    }
+    sqlite3_free(zErr);
 }
 
-static int headerGetLastError(sqlite3_vfs *pVfs, int n, char *s) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xGetLastError(pRealVfs, n, s);
+/*
+** 在数据库连接上注册 headervfs 的 SQL 函数。
+*/
+static int headerRegisterFunctions(sqlite3 *db) {
+    /*
+    ** 有副作用的函数以 SQLITE_DIRECTONLY 注册，只能在顶层的 SQL 中直接调用，数据库中的触发器和视图
+    ** （可能来自不可信的文件）不能在用户不知情时执行它们：headervfs_register 影响整个进程，
+    ** headervfs_overlay_merge 改写基础文件，两个参数的 headervfs_header 修改文件中的头部，
+    ** headervfs_export/headervfs_import 创建文件，headervfs_changes_reset 丢掉增量备份需要的修改记录。
+    ** 只读取的函数没有这个限制。
+    */
+    int rc = sqlite3_create_function(db, "headervfs_register", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerRegisterFunc, 0, 0);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_register", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerRegisterFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_overlay_merge", 0, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerOverlayMergeFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_overlay_merge", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerOverlayMergeFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_header", 0, SQLITE_UTF8, 0, headerHeaderFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_header", 1, SQLITE_UTF8, 0, headerHeaderFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_header", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerHeaderFunc, 0, 0);
+    }
+    static const struct {
+        const char *zName;
+        int nArg;
+        int bImport;
+    } aCopy[] = {
+        {"headervfs_export", 2, 0}, {"headervfs_export", 3, 0},
+        {"headervfs_import", 2, 1}, {"headervfs_import", 3, 1}, {"headervfs_import", 4, 1},
+    };
+    for (size_t i = 0; rc == SQLITE_OK && i < sizeof(aCopy) / sizeof(aCopy[0]); i++) {
+        rc = sqlite3_create_function(db, aCopy[i].zName, aCopy[i].nArg, SQLITE_UTF8 | SQLITE_DIRECTONLY,
+                                     aCopy[i].bImport ? (void *) aCopy : 0, headerCopyFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_changes_reset", 0, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerChangesResetFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_function(db, "headervfs_changes_reset", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, headerChangesResetFunc, 0, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_module(db, "headervfs_stats", &headerStatsModule, 0);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_create_module(db, "headervfs_changes", &headerChangesModule, 0);
+    }
+    return rc;
 }
 
-static int headerCurrentTimeInt64(sqlite3_vfs *pVfs, sqlite3_int64 *pTime) {
-    sqlite3_vfs *pRealVfs = pVfs->pAppData;
-    return pRealVfs->xCurrentTimeInt64(pRealVfs, pTime);
+/*
+** 自动扩展入口：扩展被永久加载后，为之后打开的每个数据库连接注册 SQL 函数。
+*/
+static int headerAutoExtension(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+    (void) pzErrMsg;
+    (void) pApi;
+    return headerRegisterFunctions(db);
 }
 
-/****************************************************************************
-** 扩展注册函数
-****************************************************************************/
-
-
-// 全局静态的 VFS 结构体实例
-static sqlite3_vfs header_vfs;
-
 /*
 ** SQLite 扩展的入口点函数。
 ** 当执行 `SELECT load_extension(...)` 时，SQLite 会调用此函数。
@@ -327,51 +8388,30 @@ int sqlite3_headervfs_init(
     char **pzErrMsg,
     const sqlite3_api_routines *pApi
 ) {
-    (void) db;
     (void) pzErrMsg;
 
     int rc = SQLITE_OK;
 
     SQLITE_EXTENSION_INIT2(pApi);
 
-    sqlite3_vfs *pDefaultVfs = sqlite3_vfs_find(0);
-    if (pDefaultVfs == 0) {
-        return SQLITE_ERROR;
-    }
-
-    /* 复制默认 VFS 的内容到我们的结构体中，以继承其方法 */
-    memcpy(&header_vfs, pDefaultVfs, sizeof(sqlite3_vfs));
-
-    /* 设置 VFS 的名字 */
-    header_vfs.zName = "headervfs";
-
-    /* 存储指向真实 VFS 的指针，以便后续的传递调用 */
-    header_vfs.pAppData = pDefaultVfs;
-
-    /* 设置自定义的 sqlite3_file 结构的大小 */
-    header_vfs.szOsFile = sizeof(HeaderFile);
-
-    /* 覆写我们需要修改的 VFS 方法 */
-    header_vfs.xOpen = headerOpen;
-    header_vfs.xDelete = headerDelete;
-    header_vfs.xAccess = headerAccess;
-    header_vfs.xFullPathname = headerFullPathname;
-    header_vfs.xDlOpen = headerDlOpen;
-    header_vfs.xDlError = headerDlError;
-    header_vfs.xDlSym = headerDlSym;
-    header_vfs.xDlClose = headerDlClose;
-    header_vfs.xRandomness = headerRandomness;
-    header_vfs.xSleep = headerSleep;
-    header_vfs.xCurrentTime = headerCurrentTime;
-    header_vfs.xGetLastError = headerGetLastError;
-    header_vfs.xCurrentTimeInt64 = headerCurrentTimeInt64;
-
     /*
-    ** 注册我们的 VFS。
-    ** 第二个参数是 makeDefault，我们将其设置为 0 (false)。
-    ** 用户需要通过 sqlite3_open_v2() 的第四个参数显式选择使用此 VFS。
+    ** 注册默认的 headervfs 实例（头部大小为 HEADER_SIZE）。
+    ** 扩展可能被多次加载，已经注册过时不再重复注册。
+    ** 用户需要通过 sqlite3_open_v2() 的第四个参数或 URI 参数 vfs= 显式选择使用此 VFS。
     */
-    rc = sqlite3_vfs_register(&header_vfs, 0);
+    if (sqlite3_vfs_find("headervfs") == 0) {
+        rc = sqlite3_headervfs_register("headervfs", 0, 0);
+        if (rc == SQLITE_ERROR && sqlite3_vfs_find("headervfs") != 0) {
+            rc = SQLITE_OK;
+        }
+    }
+
+    if (rc == SQLITE_OK && db != 0) {
+        rc = headerRegisterFunctions(db);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_auto_extension((void (*)(void)) headerAutoExtension);
+    }
 
     if (rc == SQLITE_OK) {
         rc = SQLITE_OK_LOAD_PERMANENTLY;
@@ -0,0 +1,131 @@
+/*
+** headervfs：在数据库主文件开头跳过固定大小头部的 SQLite VFS 扩展。
+**
+** 这个头文件声明了扩展对外提供的 C 接口，供静态链接或通过 dlsym 获取符号的程序使用。
+** 通过 .load 加载扩展时不需要包含它。
+*/
+#ifndef HEADERVFS_H
+#define HEADERVFS_H
+
+#include "sqlite3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+** 扩展的入口点函数，注册名为 "headervfs" 的默认实例（头部大小 1024 字节）
+** 以及 headervfs_* 系列 SQL 函数。
+*/
+int sqlite3_headervfs_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+/*
+** 注册一个新的 headervfs 实例。
+**
+** zName      实例的名字，打开数据库时通过 vfs=zName 选择
+** zOptions   默认选项，格式与 URI 参数相同，例如 "header_size=4096&read_cache=1048576"，
+**            可以为 NULL。打开文件时 URI 参数优先于这里的默认选项。
+**            选项 base_vfs 指定实例叠加在哪个已注册的 VFS 上（例如 "base_vfs=unix-excl"），
+**            默认是注册时的默认 VFS
+** makeDefault 是否设为默认 VFS
+**
+** 名字已经被占用时返回 SQLITE_ERROR，base_vfs 指定的 VFS 不存在时返回 SQLITE_NOTFOUND。
+*/
+int sqlite3_headervfs_register(const char *zName, const char *zOptions, int makeDefault);
+
+/*
+** headervfs 自己的文件控制操作码，通过 sqlite3_file_control() 使用。
+** 取值避开了 SQLite 内置的 SQLITE_FCNTL_* 范围。
+*/
+#define HEADERVFS_FCNTL_BASE 0x68760000
+
+/*
+** 把覆盖层（overlay 模式）的增量文件合并回基础文件。
+** 参数是 sqlite3_int64*，成功时写入合并的页数。数据库没有以覆盖层模式打开时
+** 返回 SQLITE_NOTFOUND，其他连接仍然打开着数据库时返回 SQLITE_BUSY。
+*/
+#define HEADERVFS_FCNTL_OVERLAY_MERGE (HEADERVFS_FCNTL_BASE + 1)
+
+/*
+** 读取主数据库文件的 I/O 统计计数。参数是 HeaderVfsStats*，内容被整个覆盖。
+** 所有打开的文件以及进程的全局计数也可以通过虚拟表 headervfs_stats 查询。
+*/
+#define HEADERVFS_FCNTL_STATS (HEADERVFS_FCNTL_BASE + 2)
+
+/*
+** 读取或修改缓存的头部。参数都是 HeaderVfsHeader*。
+**
+** 头部在打开数据库时读入内存（不超过 64 KB 的部分），其他连接修改了文件之后，
+** 在下一个读事务开始时重新读取。
+**
+** HEADERVFS_FCNTL_HEADER_READ  把头部的前 nData 字节复制到 aData，nData 被改为缓存的头部的大小。
+** HEADERVFS_FCNTL_HEADER_WRITE 用 aData 替换头部的前 nData 字节，其余的字节不变。新内容在下一次
+**                              提交（主数据库文件的同步）时与事务的数据一起写入文件，在那之前
+**                              读到的已经是新内容。nData 超过缓存的头部时返回 SQLITE_TOOBIG，
+**                              数据库以只读方式打开时返回 SQLITE_READONLY。
+*/
+#define HEADERVFS_FCNTL_HEADER_READ (HEADERVFS_FCNTL_BASE + 3)
+#define HEADERVFS_FCNTL_HEADER_WRITE (HEADERVFS_FCNTL_BASE + 4)
+
+typedef struct HeaderVfsHeader {
+    void *aData;                /* 缓冲区 */
+    int nData;                  /* 缓冲区中的字节数 */
+} HeaderVfsHeader;
+
+/*
+** 变更跟踪（URI 参数 track_changes=1）：读取自上一次重置以来修改过的范围。参数是 HeaderVfsChanges*。
+**
+** HEADERVFS_FCNTL_CHANGES       读出当前这一代的位图。
+** HEADERVFS_FCNTL_CHANGES_RESET 读出当前这一代的位图，同时开始新的一代（清空位图）。
+**
+** 位图覆盖整个真实文件（包括头部），第 i 位（aBitmap[i/8] 的第 i%8 位）表示
+** [i*szBlock, (i+1)*szBlock) 被修改过。aBitmap 由调用者用 sqlite3_free() 释放。
+** 数据库没有开启变更跟踪时返回 SQLITE_NOTFOUND。
+*/
+#define HEADERVFS_FCNTL_CHANGES (HEADERVFS_FCNTL_BASE + 5)
+#define HEADERVFS_FCNTL_CHANGES_RESET (HEADERVFS_FCNTL_BASE + 6)
+
+typedef struct HeaderVfsChanges {
+    sqlite3_int64 iGeneration;  /* 位图所属的代，重置之后新的一代是 iGeneration + 1 */
+    sqlite3_int64 szBlock;      /* 每一位代表的字节数 */
+    sqlite3_int64 nBlock;       /* aBitmap 中的位数，之后的位都是 0 */
+    sqlite3_int64 iSize;        /* 真实文件当前的大小（包括头部） */
+    unsigned char *aBitmap;     /* 位图 */
+} HeaderVfsChanges;
+
+/* 延迟直方图的桶数：第 0 桶为 1 微秒以内，第 i 桶为 [2^(i-1), 2^i) 微秒，最后一桶不设上限 */
+#define HEADERVFS_STATS_BUCKETS 20
+
+/*
+** I/O 统计计数。所有成员都是 sqlite3_int64。
+*/
+typedef struct HeaderVfsStats {
+    sqlite3_int64 nRead;        /* xRead 次数 */
+    sqlite3_int64 nReadBytes;   /* 读取的字节数 */
+    sqlite3_int64 nWrite;       /* xWrite 次数 */
+    sqlite3_int64 nWriteBytes;  /* 写入的字节数 */
+    sqlite3_int64 nSync;        /* xSync 次数 */
+    sqlite3_int64 nTruncate;    /* xTruncate 次数 */
+    sqlite3_int64 nLock;        /* 成功的 xLock 次数 */
+    sqlite3_int64 nLockBusy;    /* 因为其他连接持有锁而失败的 xLock 次数（锁等待） */
+    sqlite3_int64 nShmLockBusy; /* 失败的 xShmLock 次数（WAL 模式下的锁等待） */
+    sqlite3_int64 nReadahead;   /* 发出的预读提示次数（URI 参数 readahead） */
+    sqlite3_int64 nReadaheadBytes; /* 预读提示覆盖的字节数 */
+    sqlite3_int64 nReadaheadHit;   /* 完全落在已预读范围内的 xRead 次数 */
+    sqlite3_int64 nPageCacheHit;   /* 由进程内共享页缓存（URI 参数 page_cache）满足的 xRead 次数 */
+    sqlite3_int64 nPageCacheMiss;  /* 查找共享页缓存未命中的 xRead 次数 */
+    sqlite3_int64 nCopyBytes;      /* headervfs_export/headervfs_import 已经复制的字节数（只有全局计数） */
+    sqlite3_int64 nAtomicCommit;   /* 通过原子批量写入（URI 参数 atomic_write）完成的提交次数 */
+    sqlite3_int64 nAtomicFallback; /* 原子批量写入失败、SQLite 改用回滚日志的次数 */
+    sqlite3_int64 nChecksumVerified; /* 核对过页校验和（URI 参数 page_checksum）的整页读取次数 */
+    sqlite3_int64 nChecksumError;    /* 页校验和不一致的次数（返回 SQLITE_IOERR_DATA） */
+    sqlite3_int64 aReadLatency[HEADERVFS_STATS_BUCKETS];  /* xRead 的延迟直方图 */
+    sqlite3_int64 aWriteLatency[HEADERVFS_STATS_BUCKETS]; /* xWrite 的延迟直方图 */
+    sqlite3_int64 aSyncLatency[HEADERVFS_STATS_BUCKETS];  /* xSync 的延迟直方图 */
+} HeaderVfsStats;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADERVFS_H */
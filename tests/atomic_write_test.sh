@@ -0,0 +1,167 @@
+#!/bin/bash
+
+# 测试原子批量写入（URI 参数 atomic_write）
+
+# --- 配置 ---
+DB_FILE="./atomic_write_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&atomic_write=1"
+
+# --- 执行操作 ---
+# 提交照常进行，重做日志在打开时创建，提交之后总是空的。SQLite 用 SQLITE_ENABLE_BATCH_ATOMIC_WRITE
+# 编译时小事务不再写回滚日志，否则 SQLite 忽略 SQLITE_IOCAP_BATCH_ATOMIC，仍然使用回滚日志
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 1000);
+UPDATE t SET x = 1 WHERE rowid = 500;
+SELECT count(*), sum(x IS 1) FROM t;
+.shell wc -c < '${DB_FILE}-batch'
+SELECT (SELECT count(*) FROM pragma_compile_options WHERE compile_options = 'ENABLE_BATCH_ATOMIC_WRITE') = (value > 0)
+  FROM headervfs_stats WHERE file = '*' AND stat = 'atomic_commit';
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="1000|1
+0
+1
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 开启原子批量写入之后的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 写日志时崩溃留下的不完整的日志：只读连接不能读取，读写连接在获得 SHARED 锁时把它丢弃，数据不变
+printf 'headervfs-bat-1\0torn' > "${DB_FILE}-batch"
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&atomic_write=1&mode=ro'
+SELECT count(*) FROM t;
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "readonly"; then
+    echo "[错误] 只读连接应该拒绝读取有待重放日志的数据库："
+    echo "$RESULT"
+    exit 1
+fi
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT count(*), sum(x IS 1) FROM t;
+.shell wc -c < '${DB_FILE}-batch'
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="1000|1
+0
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 不完整的日志没有被丢弃："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 不使用 atomic_write 的连接不创建日志，设备特性也不变
+rm -f "${DB_FILE}-batch"
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+INSERT INTO t VALUES(2);
+SELECT count(*) FROM t;
+.exit
+EOF
+)
+if [ "$RESULT" != "1001" ] || [ -e "${DB_FILE}-batch" ]; then
+    echo "[错误] 没有开启原子批量写入时不应该创建日志："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 提交之后、数据库文件落盘之前崩溃：手工写出一份有效的日志（记录这次提交之后的页），
+# 把数据库文件换回提交之前的内容，下一个读写连接获得 SHARED 锁时重放日志并截断它
+# 把整数 $1 按大端序输出为 $2 字节
+be() {
+    local i
+    for ((i = $2 - 1; i >= 0; i--)); do
+        printf "\\x$(printf %02x $((($1 >> (8 * i)) & 255)))"
+    done
+}
+# 与 WAL 帧相同的校验和：按 8 字节一组累加，末尾不足 8 字节的部分补零
+batch_sum() {
+    local a=($(od -An -v -tu1 "$1")) s1=0 s2=0 i
+    while [ $((${#a[@]} % 8)) -ne 0 ]; do
+        a+=(0)
+    done
+    for ((i = 0; i < ${#a[@]}; i += 8)); do
+        s1=$(((s1 + ((a[i] << 24) | (a[i + 1] << 16) | (a[i + 2] << 8) | a[i + 3]) + s2) & 0xffffffff))
+        s2=$(((s2 + ((a[i + 4] << 24) | (a[i + 5] << 16) | (a[i + 6] << 8) | a[i + 7]) + s1) & 0xffffffff))
+    done
+    echo "$s1 $s2"
+}
+HEADER_SIZE=1024
+cp "$DB_FILE" "${DB_FILE}-before"
+PAGE_SIZE=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+UPDATE t SET x = 3 WHERE rowid = 1;
+PRAGMA page_size;
+.exit
+EOF
+)
+: > "${DB_FILE}-body"
+for PGNO in $(cmp -l "${DB_FILE}-before" "$DB_FILE" | awk -v h=$HEADER_SIZE -v p="$PAGE_SIZE" '{ print int(($1 - 1 - h) / p) }' | sort -un); do
+    be $((PGNO * PAGE_SIZE)) 8 >> "${DB_FILE}-body"
+    be "$PAGE_SIZE" 4 >> "${DB_FILE}-body"
+    tail -c +$((HEADER_SIZE + PGNO * PAGE_SIZE + 1)) "$DB_FILE" | head -c "$PAGE_SIZE" >> "${DB_FILE}-body"
+done
+COUNTER=$(od -An -tu1 -j $((HEADER_SIZE + 24)) -N 4 "$DB_FILE" | awk '{ print $1 * 16777216 + $2 * 65536 + $3 * 256 + $4 }')
+{
+    printf 'headervfs-bat-1\0'
+    be "$(wc -c < "${DB_FILE}-body")" 8
+    be "$COUNTER" 4
+    be 0 4
+} > "${DB_FILE}-head"
+read -r H1 H2 <<< "$(batch_sum "${DB_FILE}-head")"
+read -r B1 B2 <<< "$(batch_sum "${DB_FILE}-body")"
+{
+    cat "${DB_FILE}-head"
+    be $(((H1 + B1) & 0xffffffff)) 4
+    be $(((H2 + B2) & 0xffffffff)) 4
+    cat "${DB_FILE}-body"
+} > "${DB_FILE}-batch"
+mv "${DB_FILE}-before" "$DB_FILE"
+rm -f "${DB_FILE}-head" "${DB_FILE}-body"
+
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT x IS 3 FROM t WHERE rowid = 1;
+.open '${URI}'
+SELECT x IS 3 FROM t WHERE rowid = 1;
+.shell wc -c < '${DB_FILE}-batch'
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="0
+1
+0
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 有效的日志没有被重放："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# 测试叠加在指定的底层 VFS 上（注册选项和 URI 参数 base_vfs）
+
+# --- 配置 ---
+DB_FILE="./base_vfs_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 叠加在 unix-excl 上的实例：WAL 索引在堆内存中，不创建 -shm 文件
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_excl', 'base_vfs=unix-excl');
+.open 'file:${DB_FILE}?vfs=headervfs_excl'
+PRAGMA journal_mode=WAL;
+CREATE TABLE t(x);
+INSERT INTO t SELECT value FROM generate_series(1, 1000);
+PRAGMA headervfs_base_vfs;
+.shell test -e '${DB_FILE}-shm' && echo shm || echo no-shm
+PRAGMA journal_mode=DELETE;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA headervfs_base_vfs;
+SELECT sum(x) FROM t;
+.exit
+EOF
+)
+EXPECTED="
+wal
+unix-excl
+no-shm
+delete
+unix
+500500"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 叠加在 unix-excl 上的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# URI 参数为单个数据库选择底层 VFS；叠加在另一个 headervfs 实例上时使用它下面的真实 VFS，头部只跳过一次
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_stacked', 'base_vfs=headervfs');
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&base_vfs=unix-none'
+PRAGMA headervfs_base_vfs;
+INSERT INTO t VALUES(1);
+.open 'file:${DB_FILE}?vfs=headervfs_stacked'
+PRAGMA headervfs_base_vfs;
+SELECT sum(x) FROM t;
+.exit
+EOF
+)
+EXPECTED="
+unix-none
+unix
+500501"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] URI 参数 base_vfs 的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 不存在的底层 VFS：注册和打开都失败（打开失败时 shell 会退出）
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_bad', 'base_vfs=no-such-vfs');
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&base_vfs=no-such-vfs'
+SELECT count(*) FROM t;
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "base vfs not found" || ! echo "$RESULT" | grep -q "unable to open database"; then
+    echo "[错误] 不存在的底层 VFS 没有报错："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
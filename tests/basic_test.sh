@@ -22,6 +22,15 @@ esac
 
 echo "EXTENSION_PATH is set to: $EXTENSION_PATH"
 
+# 优先使用 sqlcipher，没有安装时退回到普通的 sqlite3（可通过 SQLITE_SHELL 指定）
+if [ -z "$SQLITE_SHELL" ]; then
+    if command -v sqlcipher >/dev/null 2>&1; then
+        SQLITE_SHELL=sqlcipher
+    else
+        SQLITE_SHELL=sqlite3
+    fi
+fi
+
 # --- 准备工作 ---
 set -e
 rm -f "$DB_FILE"
@@ -31,7 +40,7 @@ if [ ! -f "$EXTENSION_PATH" ]; then
 fi
 
 # --- 执行操作 ---
-sqlcipher "$DB_FILE" <<EOF
+"$SQLITE_SHELL" "$DB_FILE" <<EOF
 .load '${EXTENSION_PATH}'
 PRAGMA vfs_name = '${VFS_NAME}';
 
@@ -0,0 +1,134 @@
+#!/bin/bash
+
+# 测试变更跟踪（URI 参数 track_changes，虚拟表 headervfs_changes）
+
+# --- 配置 ---
+DB_FILE="./changes_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&track_changes=1"
+
+# --- 执行操作 ---
+# 新建的数据库整个文件（头部和所有页）都被修改过；重置之后位图清空，之后只记录新修改的块，相邻的块合并成一行
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 1000);
+SELECT offset, length >= (SELECT page_count * page_size FROM pragma_page_count, pragma_page_size), generation FROM headervfs_changes('main');
+SELECT headervfs_changes_reset();
+SELECT count(*) FROM headervfs_changes;
+UPDATE t SET x = 1 WHERE rowid = 500;
+SELECT offset, length, generation FROM headervfs_changes('main');
+.exit
+EOF
+)
+EXPECTED="0|1|1
+2
+0
+0|65536|2
+131072|65536|2"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 修改过的范围不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 位图在进程之间保留；另一个进程的修改（包括没有正常关闭的进程）也被记录
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+UPDATE t SET x = 2 WHERE rowid = 1000;
+.shell kill -9 \$PPID
+EOF
+) || true
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT offset, length, generation FROM headervfs_changes;
+SELECT x FROM t WHERE rowid = 1000;
+.exit
+EOF
+)
+EXPECTED="0|65536|2
+131072|65536|2
+262144|62464|2
+2"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 位图没有在进程之间保留："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 按照 README 中的步骤做增量备份：复制修改过的范围之后备份和数据库完全一样
+cp "$DB_FILE" "$DB_FILE-backup"
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT headervfs_changes_reset();
+DELETE FROM t WHERE rowid > 600;
+VACUUM;
+BEGIN;
+SELECT count(*) FROM sqlite_schema;
+.once '${DB_FILE}-ranges'
+SELECT offset, length FROM headervfs_changes('main');
+SELECT headervfs_changes_reset();
+COMMIT;
+SELECT count(*) FROM headervfs_changes;
+.exit
+EOF
+)
+EXPECTED="3
+1
+4
+0"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 增量备份时的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+while IFS='|' read -r OFFSET LENGTH; do
+    dd if="$DB_FILE" of="$DB_FILE-backup" bs=65536 iflag=skip_bytes,count_bytes oflag=seek_bytes skip="$OFFSET" seek="$OFFSET" count="$LENGTH" conv=notrunc status=none
+done < "$DB_FILE-ranges"
+truncate -s "$(stat -c %s "$DB_FILE")" "$DB_FILE-backup"
+if ! cmp -s "$DB_FILE" "$DB_FILE-backup"; then
+    echo "[错误] 增量备份和数据库不一致"
+    exit 1
+fi
+
+# 重置只能在顶层的 SQL 中调用，触发器中的调用被拒绝
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+CREATE TRIGGER tr AFTER INSERT ON t BEGIN SELECT headervfs_changes_reset(); END;
+INSERT INTO t VALUES(1);
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "unsafe use of headervfs_changes_reset"; then
+    echo "[错误] 触发器不应该能重置变更记录："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 没有开启变更跟踪时报错
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT * FROM headervfs_changes;
+SELECT headervfs_changes_reset();
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | grep -c "not opened with track_changes")" != "2" ]; then
+    echo "[错误] 没有开启变更跟踪时应该报错："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
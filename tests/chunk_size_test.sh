@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# 测试按逻辑大小分块预分配（URI 参数 chunk_size）
+
+# --- 配置 ---
+DB_FILE="./chunk_size_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 批量插入之后，文件大小是头部加上整数个块
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&chunk_size=1048576'
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 10000);
+SELECT count(*) FROM t;
+.exit
+EOF
+)
+if [ "$RESULT" != "10000" ]; then
+    echo "[错误] 插入的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+SIZE=$(wc -c < "$DB_FILE")
+if [ $(( (SIZE - 1024) % 1048576 )) -ne 0 ] || [ "$SIZE" -le 1048576 ]; then
+    echo "[错误] 文件大小 $SIZE 没有按逻辑大小对齐到块。"
+    exit 1
+fi
+
+# 收缩之后仍然保留整块，数据完整
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&chunk_size=1048576'
+DELETE FROM t WHERE rowid > 100;
+VACUUM;
+SELECT count(*) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="100
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 收缩之后的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+SIZE=$(wc -c < "$DB_FILE")
+if [ "$SIZE" -ne $(( 1024 + 1048576 )) ]; then
+    echo "[错误] 收缩之后的文件大小 $SIZE 不符合预期。"
+    exit 1
+fi
+
+# 不带 chunk_size 打开时仍然可以正常读取
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*) FROM t;
+.exit
+EOF
+)
+if [ "$RESULT" != "100" ]; then
+    echo "[错误] 重新打开之后的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
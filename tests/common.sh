@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# 测试脚本共用的准备工作，在脚本的配置部分之后 source：
+# 确定扩展库的路径和 sqlite3 shell，删除上次留下的 $DB_FILE 及其附属文件，检查扩展库是否存在
+
+case "$(uname)" in
+    Darwin)
+        EXTENSION_PATH="./libheadervfs.dylib"
+        ;;
+    Linux)
+        EXTENSION_PATH="./libheadervfs.so"
+        ;;
+    MINGW*|MSYS*|CYGWIN*|Windows_NT)
+        EXTENSION_PATH="./headervfs.dll"
+        ;;
+    *)
+        echo "Unsupported OS: $(uname)"
+        exit 1
+        ;;
+esac
+
+# 优先使用 sqlcipher，没有安装时退回到普通的 sqlite3（可通过 SQLITE_SHELL 指定）
+if [ -z "$SQLITE_SHELL" ]; then
+    if command -v sqlcipher >/dev/null 2>&1; then
+        SQLITE_SHELL=sqlcipher
+    else
+        SQLITE_SHELL=sqlite3
+    fi
+fi
+
+set -e
+if [ -n "$DB_FILE" ]; then
+    rm -f "$DB_FILE" "$DB_FILE"-*
+fi
+if [ ! -f "$EXTENSION_PATH" ]; then
+    echo "[错误] 扩展库 '$EXTENSION_PATH' 不存在。"
+    exit 1
+fi
@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# 测试直接 I/O（URI 参数 direct_io=1），文件系统不支持时应当退回到页缓存
+
+# --- 配置 ---
+DB_FILE="./direct_io_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 头部大小不是块大小的倍数，每个页的首尾都要读-改-写；头部的内容必须保持不变
+head -c 100 /dev/zero | tr '\0' 'H' > "$DB_FILE"
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&header_size=100&direct_io=1&write_buffer=1048576'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(300) FROM generate_series(1, 10000);
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&header_size=100&direct_io=1&read_cache=1048576'
+PRAGMA cache_size=10;
+UPDATE t SET y = zeroblob(10) WHERE x % 3 = 0;
+DELETE FROM t WHERE x > 8000;
+VACUUM;
+SELECT count(*), sum(length(y)) FROM t;
+PRAGMA integrity_check;
+PRAGMA headervfs_direct_io;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&header_size=100'
+SELECT count(*), sum(length(y)) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed 's/^align=[0-9]* reads=[1-9][0-9]* writes=[1-9][0-9]* rmw_blocks=[1-9][0-9]*$/direct/')
+EXPECTED="8000|1626860
+ok
+direct
+8000|1626860
+ok"
+EXPECTED_FALLBACK=$(echo "$EXPECTED" | sed 's/^direct$/off/')
+if [ "$RESULT" != "$EXPECTED" ] && [ "$RESULT" != "$EXPECTED_FALLBACK" ]; then
+    echo "[错误] 直接 I/O 的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 文件大小是头部加上整数个页（写到末尾之后的对齐部分已经截断），头部没有被改写
+SIZE=$(wc -c < "$DB_FILE")
+if [ $(( (SIZE - 100) % 4096 )) -ne 0 ] || [ "$(head -c 100 "$DB_FILE" | tr -d 'H' | wc -c)" -ne 0 ]; then
+    echo "[错误] 文件大小或头部不符合预期：$SIZE"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,150 @@
+#!/bin/bash
+
+# 测试导出与导入函数（headervfs_export / headervfs_import）
+
+# --- 配置 ---
+DB_FILE="./export_import_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+PLAIN_FILE="./export_import_test_plain.db"
+COPY_FILE="./export_import_test_copy.db"
+rm -f "$PLAIN_FILE" "$COPY_FILE"
+
+# --- 执行操作 ---
+# 导出为普通的数据库文件，再加上头部导入回来，两边的内容一致
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(300) FROM generate_series(1, 1000);
+SELECT headervfs_export('${DB_FILE}', '${PLAIN_FILE}') = page_count * page_size FROM pragma_page_count, pragma_page_size;
+SELECT headervfs_export('${DB_FILE}', '${PLAIN_FILE}');
+SELECT headervfs_import('${PLAIN_FILE}', '${COPY_FILE}', x'4845414445523031');
+SELECT headervfs_import('${PLAIN_FILE}', '${COPY_FILE}-big', zeroblob(1025));
+SELECT value > 0 FROM headervfs_stats WHERE file = '*' AND stat = 'copy_bytes';
+ATTACH 'file:${PLAIN_FILE}?vfs=unix' AS plain;
+ATTACH 'file:${COPY_FILE}?vfs=${VFS_NAME}' AS copy;
+SELECT count(*), sum(x) FROM plain.t;
+SELECT (SELECT group_concat(hex(y)) FROM main.t) = (SELECT group_concat(hex(y)) FROM copy.t);
+PRAGMA copy.integrity_check;
+.exit
+EOF
+) || true
+RESULT=$(echo "$RESULT" | sed 's/^[0-9]\{6,\}$/BYTES/')
+EXPECTED="1
+Runtime error near line 6: headervfs: cannot export ${DB_FILE} to ${PLAIN_FILE} (the destination must not exist)
+BYTES
+Runtime error near line 8: headervfs: header is larger than header_size (1024 bytes)
+1
+1000|500500
+1
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 导出和导入的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ "$(head -c 8 "$COPY_FILE")" != "HEADER01" ] || [ "$(stat -c %s "$COPY_FILE")" != "$(stat -c %s "$DB_FILE")" ]; then
+    echo "[错误] 导入的文件头部不符合预期"
+    exit 1
+fi
+
+# 其他头部大小的实例；WAL 文件存在时拒绝导出
+rm -f "$PLAIN_FILE" "$COPY_FILE"
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_4k', 4096);
+SELECT headervfs_import('${DB_FILE}', '${COPY_FILE}', NULL, 'unix');
+.open 'file:${COPY_FILE}?vfs=headervfs_4k'
+CREATE TABLE t(x);
+INSERT INTO t SELECT value FROM generate_series(1, 100);
+PRAGMA journal_mode=WAL;
+INSERT INTO t VALUES(0);
+SELECT headervfs_export('${COPY_FILE}', '${PLAIN_FILE}', 'headervfs_4k');
+PRAGMA journal_mode=DELETE;
+SELECT headervfs_export('${COPY_FILE}', '${PLAIN_FILE}', 'headervfs_4k') > 0;
+ATTACH 'file:${PLAIN_FILE}?vfs=unix' AS plain;
+SELECT sum(x) FROM plain.t;
+.exit
+EOF
+) || true
+EXPECTED="
+Runtime error near line 3: headervfs: \"unix\" is not a headervfs instance
+wal
+Runtime error near line 9: headervfs: ${COPY_FILE} has a WAL file, checkpoint it and close all connections first
+delete
+1
+5050"
+# 错误信息中是完整路径
+RESULT=$(echo "$RESULT" | sed "s|$(pwd)/|./|")
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 导出 WAL 模式的数据库的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# TRUNCATE 检查点之后留下的空 WAL 文件不影响导出
+rm -f "$PLAIN_FILE"
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_4k', 4096);
+.open 'file:${COPY_FILE}?vfs=headervfs_4k'
+PRAGMA journal_mode=WAL;
+INSERT INTO t VALUES(1);
+PRAGMA wal_checkpoint(TRUNCATE);
+.shell test -e '${COPY_FILE}-wal' && test ! -s '${COPY_FILE}-wal' && echo empty
+SELECT headervfs_export('${COPY_FILE}', '${PLAIN_FILE}', 'headervfs_4k') > 0;
+ATTACH 'file:${PLAIN_FILE}?vfs=unix' AS plain;
+SELECT sum(x) FROM plain.t;
+.exit
+EOF
+) || true
+EXPECTED="
+wal
+0|0|0
+empty
+1
+5051"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 空 WAL 文件时导出的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 写事务进行到一半时进程崩溃，留下热日志：回滚之前拒绝导出
+rm -f "$PLAIN_FILE"
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA cache_size=5;
+BEGIN;
+UPDATE t SET y = zeroblob(300);
+.shell kill -9 \$PPID
+EOF
+) || true
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_export('${DB_FILE}', '${PLAIN_FILE}');
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*) FROM t WHERE y = zeroblob(300);
+SELECT headervfs_export('${DB_FILE}', '${PLAIN_FILE}') > 0;
+.exit
+EOF
+) || true
+# 错误信息中是完整路径
+RESULT=$(echo "$RESULT" | sed "s|$(pwd)/|./|")
+EXPECTED="Runtime error near line 2: headervfs: ${DB_FILE} has a hot journal, open it once to roll back first
+0
+1"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 有热日志时导出的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-* "$PLAIN_FILE" "$COPY_FILE" "$COPY_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,132 @@
+#!/bin/bash
+
+# 测试缓存的头部（headervfs_header 函数和 HEADERVFS_FCNTL_HEADER_* 文件控制）
+
+# --- 配置 ---
+DB_FILE="./header_api_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+
+# --- 执行操作 ---
+# 修改先对本连接可见，下一次提交时才写入文件；超过头部大小的内容被拒绝
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT length(headervfs_header()), headervfs_header() = zeroblob(1024);
+CREATE TABLE t(x);
+SELECT headervfs_header('main', CAST('HVF1' AS BLOB));
+SELECT CAST(substr(headervfs_header(), 1, 4) AS TEXT);
+.shell head -c 4 '${DB_FILE}' | od -An -c | tr -d ' '
+INSERT INTO t VALUES(1);
+.shell head -c 4 '${DB_FILE}' | od -An -c | tr -d ' '
+SELECT headervfs_header('main', zeroblob(1025));
+.exit
+EOF
+) || true
+EXPECTED="1024|1
+
+HVF1
+\0\0\0\0
+HVF1
+Runtime error near line 10: headervfs: new header is larger than the header"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 头部的读取和修改不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 其他进程修改了头部并提交之后，下一个读事务看到新的头部
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*), CAST(substr(headervfs_header(), 1, 4) AS TEXT) FROM t;
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: "SELECT headervfs_header('main', CAST('HVF2' AS BLOB)); INSERT INTO t VALUES(2);"
+SELECT count(*), CAST(substr(headervfs_header(), 1, 4) AS TEXT) FROM t;
+.exit
+EOF
+)
+EXPECTED="1|HVF1
+
+2|HVF2"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 没有看到其他进程修改的头部："
+    echo "$RESULT"
+    exit 1
+fi
+
+# WAL 模式下数据库文件只在检查点时写入，头部也随检查点写入
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA journal_mode=WAL;
+SELECT headervfs_header('main', CAST('HVF3' AS BLOB));
+INSERT INTO t VALUES(3);
+.shell head -c 4 '${DB_FILE}' | od -An -c | tr -d ' '
+PRAGMA wal_checkpoint(TRUNCATE);
+.shell head -c 4 '${DB_FILE}' | od -An -c | tr -d ' '
+PRAGMA journal_mode=DELETE;
+.exit
+EOF
+)
+EXPECTED="wal
+
+HVF2
+0|0|0
+HVF3
+delete"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] WAL 模式下头部的写入不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 只读打开时不能修改；没有使用 headervfs 的数据库没有头部；头部大小为 0 时是空的 BLOB
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&mode=ro'
+SELECT CAST(substr(headervfs_header(), 1, 4) AS TEXT);
+SELECT headervfs_header('main', x'00');
+.open ':memory:'
+SELECT headervfs_header();
+.open 'file:${DB_FILE}-0?vfs=${VFS_NAME}&header_size=0'
+SELECT quote(headervfs_header());
+.exit
+EOF
+) || true
+EXPECTED="HVF3
+Runtime error near line 4: attempt to write a readonly database (8)
+Runtime error near line 6: headervfs: database is not opened with headervfs
+X''"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 只读和没有头部的情况不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 修改头部只能在顶层的 SQL 中调用，触发器中的调用被拒绝；读取头部不受限制
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TEMP VIEW v AS SELECT CAST(substr(headervfs_header(), 1, 4) AS TEXT);
+SELECT * FROM v;
+CREATE TRIGGER tr AFTER INSERT ON t BEGIN SELECT headervfs_header('main', CAST('EVIL' AS BLOB)); END;
+INSERT INTO t VALUES(3);
+SELECT * FROM v;
+.exit
+EOF
+) || true
+EXPECTED="HVF3
+Parse error near line 6: unsafe use of headervfs_header()
+HVF3"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 触发器不应该能修改头部："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,97 @@
+#!/bin/bash
+
+# 测试运行时头部大小（URI 参数 header_size）和多个 headervfs 实例（headervfs_register）
+
+# --- 配置 ---
+DB_A="./header_size_a.db"
+DB_B="./header_size_b.db"
+
+# 检查 $1 文件在偏移量 $2 处是否是 SQLite 数据库
+check_magic() {
+    local MAGIC
+    MAGIC=$(tail -c +$(($2 + 1)) "$1" | head -c 15)
+    if [ "$MAGIC" != "SQLite format 3" ]; then
+        echo "[错误] $1 在偏移量 $2 处不是 SQLite 数据库。"
+        exit 1
+    fi
+}
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+rm -f "$DB_A" "$DB_B"
+
+# --- 执行操作 ---
+# 在同一个进程中：A 使用 URI 参数 header_size=4096，B 使用注册的 512 字节实例
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs512', 512);
+.open 'file:${DB_A}?vfs=headervfs&header_size=4096'
+CREATE TABLE a(x);
+INSERT INTO a VALUES('four-k');
+ATTACH 'file:${DB_B}?vfs=headervfs512' AS b;
+CREATE TABLE b.b(y);
+INSERT INTO b.b VALUES('half-k');
+SELECT x, y FROM a, b.b;
+.exit
+EOF
+)
+
+if [ "$RESULT" != "
+four-k|half-k" ]; then
+    echo "[错误] 结果不符合预期：$RESULT"
+    exit 1
+fi
+
+check_magic "$DB_A" 4096
+check_magic "$DB_B" 512
+
+# 重复注册同名实例应该报错；用选项字符串注册的实例可以读取 A
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs4k', 'header_size=4096');
+SELECT headervfs_register('headervfs4k', 4096);
+.open 'file:${DB_A}?vfs=headervfs4k&mode=ro'
+SELECT x FROM a;
+.exit
+EOF
+) || true
+
+case "$RESULT" in
+    *"already exists"*four-k*) ;;
+    *)
+        echo "[错误] 结果不符合预期：$RESULT"
+        exit 1
+        ;;
+esac
+
+# 注册实例只能在顶层的 SQL 中调用，触发器和视图中的调用被拒绝
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+CREATE TABLE t(x);
+CREATE TRIGGER tr AFTER INSERT ON t BEGIN SELECT headervfs_register('headervfs_trigger', 512); END;
+INSERT INTO t VALUES(1);
+CREATE VIEW v AS SELECT headervfs_register('headervfs_view', 512);
+SELECT * FROM v;
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | grep -c "unsafe use of headervfs_register")" != "2" ]; then
+    echo "[错误] 触发器和视图不应该能注册实例：$RESULT"
+    exit 1
+fi
+
+# 头部大小不匹配时无法识别数据库
+if "$SQLITE_SHELL" >/dev/null 2>&1 <<EOF
+.bail on
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_B}?vfs=headervfs&mode=ro'
+SELECT y FROM b;
+EOF
+then
+    echo "[错误] 使用错误的头部大小打开数据库应该失败。"
+    exit 1
+fi
+
+rm -f "$DB_A" "$DB_B"
+echo "All tests succeeded!"
+exit 0
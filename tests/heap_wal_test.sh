@@ -0,0 +1,116 @@
+#!/bin/bash
+
+# 测试堆内存 WAL 索引（URI 参数 wal_index=heap）
+
+# --- 配置 ---
+DB_FILE="./heap_wal_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&wal_index=heap"
+
+# --- 执行操作 ---
+# WAL 索引在堆内存中，不创建 -shm 文件；同一进程的两个连接互相看到对方的提交，锁在进程内生效
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA journal_mode=WAL;
+CREATE TABLE t(x);
+INSERT INTO t SELECT value FROM generate_series(1, 10000);
+PRAGMA headervfs_wal_index;
+.shell test -e '${DB_FILE}-shm' && echo shm || echo no-shm
+ATTACH '${URI}' AS other;
+BEGIN;
+SELECT count(*) FROM main.t;
+INSERT INTO other.t VALUES(1);
+SELECT count(*) FROM main.t;
+COMMIT;
+SELECT count(*) FROM main.t;
+BEGIN;
+INSERT INTO main.t VALUES(2);
+INSERT INTO other.t VALUES(3);
+COMMIT;
+PRAGMA integrity_check;
+.exit
+EOF
+) || true
+EXPECTED="wal
+heap regions=1 bytes=32768
+no-shm
+10000
+10000
+10001
+Runtime error near line 17: database is locked (5)
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 堆内存 WAL 索引的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 打开着数据库时其他进程不能访问它（不论是否使用 wal_index=heap）
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT count(*) FROM t;
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: "SELECT count(*) FROM t"
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open '${URI}'" :memory: "SELECT count(*) FROM t"
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | head -1)" != "10002" ] || [ "$(echo "$RESULT" | grep -c "database is locked")" != "2" ]; then
+    echo "[错误] 其他进程没有被拒绝："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 第一个连接只读打开时同样持有排他锁：其他进程的 WAL 写入者不能绕过堆内存索引写入 -wal 文件，
+# 之后同一进程中读写打开的连接可以正常写入
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}&mode=ro'
+SELECT count(*) FROM t;
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: "INSERT INTO t VALUES(4)"
+ATTACH '${URI}' AS rw;
+INSERT INTO rw.t VALUES(5);
+SELECT count(*) FROM main.t;
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | head -1)" != "10002" ] || [ "$(echo "$RESULT" | tail -1)" != "10003" ] \
+    || [ "$(echo "$RESULT" | grep -c "database is locked")" != "1" ]; then
+    echo "[错误] 只读打开时其他进程没有被拒绝："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 进程崩溃后 WAL 文件还在，下次打开时从 WAL 文件恢复索引
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA wal_autocheckpoint=0;
+INSERT INTO t SELECT value FROM generate_series(1, 1000);
+.shell kill -9 \$PPID
+EOF
+) || true
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT count(*) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="11003
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 崩溃后恢复的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# 测试不可变模式（URI 参数 immutable）
+
+# --- 配置 ---
+DB_FILE="./immutable_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x);
+INSERT INTO t SELECT value FROM generate_series(1, 1000);
+.exit
+EOF
+)
+
+# 不可变模式下可以查询，但不加锁，写入失败（写入会让 shell 返回错误，所以忽略退出码）
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&immutable=1'
+SELECT sum(x) FROM t;
+SELECT sum(x) FROM t;
+SELECT value FROM headervfs_stats WHERE file LIKE '%immutable_test.db' AND stat = 'lock';
+PRAGMA headervfs_immutable;
+INSERT INTO t VALUES(1);
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | sed -n 1,3p)" != "500500
+500500
+0" ] || ! echo "$RESULT" | sed -n 4p | grep -q "^size=[0-9]* mtime_ns=[0-9]*$" \
+    || ! echo "$RESULT" | grep -q "readonly"; then
+    echo "[错误] 不可变模式的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 实例的默认选项同样有效；文件在进程打开着它的时候被改写，之后的打开会发现并丢弃共享页缓存
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_ro', 'immutable=1&page_cache=1048576');
+.open 'file:${DB_FILE}?vfs=headervfs_ro'
+SELECT sum(x) FROM t;
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: "INSERT INTO t VALUES(5000)"
+ATTACH 'file:${DB_FILE}?vfs=headervfs_ro' AS other;
+SELECT sum(x) FROM other.t;
+.exit
+EOF
+)
+EXPECTED="
+500500
+505500"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 改写之后不可变模式的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# WAL 文件不为空时拒绝以不可变模式打开（打开失败时 shell 会退出）
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA journal_mode=WAL;
+INSERT INTO t VALUES(1);
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}&immutable=1'" :memory: "SELECT count(*) FROM t"
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "unable to open database"; then
+    echo "[错误] WAL 文件存在时应该拒绝以不可变模式打开："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# 测试 io_uring 引擎（URI 参数 io_uring=1），内核不支持时应当退回到同步路径
+
+# --- 配置 ---
+DB_FILE="./io_uring_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 写回缓冲区的刷新通过引擎批量提交，结果与普通连接看到的一致
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&io_uring=1&write_buffer=1048576'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(300) FROM generate_series(1, 10000);
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&io_uring=1&write_buffer=65536'
+PRAGMA cache_size=10;
+UPDATE t SET y = zeroblob(10) WHERE x % 3 = 0;
+SELECT count(*), sum(length(y)) FROM t;
+PRAGMA integrity_check;
+PRAGMA headervfs_io_uring;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*), sum(length(y)) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed 's/^entries=[0-9]* .*ops=[1-9][0-9]*$/engine/')
+EXPECTED="10000|2033430
+ok
+engine
+10000|2033430
+ok"
+EXPECTED_FALLBACK=$(echo "$EXPECTED" | sed 's/^engine$/off/')
+if [ "$RESULT" != "$EXPECTED" ] && [ "$RESULT" != "$EXPECTED_FALLBACK" ]; then
+    echo "[错误] io_uring 引擎的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,126 @@
+#!/bin/bash
+
+# 测试日志目录（URI 参数 journal_dir，实例选项 temp_dir）
+
+# --- 配置 ---
+DB_FILE="./journal_dir_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+JOURNAL_DIR="./journal_dir_test.d"
+rm -rf "$JOURNAL_DIR"
+mkdir "$JOURNAL_DIR"
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&journal_dir=${JOURNAL_DIR}"
+
+# --- 执行操作 ---
+# 回滚日志和 WAL 文件都在日志目录下，数据库旁边只有 -shm 文件
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA journal_mode=PERSIST;
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, zeroblob(500) FROM generate_series(1, 1000);
+.shell ls '${JOURNAL_DIR}'; ls ${DB_FILE}*
+PRAGMA journal_mode=WAL;
+INSERT INTO t VALUES(1, NULL);
+.shell ls '${JOURNAL_DIR}'; ls ${DB_FILE}*
+PRAGMA journal_mode=DELETE;
+SELECT sum(x) FROM t;
+.shell ls '${JOURNAL_DIR}' | wc -l
+.exit
+EOF
+)
+# 文件名中间是数据库完整路径的哈希
+RESULT=$(echo "$RESULT" | sed 's/[.][0-9a-f]\{16\}[.]/.HASH./')
+EXPECTED="persist
+journal_dir_test.db.HASH.journal
+./journal_dir_test.db
+wal
+journal_dir_test.db.HASH.wal
+./journal_dir_test.db
+./journal_dir_test.db-shm
+delete
+500501
+0"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 日志文件的位置不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 写事务进行到一半时进程崩溃（页缓存很小，修改过的页已经写进了数据库文件），
+# 日志目录下的热日志在下次打开时被回滚
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA cache_size=5;
+BEGIN;
+UPDATE t SET x = x + 1000000;
+.shell kill -9 \$PPID
+EOF
+) || true
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="500501
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 热日志没有被回滚："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 快照、内存和不可变模式在日志目录下查找 WAL 文件：WAL 中还有没写回的帧时拒绝打开，
+# 检查点把 WAL 截断为空之后可以打开
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA journal_mode=WAL;
+PRAGMA wal_autocheckpoint=0;
+INSERT INTO t VALUES(1, NULL);
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open '${URI}&immutable=1'" :memory: "SELECT count(*) FROM t"
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open '${URI}&memory=1'" :memory: "SELECT count(*) FROM t"
+PRAGMA wal_checkpoint(TRUNCATE);
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open '${URI}&immutable=1'" :memory: "SELECT count(*) FROM t"
+PRAGMA journal_mode=DELETE;
+.exit
+EOF
+) || true
+if [ "$(echo "$RESULT" | grep -c "unable to open")" != "2" ] || ! echo "$RESULT" | grep -q "^1002$"; then
+    echo "[错误] 日志目录下的 WAL 文件没有被发现："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 临时文件放在实例选项 temp_dir（没有时是 journal_dir）指定的目录，目录不存在时无法创建
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+SELECT headervfs_register('headervfs_badtmp', 'temp_dir=${JOURNAL_DIR}/missing');
+SELECT headervfs_register('headervfs_tmp', 'journal_dir=${JOURNAL_DIR}');
+.open 'file:${DB_FILE}?vfs=headervfs_badtmp'
+PRAGMA temp_store=FILE;
+CREATE TEMP TABLE tt AS SELECT randomblob(1000) FROM generate_series(1, 3000);
+.open 'file:${DB_FILE}?vfs=headervfs_tmp'
+PRAGMA temp_store=FILE;
+CREATE TEMP TABLE tt AS SELECT randomblob(1000) FROM generate_series(1, 3000);
+SELECT count(*) FROM tt;
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "unable to open" || [ "$(echo "$RESULT" | tail -1)" != "3000" ]; then
+    echo "[错误] 临时文件的位置不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -rf "$JOURNAL_DIR"
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
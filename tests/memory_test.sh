@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# 测试内存模式（URI 参数 memory=1）
+
+# --- 配置 ---
+DB_FILE="./memory_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+"$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(100) FROM generate_series(1, 5000);
+.exit
+EOF
+
+# --- 执行操作 ---
+# 内存模式只读；开启 mmap 后除了第 1 页，其他页都通过 xFetch 直接取自内存镜像
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&memory=1'
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+PRAGMA headervfs_memory;
+INSERT INTO t VALUES(0, 0);
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&memory=1'
+PRAGMA mmap_size=268435456;
+SELECT sum(length(y)) FROM t;
+SELECT value < 10 FROM headervfs_stats WHERE file LIKE '%memory_test.db' AND stat = 'read';
+.exit
+EOF
+) || true
+RESULT=$(echo "$RESULT" | sed -e 's/ load_us=[0-9]*$//' -e 's/^.*readonly database.*$/readonly/')
+EXPECTED="5000|12502500
+ok
+bytes=$(( $(wc -c < "$DB_FILE") - 1024 )) backing=heap
+readonly
+268435456
+500000
+1"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 内存模式的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 内存镜像是打开时的视图，之后对文件的修改不可见；大页不可用时退回到普通内存
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}&memory=1&memory_hugepages=1' AS m;
+SELECT count(*) FROM m.t;
+DELETE FROM main.t WHERE x > 1000;
+SELECT (SELECT count(*) FROM main.t), (SELECT count(*) FROM m.t);
+.exit
+EOF
+)
+EXPECTED="5000
+1000|5000"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 修改之后内存镜像的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 不能与覆盖层同时使用
+if "$SQLITE_SHELL" >/dev/null 2>&1 <<EOF
+.bail on
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&memory=1&overlay=1'
+SELECT count(*) FROM t;
+EOF
+then
+    echo "[错误] 内存模式与覆盖层同时使用时应该失败。"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# 测试通过 headervfs 使用内存映射 I/O（PRAGMA mmap_size）读写数据库
+
+# --- 配置 ---
+DB_FILE="./mmap_test.db"
+VFS_NAME="headervfs"
+HEADER_SIZE=1024
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 开启 mmap 后写入足够多的数据，让文件在映射建立之后继续增长，然后删除一部分再 VACUUM 使文件截断
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA page_size = 512;
+PRAGMA mmap_size = 268435456;
+CREATE TABLE t(x INTEGER PRIMARY KEY, y TEXT);
+WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 20000)
+INSERT INTO t SELECT i, printf('%0100d', i) FROM c;
+SELECT count(*), sum(x) FROM t;
+DELETE FROM t WHERE x > 10000;
+VACUUM;
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+
+EXPECTED="268435456
+20000|200010000
+10000|50005000
+ok"
+
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 查询结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 重新打开，确认数据在头部之后，且头部保持为空
+HEAD_BYTES=$(head -c "$HEADER_SIZE" "$DB_FILE" | tr -d '\0' | wc -c)
+if [ "$HEAD_BYTES" -ne 0 ]; then
+    echo "[错误] 头部被改写。"
+    exit 1
+fi
+
+MAGIC=$(tail -c +$((HEADER_SIZE + 1)) "$DB_FILE" | head -c 15)
+if [ "$MAGIC" != "SQLite format 3" ]; then
+    echo "[错误] 头部之后不是 SQLite 数据库。"
+    exit 1
+fi
+
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&mode=ro'
+PRAGMA mmap_size = 268435456;
+SELECT count(*), sum(x) FROM t;
+.exit
+EOF
+)
+
+if [ "$RESULT" != "268435456
+10000|50005000" ]; then
+    echo "[错误] 只读重新打开后结果不符合预期：$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE"
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,184 @@
+#!/bin/bash
+
+# 测试覆盖层模式（URI 参数 overlay=1）
+
+# --- 配置 ---
+DB_FILE="./overlay_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+"$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x);
+INSERT INTO t SELECT value FROM generate_series(1, 1000);
+.exit
+EOF
+BASE_SUM=$(cksum < "$DB_FILE")
+
+# --- 执行操作 ---
+# 覆盖层连接的写入只进入增量文件，基础文件保持不变
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&overlay=1'
+INSERT INTO t SELECT value FROM generate_series(1001, 3000);
+DELETE FROM t WHERE x <= 500;
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="2500|4376250
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 覆盖层连接的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ "$(cksum < "$DB_FILE")" != "$BASE_SUM" ]; then
+    echo "[错误] 基础文件被修改了。"
+    exit 1
+fi
+if [ ! -s "$DB_FILE-overlay" ]; then
+    echo "[错误] 没有生成增量文件。"
+    exit 1
+fi
+
+# 不带 overlay 的连接只看到基础文件；WAL 文件和 VACUUM 的截断都落在增量文件上
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*) FROM t;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&overlay=1'
+PRAGMA journal_mode=WAL;
+DELETE FROM t WHERE x > 1000;
+VACUUM;
+.shell ls ${DB_FILE}-overlay-wal
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+PRAGMA journal_mode=DELETE;
+.exit
+EOF
+)
+EXPECTED="1000
+wal
+${DB_FILE}-overlay-wal
+500|375250
+ok
+delete"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] WAL 模式下的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ -e "$DB_FILE-wal" ] || [ -e "$DB_FILE-journal" ]; then
+    echo "[错误] 日志文件没有跟随增量文件。"
+    exit 1
+fi
+
+# 合并回基础文件之后，普通连接也能看到修改
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&overlay=1'
+SELECT headervfs_overlay_merge() > 0;
+PRAGMA headervfs_overlay;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed 's/.*-overlay pages=/overlay pages=/')
+EXPECTED="1
+overlay pages=0
+500|375250
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 合并之后的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 不是覆盖层模式时合并失败
+if "$SQLITE_SHELL" >/dev/null 2>&1 <<EOF
+.bail on
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT headervfs_overlay_merge();
+EOF
+then
+    echo "[错误] 没有覆盖层时合并应该失败。"
+    exit 1
+fi
+
+# 合并只能在顶层的 SQL 中调用，视图中的调用被拒绝
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+CREATE VIEW v AS SELECT headervfs_overlay_merge();
+SELECT * FROM v;
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "unsafe use of headervfs_overlay_merge"; then
+    echo "[错误] 视图不应该能合并覆盖层：$RESULT"
+    exit 1
+fi
+
+# 直接打开基础文件的连接在事务中途被杀掉，留下热日志：合并拒绝在它上面进行，
+# 直接打开一次回滚之后才能合并，合并成功后不留下日志
+"$SQLITE_SHELL" >/dev/null 2>&1 <<EOF || true
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA cache_size=2;
+BEGIN;
+UPDATE t SET x = randomblob(100);
+.system kill -9 \$PPID
+EOF
+if [ ! -s "$DB_FILE-journal" ]; then
+    echo "[错误] 没有留下热日志。"
+    exit 1
+fi
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&overlay=1'
+SELECT headervfs_overlay_merge();
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "database is locked"; then
+    echo "[错误] 有热日志时合并应该失败：$RESULT"
+    exit 1
+fi
+
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*), sum(x) FROM t;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&overlay=1'
+INSERT INTO t VALUES(1);
+SELECT headervfs_overlay_merge() > 0;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="500|375250
+1
+501|375251
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 回滚热日志之后合并的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ -e "$DB_FILE-journal" ]; then
+    echo "[错误] 合并之后留下了日志。"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,115 @@
+#!/bin/bash
+
+# 测试进程内共享页缓存（URI 参数 page_cache）
+
+# --- 配置 ---
+DB_FILE="./page_cache_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 两个连接打开同一个文件，共享一份页缓存：一个连接读过的页另一个连接直接命中，
+# 一个连接的写入对另一个连接可见
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&page_cache=1048576'
+PRAGMA cache_size=10;
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(200) FROM generate_series(1, 2000);
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}' AS other;
+PRAGMA other.cache_size=10;
+SELECT count(*) FROM main.t;
+SELECT count(*) FROM other.t;
+SELECT value > 100 FROM headervfs_stats WHERE file = '*' AND stat = 'page_cache_hit';
+INSERT INTO other.t VALUES(1);
+SELECT count(*), sum(x IS 1) FROM main.t;
+PRAGMA other.headervfs_page_cache;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+# 计数随读取的顺序变化，只比较容量和页大小
+RESULT=$(echo "$RESULT" | sed 's/ pages=.*//')
+EXPECTED="2000
+2000
+1
+2001|1
+size=1048576 page_size=4096
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 共享页缓存的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# WAL 模式：检查点写回的页对另一个连接可见；缓存小于数据库时淘汰旧页
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&page_cache=65536'
+PRAGMA journal_mode=WAL;
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}' AS other;
+PRAGMA other.cache_size=10;
+SELECT count(*) FROM other.t;
+INSERT INTO main.t SELECT randomblob(200) FROM generate_series(1, 500);
+PRAGMA main.wal_checkpoint(TRUNCATE);
+SELECT count(*) FROM other.t;
+UPDATE other.t SET x = 2 WHERE x IS 1;
+PRAGMA other.wal_checkpoint(TRUNCATE);
+SELECT count(*), sum(x IS 2) FROM main.t;
+PRAGMA other.integrity_check;
+DETACH other;
+PRAGMA main.journal_mode=DELETE;
+.exit
+EOF
+)
+EXPECTED="wal
+2001
+0|0|0
+2501
+0|0|0
+2501|1
+ok
+delete"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] WAL 模式下共享页缓存的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 其他进程修改了文件之后，缓存随文件修改计数器的变化被清空
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&page_cache=1048576'
+PRAGMA cache_size=10;
+SELECT count(*) FROM t;
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: 'DELETE FROM t WHERE rowid % 2 = 0'
+SELECT count(*), sum(x IS 2) FROM t;
+PRAGMA headervfs_page_cache;
+.exit
+EOF
+)
+if ! echo "$RESULT" | head -2 | tr '\n' ' ' | grep -q "^2501 1251|1 $" || ! echo "$RESULT" | grep -q "invalidations=[2-9]"; then
+    echo "[错误] 其他进程的修改没有使缓存失效："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 没有指定 page_cache 时不使用共享页缓存
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA headervfs_page_cache;
+.exit
+EOF
+)
+if [ "$RESULT" != "off" ]; then
+    echo "[错误] 默认不应该启用共享页缓存："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
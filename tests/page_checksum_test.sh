@@ -0,0 +1,158 @@
+#!/bin/bash
+
+# 测试页校验和（URI 参数 page_checksum）
+
+# --- 配置 ---
+DB_FILE="./page_checksum_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&page_checksum=1"
+
+# --- 执行操作 ---
+# 写入的页记录校验和，重新打开之后读到的整页都经过核对
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA page_size=4096;
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 2000);
+.open '${URI}'
+SELECT count(*) FROM t;
+PRAGMA integrity_check;
+SELECT value > 100 FROM headervfs_stats WHERE file = '*' AND stat = 'checksum_verified';
+SELECT value FROM headervfs_stats WHERE file = '*' AND stat = 'checksum_error';
+PRAGMA headervfs_page_checksum;
+.exit
+EOF
+)
+# 实现随 CPU 变化，计数随读取的顺序变化
+RESULT=$(echo "$RESULT" | sed 's/crc32c=[a-z0-9.]* /crc32c /; s/ verified=.*//')
+EXPECTED="2000
+ok
+1
+0
+crc32c page_size=4096 pages=156"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 页校验和的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 改变页大小之后，校验和从第一次按新的页大小写入开始记录（VACUUM 本身按旧的页大小写入）
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA page_size=8192;
+VACUUM;
+UPDATE t SET x = randomblob(300);
+.open '${URI}'
+SELECT count(*), sum(length(x)) FROM t;
+PRAGMA integrity_check;
+PRAGMA headervfs_page_checksum;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed 's/crc32c=[a-z0-9.]* /crc32c /; s/ verified=[1-9][0-9]*$/ verified/')
+EXPECTED="2000|600000
+ok
+crc32c page_size=8192 pages=79 verified"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 改变页大小之后的校验和不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 绕过 VFS 改坏第 10 页中的一个字节：启用校验和的连接读到这一页时报错，
+# 不启用时读到的错误数据没有被发现
+dd if=/dev/urandom of="$DB_FILE" bs=1 count=1 seek=$((9 * 8192 + 1000)) conv=notrunc status=none
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+SELECT count(*), sum(length(x)) FROM t;
+SELECT value > 0 FROM headervfs_stats WHERE file = '*' AND stat = 'checksum_error';
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*) FROM t;
+.exit
+EOF
+) || true
+if ! echo "$RESULT" | grep -q "disk I/O error" || [ "$(echo "$RESULT" | tail -2 | tr '\n' ' ')" != "1 2000 " ]; then
+    echo "[错误] 没有发现损坏的页："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 没有开启校验和的连接修改过的数据库：核对时不报告错误，下一次开启校验和的写入清空旧的校验和重新记录
+rm -f "$DB_FILE" "$DB_FILE"-*
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA page_size=4096;
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 2000);
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+UPDATE t SET x = randomblob(300) WHERE rowid % 7 = 0;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&page_checksum=1&mode=ro'
+SELECT count(*), sum(length(x)) FROM t;
+.open '${URI}'
+SELECT count(*), sum(length(x)) FROM t;
+UPDATE t SET x = randomblob(300);
+.open '${URI}'
+SELECT count(*), sum(length(x)) FROM t;
+PRAGMA integrity_check;
+SELECT value FROM headervfs_stats WHERE file = '*' AND stat = 'checksum_error';
+PRAGMA headervfs_page_checksum;
+.exit
+EOF
+) || true
+RESULT=$(echo "$RESULT" | sed 's/crc32c=[a-z0-9.]* /crc32c /; s/ verified=[1-9][0-9]*$/ verified/')
+EXPECTED="2000|600000
+2000|600000
+2000|600000
+ok
+0
+crc32c page_size=4096 pages=156 verified"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 混合使用之后的校验和不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 只读连接打开还没有校验和的数据库时不核对
+rm -f "$DB_FILE" "$DB_FILE"-*
+"$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open 'file:${DB_FILE}?vfs=${VFS_NAME}'" :memory: \
+    "CREATE TABLE t(x); INSERT INTO t VALUES(1);"
+RESULT=$("$SQLITE_SHELL" 2>&1 <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&page_checksum=1&mode=ro'
+SELECT count(*) FROM t;
+PRAGMA headervfs_page_checksum;
+.exit
+EOF
+)
+if [ "$(echo "$RESULT" | tail -2 | tr '\n' ' ')" != "1 off " ] || [ -e "$DB_FILE"-cksum ]; then
+    echo "[错误] 只读连接的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 没有指定 page_checksum 时不记录校验和
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+PRAGMA headervfs_page_checksum;
+.exit
+EOF
+)
+if [ "$RESULT" != "off" ]; then
+    echo "[错误] 默认不应该启用页校验和："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
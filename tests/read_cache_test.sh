@@ -0,0 +1,111 @@
+#!/bin/bash
+
+# 测试对齐读缓存（URI 参数 read_cache / read_cache_block）
+
+# --- 配置 ---
+DB_FILE="./read_cache_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+URI="file:${DB_FILE}?vfs=${VFS_NAME}&read_cache=4194304&read_cache_block=16384"
+
+# --- 执行操作 ---
+# 1、回滚日志模式：写入、更新、截断，缓存必须与文件保持一致
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+CREATE TABLE t(x INTEGER PRIMARY KEY, y TEXT);
+WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 5000)
+INSERT INTO t SELECT i, printf('%0200d', i) FROM c;
+UPDATE t SET y = 'updated' WHERE x % 7 = 0;
+DELETE FROM t WHERE x > 4000;
+VACUUM;
+SELECT count(*), sum(x), sum(y = 'updated') FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+
+EXPECTED="4000|8002000|571
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 回滚日志模式结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 2、WAL 模式：同一个文件附加为第二个连接，写入后原连接必须看到新数据
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA journal_mode = wal;
+SELECT count(*) FROM t;
+ATTACH '${URI}' AS other;
+DELETE FROM other.t WHERE x > 2000;
+PRAGMA other.wal_checkpoint(TRUNCATE);
+SELECT count(*), sum(x) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+
+EXPECTED="wal
+4000
+0|0|0
+2000|2001000
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] WAL 模式结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 3、统计计数：只读扫描应该命中缓存
+STATS=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}&mode=ro'
+SELECT count(*) FROM t WHERE y <> '';
+PRAGMA headervfs_cache_stats;
+.exit
+EOF
+)
+
+echo "$STATS"
+HITS=$(echo "$STATS" | sed -n 's/.*hits=\([0-9]*\).*/\1/p')
+if [ -z "$HITS" ] || [ "$HITS" -eq 0 ]; then
+    echo "[错误] 读缓存没有命中。"
+    exit 1
+fi
+
+# 4、文件版本号（修改计数器，或者 WAL 的检查点进度）没有变化时，缓存在读事务之间保留；
+#    其他进程修改文件之后丢弃
+for MODE in delete wal; do
+    STATS=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open '${URI}'
+PRAGMA journal_mode = ${MODE};
+PRAGMA cache_size = 10;
+SELECT count(*) FROM t WHERE y <> '';
+SELECT count(*) FROM t WHERE y <> '';
+SELECT count(*) FROM t WHERE y <> '';
+.shell "$SQLITE_SHELL" -cmd ".load '${EXTENSION_PATH}'" -cmd ".open '${URI}'" :memory: "UPDATE t SET y = 'changed' WHERE x = 1; PRAGMA wal_checkpoint(TRUNCATE);" >/dev/null
+SELECT count(*) FROM t WHERE y = 'changed';
+PRAGMA headervfs_cache_stats;
+UPDATE t SET y = 'restored' WHERE x = 1;
+.exit
+EOF
+)
+    KEPT=$(echo "$STATS" | sed -n 's/.*kept=\([0-9]*\).*/\1/p')
+    DROPPED=$(echo "$STATS" | sed -n 's/.*dropped=\([0-9]*\).*/\1/p')
+    if [ "$(echo "$STATS" | sed -n 5p)" != "1" ] || [ -z "$KEPT" ] || [ "$KEPT" -lt 2 ] || [ "$DROPPED" -lt 1 ]; then
+        echo "[错误] ${MODE} 模式下读事务之间的缓存保留不符合预期："
+        echo "$STATS"
+        exit 1
+    fi
+done
+
+rm -f "$DB_FILE" "$DB_FILE-journal" "$DB_FILE-wal" "$DB_FILE-shm"
+echo "All tests succeeded!"
+exit 0
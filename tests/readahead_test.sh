@@ -0,0 +1,50 @@
+#!/bin/bash
+
+# 测试顺序读取的预读（URI 参数 readahead）
+
+# --- 配置 ---
+DB_FILE="./readahead_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+"$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(300) FROM generate_series(1, 20000);
+.exit
+EOF
+
+# --- 执行操作 ---
+# 全表扫描被识别为顺序访问，绝大部分读取都落在已预读的范围内；按主键随机查找不触发预读
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&readahead=1048576'
+SELECT sum(length(y)) FROM t;
+SELECT (SELECT value FROM headervfs_stats WHERE file LIKE '%readahead_test.db' AND stat = 'readahead') > 0;
+SELECT (SELECT value FROM headervfs_stats WHERE file LIKE '%readahead_test.db' AND stat = 'readahead_hit') * 10
+    >= (SELECT value FROM headervfs_stats WHERE file LIKE '%readahead_test.db' AND stat = 'read') * 9;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&readahead=1048576'
+PRAGMA cache_size=10;
+CREATE TEMP TABLE k AS SELECT value * 7919 % 20000 + 1 AS id FROM generate_series(1, 1000);
+SELECT count(y) FROM k JOIN t ON t.rowid = k.id;
+SELECT value FROM headervfs_stats WHERE file LIKE '%readahead_test.db' AND stat = 'readahead';
+.exit
+EOF
+)
+EXPECTED="6000000
+1
+1
+1000
+0"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 预读的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
@@ -0,0 +1,79 @@
+#!/bin/bash
+
+# 测试快照模式（URI 参数 snapshot=1）
+
+# --- 配置 ---
+DB_FILE="./snapshot_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+"$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x);
+INSERT INTO t VALUES(1), (2), (3);
+.exit
+EOF
+
+# --- 执行操作 ---
+# 快照连接打开之后，另一个连接修改源文件，快照看到的内容不变
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&snapshot=1'
+SELECT count(*) FROM t;
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}' AS live;
+INSERT INTO live.t VALUES(4);
+SELECT count(*) FROM live.t;
+SELECT count(*) FROM main.t;
+PRAGMA headervfs_snapshot;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed 's/.*-snapshot-.*/snapshot/')
+
+EXPECTED="3
+4
+3
+snapshot"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 快照是只读的
+if "$SQLITE_SHELL" >/dev/null 2>&1 <<EOF
+.bail on
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&snapshot=1'
+INSERT INTO t VALUES(5);
+EOF
+then
+    echo "[错误] 快照应该是只读的。"
+    exit 1
+fi
+
+# 关闭后私有副本被删除
+if ls "$DB_FILE"-snapshot-* >/dev/null 2>&1; then
+    echo "[错误] 快照副本没有被删除。"
+    exit 1
+fi
+
+# 存在非空的 WAL 文件时拒绝创建快照
+printf "wal" > "$DB_FILE-wal"
+if "$SQLITE_SHELL" >/dev/null 2>&1 <<EOF
+.bail on
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&snapshot=1'
+SELECT count(*) FROM t;
+EOF
+then
+    echo "[错误] 存在 WAL 文件时应该拒绝创建快照。"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
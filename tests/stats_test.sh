@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# 测试I/O 统计计数（虚拟表 headervfs_stats）
+
+# --- 配置 ---
+DB_FILE="./stats_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 读写计数与实际操作一致，全局计数（file 为 '*'）包括所有文件
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 2000);
+SELECT value > 0 FROM headervfs_stats WHERE file LIKE '%stats_test.db' AND stat = 'write';
+SELECT value >= 2000 * 300 FROM headervfs_stats WHERE file LIKE '%stats_test.db' AND stat = 'write_bytes';
+SELECT (SELECT value FROM headervfs_stats WHERE file = '*' AND stat = 'write')
+    >= (SELECT value FROM headervfs_stats WHERE file LIKE '%stats_test.db' AND stat = 'write');
+SELECT sum(value) = (SELECT value FROM headervfs_stats WHERE file LIKE '%stats_test.db' AND stat = 'write')
+    FROM headervfs_stats WHERE file LIKE '%stats_test.db' AND stat LIKE 'write_latency_%';
+.exit
+EOF
+)
+EXPECTED="1
+1
+1
+1"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 读写计数不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 另一个连接持有排他锁时，加锁失败被记为锁等待（读取会失败，所以忽略 shell 的退出码）
+RESULT=$("$SQLITE_SHELL" 2>/dev/null <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}' AS other;
+PRAGMA other.locking_mode=EXCLUSIVE;
+INSERT INTO other.t VALUES(1);
+SELECT count(*) FROM main.t;
+PRAGMA other.locking_mode=NORMAL;
+SELECT count(*) FROM other.t;
+SELECT count(*) FROM headervfs_stats WHERE stat = 'lock_busy' AND value > 0 AND file <> '*';
+.exit
+EOF
+) || true
+if [ "$RESULT" != "exclusive
+normal
+2001
+1" ]; then
+    echo "[错误] 锁等待没有被记录："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
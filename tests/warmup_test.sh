@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# 测试启动预热（URI 参数 warmup）
+
+# --- 配置 ---
+DB_FILE="./warmup_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+"$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+CREATE TABLE t(x, y);
+INSERT INTO t SELECT value, randomblob(300) FROM generate_series(1, 5000);
+.exit
+EOF
+
+# --- 执行操作 ---
+# 第一次打开：记录窗口内读取的页，窗口结束后的第一次读取写入访问记录
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&warmup=1'
+SELECT count(y) FROM t;
+.shell sleep 1.2
+PRAGMA cache_size=2;
+SELECT x FROM t WHERE rowid = 7;
+PRAGMA headervfs_warmup;
+.exit
+EOF
+)
+PAGES=$(( ($(wc -c < "$DB_FILE") - 1024) / 4096 ))
+RESULT=$(echo "$RESULT" | sed 's/ replay_us=[0-9]*$//')
+EXPECTED="5000
+7
+recording=0 recorded=${PAGES} replayed=0/0"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 记录访问的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ "$(wc -c < "$DB_FILE-warmup")" -ne $(( 24 + PAGES * 4 )) ]; then
+    echo "[错误] 访问记录文件的大小不符合预期。"
+    exit 1
+fi
+
+# 第二次打开：后台线程回放访问记录；还没到时间就关闭的连接不覆盖已有的记录
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&warmup=60'
+.shell sleep 0.5
+SELECT x FROM t WHERE rowid = 9;
+PRAGMA headervfs_warmup;
+.exit
+EOF
+)
+RESULT=$(echo "$RESULT" | sed -e 's/ replay_us=[0-9]*$//' -e 's/recorded=[0-9]*/recorded=N/')
+EXPECTED="9
+recording=1 recorded=N replayed=${PAGES}/${PAGES}"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 回放访问记录的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+if [ "$(wc -c < "$DB_FILE-warmup")" -ne $(( 24 + PAGES * 4 )) ]; then
+    echo "[错误] 访问记录被短暂的连接覆盖了。"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0
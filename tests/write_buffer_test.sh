@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# 测试写回缓冲区（URI 参数 write_buffer）
+
+# --- 配置 ---
+DB_FILE="./write_buffer_test.db"
+VFS_NAME="headervfs"
+
+# --- 准备工作 ---
+. "$(dirname "$0")/common.sh"
+
+# --- 执行操作 ---
+# 批量插入：相邻的页被合并写入，写入调用次数远少于页数
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&write_buffer=8388608'
+CREATE TABLE t(x);
+INSERT INTO t SELECT randomblob(300) FROM generate_series(1, 20000);
+SELECT count(*) FROM t;
+PRAGMA headervfs_write_buffer;
+.exit
+EOF
+)
+COUNT=$(echo "$RESULT" | sed -n 1p)
+WRITES=$(echo "$RESULT" | sed -n 's/.*writes=\([0-9]*\).*/\1/p')
+SYSCALLS=$(echo "$RESULT" | sed -n 's/.*syscalls=\([0-9]*\).*/\1/p')
+if [ "$COUNT" != "20000" ] || [ -z "$WRITES" ] || [ "$SYSCALLS" -ge $(( WRITES / 10 )) ]; then
+    echo "[错误] 写入没有被合并："
+    echo "$RESULT"
+    exit 1
+fi
+
+# 缓存很小时脏页会提前写出（spill），读取必须看到缓冲区中的内容；
+# synchronous=OFF 时提交之后另一个连接也能看到全部数据
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&write_buffer=1048576'
+PRAGMA synchronous=OFF;
+PRAGMA cache_size=10;
+UPDATE t SET x=zeroblob(100) WHERE rowid % 2 = 0;
+CREATE INDEX i ON t(x);
+PRAGMA integrity_check;
+ATTACH 'file:${DB_FILE}?vfs=${VFS_NAME}' AS other;
+SELECT count(*) FROM other.t WHERE length(x) = 100;
+.exit
+EOF
+)
+EXPECTED="ok
+10000"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] 读取没有看到缓冲的写入："
+    echo "$RESULT"
+    exit 1
+fi
+
+# WAL 模式下不使用缓冲区，检查点之后数据完整
+RESULT=$("$SQLITE_SHELL" <<EOF
+.load '${EXTENSION_PATH}'
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}&write_buffer=1048576'
+PRAGMA journal_mode=WAL;
+DELETE FROM t WHERE rowid > 1000;
+PRAGMA wal_checkpoint(TRUNCATE);
+PRAGMA journal_mode=DELETE;
+.open 'file:${DB_FILE}?vfs=${VFS_NAME}'
+SELECT count(*) FROM t;
+PRAGMA integrity_check;
+.exit
+EOF
+)
+EXPECTED="wal
+0|0|0
+delete
+1000
+ok"
+if [ "$RESULT" != "$EXPECTED" ]; then
+    echo "[错误] WAL 模式下的结果不符合预期："
+    echo "$RESULT"
+    exit 1
+fi
+
+rm -f "$DB_FILE" "$DB_FILE"-*
+echo "All tests succeeded!"
+exit 0